@@ -19,6 +19,7 @@
  ***************************************************************************/
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,19 +27,40 @@
 #include <sys/types.h>
 #include <time.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LMP_SSE2 1
+#endif
+
 #include "libmseed.h"
 #include "msio.h"
+#include "unpack.h"
 
 /* Skip length in bytes when skipping non-data */
 #define SKIPLEN 1
 
+/* Initial and maximum read lengths when probing for records by bisection */
+#define PROBELEN 8192
+#define PROBEMAX (2 * MAXRECLEN + 64)
+
 /* Initialize the global file reading parameters */
 MS3FileParam gMS3FileParam = MS3FileParam_INITIALIZER;
 
+/* Global read buffer size, 0 means MAXRECLEN */
+size_t libmseed_readbuffer_size = 0;
+
 /* Stream state flags */
 #define MSFP_RANGEAPPLIED 0x0001  //!< Byte ranging has been applied
+#define MSFP_FIXEDRECLEN  0x0002  //!< Records are parsed at the fixed record length
+#define MSFP_SELECTSKIP   0x0004  //!< Records have been skipped by selection
 
 static char *parse_pathname_range (const char *string, int64_t *start, int64_t *end);
+static int check_fixed_reclen (const char *record, int buflen, int reclen, uint32_t pflags);
+static int scan_notdata (const char *buffer, int length);
+static int seek_msfp (MS3FileParam *msfp, int64_t position);
+static int seek_index (MS3FileParam *msfp, const MS3Selections *selections);
+static int bisect_timerange (const char *path, const MS3Selections *selections,
+                             int64_t *startoffset, int64_t *endoffset, int8_t verbose);
 
 /*****************************************************************/ /**
  * @brief Run-time test for URL support in libmseed.
@@ -168,16 +190,49 @@ ms3_shift_msfp (MS3FileParam *msfp, int shift)
  *  - ::MSF_UNPACKDATA data samples will be unpacked
  *  - ::MSF_VALIDATECRC Validate CRC (if present in format)
  *  - ::MSF_PNAMERANGE Parse byte range suffix from \a mspath
+ *  - ::MSF_MMAP Memory map local files and parse records in place
+ *  - ::MSF_HEADERONLY Parse only header values, see ms3_parse_header()
+ *  - ::MSF_TIMESORTED Input is time-ordered, seek to selection time range
+ *  - ::MSF_RECORDINDEX Use a record index file to seek to selected records
  *
  * If ::MSF_PNAMERANGE is set in \a flags, the \a mspath will be
  * searched for start and end byte offsets for the file or URL in the
  * following format: '\c PATH@@\c START-\c END', where \c START and \c
  * END are both optional and specified in bytes.
  *
+ * If ::MSF_MMAP is set in \a flags, regular files are mapped into
+ * memory in large windows and records are parsed directly from the
+ * mapping, avoiding copies through the read buffer.  Record data
+ * referenced by the returned ::MS3Record are valid until the next
+ * call.  Input that cannot be mapped (URLs, pipes, \c stdin and all
+ * files on Windows) is read normally.
+ *
+ * Local files compressed with gzip or zstd are detected by their
+ * magic number and decompressed while reading when the library is
+ * built with \c LIBMSEED_ZLIB or \c LIBMSEED_ZSTD defined.  Byte
+ * ranges and stream positions of compressed files refer to the
+ * decompressed data.
+ *
  * If \a selections is not NULL, the ::MS3Selections will be used to
  * limit what is returned to the caller.  Any data not matching the
  * selections will be skipped.
  *
+ * If ::MSF_TIMESORTED is set in \a flags and \a selections contain
+ * time windows, local uncompressed files are assumed to contain
+ * records in order of non-decreasing start time, records of multiple
+ * channels may be interleaved.  The byte range containing the overall
+ * time range of the selections is located by bisection on start times,
+ * probing for records from the middle of the remaining range, and only
+ * that range is read.  Files found not to be in time order are read
+ * completely.  The byte range is
+ * further limited if also specified by the path name.
+ *
+ * If ::MSF_RECORDINDEX is set in \a flags and \a selections are
+ * specified, a current record index file for a local file, see @ref
+ * record-index, is used to seek directly to the records that match
+ * the selections.  If no current index exists the file is read
+ * normally.  When an index is used ::MSF_TIMESORTED is ignored.
+ *
  * After reading all the records in a stream the calling program should
  * call this routine a final time with \a mspath set to NULL.  This
  * will close the input stream and free allocated memory.
@@ -217,9 +272,12 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
   char *pathname_range = NULL;
 
   int parseval  = 0;
+  int parselen  = 0;
+  int skiplen   = 0;
   int readsize  = 0;
   int readcount = 0;
   int retcode   = MS_NOERROR;
+  size_t mapsize = 0;
 
   if (!ppmsr || !ppmsfp)
   {
@@ -251,12 +309,18 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
   {
     msr3_free (ppmsr);
 
+    /* Read buffer of a memory-mapped file is the mapping itself */
+    if (msfp->input.type == LMIO_MMAP)
+      msfp->readbuffer = NULL;
+
     if (msfp->input.handle != NULL)
       msio_fclose (&msfp->input);
 
     if (msfp->readbuffer != NULL)
       libmseed_memory.free (msfp->readbuffer);
 
+    ms3_index_free (&msfp->index);
+
     /* If the parameters are the global parameters reset them */
     if (*ppmsfp == &gMS3FileParam)
     {
@@ -272,16 +336,6 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
     return MS_NOERROR;
   }
 
-  /* Allocate reading buffer */
-  if (msfp->readbuffer == NULL)
-  {
-    if (!(msfp->readbuffer = (char *)libmseed_memory.malloc (MAXRECLEN)))
-    {
-      ms_log (2, "Cannot allocate memory for read buffer\n");
-      return MS_GENERROR;
-    }
-  }
-
   /* Open the stream if needed, use stdin if path is "-" */
   if (msfp->input.handle == NULL)
   {
@@ -311,7 +365,29 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
     }
     else
     {
-      if (msio_fopen(&msfp->input, msfp->path, "rb", &msfp->startoffset, &msfp->endoffset))
+      /* Load a current record index of a local file to seek to selected records */
+      if ((flags & MSF_RECORDINDEX) && selections && strstr (msfp->path, "://") == NULL)
+        msfp->index = ms3_index_load (msfp->path, NULL, verbose);
+
+      /* Narrow the byte range to the selection time range in time-ordered files */
+      if ((flags & MSF_TIMESORTED) && selections && !msfp->index &&
+          strstr (msfp->path, "://") == NULL &&
+          bisect_timerange (msfp->path, selections, &msfp->startoffset, &msfp->endoffset, verbose))
+      {
+        msr3_free (ppmsr);
+        return MS_GENERROR;
+      }
+
+      /* Try memory mapping if requested, fall back to stream reading */
+      if ((flags & MSF_MMAP) &&
+          msio_mmap_open (&msfp->input, msfp->path, &msfp->startoffset) < -1)
+      {
+        msr3_free (ppmsr);
+        return MS_GENERROR;
+      }
+
+      if (msfp->input.type != LMIO_MMAP &&
+          msio_fopen (&msfp->input, msfp->path, "rb", &msfp->startoffset, &msfp->endoffset))
       {
         msr3_free (ppmsr);
         return MS_GENERROR;
@@ -322,6 +398,25 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
       {
         msfp->streampos = msfp->startoffset;
       }
+
+      /* Record offsets of an index are not usable for decompressed streams */
+      if (msfp->index && msfp->input.type != LMIO_FILE && msfp->input.type != LMIO_MMAP)
+        ms3_index_free (&msfp->index);
+    }
+  }
+
+  /* Allocate reading buffer, not needed for memory-mapped files */
+  if (msfp->readbuffer == NULL && msfp->input.type != LMIO_MMAP)
+  {
+    msfp->readbuffersize = MAXRECLEN;
+
+    if (libmseed_readbuffer_size > MAXRECLEN && libmseed_readbuffer_size <= INT_MAX)
+      msfp->readbuffersize = (int)libmseed_readbuffer_size;
+
+    if (!(msfp->readbuffer = (char *)libmseed_memory.malloc (msfp->readbuffersize)))
+    {
+      ms_log (2, "Cannot allocate memory for read buffer\n");
+      return MS_GENERROR;
     }
   }
 
@@ -339,9 +434,28 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
       break;
     }
 
+    /* Seek to the next selected record of an index */
+    if (msfp->index && (retcode = seek_index (msfp, selections)) != MS_NOERROR)
+      break;
+
     /* Read more data into buffer if not at EOF and buffer has less than MINRECLEN
      * or more data is needed for the current record detected in buffer. */
-    if (!msio_feof (&msfp->input) && (MSFPBUFLEN (msfp) < MINRECLEN || parseval > 0))
+    if (!msio_feof (&msfp->input) && (MSFPBUFLEN (msfp) < MINRECLEN || parseval > 0) &&
+        msfp->input.type == LMIO_MMAP)
+    {
+      /* Map the next window of the file starting at the current position */
+      if (msio_mmap_window (&msfp->input, msfp->streampos, &msfp->readbuffer, &mapsize))
+      {
+        ms_log (2, "Error mapping %s at offset %" PRId64 "\n", msfp->path, msfp->streampos);
+        msfp->readbuffer = NULL;
+        retcode = MS_GENERROR;
+        break;
+      }
+
+      msfp->readoffset = 0;
+      msfp->readlength = (int)mapsize;
+    }
+    else if (!msio_feof (&msfp->input) && (MSFPBUFLEN (msfp) < MINRECLEN || parseval > 0))
     {
       /* Reset offsets if no unprocessed data in buffer */
       if (MSFPBUFLEN (msfp) <= 0)
@@ -349,14 +463,15 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
         msfp->readlength = 0;
         msfp->readoffset = 0;
       }
-      /* Otherwise shift existing data to beginning of buffer */
-      else if (msfp->readoffset > 0)
+      /* Otherwise shift existing data to beginning of buffer if a record of
+       * maximum length starting at the read offset would not fit */
+      else if (msfp->readoffset > (msfp->readbuffersize - MAXRECLEN))
       {
         ms3_shift_msfp (msfp, msfp->readoffset);
       }
 
       /* Determine read size */
-      readsize = (MAXRECLEN - msfp->readlength);
+      readsize = (msfp->readbuffersize - msfp->readlength);
 
       /* Read data into record buffer */
       readcount = (int)msio_fread (&msfp->input, msfp->readbuffer + msfp->readlength, readsize);
@@ -375,15 +490,46 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
     /* Attempt to parse record from buffer */
     if (MSFPBUFLEN (msfp) >= MINRECLEN)
     {
+      /* Limit parsing to MAXRECLEN, only a mapped window can be larger */
+      parselen = (MSFPBUFLEN (msfp) > MAXRECLEN) ? MAXRECLEN : MSFPBUFLEN (msfp);
+
       /* Set end of file flag if at EOF */
-      if (msio_feof (&msfp->input))
+      if (msio_feof (&msfp->input) && parselen == MSFPBUFLEN (msfp))
         pflags |= MSF_ATENDOFFILE;
 
-      parseval = msr3_parse (MSFPREADPTR (msfp), MSFPBUFLEN (msfp), ppmsr, pflags, verbose);
+      /* Parse at the fixed record length of the stream, skipping detection,
+       * if the headers at this and the next record boundary confirm it */
+      if ((msfp->flags & MSFP_FIXEDRECLEN) &&
+          check_fixed_reclen (MSFPREADPTR (msfp), parselen, msfp->fixedreclen, pflags))
+      {
+        parseval = msr3_parse_reclen (MSFPREADPTR (msfp), msfp->fixedreclen, 2,
+                                      ppmsr, pflags, verbose);
+
+        /* Detect length if it differs in blockette 1000 */
+        if (parseval == 0 && (*ppmsr)->reclen != msfp->fixedreclen)
+          parseval = msr3_parse (MSFPREADPTR (msfp), parselen, ppmsr, pflags, verbose);
+      }
+      /* Detect and parse record, determining the length */
+      else
+      {
+        parseval = msr3_parse (MSFPREADPTR (msfp), parselen, ppmsr, pflags, verbose);
+      }
 
       /* Record detected and parsed */
       if (parseval == 0)
       {
+        /* Track fixed record length of miniSEED 2 streams, confirmed by
+         * two consecutive records of the same length */
+        if ((*ppmsr)->formatversion == 2 && (*ppmsr)->reclen == msfp->fixedreclen)
+        {
+          msfp->flags |= MSFP_FIXEDRECLEN;
+        }
+        else
+        {
+          msfp->fixedreclen = ((*ppmsr)->formatversion == 2) ? (*ppmsr)->reclen : 0;
+          msfp->flags &= ~MSFP_FIXEDRECLEN;
+        }
+
         /* Test against selections if supplied */
         if (selections &&
             !ms3_matchselect (selections, (*ppmsr)->sid, (*ppmsr)->starttime,
@@ -398,11 +544,13 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
           /* Skip record length bytes, update reading offset and file position */
           msfp->readoffset += (*ppmsr)->reclen;
           msfp->streampos += (*ppmsr)->reclen;
+          msfp->flags |= MSFP_SELECTSKIP;
         }
         else
         {
           /* Unpack data samples if this has been deferred */
-          if (!(pflags & MSF_UNPACKDATA) && (flags & MSF_UNPACKDATA) && (*ppmsr)->samplecnt > 0)
+          if (!(pflags & MSF_UNPACKDATA) && (flags & MSF_UNPACKDATA) &&
+              !(flags & MSF_HEADERONLY) && (*ppmsr)->samplecnt > 0)
           {
             if (msr3_unpack_data ((*ppmsr), verbose) != (*ppmsr)->samplecnt)
             {
@@ -431,15 +579,23 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
         /* Skip non-data if requested */
         if (flags & MSF_SKIPNOTDATA)
         {
+          /* Scan following bytes for the next offset that could start a record,
+           * limited to the known end offset */
+          skiplen = parselen;
+          if (msfp->endoffset && (msfp->endoffset + 1 - msfp->streampos) < skiplen)
+            skiplen = (int)(msfp->endoffset + 1 - msfp->streampos);
+
+          skiplen = SKIPLEN + scan_notdata (MSFPREADPTR (msfp) + SKIPLEN, skiplen - SKIPLEN);
+
           if (verbose > 1)
           {
             ms_log (0, "Skipped %d bytes of non-data record at byte offset %" PRId64 "\n",
-                    SKIPLEN, msfp->streampos);
+                    skiplen, msfp->streampos);
           }
 
-          /* Skip SKIPLEN bytes, update reading offset and file position */
-          msfp->readoffset += SKIPLEN;
-          msfp->streampos += SKIPLEN;
+          /* Skip non-data bytes, update reading offset and file position */
+          msfp->readoffset += skiplen;
+          msfp->streampos += skiplen;
         }
         /* Parsing errors */
         else if (parseval == MS_NOTSEED)
@@ -467,7 +623,7 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
       else /* parseval > 0 (found record but need more data) */
       {
         /* Check for parse hints that are larger than MAXRECLEN */
-        if ((MSFPBUFLEN (msfp) + parseval) > MAXRECLEN)
+        if ((parselen + parseval) > MAXRECLEN)
         {
           if (flags & MSF_SKIPNOTDATA)
           {
@@ -500,7 +656,7 @@ ms3_readmsr_selection (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *msp
     /* Finished when at end-of-stream and buffer contains less than MINRECLEN */
     if (msio_feof (&msfp->input) && MSFPBUFLEN (msfp) < MINRECLEN)
     {
-      if (msfp->recordcount == 0)
+      if (msfp->recordcount == 0 && !(msfp->flags & MSFP_SELECTSKIP))
       {
         ms_log (2, "%s: No data records read, not SEED?\n", msfp->path);
         retcode = MS_NOTSEED;
@@ -662,6 +818,16 @@ ms3_readtracelist_selection (MS3TraceList **ppmstl, const char *mspath,
   while ((retcode = ms3_readmsr_selection (&msfp, &msr, mspath,
                                            flags, selections, verbose)) == MS_NOERROR)
   {
+    /* Record pointers reference offsets in the file, not possible for compressed files */
+    if ((flags & MSF_RECORDLIST) &&
+        (msfp->input.type == LMIO_GZIP || msfp->input.type == LMIO_ZSTD))
+    {
+      ms_log (2, "%s: Record lists are not supported for compressed files\n", mspath);
+
+      retcode = MS_GENERROR;
+      break;
+    }
+
     seg = mstl3_addmsr_recordptr (*ppmstl, msr, (flags & MSF_RECORDLIST) ? &recordptr : NULL,
                                   splitversion, 1, flags, tolerance);
 
@@ -701,6 +867,53 @@ ms3_readtracelist_selection (MS3TraceList **ppmstl, const char *mspath,
   return retcode;
 } /* End of ms3_readtracelist_selection() */
 
+/*****************************************************************/ /**
+ * @brief Request that a file be read ahead of time into the page cache
+ *
+ * Initiate asynchronous reading of the beginning of a local file so
+ * that a later call to ms3_readmsr_selection() or related routines
+ * for the same path does not wait on the storage device.  Typically
+ * called for the next file in a list while the current file is
+ * processed.  Reading of regular files continues to be requested
+ * ahead of the read position while they are read.
+ *
+ * If ::MSF_PNAMERANGE is set in \a flags, a byte range suffix of \a
+ * mspath is parsed and the read ahead starts at the start offset.
+ *
+ * URLs, \c stdin (\a mspath of "-") and platforms without support
+ * for read ahead advice are silently ignored.
+ *
+ * @param[in] mspath File to read ahead
+ * @param[in] flags Flags, only ::MSF_PNAMERANGE is used
+ *
+ * @returns 0 on success and -1 if the file cannot be opened.
+ *********************************************************************/
+int
+ms3_prefetch (const char *mspath, uint32_t flags)
+{
+  char path[512];
+  char *pathname_range = NULL;
+  int64_t startoffset = 0;
+  int64_t endoffset = 0;
+
+  if (!mspath)
+    return -1;
+
+  strncpy (path, mspath, sizeof (path) - 1);
+  path[sizeof (path) - 1] = '\0';
+
+  /* Parse byte range from path name suffix and truncate */
+  if (flags & MSF_PNAMERANGE)
+  {
+    pathname_range = parse_pathname_range (mspath, &startoffset, &endoffset);
+
+    if (pathname_range && (size_t)(pathname_range - mspath) < sizeof (path))
+      path[pathname_range - mspath] = '\0';
+  }
+
+  return msio_prefetch (path, startoffset);
+} /* End of ms3_prefetch() */
+
 /*****************************************************************/ /**
  * @brief Set User-Agent header for URL-based requests.
  *
@@ -1013,3 +1226,528 @@ parse_pathname_range (const char *string, int64_t *start, int64_t *end)
 
   return at;
 } /* End of parse_pathname_range() */
+
+/***************************************************************************
+ * check_fixed_reclen:
+ *
+ * Check that a miniSEED 2 record of the fixed length \a reclen can be
+ * parsed from the buffer without detection: the record header must be
+ * valid and either another valid header must follow at \a reclen or the
+ * record must end exactly at the end of the file.
+ *
+ * Returns 1 if the fixed record length is confirmed, otherwise 0.
+ ***************************************************************************/
+static int
+check_fixed_reclen (const char *record, int buflen, int reclen, uint32_t pflags)
+{
+  if (buflen < reclen || !MS2_ISVALIDHEADER (record))
+    return 0;
+
+  if (buflen == reclen)
+    return (pflags & MSF_ATENDOFFILE) ? 1 : 0;
+
+  if (buflen < reclen + 48)
+    return 0;
+
+  return MS2_ISVALIDHEADER (record + reclen) ? 1 : 0;
+} /* End of check_fixed_reclen() */
+
+/***************************************************************************
+ * scan_notdata:
+ *
+ * Scan a buffer for the first offset at which a miniSEED record could
+ * start, i.e. where the buffer passes MS3_ISVALIDHEADER() or
+ * MS2_ISVALIDHEADER().  Only offsets followed by at least MINRECLEN
+ * bytes are tested, as required for parsing.
+ *
+ * Offsets are pre-filtered on the bytes that are most selective: 'M'
+ * at the start of a miniSEED 3 header and the data quality indicator
+ * at byte 6 of a miniSEED 2 header.  With SSE2 the pre-filter is
+ * applied to 16 offsets at a time.
+ *
+ * Returns the number of bytes at the start of the buffer that cannot
+ * start a record.
+ ***************************************************************************/
+static int
+scan_notdata (const char *buffer, int length)
+{
+  int last = length - MINRECLEN;
+  int offset = 0;
+
+#if defined(LMP_SSE2)
+  const __m128i vM = _mm_set1_epi8 ('M');
+  const __m128i vD = _mm_set1_epi8 ('D');
+  const __m128i vR = _mm_set1_epi8 ('R');
+  const __m128i vQ = _mm_set1_epi8 ('Q');
+  __m128i start;
+  __m128i indicator;
+  int mask;
+  int idx;
+
+  /* 16 offsets at a time, reading bytes up to offset + 21 */
+  for (; offset + 15 <= last; offset += 16)
+  {
+    start     = _mm_loadu_si128 ((const __m128i *)(buffer + offset));
+    indicator = _mm_loadu_si128 ((const __m128i *)(buffer + offset + 6));
+
+    mask = _mm_movemask_epi8 (
+        _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (start, vM), _mm_cmpeq_epi8 (indicator, vM)),
+                      _mm_or_si128 (_mm_cmpeq_epi8 (indicator, vD),
+                                    _mm_or_si128 (_mm_cmpeq_epi8 (indicator, vR),
+                                                  _mm_cmpeq_epi8 (indicator, vQ)))));
+
+    for (idx = 0; mask; idx++, mask >>= 1)
+    {
+      if ((mask & 1) &&
+          (MS3_ISVALIDHEADER (buffer + offset + idx) || MS2_ISVALIDHEADER (buffer + offset + idx)))
+        return offset + idx;
+    }
+  }
+#endif
+
+  for (; offset <= last; offset++)
+  {
+    if ((buffer[offset] == 'M' || MS2_ISDATAINDICATOR (buffer[offset + 6])) &&
+        (MS3_ISVALIDHEADER (buffer + offset) || MS2_ISVALIDHEADER (buffer + offset)))
+      return offset;
+  }
+
+  return offset;
+} /* End of scan_notdata() */
+
+/***************************************************************************
+ * seek_msfp:
+ *
+ * Set the stream position of a local file to 'position', at or after
+ * the current position.  Data already in the read buffer (or mapped
+ * window) are skipped over, otherwise the input is repositioned and
+ * the buffer is emptied.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+seek_msfp (MS3FileParam *msfp, int64_t position)
+{
+  if (position - msfp->streampos <= MSFPBUFLEN (msfp))
+  {
+    msfp->readoffset += (int)(position - msfp->streampos);
+  }
+  else
+  {
+    if (msio_fseek (&msfp->input, position))
+    {
+      ms_log (2, "Cannot seek to offset %" PRId64 ": %s\n", position, msfp->path);
+      return -1;
+    }
+
+    msfp->readoffset = 0;
+    msfp->readlength = 0;
+  }
+
+  msfp->streampos = position;
+
+  return 0;
+} /* End of seek_msfp() */
+
+/***************************************************************************
+ * seek_index:
+ *
+ * Advance the cursor of the stream's record index to the next entry at
+ * or after the stream position that matches the selections and seek
+ * to the record.
+ *
+ * Returns MS_NOERROR when positioned at a selected record,
+ * MS_ENDOFFILE when no further records are selected in the stream
+ * range and MS_GENERROR on error.
+ ***************************************************************************/
+static int
+seek_index (MS3FileParam *msfp, const MS3Selections *selections)
+{
+  MS3RecordIndex *index = msfp->index;
+  const MS3IndexEntry *entry = NULL;
+
+  for (; index->cursor < index->entrycount; index->cursor++)
+  {
+    entry = &index->entries[index->cursor];
+
+    if (entry->offset < msfp->streampos)
+      continue;
+
+    if (msfp->endoffset && entry->offset + entry->reclen > msfp->endoffset + 1)
+      return MS_ENDOFFILE;
+
+    if (ms3_matchselect (selections, MS3IndexEntry_SID (index, entry), entry->starttime,
+                         entry->endtime, entry->pubversion, NULL))
+      break;
+
+    msfp->flags |= MSFP_SELECTSKIP;
+  }
+
+  if (index->cursor >= index->entrycount)
+    return MS_ENDOFFILE;
+
+  if (entry->offset != msfp->streampos && seek_msfp (msfp, entry->offset))
+    return MS_GENERROR;
+
+  return MS_NOERROR;
+} /* End of seek_index() */
+
+/***************************************************************************
+ * probe_record:
+ *
+ * Find the first record starting at or after 'offset', and before
+ * 'limit', in an uncompressed file.  A record is accepted when its
+ * header parses and it is followed by another valid header or ends at
+ * 'limit'.  Reads start at PROBELEN bytes and are doubled up to
+ * 'buffersize' bytes when more data are needed.
+ *
+ * Returns 1 and sets 'recoffset' and 'header' when a record is found, 0
+ * when none is found and -1 on read error.
+ ***************************************************************************/
+static int
+probe_record (FILE *fp, char *buffer, int buffersize, int64_t offset, int64_t limit,
+              int64_t *recoffset, MS3RecordHeader *header)
+{
+  int readlength = PROBELEN;
+  int length;
+  int pos;
+  int next;
+  int more;
+
+  for (;;)
+  {
+    if (readlength > limit - offset)
+      readlength = (int)(limit - offset);
+
+    if (lmp_fseek64 (fp, offset, SEEK_SET))
+      return -1;
+
+    if ((length = (int)fread (buffer, 1, readlength, fp)) < readlength)
+    {
+      if (ferror (fp))
+        return -1;
+
+      limit = offset + length;
+    }
+
+    more = 0;
+    pos = 0;
+    while (pos + MINRECLEN <= length)
+    {
+      pos += scan_notdata (buffer + pos, length - pos);
+
+      if (pos + MINRECLEN > length)
+        break;
+
+      next = ms3_parse_header (buffer + pos, length - pos, header,
+                               (offset + length == limit) ? MSF_ATENDOFFILE : 0, 0);
+
+      if (next == 0)
+      {
+        next = pos + header->reclen;
+
+        if (offset + next == limit)
+        {
+          *recoffset = offset + pos;
+          return 1;
+        }
+        if (next + 48 <= length)
+        {
+          if (MS3_ISVALIDHEADER (buffer + next) || MS2_ISVALIDHEADER (buffer + next))
+          {
+            *recoffset = offset + pos;
+            return 1;
+          }
+        }
+        else
+        {
+          more = 1;
+          break;
+        }
+      }
+      else if (next > 0)
+      {
+        more = 1;
+        break;
+      }
+
+      pos++;
+    }
+
+    /* Read more if a candidate record is truncated */
+    if (!more || readlength >= buffersize || offset + readlength >= limit)
+      return 0;
+
+    readlength = (readlength * 2 > buffersize) ? buffersize : readlength * 2;
+  }
+} /* End of probe_record() */
+
+/***************************************************************************
+ * record_span:
+ *
+ * Returns the time covered by a record, from the start time to the end
+ * of the last sample period, or 0 if not known.
+ ***************************************************************************/
+static nstime_t
+record_span (const MS3RecordHeader *header)
+{
+  if (header->samplecnt <= 0 || header->samprate == 0.0)
+    return 0;
+
+  return ms_sampletime (header->starttime, header->samplecnt, header->samprate) -
+         header->starttime;
+} /* End of record_span() */
+
+/***************************************************************************
+ * bisect_timerange:
+ *
+ * Locate the byte range of records in the overall time range of the
+ * selections in a time-ordered, uncompressed file by bisection on
+ * record start times.  The start offset is set to a record starting
+ * before the start of the time range, less the longest record span
+ * seen, or the first record, and the end offset to the byte before the
+ * first record starting after the end of the time range.
+ *
+ * Records of different channels and sample rates end at different
+ * times, only start times are ordered in a file with multiple
+ * channels.  Stepping back by the longest record span includes earlier
+ * records that extend into the time range.  If the probed start times
+ * are not in order, e.g. in a file ordered by channel, a warning is
+ * logged and the file is read completely.
+ *
+ * Files that cannot be opened, compressed files and selections without
+ * a time range are left to normal reading.
+ *
+ * Returns 0 on success (including when no range is determined) and -1
+ * on error.
+ ***************************************************************************/
+static int
+bisect_timerange (const char *path, const MS3Selections *selections,
+                  int64_t *startoffset, int64_t *endoffset, int8_t verbose)
+{
+  const MS3Selections *select;
+  const MS3SelectTime *selecttime;
+  MS3RecordHeader header;
+  nstime_t winstart = NSTUNSET;
+  nstime_t winend   = NSTUNSET;
+  nstime_t firststart;
+  nstime_t lostart;
+  nstime_t boundstart;
+  nstime_t maxspan;
+  nstime_t span;
+  int8_t openstart  = 0;
+  int8_t openend    = 0;
+  unsigned char magic[4];
+  char *buffer = NULL;
+  FILE *fp;
+  int64_t lo;
+  int64_t hi;
+  int64_t mid;
+  int64_t bound;
+  int64_t record;
+  int64_t firstrecord;
+  int64_t lorecord;
+  int64_t hirecord;
+  int firstlength;
+  int lolength;
+  int retval = -1;
+  int rv;
+
+  /* Determine the overall time range of the selections */
+  for (select = selections; select; select = select->next)
+  {
+    if (!select->timewindows)
+      return 0;
+
+    for (selecttime = select->timewindows; selecttime; selecttime = selecttime->next)
+    {
+      if (selecttime->starttime == NSTUNSET)
+        openstart = 1;
+      else if (winstart == NSTUNSET || selecttime->starttime < winstart)
+        winstart = selecttime->starttime;
+
+      if (selecttime->endtime == NSTUNSET)
+        openend = 1;
+      else if (winend == NSTUNSET || selecttime->endtime > winend)
+        winend = selecttime->endtime;
+    }
+  }
+
+  if (openstart)
+    winstart = NSTUNSET;
+  if (openend)
+    winend = NSTUNSET;
+
+  if (winstart == NSTUNSET && winend == NSTUNSET)
+    return 0;
+
+  /* Errors opening are reported by normal reading */
+  if ((fp = fopen (path, "rb")) == NULL)
+    return 0;
+
+  /* Compressed files are not seekable */
+  if (fread (magic, 1, sizeof (magic), fp) != sizeof (magic) ||
+      msio_compression (magic, sizeof (magic)) != LMIO_NULL ||
+      lmp_fseek64 (fp, 0, SEEK_END) || (hi = lmp_ftell64 (fp)) <= 0)
+  {
+    fclose (fp);
+    return 0;
+  }
+
+  lo = (*startoffset > 0) ? *startoffset : 0;
+  if (*endoffset > 0 && *endoffset + 1 < hi)
+    hi = *endoffset + 1;
+
+  if (!(buffer = (char *)libmseed_memory.malloc (PROBEMAX)))
+  {
+    ms_log (2, "Cannot allocate memory for probe buffer\n");
+    fclose (fp);
+    return -1;
+  }
+
+  /* First record in range */
+  if ((rv = probe_record (fp, buffer, PROBEMAX, lo, hi, &firstrecord, &header)) <= 0)
+  {
+    retval = (rv == 0) ? 0 : -1;
+    goto cleanup;
+  }
+
+  firstlength = header.reclen;
+  firststart  = header.starttime;
+  maxspan     = record_span (&header);
+  lorecord    = firstrecord;
+  hirecord    = hi;
+
+  /* Bisect for the last record starting before the start time less the
+   * longest record span, probing at multiples of the record length of
+   * the lower bound record.  The search is repeated if a longer span is
+   * found by probing. */
+  if (winstart != NSTUNSET)
+  {
+    do
+    {
+      span       = maxspan;
+      lorecord   = firstrecord;
+      lostart    = firststart;
+      lolength   = firstlength;
+      bound      = hi;
+      boundstart = NSTUNSET;
+
+      if (lostart >= winstart - span)
+        break;
+
+      while (bound - lorecord > lolength)
+      {
+        mid = lorecord + ((bound - lorecord) / 2 / lolength) * lolength;
+        if (mid <= lorecord)
+          mid = lorecord + lolength;
+
+        if ((rv = probe_record (fp, buffer, PROBEMAX, mid, bound, &record, &header)) < 0)
+          goto cleanup;
+
+        if (rv == 0)
+        {
+          bound = mid;
+          continue;
+        }
+
+        if (header.starttime < lostart || (boundstart != NSTUNSET && header.starttime > boundstart))
+          goto unordered;
+
+        if (record_span (&header) > maxspan)
+          maxspan = record_span (&header);
+
+        if (header.starttime < winstart - span)
+        {
+          lorecord = record;
+          lostart  = header.starttime;
+          lolength = header.reclen;
+        }
+        else
+        {
+          bound      = record;
+          boundstart = header.starttime;
+        }
+      }
+    } while (maxspan != span);
+
+    if (probe_record (fp, buffer, PROBEMAX, lorecord, hi, &record, &header) != 1)
+      goto cleanup;
+  }
+
+  lolength = header.reclen;
+
+  /* Bisect for the first record starting after the end time */
+  if (winend != NSTUNSET)
+  {
+    if (header.starttime > winend)
+    {
+      hirecord = lorecord;
+    }
+    else
+    {
+      lo         = lorecord;
+      lostart    = header.starttime;
+      bound      = hi;
+      boundstart = NSTUNSET;
+      while (bound - lo > lolength)
+      {
+        mid = lo + ((bound - lo) / 2 / lolength) * lolength;
+        if (mid <= lo)
+          mid = lo + lolength;
+
+        if ((rv = probe_record (fp, buffer, PROBEMAX, mid, bound, &record, &header)) < 0)
+          goto cleanup;
+
+        if (rv == 0)
+        {
+          bound = mid;
+          continue;
+        }
+
+        if (header.starttime < lostart || (boundstart != NSTUNSET && header.starttime > boundstart))
+          goto unordered;
+
+        if (header.starttime > winend)
+        {
+          bound = hirecord = record;
+          boundstart       = header.starttime;
+        }
+        else
+        {
+          lo       = record;
+          lostart  = header.starttime;
+          lolength = header.reclen;
+        }
+      }
+    }
+  }
+
+  /* No records in time range, set an empty range at the end */
+  if (hirecord <= lorecord)
+  {
+    lorecord = hi;
+    hirecord = hi;
+  }
+
+  *startoffset = lorecord;
+  if (hirecord < hi || lorecord == hi)
+    *endoffset = hirecord - 1;
+
+  if (verbose > 1)
+    ms_log (0, "Located time range at byte offsets %" PRId64 "-%" PRId64 " in %s\n",
+            *startoffset, hirecord - 1, path);
+
+  retval = 0;
+  goto cleanup;
+
+unordered:
+  ms_log (1, "Records are not in time order, reading all records: %s\n", path);
+  retval = 0;
+
+cleanup:
+  libmseed_memory.free (buffer);
+  fclose (fp);
+
+  return retval;
+} /* End of bisect_timerange() */
@@ -28,8 +28,8 @@
 extern "C" {
 #endif
 
-#define LIBMSEED_VERSION "3.0.17"    //!< Library version
-#define LIBMSEED_RELEASE "2023.206"  //!< Library release date
+#define LIBMSEED_VERSION "4.0.0"     //!< Library version
+#define LIBMSEED_RELEASE "2026.291"  //!< Library release date
 
 /** @defgroup io-functions File and URL I/O */
 /** @defgroup miniseed-record Record Handling */
@@ -38,6 +38,7 @@ extern "C" {
 /** @defgroup string-functions Source Identifiers */
 /** @defgroup extra-headers Extra Headers */
 /** @defgroup record-list Record List */
+/** @defgroup record-index Record Index */
 /** @defgroup time-related Time definitions and functions */
 /** @defgroup logging Central Logging */
 /** @defgroup utility-functions General Utility Functions */
@@ -378,9 +379,28 @@ typedef struct MS3Record {
   char            sampletype;        //!< Sample type code: a, i, f, d @ref sample-types
 } MS3Record;
 
+/** @brief Record header values identifying a record and its time coverage
+
+    A lightweight view of a record header populated by ms3_parse_header()
+    without extra headers or data samples, sufficient for determining
+    the time coverage of a record.
+*/
+typedef struct MS3RecordHeader {
+  int32_t         reclen;            //!< Length of miniSEED record in bytes
+  char            sid[LM_SIDLEN];    //!< Source identifier as URN, max length @ref LM_SIDLEN
+  uint8_t         formatversion;     //!< Format major version
+  uint8_t         pubversion;        //!< Publication version
+  nstime_t        starttime;         //!< Record start time (first sample)
+  double          samprate;          //!< Nominal sample rate as samples/second (Hz) or period (s)
+  int64_t         samplecnt;         //!< Number of samples in record
+} MS3RecordHeader;
+
 extern int msr3_parse (const char *record, uint64_t recbuflen, MS3Record **ppmsr,
                        uint32_t flags, int8_t verbose);
 
+extern int ms3_parse_header (const char *record, uint64_t recbuflen, MS3RecordHeader *header,
+                             uint32_t flags, int8_t verbose);
+
 extern int msr3_pack (const MS3Record *msr,
                       void (*record_handler) (char *, int, void *),
                       void *handlerdata, int64_t *packedsamples,
@@ -396,6 +416,9 @@ extern int64_t msr3_unpack_data (MS3Record *msr, int8_t verbose);
 
 extern int msr3_data_bounds (const MS3Record *msr, uint32_t *dataoffset, uint32_t *datasize);
 
+extern int64_t msr3_decode_samples (const MS3Record *msr, int64_t count, void *output, size_t outputsize,
+                                    char *sampletype, int8_t verbose);
+
 extern int64_t ms_decode_data (const void *input, size_t inputsize, uint8_t encoding,
                                int64_t samplecount, void *output, size_t outputsize,
                                char *sampletype, int8_t swapflag, const char *sid, int8_t verbose);
@@ -504,6 +527,7 @@ typedef struct MS3RecordList
   uint64_t recordcnt;  //!< Count of records in the list (for convenience)
   MS3RecordPtr *first; //!< Pointer to first entry, NULL if the none
   MS3RecordPtr *last;  //!< Pointer to last entry, NULL if the none
+  struct MS3FileCache *filecache; //!< INTERNAL: Open files shared by the record lists of a trace list
 } MS3RecordList;
 
 /** @} */
@@ -540,7 +564,32 @@ typedef struct MS3RecordList
     @{ */
 
 /** @brief Maximum skip list height for MSTraceIDs */
-#define MSTRACEID_SKIPLIST_HEIGHT 8
+#define MSTRACEID_SKIPLIST_HEIGHT 16
+
+/** @brief Chunk of data samples for a ::MS3TraceSeg, linkable
+ *
+ * When a trace list is constructed with ::MSF_SAMPLECHUNKS the data
+ * samples of each ::MS3TraceSeg are stored in a list of chunks at
+ * ::MS3TraceSeg.chunks instead of the contiguous
+ * ::MS3TraceSeg.datasamples buffer.  This allows samples to be
+ * appended, prepended and segments to be joined without
+ * reallocating and moving all existing samples.
+ *
+ * The samples of a segment are the concatenation of the samples in
+ * each chunk, all of type ::MS3TraceSeg.sampletype.  Use
+ * mstl3_flatten_samples() to convert to a contiguous buffer.
+ *
+ * Chunks moved to a temporary file by mstl3_spill_samples() are
+ * read-only mappings of that file, indicated by \a mapped.
+ */
+typedef struct MS3SampleChunk {
+  void           *datasamples;       //!< Data samples, \a numsamples of type ::MS3TraceSeg.sampletype
+  size_t          datasize;          //!< Size of datasamples buffer in bytes
+  int64_t         numsamples;        //!< Number of data samples in datasamples
+  int8_t          mapped;            //!< Samples are a read-only mapping of a spill file, see mstl3_spill_samples()
+  void           *prvtptr;           //!< Private pointer for general use, unused by library
+  struct MS3SampleChunk *next;       //!< Pointer to next chunk, NULL if the last
+} MS3SampleChunk;
 
 /** @brief Container for a continuous trace segment, linkable */
 typedef struct MS3TraceSeg {
@@ -548,27 +597,36 @@ typedef struct MS3TraceSeg {
   nstime_t        endtime;           //!< Time of last sample
   double          samprate;          //!< Nominal sample rate (Hz)
   int64_t         samplecnt;         //!< Number of samples in trace coverage
-  void           *datasamples;       //!< Data samples, \a numsamples of type \a sampletype
+  void           *datasamples;       //!< Data samples, \a numsamples of type \a sampletype, NULL if in \a chunks
   size_t          datasize;          //!< Size of datasamples buffer in bytes
-  int64_t         numsamples;        //!< Number of data samples in datasamples
+  int64_t         numsamples;        //!< Number of data samples in datasamples or \a chunks
   char            sampletype;        //!< Sample type code, see @ref sample-types
   void           *prvtptr;           //!< Private pointer for general use, unused by library
   struct MS3RecordList *recordlist;  //!< List of pointers to records that contributed
   struct MS3TraceSeg *prev;          //!< Pointer to previous segment
   struct MS3TraceSeg *next;          //!< Pointer to next segment, NULL if the last
+  struct MS3SampleChunk *chunks;     //!< List of data sample chunks, see ::MSF_SAMPLECHUNKS
+  struct MS3SampleChunk *lastchunk;  //!< Pointer to last of list of data sample chunks
 } MS3TraceSeg;
 
-/** @brief Container for a trace ID, linkable */
+/** @brief Container for a trace ID, linkable
+ *
+ * The source identifier at \a sid is stored once per trace list and
+ * shared by the IDs of all publication versions of the source, it
+ * remains valid until the list is freed.  The skip list pointers at
+ * \a next are stored following the structure, \a height entries.
+ */
 typedef struct MS3TraceID {
-  char            sid[LM_SIDLEN];    //!< Source identifier as URN, max length @ref LM_SIDLEN
-  uint8_t         pubversion;        //!< Largest contributing publication version
+  const char     *sid;               //!< Source identifier as URN, max length @ref LM_SIDLEN
   nstime_t        earliest;          //!< Time of earliest sample
   nstime_t        latest;            //!< Time of latest sample
   void           *prvtptr;           //!< Private pointer for general use, unused by library
-  uint32_t        numsegments;       //!< Number of segments for this ID
   struct MS3TraceSeg *first;         //!< Pointer to first of list of segments
   struct MS3TraceSeg *last;          //!< Pointer to last of list of segments
-  struct MS3TraceID *next[MSTRACEID_SKIPLIST_HEIGHT];   //!< Next trace ID at first pointer, NULL if the last
+  struct MS3TraceID **next;          //!< Next trace IDs by skip list level, next ID at first pointer, NULL if the last
+  struct MS3TraceSegIndex *segindex; //!< INTERNAL: Index of segments by time, for long segment lists
+  uint32_t        numsegments;       //!< Number of segments for this ID
+  uint8_t         pubversion;        //!< Largest contributing publication version
   uint8_t         height;            //!< Height of skip list at \a next
 } MS3TraceID;
 
@@ -576,7 +634,13 @@ typedef struct MS3TraceID {
 typedef struct MS3TraceList {
   uint32_t           numtraceids;    //!< Number of traces IDs in list
   struct MS3TraceID  traces;         //!< Head node of trace skip list, first entry at \a traces.next[0]
+  struct MS3TraceID *tracesnext[MSTRACEID_SKIPLIST_HEIGHT]; //!< INTERNAL: Skip list pointers of head node
   uint64_t           prngstate;      //!< INTERNAL: State for Pseudo RNG
+  struct MS3TraceListArena *arena;   //!< INTERNAL: Node allocator, see mstl3_init_arena()
+  struct MS3TraceIDIndex *idindex;   //!< INTERNAL: Hash index of trace IDs, see mstl3_findID()
+  struct MS3FileCache *filecache;    //!< INTERNAL: Open files for mstl3_unpack_recordlist()
+  struct MS3SIDTable *sidtable;      //!< INTERNAL: Source identifiers of trace IDs
+  struct MS3TraceListLock *lock;     //!< INTERNAL: Locks for concurrent additions, see mstl3_set_concurrent()
 } MS3TraceList;
 
 /** @brief Callback functions that return time and sample rate tolerances
@@ -618,8 +682,14 @@ typedef struct MS3Tolerance
   }
 
 extern MS3TraceList* mstl3_init (MS3TraceList *mstl);
+extern MS3TraceList* mstl3_init_arena (MS3TraceList *mstl, size_t blocksize);
+extern int           mstl3_set_concurrent (MS3TraceList *mstl);
 extern void          mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr);
 extern MS3TraceID*   mstl3_findID (MS3TraceList *mstl, const char *sid, uint8_t pubversion, MS3TraceID **prev);
+extern int           mstl3_remove_segment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg, int8_t freeprvtptr);
+extern MS3TraceSeg*  mstl3_split_segment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg, int64_t count);
+extern int           mstl3_merge (MS3TraceList *dst, MS3TraceList **ppsrc, int8_t splitversion, int8_t autoheal,
+                                  const MS3Tolerance *tolerance);
 
 /** @def mstl3_addmsr
     @brief Add a ::MS3Record to a ::MS3TraceList @see mstl3_addmsr_recordptr() */
@@ -640,6 +710,8 @@ extern int64_t mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *
                                         size_t outputsize, int8_t verbose);
 extern int mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate);
 extern int mstl3_resize_buffers (MS3TraceList *mstl);
+extern int64_t mstl3_flatten_samples (MS3TraceSeg *seg);
+extern int64_t mstl3_spill_samples (MS3TraceSeg *seg, const char *tempdir);
 extern int64_t mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
                            void *handlerdata, int reclen, int8_t encoding,
                            int64_t *packedsamples, uint32_t flags, int8_t verbose, char *extra);
@@ -690,9 +762,12 @@ typedef struct LMIO
   {
     LMIO_NULL = 0,   //!< IO handle type is undefined
     LMIO_FILE = 1,   //!< IO handle is FILE-type
-    LMIO_URL  = 2    //!< IO handle is URL-type
+    LMIO_URL  = 2,   //!< IO handle is URL-type
+    LMIO_MMAP = 3,   //!< IO handle is a memory-mapped file
+    LMIO_GZIP = 4,   //!< IO handle is a gzip-compressed file
+    LMIO_ZSTD = 5    //!< IO handle is a zstd-compressed file
   } type;            //!< IO handle type
-  void *handle;      //!< Primary IO handle, either file or URL
+  void *handle;      //!< Primary IO handle, either file, URL or mapped file
   void *handle2;     //!< Secondary IO handle for URL
   int still_running; //!< Fetch status flag for URL transmissions
 } LMIO;
@@ -722,8 +797,11 @@ typedef struct MS3FileParam
   char *readbuffer;    //!< INTERNAL: Read buffer, allocated internally
   int readlength;      //!< INTERNAL: Length of data in read buffer
   int readoffset;      //!< INTERNAL: Read offset in read buffer
+  int readbuffersize;  //!< INTERNAL: Size of read buffer
+  int fixedreclen;     //!< INTERNAL: Record length of a stream with fixed length records, 0 == unknown
   uint32_t flags;      //!< INTERNAL: Stream reading state flags
   LMIO input;          //!< INTERNAL: IO handle, file or URL
+  struct MS3RecordIndex *index; //!< INTERNAL: Record index of file, if used
 } MS3FileParam;
 
 /** @def MS3FileParam_INITIALIZER
@@ -732,9 +810,26 @@ typedef struct MS3FileParam
   {                                                               \
     .path = "", .startoffset = 0, .endoffset = 0, .streampos = 0, \
     .recordcount = 0, .readbuffer = NULL, .readlength = 0,        \
-    .readoffset = 0, .flags = 0, .input = LMIO_INITIALIZER        \
+    .readoffset = 0, .readbuffersize = 0, .fixedreclen = 0,       \
+    .flags = 0, .input = LMIO_INITIALIZER, .index = NULL          \
   }
 
+/** Global read buffer size for reading streams.
+ *
+ * Size of the buffer allocated by ms3_readmsr_selection() and related
+ * routines for reading files that are not memory-mapped, \c stdin and
+ * URLs.  Data are read in chunks up to this size and a partial record
+ * at the end of the buffer is moved to the front only when there is
+ * not room for a complete record of maximum length.  Large buffers
+ * (e.g. 4 MiB) reduce the number of reads and moves for pipes and
+ * URLs with small records.
+ *
+ * Default is 0, meaning ::MAXRECLEN, values smaller than ::MAXRECLEN
+ * are increased to ::MAXRECLEN.  Changes apply to streams opened
+ * afterwards.
+ */
+extern size_t libmseed_readbuffer_size;
+
 extern int ms3_readmsr (MS3Record **ppmsr, const char *mspath, uint32_t flags, int8_t verbose);
 extern int ms3_readmsr_r (MS3FileParam **ppmsfp, MS3Record **ppmsr, const char *mspath,
                           uint32_t flags, int8_t verbose);
@@ -747,6 +842,7 @@ extern int ms3_readtracelist_timewin (MS3TraceList **ppmstl, const char *mspath,
                                       int8_t verbose);
 extern int ms3_readtracelist_selection (MS3TraceList **ppmstl, const char *mspath, const MS3Tolerance *tolerance,
                                         const MS3Selections *selections, int8_t splitversion, uint32_t flags, int8_t verbose);
+extern int ms3_prefetch (const char *mspath, uint32_t flags);
 extern int ms3_url_useragent (const char *program, const char *version);
 extern int ms3_url_userpassword (const char *userpassword);
 extern int ms3_url_addheader (const char *header);
@@ -758,6 +854,75 @@ extern int64_t mstl3_writemseed (MS3TraceList *mst, const char *mspath, int8_t o
 extern int libmseed_url_support (void);
 /** @} */
 
+/** @addtogroup record-index
+    @brief Sidecar index files of the records in a file
+
+    A record index describes every record in a file: source
+    identifier, start and end time, sample count, encoding,
+    publication version, byte offset and length.  It is built once
+    with ms3_index_build() and stored next to the data file with the
+    ::MS3_INDEX_SUFFIX appended to the file name, e.g. when data are
+    archived.
+
+    When ::MSF_RECORDINDEX is set in the flags of
+    ms3_readmsr_selection() and related routines, a current index is
+    used to read only the records that match the selections, skipping
+    directly between them.  This is effective for files that are not
+    time-ordered, e.g. multiplexed volumes of many channels, where
+    ::MSF_TIMESORTED cannot be used.
+
+    The index file contains a fixed header followed by an array of
+    ::MS3IndexEntry in order of record offset and a table of source
+    identifiers, each ::LM_SIDLEN bytes, in host byte order.  It is
+    memory-mapped for use where supported.  An index is considered
+    stale, and is not used, when the size or modification time of the
+    data file differ from when it was built.
+
+    \sa ms3_index_build()
+    \sa ms3_index_load()
+    @{ */
+
+/** @def MS3_INDEX_SUFFIX
+    @brief Suffix appended to a data file name for the default index file name */
+#define MS3_INDEX_SUFFIX ".msidx"
+
+/** @brief Record index entry, describing a single record */
+typedef struct MS3IndexEntry
+{
+  nstime_t starttime;    //!< Time of first sample
+  nstime_t endtime;      //!< Time of last sample
+  int64_t offset;        //!< Byte offset of record in file
+  int64_t samplecnt;     //!< Number of samples in record
+  int32_t reclen;        //!< Length of record in bytes
+  uint32_t sidindex;     //!< Index of source identifier in ::MS3RecordIndex.sids
+  int8_t encoding;       //!< Data encoding format, see @ref encoding-values
+  uint8_t pubversion;    //!< Publication version
+  uint8_t formatversion; //!< Format major version
+  uint8_t reserved[5];   //!< Reserved, zero
+} MS3IndexEntry;
+
+/** @brief Record index of a file, see @ref record-index */
+typedef struct MS3RecordIndex
+{
+  int64_t entrycount;           //!< Number of entries
+  uint32_t sidcount;            //!< Number of source identifiers
+  const MS3IndexEntry *entries; //!< Entries in order of record offset
+  const char *sids;             //!< Source identifiers, \c sidcount of ::LM_SIDLEN bytes each
+  int64_t cursor;               //!< INTERNAL: Next entry to consider while reading
+  void *base;                   //!< INTERNAL: Contents of index file, loaded or mapped
+  size_t length;                //!< INTERNAL: Length of index file contents
+  int8_t mapped;                //!< INTERNAL: Index file contents are memory-mapped
+} MS3RecordIndex;
+
+/** @def MS3IndexEntry_SID
+    @brief Source identifier of an ::MS3IndexEntry in an ::MS3RecordIndex */
+#define MS3IndexEntry_SID(index, entry) ((index)->sids + (size_t)(entry)->sidindex * LM_SIDLEN)
+
+extern int64_t ms3_index_build (const char *mspath, const char *indexpath, uint32_t flags, int8_t verbose);
+extern MS3RecordIndex *ms3_index_load (const char *mspath, const char *indexpath, int8_t verbose);
+extern void ms3_index_free (MS3RecordIndex **ppindex);
+/** @} */
+
 /** @addtogroup string-functions
     @brief Source identifier (SID) and string manipulation functions
 
@@ -1458,6 +1623,11 @@ extern void *libmseed_memory_prealloc (void *ptr, size_t size, size_t *currentsi
 #define MSF_PACKVER2      0x0080  //!< [Packing] Pack as miniSEED version 2 instead of 3
 #define MSF_RECORDLIST    0x0100  //!< [TraceList] Build a ::MS3RecordList for each ::MS3TraceSeg
 #define MSF_MAINTAINMSTL  0x0200  //!< [TraceList] Do not modify a trace list when packing
+#define MSF_SAMPLECHUNKS  0x0400  //!< [TraceList] Store ::MS3TraceSeg data samples in a list of ::MS3SampleChunk
+#define MSF_MMAP          0x0800  //!< [Parsing] Read local files via memory mapping instead of buffered reads
+#define MSF_HEADERONLY    0x1000  //!< [Parsing] Populate only ::MS3RecordHeader values of an ::MS3Record, see ms3_parse_header()
+#define MSF_TIMESORTED    0x2000  //!< [Parsing] Input is time-ordered, locate the time range of selections by bisection
+#define MSF_RECORDINDEX   0x4000  //!< [Parsing] Use a current record index file to read only records matching selections
 /** @} */
 
 #ifdef __cplusplus
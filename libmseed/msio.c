@@ -25,6 +25,109 @@
 
 #include "msio.h"
 
+/* Include compression library headers if support is requested */
+#if defined(LIBMSEED_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(LIBMSEED_ZSTD)
+#include <zstd.h>
+
+/* State of a zstd-compressed file, stored as the LMIO primary handle */
+struct msio_zstd
+{
+  FILE *fp;               /* Compressed file stream */
+  ZSTD_DStream *dstream;  /* Decompression stream */
+  ZSTD_inBuffer input;    /* Compressed input, references inbuffer */
+  void *inbuffer;         /* Compressed input buffer */
+  size_t inbuffersize;    /* Size of compressed input buffer */
+  int finished;           /* Flag indicating all data have been returned */
+};
+#endif
+
+/* Size of buffers for reading compressed files */
+#define MSIO_COMPRESSED_BUFSIZE ((size_t)1 << 20)
+
+/* Compressed files are decompressed by a thread into a ring of blocks
+ * ahead of reading, overlapping decompression with parsing */
+#if !defined(LMP_WIN) && (defined(LIBMSEED_ZLIB) || defined(LIBMSEED_ZSTD))
+#include <pthread.h>
+
+/* Number of decompressed blocks buffered ahead of reading */
+#define MSIO_DECOMPRESS_BLOCKS 4
+
+/* State of a decompression thread, stored as the LMIO secondary handle */
+struct msio_decompress
+{
+  pthread_t thread;         /* Decompression thread */
+  pthread_mutex_t lock;     /* Lock for the fields below */
+  pthread_cond_t cond;      /* Signaled when a block is filled or consumed */
+  LMIO source;              /* Compressed stream read by the thread */
+  char *blocks[MSIO_DECOMPRESS_BLOCKS];   /* Ring of decompressed blocks */
+  size_t lengths[MSIO_DECOMPRESS_BLOCKS]; /* Data lengths of blocks */
+  int head;                 /* Block being read */
+  int count;                /* Count of filled blocks */
+  size_t position;          /* Read position in head block */
+  int finished;             /* Flag indicating all data are decompressed */
+  int error;                /* Flag indicating a decompression error */
+  int stop;                 /* Flag requesting the thread to stop */
+};
+#endif
+
+/* Include memory mapping headers if supported by the platform */
+#if !defined(LMP_WIN)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Maximum size of a single memory-mapped window of a file */
+#if defined(MSIO_MMAP_WINDOW)
+/* Defined by the build */
+#elif SIZE_MAX > 0xFFFFFFFFu
+#define MSIO_MMAP_WINDOW ((size_t)1 << 30)
+#else
+#define MSIO_MMAP_WINDOW ((size_t)1 << 26)
+#endif
+
+/* Size of blocks requested to be read ahead of regular file reading */
+#if !defined(MSIO_READAHEAD)
+#define MSIO_READAHEAD ((int64_t)4 << 20)
+#endif
+
+/* State of a memory-mapped file, stored as the LMIO primary handle */
+struct msio_mmap
+{
+  int fd;           /* File descriptor of mapped file */
+  int64_t filesize; /* Size of file in bytes */
+  char *base;       /* Start of current mapping or NULL */
+  size_t length;    /* Length of current mapping */
+  int64_t position; /* File offset following the last byte provided */
+};
+
+/***************************************************************************
+ * msio_readahead:
+ *
+ * Advise the system that a region of a file will be needed soon,
+ * initiating asynchronous reading into the page cache.  The advice is
+ * ignored for pipes and other special files.
+ *
+ * The kernel reads ahead into the page cache that buffered, mapped
+ * and later opened files all read from, so no data are copied between
+ * threads and no reader state is kept per stream.
+ ***************************************************************************/
+static void
+msio_readahead (int fd, int64_t offset, int64_t length)
+{
+#if defined(POSIX_FADV_WILLNEED)
+  posix_fadvise (fd, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+#else
+  (void)fd;
+  (void)offset;
+  (void)length;
+#endif
+} /* End of msio_readahead() */
+#endif /* !defined(LMP_WIN) */
+
 /* Include libcurl library header if URL supported is requested */
 #if defined(LIBMSEED_URL)
 
@@ -160,6 +263,430 @@ header_callback (char *buffer, size_t size, size_t num, void *userdata)
 #endif /* defined(LIBMSEED_URL) */
 
 
+/***************************************************************************
+ * msio_compression:
+ *
+ * Identify a compressed file from the magic number at the beginning.
+ *
+ * Return LMIO_GZIP or LMIO_ZSTD for a recognized format and
+ * LMIO_NULL otherwise.
+ ***************************************************************************/
+int
+msio_compression (const unsigned char *magic, size_t length)
+{
+  if (length >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+    return LMIO_GZIP;
+
+  if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 &&
+      magic[2] == 0x2F && magic[3] == 0xFD)
+    return LMIO_ZSTD;
+
+  return LMIO_NULL;
+} /* End of msio_compression() */
+
+/***************************************************************************
+ * msio_fread_compressed:
+ *
+ * Read and decompress up to 'size' bytes from a gzip or zstd-compressed
+ * file.
+ *
+ * Returns the number of bytes read on success and a negative value on
+ * error.
+ ***************************************************************************/
+static size_t
+msio_fread_compressed (LMIO *io, void *buffer, size_t size)
+{
+  size_t read = 0;
+
+#if !defined(LIBMSEED_ZLIB) && !defined(LIBMSEED_ZSTD)
+  (void)buffer;
+  (void)size;
+#endif
+
+  /* Read and decompress from gzip-compressed file */
+  if (io->type == LMIO_GZIP)
+  {
+#if defined(LIBMSEED_ZLIB)
+    int rv = gzread ((gzFile)io->handle, buffer, (unsigned int)size);
+
+    if (rv < 0)
+    {
+      ms_log (2, "Error decompressing gzip data: %s\n", gzerror ((gzFile)io->handle, &rv));
+      return -1;
+    }
+
+    read = (size_t)rv;
+#endif
+  }
+  /* Read and decompress from zstd-compressed file */
+  else if (io->type == LMIO_ZSTD)
+  {
+#if defined(LIBMSEED_ZSTD)
+    struct msio_zstd *zs = (struct msio_zstd *)io->handle;
+    ZSTD_outBuffer output = {buffer, size, 0};
+    size_t lastpos;
+    size_t rv;
+
+    while (!zs->finished && output.pos < output.size)
+    {
+      /* Refill compressed input buffer when consumed */
+      if (zs->input.pos == zs->input.size && !feof (zs->fp))
+      {
+        zs->input.src  = zs->inbuffer;
+        zs->input.size = fread (zs->inbuffer, 1, zs->inbuffersize, zs->fp);
+        zs->input.pos  = 0;
+
+        if (ferror (zs->fp))
+        {
+          ms_log (2, "Error reading compressed file (%s)\n", strerror(errno));
+          return -1;
+        }
+      }
+
+      lastpos = output.pos;
+      rv      = ZSTD_decompressStream (zs->dstream, &output, &zs->input);
+
+      if (ZSTD_isError (rv))
+      {
+        ms_log (2, "Error decompressing zstd data: %s\n", ZSTD_getErrorName (rv));
+        return -1;
+      }
+
+      /* Finished when all input is consumed and no more output is produced */
+      if (zs->input.pos == zs->input.size && feof (zs->fp) && output.pos == lastpos)
+        zs->finished = 1;
+    }
+
+    read = output.pos;
+#endif
+  }
+
+  return read;
+} /* End of msio_fread_compressed() */
+
+#if !defined(LMP_WIN) && (defined(LIBMSEED_ZLIB) || defined(LIBMSEED_ZSTD))
+/***************************************************************************
+ * msio_decompress_thread:
+ *
+ * Decompress a compressed stream into the ring of blocks, waiting while
+ * all blocks are filled, until the end of the stream, an error or a
+ * request to stop.
+ ***************************************************************************/
+static void *
+msio_decompress_thread (void *arg)
+{
+  struct msio_decompress *dc = (struct msio_decompress *)arg;
+  size_t length;
+  int slot;
+  int done;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&dc->lock);
+    while (dc->count == MSIO_DECOMPRESS_BLOCKS && !dc->stop)
+      pthread_cond_wait (&dc->cond, &dc->lock);
+
+    if (dc->stop)
+    {
+      pthread_mutex_unlock (&dc->lock);
+      break;
+    }
+
+    slot = (dc->head + dc->count) % MSIO_DECOMPRESS_BLOCKS;
+    pthread_mutex_unlock (&dc->lock);
+
+    /* Blocks not yet filled are only accessed by this thread */
+    length = msio_fread_compressed (&dc->source, dc->blocks[slot], MSIO_COMPRESSED_BUFSIZE);
+
+    pthread_mutex_lock (&dc->lock);
+    if (length == (size_t)-1)
+      dc->error = 1;
+    else if (length == 0)
+      dc->finished = 1;
+    else
+    {
+      dc->lengths[slot] = length;
+      dc->count++;
+    }
+
+    done = (dc->error || dc->finished);
+    pthread_cond_signal (&dc->cond);
+    pthread_mutex_unlock (&dc->lock);
+
+    if (done)
+      break;
+  }
+
+  return NULL;
+} /* End of msio_decompress_thread() */
+
+/***************************************************************************
+ * msio_fread_decompressed:
+ *
+ * Read up to 'size' bytes from the blocks filled by a decompression
+ * thread, waiting for blocks as needed.
+ *
+ * Returns the number of bytes read on success and a negative value on
+ * error.
+ ***************************************************************************/
+static size_t
+msio_fread_decompressed (struct msio_decompress *dc, void *buffer, size_t size)
+{
+  size_t read = 0;
+  size_t length;
+
+  pthread_mutex_lock (&dc->lock);
+
+  while (read < size)
+  {
+    while (dc->count == 0 && !dc->finished && !dc->error)
+      pthread_cond_wait (&dc->cond, &dc->lock);
+
+    if (dc->count == 0)
+    {
+      /* Errors are returned after all decompressed data are read */
+      if (dc->error && read == 0)
+        read = (size_t)-1;
+      break;
+    }
+
+    /* The head block is not modified by the thread while filled */
+    pthread_mutex_unlock (&dc->lock);
+
+    length = dc->lengths[dc->head] - dc->position;
+    if (length > size - read)
+      length = size - read;
+
+    memcpy ((char *)buffer + read, dc->blocks[dc->head] + dc->position, length);
+    read += length;
+
+    pthread_mutex_lock (&dc->lock);
+
+    dc->position += length;
+    if (dc->position == dc->lengths[dc->head])
+    {
+      dc->head     = (dc->head + 1) % MSIO_DECOMPRESS_BLOCKS;
+      dc->position = 0;
+      dc->count--;
+      pthread_cond_signal (&dc->cond);
+    }
+  }
+
+  pthread_mutex_unlock (&dc->lock);
+
+  return read;
+} /* End of msio_fread_decompressed() */
+
+/***************************************************************************
+ * msio_decompress_free:
+ *
+ * Free the state of a decompression thread that is not running.
+ ***************************************************************************/
+static void
+msio_decompress_free (struct msio_decompress *dc)
+{
+  int idx;
+
+  pthread_mutex_destroy (&dc->lock);
+  pthread_cond_destroy (&dc->cond);
+
+  for (idx = 0; idx < MSIO_DECOMPRESS_BLOCKS; idx++)
+    libmseed_memory.free (dc->blocks[idx]);
+
+  libmseed_memory.free (dc);
+} /* End of msio_decompress_free() */
+
+/***************************************************************************
+ * msio_decompress_start:
+ *
+ * Start a thread decompressing an opened compressed stream ahead of
+ * reading.  If the thread cannot be started the stream is decompressed
+ * when read.
+ ***************************************************************************/
+static void
+msio_decompress_start (LMIO *io)
+{
+  struct msio_decompress *dc;
+  int idx;
+
+  if ((dc = (struct msio_decompress *)libmseed_memory.malloc (sizeof (struct msio_decompress))) == NULL)
+    return;
+
+  memset (dc, 0, sizeof (struct msio_decompress));
+  dc->source = *io;
+
+  for (idx = 0; idx < MSIO_DECOMPRESS_BLOCKS; idx++)
+  {
+    if ((dc->blocks[idx] = (char *)libmseed_memory.malloc (MSIO_COMPRESSED_BUFSIZE)) == NULL)
+    {
+      while (idx-- > 0)
+        libmseed_memory.free (dc->blocks[idx]);
+      libmseed_memory.free (dc);
+      return;
+    }
+  }
+
+  pthread_mutex_init (&dc->lock, NULL);
+  pthread_cond_init (&dc->cond, NULL);
+
+  if (pthread_create (&dc->thread, NULL, msio_decompress_thread, dc))
+  {
+    msio_decompress_free (dc);
+    return;
+  }
+
+  io->handle2 = dc;
+} /* End of msio_decompress_start() */
+
+/***************************************************************************
+ * msio_decompress_stop:
+ *
+ * Stop a decompression thread and free its state.
+ ***************************************************************************/
+static void
+msio_decompress_stop (struct msio_decompress *dc)
+{
+  pthread_mutex_lock (&dc->lock);
+  dc->stop = 1;
+  pthread_cond_signal (&dc->cond);
+  pthread_mutex_unlock (&dc->lock);
+
+  pthread_join (dc->thread, NULL);
+
+  msio_decompress_free (dc);
+} /* End of msio_decompress_stop() */
+#endif
+
+/***************************************************************************
+ * msio_fopen_compressed:
+ *
+ * Open a gzip or zstd compressed file for decompressed reading.  If
+ * 'startoffset' is non-zero it is an offset in the decompressed data
+ * and the data before it are decompressed and discarded.  A thread is
+ * then started to decompress the file ahead of reading, where
+ * supported.
+ *
+ * Return 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+static int
+msio_fopen_compressed (LMIO *io, const char *path, int compression,
+                       int64_t *startoffset)
+{
+#if !defined(LIBMSEED_ZLIB) && !defined(LIBMSEED_ZSTD)
+  (void)io;
+  (void)startoffset;
+#endif
+
+  if (compression == LMIO_GZIP)
+  {
+#if !defined(LIBMSEED_ZLIB)
+    ms_log (2, "gzip support not included in library for %s\n", path);
+    return -1;
+#else
+    if ((io->handle = gzopen (path, "rb")) == NULL)
+    {
+      ms_log (2, "Cannot open: %s (%s)\n", path, strerror(errno));
+      return -1;
+    }
+
+    io->type = LMIO_GZIP;
+    gzbuffer ((gzFile)io->handle, (unsigned int)MSIO_COMPRESSED_BUFSIZE);
+
+    if (startoffset && *startoffset > 0)
+    {
+      if (gzseek ((gzFile)io->handle, (z_off_t)*startoffset, SEEK_SET) != (z_off_t)*startoffset)
+      {
+        ms_log (2, "Cannot seek in %s to offset %" PRId64 "\n", path, *startoffset);
+        return -1;
+      }
+    }
+
+#if !defined(LMP_WIN)
+    msio_decompress_start (io);
+#endif
+
+    return 0;
+#endif
+  }
+  else if (compression == LMIO_ZSTD)
+  {
+#if !defined(LIBMSEED_ZSTD)
+    ms_log (2, "zstd support not included in library for %s\n", path);
+    return -1;
+#else
+    struct msio_zstd *zs;
+    char *skipbuffer;
+    int64_t skip;
+    size_t read;
+
+    if ((zs = (struct msio_zstd *)libmseed_memory.malloc (sizeof (struct msio_zstd))) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for zstd state\n");
+      return -1;
+    }
+
+    memset (zs, 0, sizeof (struct msio_zstd));
+    zs->inbuffersize = ZSTD_DStreamInSize ();
+
+    if ((zs->fp = fopen (path, "rb")) == NULL)
+    {
+      ms_log (2, "Cannot open: %s (%s)\n", path, strerror(errno));
+      libmseed_memory.free (zs);
+      return -1;
+    }
+
+    io->type   = LMIO_ZSTD;
+    io->handle = zs;
+
+    if ((zs->inbuffer = libmseed_memory.malloc (zs->inbuffersize)) == NULL ||
+        (zs->dstream = ZSTD_createDStream ()) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for zstd decompression\n");
+      return -1;
+    }
+
+    ZSTD_initDStream (zs->dstream);
+
+    /* Decompress and discard data before the start offset */
+    if (startoffset && *startoffset > 0)
+    {
+      if ((skipbuffer = (char *)libmseed_memory.malloc (MSIO_COMPRESSED_BUFSIZE)) == NULL)
+      {
+        ms_log (2, "Cannot allocate memory for zstd decompression\n");
+        return -1;
+      }
+
+      for (skip = *startoffset; skip > 0; skip -= (int64_t)read)
+      {
+        read = msio_fread (io, skipbuffer,
+                           (skip < (int64_t)MSIO_COMPRESSED_BUFSIZE) ? (size_t)skip : MSIO_COMPRESSED_BUFSIZE);
+
+        if (read == 0 || read == (size_t)-1)
+          break;
+      }
+
+      libmseed_memory.free (skipbuffer);
+
+      if (skip > 0)
+      {
+        ms_log (2, "Cannot seek in %s to offset %" PRId64 "\n", path, *startoffset);
+        return -1;
+      }
+    }
+
+#if !defined(LMP_WIN)
+    msio_decompress_start (io);
+#endif
+
+    return 0;
+#endif
+  }
+
+  return -1;
+} /* End of msio_fopen_compressed() */
+
 /***************************************************************************
  * msio_fopen:
  *
@@ -384,6 +911,10 @@ msio_fopen (LMIO *io, const char *path, const char *mode,
   }
   else
   {
+    unsigned char magic[4];
+    size_t magiclength;
+    int compression;
+
     io->type = LMIO_FILE;
 
     if ((io->handle = fopen (path, mode)) == NULL)
@@ -392,6 +923,28 @@ msio_fopen (LMIO *io, const char *path, const char *mode,
       return -1;
     }
 
+    /* Detect compressed files by magic number, only possible if seekable */
+    if (lmp_ftell64 (io->handle) == 0)
+    {
+      magiclength = fread (magic, 1, sizeof (magic), io->handle);
+      compression = msio_compression (magic, magiclength);
+
+      if (lmp_fseek64 (io->handle, 0, SEEK_SET))
+      {
+        ms_log (2, "Cannot seek in %s to offset 0\n", path);
+        return -1;
+      }
+
+      if (compression != LMIO_NULL)
+      {
+        fclose (io->handle);
+        io->handle = NULL;
+        io->type   = LMIO_NULL;
+
+        return msio_fopen_compressed (io, path, compression, startoffset);
+      }
+    }
+
     /* Seek to position if start offset is provided */
     if (startoffset && *startoffset > 0)
     {
@@ -401,11 +954,237 @@ msio_fopen (LMIO *io, const char *path, const char *mode,
         return -1;
       }
     }
+
+#if !defined(LMP_WIN)
+    /* Request sequential access and the first blocks be read ahead */
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise (fileno ((FILE *)io->handle), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    msio_readahead (fileno ((FILE *)io->handle),
+                    (startoffset && *startoffset > 0) ? *startoffset : 0,
+                    2 * MSIO_READAHEAD);
+#endif
   }
 
   return 0;
 }  /* End of msio_fopen() */
 
+/***************************************************************************
+ * msio_prefetch:
+ *
+ * Request that the beginning of a local file, starting at
+ * 'startoffset', be read into the page cache asynchronously so that
+ * a later open and read does not wait on the storage device.
+ *
+ * URLs, special files and platforms without posix_fadvise() are
+ * ignored.
+ *
+ * Return 0 on success or when ignored and -1 when the file cannot be
+ * opened.
+ ***************************************************************************/
+int
+msio_prefetch (const char *path, int64_t startoffset)
+{
+#if defined(LMP_WIN) || !defined(POSIX_FADV_WILLNEED)
+  (void)path;
+  (void)startoffset;
+  return 0;
+#else
+  struct stat sb;
+  int fd;
+
+  if (!path)
+    return -1;
+
+  if (!strncasecmp (path, "file://", 7))
+    path += 7;
+  else if (strstr (path, "://") || !strcmp (path, "-"))
+    return 0;
+
+  if ((fd = open (path, O_RDONLY)) < 0)
+    return -1;
+
+  if (!fstat (fd, &sb) && S_ISREG (sb.st_mode))
+    msio_readahead (fd, (startoffset > 0) ? startoffset : 0, 2 * MSIO_READAHEAD);
+
+  close (fd);
+
+  return 0;
+#endif
+} /* End of msio_prefetch() */
+
+/***************************************************************************
+ * msio_mmap_open:
+ *
+ * Open a local file for reading via memory mapping.  No mapping is
+ * created until msio_mmap_window() is called.
+ *
+ * Only regular, non-empty files are supported, URLs, pipes and other
+ * special files are not.  Memory mapping is not supported on Windows.
+ *
+ * If 'startoffset' is non-zero it is used as the initial stream
+ * position.
+ *
+ * Return 0 on success, -1 if the path cannot be mapped (the caller
+ * should fall back to msio_fopen()) and -2 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+msio_mmap_open (LMIO *io, const char *path, int64_t *startoffset)
+{
+#if defined(LMP_WIN)
+  (void)io;
+  (void)path;
+  (void)startoffset;
+  return -1;
+#else
+  struct msio_mmap *map;
+  struct stat sb;
+  unsigned char magic[4];
+  ssize_t magiclength;
+  int fd;
+
+  if (!io || !path)
+    return -2;
+
+  /* Treat "file://" specifications as local files by removing the scheme */
+  if (!strncasecmp (path, "file://", 7))
+    path += 7;
+  else if (strstr (path, "://"))
+    return -1;
+
+  if ((fd = open (path, O_RDONLY)) < 0)
+    return -1;
+
+  /* Only regular, uncompressed files are mapped */
+  if (fstat (fd, &sb) || !S_ISREG (sb.st_mode) || sb.st_size <= 0 ||
+      (magiclength = pread (fd, magic, sizeof (magic), 0)) < 0 ||
+      msio_compression (magic, (size_t)magiclength) != LMIO_NULL)
+  {
+    close (fd);
+    return -1;
+  }
+
+  if ((map = (struct msio_mmap *)libmseed_memory.malloc (sizeof (struct msio_mmap))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for memory map state\n");
+    close (fd);
+    return -2;
+  }
+
+  map->fd       = fd;
+  map->filesize = (int64_t)sb.st_size;
+  map->base     = NULL;
+  map->length   = 0;
+  map->position = (startoffset && *startoffset > 0) ? *startoffset : 0;
+
+  io->type    = LMIO_MMAP;
+  io->handle  = map;
+  io->handle2 = NULL;
+
+  return 0;
+#endif
+} /* End of msio_mmap_open() */
+
+/***************************************************************************
+ * msio_mmap_window:
+ *
+ * Map a window of a file opened with msio_mmap_open() starting at
+ * file offset 'position', replacing any previous window.  The window
+ * extends to the end of the file or the maximum window size, whichever
+ * is smaller, and always includes at least MAXRECLEN bytes following
+ * 'position' when available.  The window is advised for sequential
+ * access.
+ *
+ * The mapping is private and writable, pages modified by the caller
+ * (e.g. while validating a CRC) are copied and never written to the
+ * file.  Pointers into a previous window are invalid after this call.
+ *
+ * On success '*window' is set to the byte at 'position' and '*length'
+ * to the number of bytes available from there, zero at end of file.
+ *
+ * Return 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+msio_mmap_window (LMIO *io, int64_t position, char **window, size_t *length)
+{
+#if defined(LMP_WIN)
+  (void)io;
+  (void)position;
+  (void)window;
+  (void)length;
+  return -1;
+#else
+  struct msio_mmap *map;
+  int64_t mapoffset;
+  int64_t maplength;
+  long pagesize;
+
+  if (!io || io->type != LMIO_MMAP || !window || !length)
+    return -1;
+
+  map = (struct msio_mmap *)io->handle;
+
+  if (map->base)
+  {
+    munmap (map->base, map->length);
+    map->base   = NULL;
+    map->length = 0;
+  }
+
+  if (position >= map->filesize)
+  {
+    map->position = map->filesize;
+    *window       = NULL;
+    *length       = 0;
+    return 0;
+  }
+
+  /* Mapping offset must be a multiple of the page size */
+  if ((pagesize = sysconf (_SC_PAGESIZE)) <= 0)
+    pagesize = 4096;
+
+  mapoffset = position - (position % pagesize);
+  maplength = (int64_t)MSIO_MMAP_WINDOW;
+
+  /* Always include a complete record of maximum length */
+  if (maplength < (position - mapoffset) + MAXRECLEN)
+    maplength = (position - mapoffset) + MAXRECLEN;
+
+  if (maplength > map->filesize - mapoffset)
+    maplength = map->filesize - mapoffset;
+
+  map->base = (char *)mmap (NULL, (size_t)maplength, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, map->fd, (off_t)mapoffset);
+
+  if (map->base == MAP_FAILED)
+  {
+    ms_log (2, "Cannot memory map file at offset %" PRId64 " (%s)\n",
+            mapoffset, strerror (errno));
+    map->base = NULL;
+    return -1;
+  }
+
+  map->length = (size_t)maplength;
+
+#if defined(MADV_SEQUENTIAL)
+  madvise (map->base, map->length, MADV_SEQUENTIAL);
+#endif
+#if defined(MADV_WILLNEED)
+  madvise (map->base, map->length, MADV_WILLNEED);
+#endif
+
+  map->position = mapoffset + maplength;
+  *window       = map->base + (position - mapoffset);
+  *length       = (size_t)(map->position - position);
+
+  return 0;
+#endif
+} /* End of msio_mmap_window() */
+
 /*********************************************************************
  * msio_fclose:
  *
@@ -429,6 +1208,15 @@ msio_fclose (LMIO *io)
   if (io->handle == NULL || io->type == LMIO_NULL)
     return 0;
 
+#if !defined(LMP_WIN) && (defined(LIBMSEED_ZLIB) || defined(LIBMSEED_ZSTD))
+  /* Stop decompression thread before closing its stream */
+  if ((io->type == LMIO_GZIP || io->type == LMIO_ZSTD) && io->handle2)
+  {
+    msio_decompress_stop ((struct msio_decompress *)io->handle2);
+    io->handle2 = NULL;
+  }
+#endif
+
   if (io->type == LMIO_FILE)
   {
     rv = fclose (io->handle);
@@ -439,6 +1227,55 @@ msio_fclose (LMIO *io)
       return -1;
     }
   }
+  else if (io->type == LMIO_GZIP)
+  {
+#if defined(LIBMSEED_ZLIB)
+    rv = gzclose ((gzFile)io->handle);
+
+    if (rv != Z_OK)
+    {
+      ms_log (2, "Error closing compressed file (%d)\n", rv);
+      return -1;
+    }
+#endif
+  }
+  else if (io->type == LMIO_ZSTD)
+  {
+#if defined(LIBMSEED_ZSTD)
+    struct msio_zstd *zs = (struct msio_zstd *)io->handle;
+
+    ZSTD_freeDStream (zs->dstream);
+    rv = fclose (zs->fp);
+
+    if (zs->inbuffer)
+      libmseed_memory.free (zs->inbuffer);
+    libmseed_memory.free (zs);
+
+    if (rv)
+    {
+      ms_log (2, "Error closing file (%s)\n", strerror(errno));
+      return -1;
+    }
+#endif
+  }
+  else if (io->type == LMIO_MMAP)
+  {
+#if !defined(LMP_WIN)
+    struct msio_mmap *map = (struct msio_mmap *)io->handle;
+
+    if (map->base)
+      munmap (map->base, map->length);
+
+    rv = close (map->fd);
+    libmseed_memory.free (map);
+
+    if (rv)
+    {
+      ms_log (2, "Error closing file (%s)\n", strerror(errno));
+      return -1;
+    }
+#endif
+  }
   else if (io->type == LMIO_URL)
   {
 #if !defined(LIBMSEED_URL)
@@ -492,6 +1329,44 @@ msio_fread (LMIO *io, void *buffer, size_t size)
   if (io->type == LMIO_FILE)
   {
     read = fread (buffer, 1, size, io->handle);
+
+#if !defined(LMP_WIN)
+    /* Request the next block be read ahead when crossing into a new block,
+     * keeping a block in flight while the current one is processed */
+    if (read > 0)
+    {
+      int64_t position = lmp_ftell64 (io->handle);
+
+      if (position > 0 && (position / MSIO_READAHEAD) != ((position - (int64_t)read) / MSIO_READAHEAD))
+        msio_readahead (fileno ((FILE *)io->handle),
+                        (position / MSIO_READAHEAD + 1) * MSIO_READAHEAD, MSIO_READAHEAD);
+    }
+#endif
+  }
+  /* Read decompressed data from gzip or zstd-compressed file */
+  else if (io->type == LMIO_GZIP || io->type == LMIO_ZSTD)
+  {
+#if !defined(LMP_WIN) && (defined(LIBMSEED_ZLIB) || defined(LIBMSEED_ZSTD))
+    if (io->handle2)
+      read = msio_fread_decompressed ((struct msio_decompress *)io->handle2, buffer, size);
+    else
+#endif
+      read = msio_fread_compressed (io, buffer, size);
+  }
+
+  /* Read from memory-mapped file descriptor, bypassing the mapping */
+  else if (io->type == LMIO_MMAP)
+  {
+#if !defined(LMP_WIN)
+    struct msio_mmap *map = (struct msio_mmap *)io->handle;
+    ssize_t rv;
+
+    if ((rv = pread (map->fd, buffer, size, (off_t)map->position)) < 0)
+      return -1;
+
+    read = (size_t)rv;
+    map->position += rv;
+#endif
   }
   /* Read from URL stream */
   else if (io->type == LMIO_URL)
@@ -603,6 +1478,43 @@ msio_feof (LMIO *io)
     if (feof ((FILE *)io->handle))
       return 1;
   }
+  else if (io->type == LMIO_MMAP)
+  {
+#if !defined(LMP_WIN)
+    struct msio_mmap *map = (struct msio_mmap *)io->handle;
+
+    if (map->position >= map->filesize)
+      return 1;
+#endif
+  }
+#if !defined(LMP_WIN) && (defined(LIBMSEED_ZLIB) || defined(LIBMSEED_ZSTD))
+  else if ((io->type == LMIO_GZIP || io->type == LMIO_ZSTD) && io->handle2)
+  {
+    struct msio_decompress *dc = (struct msio_decompress *)io->handle2;
+    int eof;
+
+    pthread_mutex_lock (&dc->lock);
+    eof = (dc->finished && dc->count == 0);
+    pthread_mutex_unlock (&dc->lock);
+
+    if (eof)
+      return 1;
+  }
+#endif
+  else if (io->type == LMIO_GZIP)
+  {
+#if defined(LIBMSEED_ZLIB)
+    if (gzeof ((gzFile)io->handle))
+      return 1;
+#endif
+  }
+  else if (io->type == LMIO_ZSTD)
+  {
+#if defined(LIBMSEED_ZSTD)
+    if (((struct msio_zstd *)io->handle)->finished)
+      return 1;
+#endif
+  }
   else if (io->type == LMIO_URL)
   {
 #if !defined(LIBMSEED_URL)
@@ -620,6 +1532,39 @@ msio_feof (LMIO *io)
   return 0;
 } /* End of msio_feof() */
 
+/*********************************************************************
+ * msio_fseek:
+ *
+ * Set the position of a local file stream to an absolute byte
+ * offset.  The position of a memory-mapped file is the start of the
+ * next window or direct read.  Compressed and URL streams cannot be
+ * repositioned.
+ *
+ * Returns 0 on success and -1 on error.
+ *********************************************************************/
+int
+msio_fseek (LMIO *io, int64_t position)
+{
+  if (!io || !io->handle || position < 0)
+    return -1;
+
+  if (io->type == LMIO_FILE)
+  {
+    return (lmp_fseek64 ((FILE *)io->handle, position, SEEK_SET)) ? -1 : 0;
+  }
+  else if (io->type == LMIO_MMAP)
+  {
+#if !defined(LMP_WIN)
+    struct msio_mmap *map = (struct msio_mmap *)io->handle;
+
+    map->position = position;
+    return 0;
+#endif
+  }
+
+  return -1;
+} /* End of msio_fseek() */
+
 /*********************************************************************
  * msio_url_useragent:
  *
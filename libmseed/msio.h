@@ -29,9 +29,14 @@ extern "C" {
 
 extern int msio_fopen (LMIO *io, const char *path, const char *mode,
                        int64_t *startoffset, int64_t *endoffset);
+extern int msio_compression (const unsigned char *magic, size_t length);
+extern int msio_prefetch (const char *path, int64_t startoffset);
+extern int msio_mmap_open (LMIO *io, const char *path, int64_t *startoffset);
+extern int msio_mmap_window (LMIO *io, int64_t position, char **window, size_t *length);
 extern int msio_fclose (LMIO *io);
 extern size_t msio_fread (LMIO *io, void *buffer, size_t size);
 extern int msio_feof (LMIO *io);
+extern int msio_fseek (LMIO *io, int64_t position);
 extern int msio_url_useragent (const char *program, const char *version);
 extern int msio_url_userpassword (const char *userpassword);
 extern int msio_url_addheader (const char *header);
@@ -28,6 +28,9 @@
 #include "unpack.h"
 #include "mseedformat.h"
 
+static int parse_reclen (const char *record, uint64_t recbuflen, uint32_t flags,
+                         int *reclen, uint8_t *formatversion, int8_t verbose);
+
 /***********************************************************************/ /**
  * @brief Parse miniSEED from a buffer
  *
@@ -46,6 +49,8 @@
  * @parblock
  *  - \c ::MSF_UNPACKDATA - Unpack data samples
  *  - \c ::MSF_VALIDATECRC Validate CRC (if present in format)
+ *  - \c ::MSF_HEADERONLY Populate only the values of ::MS3RecordHeader,
+ *    see ms3_parse_header()
  * @endparblock
  * @param verbose control verbosity of diagnostic output
  *
@@ -72,7 +77,148 @@ msr3_parse (const char *record, uint64_t recbuflen, MS3Record **ppmsr,
   }
 
   /* Detect record, determine length and format version */
-  reclen = ms3_detect (record, recbuflen, &formatversion);
+  if ((retcode = parse_reclen (record, recbuflen, flags, &reclen, &formatversion, verbose)))
+    return retcode;
+
+  return msr3_parse_reclen (record, reclen, formatversion, ppmsr, flags, verbose);
+} /* End of msr3_parse() */
+
+/***************************************************************************
+ * msr3_parse_reclen:
+ *
+ * Parse a record of known length and format version, as determined by
+ * ms3_detect() or by the caller, e.g. from the fixed record length of
+ * a stream.  No detection is performed, the caller must ensure that
+ * \a reclen bytes are available at \a record.
+ *
+ * Returns 0 on success or a (negative) libmseed error code.
+ ***************************************************************************/
+int
+msr3_parse_reclen (const char *record, int reclen, uint8_t formatversion,
+                   MS3Record **ppmsr, uint32_t flags, int8_t verbose)
+{
+  MS3RecordHeader header;
+  int retcode = MS_NOERROR;
+
+  /* Populate only record header values */
+  if (flags & MSF_HEADERONLY)
+  {
+    if (formatversion == 3)
+      retcode = ms3_unpack_header3 (record, reclen, &header, verbose);
+    else
+      retcode = ms3_unpack_header2 (record, reclen, &header, verbose);
+
+    if (retcode == MS_NOERROR)
+    {
+      if (!(*ppmsr = msr3_init (*ppmsr)))
+        return MS_GENERROR;
+
+      (*ppmsr)->record        = record;
+      (*ppmsr)->reclen        = header.reclen;
+      (*ppmsr)->formatversion = header.formatversion;
+      (*ppmsr)->pubversion    = header.pubversion;
+      (*ppmsr)->starttime     = header.starttime;
+      (*ppmsr)->samprate      = header.samprate;
+      (*ppmsr)->samplecnt     = header.samplecnt;
+      memcpy ((*ppmsr)->sid, header.sid, sizeof (header.sid));
+    }
+  }
+  /* Unpack record */
+  else if (formatversion == 3)
+  {
+    retcode = msr3_unpack_mseed3 (record, reclen, ppmsr, flags, verbose);
+  }
+  else
+  {
+    retcode = msr3_unpack_mseed2 (record, reclen, ppmsr, flags, verbose);
+  }
+
+  if (retcode != MS_NOERROR)
+  {
+    msr3_free (ppmsr);
+
+    return retcode;
+  }
+
+  return MS_NOERROR;
+} /* End of msr3_parse_reclen() */
+
+/***********************************************************************/ /**
+ * @brief Parse only the header values of a miniSEED record from a buffer
+ *
+ * This routine will attempt to detect a miniSEED record in a specified
+ * memory buffer and populate a supplied ::MS3RecordHeader with the
+ * values identifying the record and its time coverage: source
+ * identifier, start time, sample rate, sample count, publication
+ * version, format version and record length.  Both miniSEED 2.x and
+ * 3.x records are supported.
+ *
+ * Compared to msr3_parse() no ::MS3Record is allocated, no extra
+ * headers are parsed or copied and the data payload is not
+ * inspected.  For miniSEED 2.x the blockette chain is traversed only
+ * for Blockettes 100, 1000 and 1001.  This is well suited to
+ * determining the coverage of large volumes of data.
+ *
+ * The same parsing is applied by msr3_parse(), and therefore
+ * ms3_readmsr_selection() and related routines, when ::MSF_HEADERONLY
+ * is set in the flags.
+ *
+ * @param record Buffer containing record to parse
+ * @param recbuflen Buffer length in bytes
+ * @param header Pointer to a ::MS3RecordHeader that will be populated
+ * @param flags Flags controlling features:
+ * @parblock
+ *  - \c ::MSF_ATENDOFFILE - Buffer ends at the end of the input
+ * @endparblock
+ * @param verbose control verbosity of diagnostic output
+ *
+ * @return Parsing status
+ * @retval 0 Success, populates the supplied ::MS3RecordHeader.
+ * @retval >0 Data record detected but not enough data is present, the
+ *       return value is a hint of how many more bytes are needed.
+ * @retval <0 library error code is returned.
+ *
+ * \ref MessageOnError - this function logs a message on error except MS_NOTSEED
+ ***************************************************************************/
+int
+ms3_parse_header (const char *record, uint64_t recbuflen, MS3RecordHeader *header,
+                  uint32_t flags, int8_t verbose)
+{
+  int reclen  = 0;
+  int retcode = MS_NOERROR;
+  uint8_t formatversion = 0;
+
+  if (!header || !record)
+  {
+    ms_log (2, "Required argument not defined: 'header' or 'record'\n");
+    return MS_GENERROR;
+  }
+
+  /* Detect record, determine length and format version */
+  if ((retcode = parse_reclen (record, recbuflen, flags, &reclen, &formatversion, verbose)))
+    return retcode;
+
+  if (formatversion == 3)
+    return ms3_unpack_header3 (record, reclen, header, verbose);
+
+  return ms3_unpack_header2 (record, reclen, header, verbose);
+} /* End of ms3_parse_header() */
+
+/***************************************************************************
+ * parse_reclen:
+ *
+ * Detect a record in a buffer and determine the record length and
+ * format version for parsing.
+ *
+ * Returns 0 when a complete record of a supported format is in the
+ * buffer, a positive hint of how many more bytes are needed, or a
+ * (negative) libmseed error code.
+ ***************************************************************************/
+static int
+parse_reclen (const char *record, uint64_t recbuflen, uint32_t flags,
+              int *reclen, uint8_t *formatversion, int8_t verbose)
+{
+  *reclen = ms3_detect (record, recbuflen, formatversion);
 
   /* Return record length implied by buffer length if:
      - version 2
@@ -82,76 +228,60 @@ msr3_parse (const char *record, uint64_t recbuflen, MS3Record **ppmsr,
      - within supported record length
 
      Power of two if (X & (X - 1)) == 0 */
-  if (formatversion == 2 &&
-      reclen == 0 &&
+  if (*formatversion == 2 &&
+      *reclen == 0 &&
       flags & MSF_ATENDOFFILE &&
       (recbuflen & (recbuflen - 1)) == 0 &&
       recbuflen <= MAXRECLEN)
   {
-    reclen = (int)recbuflen;
+    *reclen = (int)recbuflen;
   }
 
   /* No data record detected */
-  if (reclen < 0)
+  if (*reclen < 0)
   {
     return MS_NOTSEED;
   }
 
   /* Found record but could not determine length */
-  if (reclen == 0)
+  if (*reclen == 0)
   {
     return MINRECLEN;
   }
 
   if (verbose > 2)
   {
-    ms_log (0, "Detected record length of %d bytes\n", reclen);
+    ms_log (0, "Detected record length of %d bytes\n", *reclen);
   }
 
   /* Check that record length is in supported range */
-  if (reclen < MINRECLEN || reclen > MAXRECLEN)
+  if (*reclen < MINRECLEN || *reclen > MAXRECLEN)
   {
     ms_log (2, "Record length of %d is out of range allowed: %d to %d)\n",
-            reclen, MINRECLEN, MAXRECLEN);
+            *reclen, MINRECLEN, MAXRECLEN);
 
     return MS_OUTOFRANGE;
   }
 
   /* Check if more data is required, return hint */
-  if (reclen > recbuflen)
+  if ((uint64_t)*reclen > recbuflen)
   {
     if (verbose > 2)
       ms_log (0, "Detected %d byte record, need %d more bytes\n",
-              reclen, (int)(reclen - recbuflen));
+              *reclen, (int)(*reclen - recbuflen));
 
-    return (int)(reclen - recbuflen);
+    return (int)(*reclen - recbuflen);
   }
 
-  /* Unpack record */
-  if (formatversion == 3)
-  {
-    retcode = msr3_unpack_mseed3 (record, reclen, ppmsr, flags, verbose);
-  }
-  else if (formatversion == 2)
+  if (*formatversion != 2 && *formatversion != 3)
   {
-    retcode = msr3_unpack_mseed2 (record, reclen, ppmsr, flags, verbose);
-  }
-  else
-  {
-    ms_log (2, "Unrecognized format version: %d\n", formatversion);
+    ms_log (2, "Unrecognized format version: %d\n", *formatversion);
 
     return MS_GENERROR;
   }
 
-  if (retcode != MS_NOERROR)
-  {
-    msr3_free (ppmsr);
-
-    return retcode;
-  }
-
   return MS_NOERROR;
-} /* End of msr3_parse() */
+} /* End of parse_reclen() */
 
 /***************************************************************/ /**
  * @brief Detect miniSEED record in buffer
@@ -0,0 +1,527 @@
+/***************************************************************************
+ * Routines to build and load sidecar record index files.
+ *
+ * This file is part of the miniSEED Library.
+ *
+ * Copyright (c) 2023 Chad Trabant, EarthScope Data Services
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libmseed.h"
+
+#if !defined(LMP_WIN)
+#include <sys/mman.h>
+#endif
+
+/* Index file identification and byte order marker */
+#define INDEX_MAGIC "LMSIDX1"
+#define INDEX_BYTEORDER 0x01020304u
+
+/* Index file header, followed by entries and source identifiers */
+typedef struct IndexHeader
+{
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t sidcount;
+  int64_t entrycount;
+  int64_t filesize;
+  int64_t filemtime;
+} IndexHeader;
+
+/* Table of unique source identifiers with a hash lookup */
+typedef struct SIDTable
+{
+  char *sids;          /* Identifiers, LM_SIDLEN bytes each */
+  uint32_t count;      /* Number of identifiers */
+  uint32_t capacity;   /* Allocated identifiers */
+  uint32_t *slots;     /* Hash slots, identifier index + 1, 0 == empty */
+  uint32_t slotcount;  /* Number of hash slots, power of 2 */
+} SIDTable;
+
+static int data_fileinfo (const char *path, int64_t *size, int64_t *mtime);
+static char *index_path (const char *mspath, const char *indexpath, char *buffer, size_t size);
+static int64_t sidtable_add (SIDTable *table, const char *sid);
+
+/**********************************************************************/ /**
+ * @brief Build a record index file for a miniSEED file
+ *
+ * Read all records in \a mspath and write an index describing each
+ * record to \a indexpath, see @ref record-index.  The index is written
+ * to a temporary file that is renamed to \a indexpath when complete,
+ * replacing any existing index.
+ *
+ * Only local, uncompressed files can be indexed.  Of the \a flags,
+ * only ::MSF_SKIPNOTDATA, ::MSF_VALIDATECRC and ::MSF_MMAP are used.
+ *
+ * @param[in] mspath File to index
+ * @param[in] indexpath Index file to write, if NULL the default of
+ * \a mspath with ::MS3_INDEX_SUFFIX appended is used
+ * @param[in] flags Flags used to control reading, see @ref control-flags
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns The number of records indexed on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+ms3_index_build (const char *mspath, const char *indexpath, uint32_t flags, int8_t verbose)
+{
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  MS3IndexEntry *entries = NULL;
+  MS3IndexEntry *entry;
+  SIDTable table = {NULL, 0, 0, NULL, 0};
+  IndexHeader header;
+  char path[sizeof (msfp->path) + sizeof (MS3_INDEX_SUFFIX)];
+  char tmppath[sizeof (path) + 4];
+  int64_t entrycount = 0;
+  int64_t capacity = 0;
+  int64_t sidindex;
+  int64_t retval = -1;
+  FILE *fp = NULL;
+  int retcode;
+
+  if (!mspath)
+  {
+    ms_log (2, "Required argument not defined: 'mspath'\n");
+    return -1;
+  }
+
+  if (strcmp (mspath, "-") == 0 || strstr (mspath, "://") != NULL)
+  {
+    ms_log (2, "Cannot index stream or URL input: %s\n", mspath);
+    return -1;
+  }
+
+  if (!index_path (mspath, indexpath, path, sizeof (path)))
+    return -1;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, INDEX_MAGIC, sizeof (INDEX_MAGIC));
+  header.byteorder = INDEX_BYTEORDER;
+
+  if (data_fileinfo (mspath, &header.filesize, &header.filemtime))
+  {
+    ms_log (2, "Cannot determine size of %s: %s\n", mspath, strerror (errno));
+    return -1;
+  }
+
+  flags &= (MSF_SKIPNOTDATA | MSF_VALIDATECRC | MSF_MMAP);
+
+  while ((retcode = ms3_readmsr_r (&msfp, &msr, mspath, flags, verbose)) == MS_NOERROR)
+  {
+    /* Record offsets of decompressed streams cannot be used for seeking */
+    if (msfp->input.type != LMIO_FILE && msfp->input.type != LMIO_MMAP)
+    {
+      ms_log (2, "Cannot index compressed file: %s\n", mspath);
+      goto cleanup;
+    }
+
+    if (entrycount >= capacity)
+    {
+      capacity = (capacity) ? capacity * 2 : 1024;
+
+      if (!(entry = (MS3IndexEntry *)libmseed_memory.realloc (entries, (size_t)capacity * sizeof (MS3IndexEntry))))
+      {
+        ms_log (2, "Cannot allocate memory for index entries\n");
+        goto cleanup;
+      }
+
+      entries = entry;
+    }
+
+    if ((sidindex = sidtable_add (&table, msr->sid)) < 0)
+      goto cleanup;
+
+    entry = &entries[entrycount++];
+    memset (entry, 0, sizeof (MS3IndexEntry));
+    entry->starttime     = msr->starttime;
+    entry->endtime       = msr3_endtime (msr);
+    entry->offset        = msfp->streampos - msr->reclen;
+    entry->samplecnt     = msr->samplecnt;
+    entry->reclen        = msr->reclen;
+    entry->sidindex      = (uint32_t)sidindex;
+    entry->encoding      = msr->encoding;
+    entry->pubversion    = msr->pubversion;
+    entry->formatversion = msr->formatversion;
+  }
+
+  /* Reading errors are reported by ms3_readmsr_r() */
+  if (retcode != MS_ENDOFFILE)
+    goto cleanup;
+
+  header.sidcount   = table.count;
+  header.entrycount = entrycount;
+
+  snprintf (tmppath, sizeof (tmppath), "%s.tmp", path);
+
+  if ((fp = fopen (tmppath, "wb")) == NULL)
+  {
+    ms_log (2, "Cannot open index file %s: %s\n", tmppath, strerror (errno));
+    goto cleanup;
+  }
+
+  if (fwrite (&header, sizeof (header), 1, fp) != 1 ||
+      (entrycount > 0 && fwrite (entries, sizeof (MS3IndexEntry), (size_t)entrycount, fp) != (size_t)entrycount) ||
+      (table.count > 0 && fwrite (table.sids, LM_SIDLEN, table.count, fp) != table.count))
+  {
+    ms_log (2, "Cannot write index file %s: %s\n", tmppath, strerror (errno));
+    fclose (fp);
+    remove (tmppath);
+    goto cleanup;
+  }
+
+  if (fclose (fp))
+  {
+    ms_log (2, "Cannot write index file %s: %s\n", tmppath, strerror (errno));
+    remove (tmppath);
+    goto cleanup;
+  }
+
+#if defined(LMP_WIN)
+  /* Rename does not replace an existing file on Windows */
+  remove (path);
+#endif
+
+  if (rename (tmppath, path))
+  {
+    ms_log (2, "Cannot rename %s to %s: %s\n", tmppath, path, strerror (errno));
+    remove (tmppath);
+    goto cleanup;
+  }
+
+  if (verbose)
+    ms_log (0, "Indexed %" PRId64 " records of %u source identifiers in %s\n",
+            entrycount, table.count, path);
+
+  retval = entrycount;
+
+cleanup:
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+
+  if (entries)
+    libmseed_memory.free (entries);
+  if (table.sids)
+    libmseed_memory.free (table.sids);
+  if (table.slots)
+    libmseed_memory.free (table.slots);
+
+  return retval;
+} /* End of ms3_index_build() */
+
+/**********************************************************************/ /**
+ * @brief Load the record index file of a miniSEED file
+ *
+ * Load the index at \a indexpath, memory-mapping it where supported,
+ * and verify that it is current for \a mspath, see @ref record-index.
+ *
+ * An index is not returned when it does not exist, when the size or
+ * modification time of \a mspath differ from when the index was
+ * built, or when the index is not valid for this host.  The file can
+ * then be read without the index.
+ *
+ * @param[in] mspath File described by the index
+ * @param[in] indexpath Index file to load, if NULL the default of
+ * \a mspath with ::MS3_INDEX_SUFFIX appended is used
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns A pointer to an ::MS3RecordIndex, which must be freed with
+ * ms3_index_free(), or NULL if no current index is available.
+ ***************************************************************************/
+MS3RecordIndex *
+ms3_index_load (const char *mspath, const char *indexpath, int8_t verbose)
+{
+  MS3RecordIndex *index = NULL;
+  IndexHeader header;
+  char path[sizeof (((MS3FileParam *)0)->path) + sizeof (MS3_INDEX_SUFFIX)];
+  int64_t filesize;
+  int64_t filemtime;
+  int64_t length;
+  int64_t idx;
+  FILE *fp;
+
+  if (!mspath || !index_path (mspath, indexpath, path, sizeof (path)))
+    return NULL;
+
+  if ((fp = fopen (path, "rb")) == NULL)
+  {
+    if (verbose > 1)
+      ms_log (0, "No record index file %s\n", path);
+
+    return NULL;
+  }
+
+  /* Index must be for this host and current for the data file */
+  if (fread (&header, sizeof (header), 1, fp) != 1 ||
+      memcmp (header.magic, INDEX_MAGIC, sizeof (INDEX_MAGIC)) ||
+      header.byteorder != INDEX_BYTEORDER || header.entrycount < 0 ||
+      lmp_fseek64 (fp, 0, SEEK_END) || (length = lmp_ftell64 (fp)) < 0 ||
+      length != (int64_t)sizeof (header) + header.entrycount * (int64_t)sizeof (MS3IndexEntry) +
+                    (int64_t)header.sidcount * LM_SIDLEN ||
+      (uint64_t)length > SIZE_MAX)
+  {
+    ms_log (1, "Record index file is not valid, ignoring: %s\n", path);
+    fclose (fp);
+    return NULL;
+  }
+
+  if (data_fileinfo (mspath, &filesize, &filemtime) ||
+      filesize != header.filesize || filemtime != header.filemtime)
+  {
+    if (verbose)
+      ms_log (0, "Record index file is not current, ignoring: %s\n", path);
+
+    fclose (fp);
+    return NULL;
+  }
+
+  if (!(index = (MS3RecordIndex *)libmseed_memory.malloc (sizeof (MS3RecordIndex))))
+  {
+    ms_log (2, "Cannot allocate memory for record index\n");
+    fclose (fp);
+    return NULL;
+  }
+
+  memset (index, 0, sizeof (MS3RecordIndex));
+  index->length = (size_t)length;
+
+#if !defined(LMP_WIN)
+  if ((index->base = mmap (NULL, index->length, PROT_READ, MAP_SHARED, fileno (fp), 0)) != MAP_FAILED)
+    index->mapped = 1;
+  else
+    index->base = NULL;
+#endif
+
+  /* Read the file when it cannot be mapped */
+  if (!index->mapped)
+  {
+    if (!(index->base = libmseed_memory.malloc (index->length)))
+    {
+      ms_log (2, "Cannot allocate memory for record index\n");
+      fclose (fp);
+      ms3_index_free (&index);
+      return NULL;
+    }
+
+    if (lmp_fseek64 (fp, 0, SEEK_SET) || fread (index->base, 1, index->length, fp) != index->length)
+    {
+      ms_log (2, "Cannot read record index file %s: %s\n", path, strerror (errno));
+      fclose (fp);
+      ms3_index_free (&index);
+      return NULL;
+    }
+  }
+
+  fclose (fp);
+
+  index->entrycount = header.entrycount;
+  index->sidcount   = header.sidcount;
+  index->entries    = (const MS3IndexEntry *)((char *)index->base + sizeof (header));
+  index->sids       = (const char *)(index->entries + header.entrycount);
+  index->cursor     = 0;
+
+  for (idx = 0; idx < index->entrycount; idx++)
+  {
+    if (index->entries[idx].sidindex >= index->sidcount)
+    {
+      ms_log (1, "Record index file is not valid, ignoring: %s\n", path);
+      ms3_index_free (&index);
+      return NULL;
+    }
+  }
+
+  if (verbose > 1)
+    ms_log (0, "Loaded record index of %" PRId64 " records: %s\n", index->entrycount, path);
+
+  return index;
+} /* End of ms3_index_load() */
+
+/**********************************************************************/ /**
+ * @brief Free a record index loaded with ms3_index_load()
+ *
+ * @param[in] ppindex Pointer-to-pointer to the index to free, set to
+ * NULL on return
+ ***************************************************************************/
+void
+ms3_index_free (MS3RecordIndex **ppindex)
+{
+  if (!ppindex || !*ppindex)
+    return;
+
+  if ((*ppindex)->base)
+  {
+#if !defined(LMP_WIN)
+    if ((*ppindex)->mapped)
+      munmap ((*ppindex)->base, (*ppindex)->length);
+    else
+#endif
+      libmseed_memory.free ((*ppindex)->base);
+  }
+
+  libmseed_memory.free (*ppindex);
+  *ppindex = NULL;
+} /* End of ms3_index_free() */
+
+/***************************************************************************
+ * data_fileinfo:
+ *
+ * Determine the size and modification time, in seconds, of a file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+data_fileinfo (const char *path, int64_t *size, int64_t *mtime)
+{
+#if defined(LMP_WIN)
+  struct _stat64 st;
+
+  if (_stat64 (path, &st))
+    return -1;
+#else
+  struct stat st;
+
+  if (stat (path, &st))
+    return -1;
+#endif
+
+  *size  = (int64_t)st.st_size;
+  *mtime = (int64_t)st.st_mtime;
+
+  return 0;
+} /* End of data_fileinfo() */
+
+/***************************************************************************
+ * index_path:
+ *
+ * Determine the index file path, either 'indexpath' or the default of
+ * 'mspath' with MS3_INDEX_SUFFIX appended.
+ *
+ * Returns 'buffer' on success and NULL if the path is too long.
+ ***************************************************************************/
+static char *
+index_path (const char *mspath, const char *indexpath, char *buffer, size_t size)
+{
+  int length;
+
+  if (indexpath)
+    length = snprintf (buffer, size, "%s", indexpath);
+  else
+    length = snprintf (buffer, size, "%s%s", mspath, MS3_INDEX_SUFFIX);
+
+  if (length < 0 || (size_t)length >= size)
+  {
+    ms_log (2, "Record index file path is too long for %s\n", mspath);
+    return NULL;
+  }
+
+  return buffer;
+} /* End of index_path() */
+
+/***************************************************************************
+ * sidtable_add:
+ *
+ * Find a source identifier in the table using an FNV-1a hash of the
+ * identifier and open addressing, adding it if not present.
+ *
+ * Returns the index of the identifier in the table or -1 on error.
+ ***************************************************************************/
+static int64_t
+sidtable_add (SIDTable *table, const char *sid)
+{
+  char idsid[LM_SIDLEN];
+  size_t length;
+  uint32_t hash;
+  uint32_t slot;
+  uint32_t idx;
+  void *ptr;
+  const char *cp;
+
+  /* Identifiers are stored zero-padded */
+  length = strlen (sid);
+  if (length > sizeof (idsid) - 1)
+    length = sizeof (idsid) - 1;
+
+  memset (idsid, 0, sizeof (idsid));
+  memcpy (idsid, sid, length);
+
+  /* Grow and rehash slots when half full */
+  if (table->count >= table->slotcount / 2)
+  {
+    uint32_t slotcount = (table->slotcount) ? table->slotcount * 2 : 256;
+    uint32_t *slots;
+
+    if (!(slots = (uint32_t *)libmseed_memory.malloc (slotcount * sizeof (uint32_t))))
+    {
+      ms_log (2, "Cannot allocate memory for source identifier table\n");
+      return -1;
+    }
+
+    memset (slots, 0, slotcount * sizeof (uint32_t));
+
+    for (idx = 0; idx < table->count; idx++)
+    {
+      for (hash = 2166136261u, cp = table->sids + (size_t)idx * LM_SIDLEN; *cp; cp++)
+        hash = (hash ^ (uint8_t)*cp) * 16777619u;
+
+      for (slot = hash & (slotcount - 1); slots[slot]; slot = (slot + 1) & (slotcount - 1))
+        ;
+
+      slots[slot] = idx + 1;
+    }
+
+    if (table->slots)
+      libmseed_memory.free (table->slots);
+
+    table->slots     = slots;
+    table->slotcount = slotcount;
+  }
+
+  for (hash = 2166136261u, cp = idsid; *cp; cp++)
+    hash = (hash ^ (uint8_t)*cp) * 16777619u;
+
+  for (slot = hash & (table->slotcount - 1); table->slots[slot];
+       slot = (slot + 1) & (table->slotcount - 1))
+  {
+    idx = table->slots[slot] - 1;
+
+    if (!memcmp (table->sids + (size_t)idx * LM_SIDLEN, idsid, LM_SIDLEN))
+      return idx;
+  }
+
+  if (table->count >= table->capacity)
+  {
+    uint32_t capacity = (table->capacity) ? table->capacity * 2 : 64;
+
+    if (!(ptr = libmseed_memory.realloc (table->sids, (size_t)capacity * LM_SIDLEN)))
+    {
+      ms_log (2, "Cannot allocate memory for source identifier table\n");
+      return -1;
+    }
+
+    table->sids     = (char *)ptr;
+    table->capacity = capacity;
+  }
+
+  memcpy (table->sids + (size_t)table->count * LM_SIDLEN, idsid, LM_SIDLEN);
+  table->slots[slot] = table->count + 1;
+
+  return table->count++;
+} /* End of sidtable_add() */
@@ -374,6 +374,574 @@ TEST (read, byterange)
   ms3_readmsr(&msr, NULL, flags, 0);
 }
 
+TEST (read, mmap)
+{
+  MS3FileParam *msfp = NULL;
+  MS3FileParam *mmfp = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *mmr = NULL;
+  uint32_t flags = MSF_UNPACKDATA | MSF_VALIDATECRC | MSF_PNAMERANGE;
+  int records;
+  int idx;
+  int rv;
+  int mv;
+
+  const char *paths[] = {
+      "data/testdata-3channel-signal.mseed3",
+      "data/testdata-oneseries-mixedlengths-mixedorder.mseed2",
+      "data/testdata-oneseries-mixedlengths-mixedorder.mseed3@9428-",
+      "data/testdata-no-blockette1000-steim1.mseed2",
+  };
+
+  /* Records read via memory mapping must match those read via stdio */
+  for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+  {
+    records = 0;
+
+    for (;;)
+    {
+      rv = ms3_readmsr_r (&msfp, &msr, paths[idx], flags, 0);
+      mv = ms3_readmsr_r (&mmfp, &mmr, paths[idx], flags | MSF_MMAP, 0);
+
+      REQUIRE (rv == mv, "Memory-mapped read returned a different value");
+
+      if (rv != MS_NOERROR)
+        break;
+
+      CHECK_STREQ (msr->sid, mmr->sid);
+      CHECK (msr->starttime == mmr->starttime, "Memory-mapped read, unexpected record start time");
+      CHECK (msr->reclen == mmr->reclen, "Memory-mapped read, unexpected record length");
+      REQUIRE (msr->numsamples == mmr->numsamples, "Memory-mapped read, unexpected number of samples");
+      CHECK (memcmp (msr->datasamples, mmr->datasamples,
+                     msr->numsamples * ms_samplesize (msr->sampletype)) == 0,
+             "Memory-mapped read, unexpected sample values");
+      records++;
+    }
+
+    CHECK (rv == MS_ENDOFFILE, "Memory-mapped read did not return expected MS_ENDOFFILE");
+    CHECK (records > 0, "Memory-mapped read, no records read");
+
+    ms3_readmsr_r (&msfp, &msr, NULL, flags, 0);
+    ms3_readmsr_r (&mmfp, &mmr, NULL, flags, 0);
+  }
+}
+
+#if defined(LIBMSEED_ZLIB)
+#include <zlib.h>
+
+TEST (read, gzip)
+{
+  MS3Record *msr = NULL;
+  MS3Record *gzmsr = NULL;
+  MS3FileParam *msfp = NULL;
+  MS3FileParam *gzfp = NULL;
+  uint32_t flags = MSF_UNPACKDATA;
+  char buffer[4096];
+  gzFile gzfile;
+  FILE *file;
+  size_t length;
+  int rv;
+  int gzrv;
+
+  /* Write gzip-compressed copy of a test file */
+  file = fopen ("data/testdata-3channel-signal.mseed3", "rb");
+  REQUIRE (file != NULL, "Cannot open test file");
+  gzfile = gzopen ("testdata-3channel-signal.mseed3.gz", "wb");
+  REQUIRE (gzfile != NULL, "Cannot open compressed test file");
+
+  while ((length = fread (buffer, 1, sizeof (buffer), file)) > 0)
+    gzwrite (gzfile, buffer, (unsigned int)length);
+
+  gzclose (gzfile);
+  fclose (file);
+
+  /* Records read from compressed file must match those from the original */
+  for (;;)
+  {
+    rv   = ms3_readmsr_r (&msfp, &msr, "data/testdata-3channel-signal.mseed3", flags, 0);
+    gzrv = ms3_readmsr_r (&gzfp, &gzmsr, "testdata-3channel-signal.mseed3.gz", flags, 0);
+
+    REQUIRE (rv == gzrv, "Compressed read returned a different value");
+
+    if (rv != MS_NOERROR)
+      break;
+
+    CHECK_STREQ (msr->sid, gzmsr->sid);
+    CHECK (msr->starttime == gzmsr->starttime, "Compressed read, unexpected record start time");
+    CHECK (msr->numsamples == gzmsr->numsamples, "Compressed read, unexpected number of samples");
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "Compressed read did not return expected MS_ENDOFFILE");
+  CHECK (msfp->recordcount == gzfp->recordcount, "Compressed read, unexpected number of records");
+
+  ms3_readmsr_r (&msfp, &msr, NULL, flags, 0);
+  ms3_readmsr_r (&gzfp, &gzmsr, NULL, flags, 0);
+}
+#endif /* defined(LIBMSEED_ZLIB) */
+
+TEST (read, readbuffer)
+{
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  uint32_t flags = MSF_UNPACKDATA;
+  int64_t records[2];
+  int idx;
+  int rv;
+
+  /* Read with the default and a large read buffer */
+  for (idx = 0; idx < 2; idx++)
+  {
+    libmseed_readbuffer_size = (idx == 0) ? 0 : 4 * 1024 * 1024;
+
+    while ((rv = ms3_readmsr_r (&msfp, &msr, "data/testdata-3channel-signal.mseed2", flags, 0)) == MS_NOERROR)
+      ;
+
+    CHECK (rv == MS_ENDOFFILE, "ms3_readmsr_r() did not return expected MS_ENDOFFILE");
+    CHECK (msfp->readbuffersize == ((idx == 0) ? MAXRECLEN : 4 * 1024 * 1024),
+           "Unexpected read buffer size");
+    records[idx] = msfp->recordcount;
+
+    ms3_readmsr_r (&msfp, &msr, NULL, flags, 0);
+  }
+
+  libmseed_readbuffer_size = 0;
+
+  CHECK (records[0] > 0, "No records read with default read buffer");
+  CHECK (records[0] == records[1], "Large read buffer, unexpected number of records");
+}
+
+TEST (read, prefetch)
+{
+  CHECK (ms3_prefetch ("data/testdata-3channel-signal.mseed3", 0) == 0,
+         "ms3_prefetch() did not return expected 0 for a file");
+  CHECK (ms3_prefetch ("data/testdata-3channel-signal.mseed3@512-", MSF_PNAMERANGE) == 0,
+         "ms3_prefetch() did not return expected 0 for a byte range");
+  CHECK (ms3_prefetch ("http://localhost/none.mseed", 0) == 0,
+         "ms3_prefetch() did not return expected 0 for a URL");
+  CHECK (ms3_prefetch ("data/no-such-file.mseed", 0) == -1,
+         "ms3_prefetch() did not return expected -1 for a missing file");
+}
+
+TEST (read, headeronly)
+{
+  MS3FileParam *msfp = NULL;
+  MS3FileParam *hofp = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *homsr = NULL;
+  MS3RecordHeader header;
+  int idx;
+  int rv;
+  int horv;
+
+  const char *paths[] = {
+      "data/testdata-3channel-signal.mseed3",
+      "data/testdata-3channel-signal.mseed2",
+      "data/testdata-oneseries-mixedlengths-mixedorder.mseed2",
+      "data/testdata-no-blockette1000-steim1.mseed2",
+      "data/testdata-unapplied-timecorrection.mseed2",
+  };
+
+  /* Header values must match those of fully parsed records */
+  for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+  {
+    for (;;)
+    {
+      rv   = ms3_readmsr_r (&msfp, &msr, paths[idx], 0, 0);
+      horv = ms3_readmsr_r (&hofp, &homsr, paths[idx], MSF_HEADERONLY, 0);
+
+      REQUIRE (rv == horv, "Header-only read returned a different value");
+
+      if (rv != MS_NOERROR)
+        break;
+
+      CHECK_STREQ (msr->sid, homsr->sid);
+      CHECK (msr->starttime == homsr->starttime, "Header-only read, unexpected start time");
+      CHECK (msr->samprate == homsr->samprate, "Header-only read, unexpected sample rate");
+      CHECK (msr->samplecnt == homsr->samplecnt, "Header-only read, unexpected sample count");
+      CHECK (msr->pubversion == homsr->pubversion, "Header-only read, unexpected publication version");
+      CHECK (msr->reclen == homsr->reclen, "Header-only read, unexpected record length");
+      CHECK (homsr->extra == NULL, "Header-only read, unexpected extra headers");
+
+      rv = ms3_parse_header (msr->record, msr->reclen, &header, MSF_ATENDOFFILE, 0);
+      REQUIRE (rv == MS_NOERROR, "ms3_parse_header() did not return expected MS_NOERROR");
+      CHECK_STREQ (msr->sid, header.sid);
+      CHECK (msr->starttime == header.starttime, "ms3_parse_header(), unexpected start time");
+      CHECK (msr->samplecnt == header.samplecnt, "ms3_parse_header(), unexpected sample count");
+    }
+
+    CHECK (rv == MS_ENDOFFILE, "Header-only read did not return expected MS_ENDOFFILE");
+
+    ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+    ms3_readmsr_r (&hofp, &homsr, NULL, 0, 0);
+  }
+}
+
+TEST (read, decode_samples)
+{
+  MS3Record *msr = NULL;
+  int32_t samples[50];
+  char sampletype = 0;
+  int idx;
+  int rv;
+  int64_t nsamples;
+
+  const char *paths[] = {
+      "data/reference-testdata-steim1.mseed2",
+      "data/reference-testdata-steim2.mseed3",
+      "data/reference-testdata-int32.mseed3",
+  };
+
+  /* The first samples must match those of fully decoded records */
+  for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+  {
+    rv = ms3_readmsr (&msr, paths[idx], MSF_UNPACKDATA, 0);
+    REQUIRE (rv == MS_NOERROR, "ms3_readmsr() did not return expected MS_NOERROR");
+    REQUIRE (msr->samplecnt > 50, "Record does not contain more than 50 samples");
+
+    nsamples = msr3_decode_samples (msr, 50, samples, sizeof (samples), &sampletype, 0);
+    CHECK (nsamples == 50, "msr3_decode_samples() did not return expected 50");
+    CHECK (sampletype == 'i', "Decoded sample type is not expected 'i'");
+    CHECK (!cmpint32s (samples, (int32_t *)msr->datasamples, 50),
+           "Decoded samples do not match the first samples of the record");
+
+    nsamples = msr3_decode_samples (msr, msr->samplecnt + 1, samples, sizeof (samples), &sampletype, 0);
+    CHECK (nsamples < 0, "msr3_decode_samples() did not return an error");
+
+    ms3_readmsr (&msr, NULL, 0, 0);
+  }
+}
+
+TEST (read, fixedreclen)
+{
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *bufmsr = NULL;
+  uint32_t flags = MSF_UNPACKDATA;
+  char buffer[65536];
+  uint64_t offset;
+  size_t length;
+  FILE *file;
+  int idx;
+  int rv;
+
+  const char *paths[] = {
+      "data/testdata-3channel-signal.mseed2",
+      "data/testdata-oneseries-mixedlengths-mixedorder.mseed2",
+      "data/testdata-no-blockette1000-steim1.mseed2",
+  };
+
+  /* Records read at a fixed record length must match records detected individually */
+  for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+  {
+    file = fopen (paths[idx], "rb");
+    REQUIRE (file != NULL, "Cannot open test file");
+    length = fread (buffer, 1, sizeof (buffer), file);
+    fclose (file);
+
+    offset = 0;
+    while ((rv = ms3_readmsr_r (&msfp, &msr, paths[idx], flags, 0)) == MS_NOERROR)
+    {
+      rv = msr3_parse (buffer + offset, length - offset, &bufmsr, flags | MSF_ATENDOFFILE, 0);
+      REQUIRE (rv == MS_NOERROR, "msr3_parse() did not return expected MS_NOERROR");
+
+      CHECK_STREQ (msr->sid, bufmsr->sid);
+      CHECK (msr->reclen == bufmsr->reclen, "Fixed length read, unexpected record length");
+      CHECK (msr->starttime == bufmsr->starttime, "Fixed length read, unexpected start time");
+      CHECK (msr->numsamples == bufmsr->numsamples, "Fixed length read, unexpected number of samples");
+
+      offset += bufmsr->reclen;
+    }
+
+    CHECK (rv == MS_ENDOFFILE, "ms3_readmsr_r() did not return expected MS_ENDOFFILE");
+    CHECK (offset == length, "Fixed length read, records do not cover the file");
+
+    if (idx == 0)
+      CHECK (msfp->fixedreclen == 512, "Fixed record length not detected");
+
+    ms3_readmsr_r (&msfp, &msr, NULL, flags, 0);
+  }
+
+  msr3_free (&bufmsr);
+}
+
+TEST (read, skipnotdata)
+{
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr = NULL;
+  uint32_t flags = MSF_UNPACKDATA | MSF_SKIPNOTDATA;
+  const char junkchars[] = "MDRQSx";
+  const int junklengths[] = {70001, 1000, 37};
+  char buffer[65536];
+  int64_t records = 0;
+  uint32_t seed = 1;
+  size_t length;
+  FILE *input;
+  FILE *file;
+  int idx;
+  int rv;
+
+  const char *paths[] = {
+      "data/testdata-3channel-signal.mseed3",
+      "data/testdata-3channel-signal.mseed2",
+  };
+
+  /* Write test file of records from test files separated by non-data */
+  file = fopen ("testdata-skipnotdata.mseed", "wb");
+  REQUIRE (file != NULL, "Cannot open test file for writing");
+
+  for (idx = 0; idx < 3; idx++)
+  {
+    for (length = 0; length < (size_t)junklengths[idx]; length++)
+    {
+      seed = seed * 1103515245 + 12345;
+      fputc ((length % 4096 < 512) ? 0xFF : junkchars[(seed >> 16) % 6], file);
+    }
+
+    if (idx < 2)
+    {
+      input = fopen (paths[idx], "rb");
+      REQUIRE (input != NULL, "Cannot open test file");
+
+      while ((length = fread (buffer, 1, sizeof (buffer), input)) > 0)
+        fwrite (buffer, 1, length, file);
+
+      fclose (input);
+
+      while ((rv = ms3_readmsr_r (&msfp, &msr, paths[idx], flags, 0)) == MS_NOERROR)
+        ;
+      records += msfp->recordcount;
+      ms3_readmsr_r (&msfp, &msr, NULL, flags, 0);
+    }
+  }
+
+  fclose (file);
+
+  /* Read all records, skipping non-data */
+  while ((rv = ms3_readmsr_r (&msfp, &msr, "testdata-skipnotdata.mseed", flags, 0)) == MS_NOERROR)
+    ;
+
+  CHECK (rv == MS_ENDOFFILE, "ms3_readmsr_r() did not return expected MS_ENDOFFILE");
+  CHECK (msfp->recordcount == records, "Skipping non-data, unexpected number of records");
+
+  ms3_readmsr_r (&msfp, &msr, NULL, flags, 0);
+}
+
+/* Record start time and location for writing records in time order */
+struct timesortrecord
+{
+  nstime_t starttime;
+  size_t offset;
+  uint32_t reclen;
+};
+
+static int
+cmptimesortrecord (const void *a, const void *b)
+{
+  const struct timesortrecord *ra = (const struct timesortrecord *)a;
+  const struct timesortrecord *rb = (const struct timesortrecord *)b;
+
+  if (ra->starttime != rb->starttime)
+    return (ra->starttime < rb->starttime) ? -1 : 1;
+
+  return (ra->offset < rb->offset) ? -1 : (ra->offset > rb->offset);
+}
+
+TEST (read, timesorted)
+{
+  MS3FileParam *msfp = NULL;
+  MS3FileParam *tsfp = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *tsmsr = NULL;
+  MS3Selections *selections = NULL;
+  struct timesortrecord records[256];
+  char *data = NULL;
+  size_t datasize = 0;
+  int recordcount = 0;
+  uint32_t flags = MSF_PNAMERANGE;
+  FILE *file;
+  int widx;
+  int idx;
+  int rv;
+  int tsrv;
+
+  /* Files ordered by channel, read completely, and with all channels
+   * ordered by start time, interleaving records of different spans */
+  const char *paths[] = {
+      "data/testdata-3channel-signal.mseed2",
+      "data/testdata-3channel-signal.mseed3",
+      "testdata-timesorted.mseed3",
+  };
+
+  const char *windows[][2] = {
+      {"2010-02-27T06:50:00", "2010-02-27T06:55:00"},
+      {"2010-02-27T07:11:00", "2010-02-27T07:32:00"},
+      {"2010-02-27T07:55:00", NULL},
+  };
+
+  /* Write the records of all channels ordered by start time */
+  while ((rv = ms3_readmsr_r (&msfp, &msr, "data/testdata-3channel-signal.mseed3", 0, 0)) == MS_NOERROR)
+  {
+    REQUIRE (recordcount < (int)(sizeof (records) / sizeof (records[0])), "Too many test records");
+    REQUIRE ((data = realloc (data, datasize + msr->reclen)) != NULL, "Cannot allocate memory");
+
+    memcpy (data + datasize, msr->record, msr->reclen);
+    records[recordcount].starttime = msr->starttime;
+    records[recordcount].offset    = datasize;
+    records[recordcount].reclen    = msr->reclen;
+    datasize += msr->reclen;
+    recordcount++;
+  }
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+
+  REQUIRE (rv == MS_ENDOFFILE, "ms3_readmsr_r() did not return expected MS_ENDOFFILE");
+
+  qsort (records, recordcount, sizeof (records[0]), cmptimesortrecord);
+
+  file = fopen (paths[2], "wb");
+  REQUIRE (file != NULL, "Cannot open output file");
+  for (idx = 0; idx < recordcount; idx++)
+    fwrite (data + records[idx].offset, 1, records[idx].reclen, file);
+  fclose (file);
+  free (data);
+
+  /* Records read after bisection must match those selected from the full range */
+  for (widx = 0; widx < (int)(sizeof (windows) / sizeof (windows[0])); widx++)
+  {
+    rv = ms3_addselect (&selections, "*", ms_timestr2nstime (windows[widx][0]),
+                        (windows[widx][1]) ? ms_timestr2nstime (windows[widx][1]) : NSTUNSET, 0);
+    REQUIRE (rv == 0, "ms3_addselect() returned an unexpected error");
+
+    for (idx = 0; idx < (int)(sizeof (paths) / sizeof (paths[0])); idx++)
+    {
+      for (;;)
+      {
+        rv   = ms3_readmsr_selection (&msfp, &msr, paths[idx], flags, selections, 0);
+        tsrv = ms3_readmsr_selection (&tsfp, &tsmsr, paths[idx], flags | MSF_TIMESORTED, selections, 0);
+
+        REQUIRE (rv == tsrv, "Time-sorted read returned a different value");
+
+        if (rv != MS_NOERROR)
+          break;
+
+        CHECK_STREQ (msr->sid, tsmsr->sid);
+        CHECK (msr->starttime == tsmsr->starttime, "Time-sorted read, unexpected record start time");
+      }
+
+      CHECK (rv == MS_ENDOFFILE, "Time-sorted read did not return expected MS_ENDOFFILE");
+      CHECK (msfp->recordcount > 0, "No selected records");
+      CHECK (tsfp->recordcount == msfp->recordcount, "Time-sorted read, unexpected number of records");
+
+      /* The byte range is only located in the file ordered by start time */
+      if (idx == 2 && widx > 0)
+        CHECK (tsfp->startoffset > 0, "Time-sorted read, start offset not located");
+      if (idx == 2 && windows[widx][1])
+        CHECK (tsfp->endoffset > 0 && tsfp->endoffset + 1 < (int64_t)datasize,
+               "Time-sorted read, end offset not located");
+
+      ms3_readmsr_selection (&msfp, &msr, NULL, flags, NULL, 0);
+      ms3_readmsr_selection (&tsfp, &tsmsr, NULL, flags, NULL, 0);
+    }
+
+    ms3_freeselections (selections);
+    selections = NULL;
+  }
+}
+
+TEST (read, recordindex)
+{
+  MS3FileParam *msfp = NULL;
+  MS3FileParam *ixfp = NULL;
+  MS3Record *msr = NULL;
+  MS3Record *ixmsr = NULL;
+  MS3Selections *selections = NULL;
+  MS3RecordIndex *index = NULL;
+  uint32_t flags = MSF_MMAP;
+  FILE *input;
+  FILE *file;
+  char buffer[4096];
+  size_t length;
+  int64_t count;
+  int rv;
+  int ixrv;
+
+  const char *path = "testdata-recordindex.mseed3";
+
+  /* Copy of a multiplexed file to index next to */
+  input = fopen ("data/testdata-3channel-signal.mseed3", "rb");
+  REQUIRE (input != NULL, "Cannot open input test file");
+  file = fopen (path, "wb");
+  REQUIRE (file != NULL, "Cannot open test file for writing");
+
+  while ((length = fread (buffer, 1, sizeof (buffer), input)) > 0)
+    fwrite (buffer, 1, length, file);
+
+  fclose (input);
+  fclose (file);
+
+  count = ms3_index_build (path, NULL, 0, 0);
+  REQUIRE (count > 0, "ms3_index_build() returned an unexpected error");
+
+  index = ms3_index_load (path, NULL, 0);
+  REQUIRE (index != NULL, "ms3_index_load() did not load index");
+  CHECK (index->entrycount == count, "Unexpected number of index entries");
+  CHECK (index->sidcount == 3, "Unexpected number of index source identifiers");
+  CHECK_STREQ (MS3IndexEntry_SID (index, &index->entries[0]), "FDSN:IU_COLA_00_L_H_1");
+  CHECK (index->entries[0].offset == 0, "Unexpected offset of first index entry");
+  CHECK (index->entries[1].offset == index->entries[0].reclen, "Unexpected offset of second index entry");
+  ms3_index_free (&index);
+  CHECK (index == NULL, "ms3_index_free() did not reset pointer");
+
+  /* Index of different data and missing index are not loaded */
+  CHECK (ms3_index_load ("data/testdata-3channel-signal.mseed2", "testdata-recordindex.mseed3.msidx", 0) == NULL,
+         "ms3_index_load() loaded index for different data");
+  CHECK (ms3_index_load ("data/testdata-3channel-signal.mseed2", NULL, 0) == NULL,
+         "ms3_index_load() loaded missing index");
+
+  rv = ms3_addselect (&selections, "FDSN:IU_COLA_00_L_H_2",
+                      ms_timestr2nstime ("2010-02-27T07:11:00"),
+                      ms_timestr2nstime ("2010-02-27T07:32:00"), 0);
+  REQUIRE (rv == 0, "ms3_addselect() returned an unexpected error");
+
+  /* Records read using the index must match those selected by reading all */
+  for (;;)
+  {
+    rv   = ms3_readmsr_selection (&msfp, &msr, path, flags, selections, 0);
+    ixrv = ms3_readmsr_selection (&ixfp, &ixmsr, path, flags | MSF_RECORDINDEX, selections, 0);
+
+    REQUIRE (rv == ixrv, "Indexed read returned a different value");
+    REQUIRE (ixfp->index != NULL, "Indexed read did not use index");
+
+    if (rv != MS_NOERROR)
+      break;
+
+    CHECK_STREQ (msr->sid, ixmsr->sid);
+    CHECK (msr->starttime == ixmsr->starttime, "Indexed read, unexpected record start time");
+    CHECK (msr->reclen == ixmsr->reclen, "Indexed read, unexpected record length");
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "Indexed read did not return expected MS_ENDOFFILE");
+  CHECK (msfp->recordcount == 11, "Unexpected number of selected records");
+  CHECK (ixfp->recordcount == msfp->recordcount, "Indexed read, unexpected number of records");
+
+  ms3_readmsr_selection (&msfp, &msr, NULL, flags, NULL, 0);
+  ms3_readmsr_selection (&ixfp, &ixmsr, NULL, flags, NULL, 0);
+
+  /* Without memory mapping, in a byte range ending before the last selected record */
+  count = 0;
+  while ((rv = ms3_readmsr_selection (&ixfp, &ixmsr, "testdata-recordindex.mseed3@0-25999",
+                                      MSF_PNAMERANGE | MSF_RECORDINDEX, selections, 0)) == MS_NOERROR)
+  {
+    CHECK_STREQ (ixmsr->sid, "FDSN:IU_COLA_00_L_H_2");
+    count++;
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "Indexed read did not return expected MS_ENDOFFILE");
+  CHECK (count == 5, "Indexed read, unexpected number of records in range");
+
+  ms3_readmsr_selection (&ixfp, &ixmsr, NULL, flags, NULL, 0);
+  ms3_freeselections (selections);
+}
+
 TEST (read, selection)
 {
   MS3Record *msr = NULL;
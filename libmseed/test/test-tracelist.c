@@ -1,6 +1,10 @@
 #include <tau/tau.h>
 #include <libmseed.h>
 
+#if !defined(LMP_WIN)
+#include <pthread.h>
+#endif
+
 TEST (trace, read)
 {
   MS3TraceList *mstl = NULL;
@@ -43,6 +47,635 @@ TEST (trace, read)
   mstl3_free (&mstl, 1);
 }
 
+TEST (trace, decode_on_add)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *ref  = NULL;
+  MS3TraceID *id     = NULL;
+  MS3Record *msr     = NULL;
+  int32_t *int32s;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+
+  /* Parse records without unpacking, decode into the trace list */
+  while ((rv = ms3_readmsr (&msr, path, 0, 0)) == MS_NOERROR)
+  {
+    CHECK (msr->numsamples == 0, "msr->numsamples is not expected 0");
+
+    if (!mstl3_addmsr (mstl, msr, 0, 1, MSF_UNPACKDATA, NULL))
+      break;
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "ms3_readmsr() did not return expected MS_ENDOFFILE");
+  ms3_readmsr (&msr, NULL, 0, 0);
+
+  id = mstl->traces.next[0];
+
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  REQUIRE (id->first != NULL, "id->first is not populated");
+  CHECK (id->numsegments == 1, "id->numsegments is not expected 1");
+  CHECK (id->first->samplecnt == 3952, "id->first->samplecnt is not expected 3952");
+  CHECK (id->first->sampletype == 'i', "id->first->sampletype is not expected 'i'");
+  CHECK (id->first->numsamples == 3952, "id->first->numsamples is not expected 3952");
+  REQUIRE (id->first->datasamples != NULL, "id->first->datasamples is unexpected NULL");
+
+  int32s = (int32_t *)id->first->datasamples;
+  CHECK (int32s[3948] == 28067, "Decoded sample value mismatch");
+  CHECK (int32s[3951] == -146622, "Decoded sample value mismatch");
+
+  /* Compare to samples unpacked when parsed */
+  rv = ms3_readtracelist (&ref, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  REQUIRE (ref->traces.next[0]->first->numsamples == 3952, "Reference numsamples is not expected 3952");
+  CHECK (memcmp (int32s, ref->traces.next[0]->first->datasamples, 3952 * sizeof (int32_t)) == 0,
+         "Decoded samples do not match samples unpacked when parsed");
+
+  mstl3_free (&ref, 1);
+  mstl3_free (&mstl, 1);
+}
+
+TEST (trace, sample_chunks)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *ref  = NULL;
+  MS3TraceSeg *seg   = NULL;
+  MS3Record *msr     = NULL;
+  uint32_t flags     = MSF_UNPACKDATA | MSF_SAMPLECHUNKS;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+
+  /* Decode out-of-order records into chunked segment storage */
+  while ((rv = ms3_readmsr (&msr, path, 0, 0)) == MS_NOERROR)
+  {
+    if (!mstl3_addmsr (mstl, msr, 0, 1, flags, NULL))
+      break;
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "ms3_readmsr() did not return expected MS_ENDOFFILE");
+  ms3_readmsr (&msr, NULL, 0, 0);
+
+  REQUIRE (mstl->traces.next[0] != NULL, "mstl->traces.next[0] is not populated");
+  seg = mstl->traces.next[0]->first;
+
+  REQUIRE (seg != NULL, "seg is not populated");
+  CHECK (seg->numsamples == 3952, "seg->numsamples is not expected 3952");
+  CHECK (seg->datasamples == NULL, "seg->datasamples is not expected NULL");
+  REQUIRE (seg->chunks != NULL, "seg->chunks is unexpected NULL");
+  CHECK (seg->chunks->next != NULL, "seg->chunks is expected to have multiple chunks");
+
+  REQUIRE (mstl3_flatten_samples (seg) == 3952, "mstl3_flatten_samples() did not return expected 3952");
+  CHECK (seg->chunks == NULL, "seg->chunks is not expected NULL");
+  REQUIRE (seg->datasamples != NULL, "seg->datasamples is unexpected NULL");
+
+  rv = ms3_readtracelist (&ref, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (memcmp (seg->datasamples, ref->traces.next[0]->first->datasamples, 3952 * sizeof (int32_t)) == 0,
+         "Flattened samples do not match samples unpacked when parsed");
+
+  mstl3_free (&ref, 1);
+  mstl3_free (&mstl, 1);
+}
+
+TEST (trace, spill_samples)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *ref  = NULL;
+  MS3TraceSeg *seg   = NULL;
+  MS3Record *msr     = NULL;
+  MS3SampleChunk *chunk = NULL;
+  uint32_t flags     = MSF_UNPACKDATA | MSF_SAMPLECHUNKS;
+  int64_t released   = 0;
+  int count          = 0;
+  int mapped         = 0;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+
+  /* Spill the samples after some records, later records add new chunks */
+  while ((rv = ms3_readmsr (&msr, path, 0, 0)) == MS_NOERROR)
+  {
+    if (!(seg = mstl3_addmsr (mstl, msr, 0, 1, flags, NULL)))
+      break;
+
+    if (++count == 4)
+    {
+      released = mstl3_spill_samples (seg, "data");
+      CHECK (released > 0, "mstl3_spill_samples() did not release memory");
+      CHECK (mstl3_spill_samples (seg, "data") == 0, "mstl3_spill_samples() of a spilled segment is not expected 0");
+    }
+  }
+
+  CHECK (rv == MS_ENDOFFILE, "ms3_readmsr() did not return expected MS_ENDOFFILE");
+  ms3_readmsr (&msr, NULL, 0, 0);
+
+  REQUIRE (mstl->traces.next[0] != NULL, "mstl->traces.next[0] is not populated");
+  seg = mstl->traces.next[0]->first;
+
+  REQUIRE (seg != NULL, "seg is not populated");
+  CHECK (seg->numsamples == 3952, "seg->numsamples is not expected 3952");
+
+  for (chunk = seg->chunks; chunk; chunk = chunk->next)
+    mapped += chunk->mapped;
+
+  CHECK (mapped > 0, "No chunks are mapped");
+  CHECK (seg->lastchunk->mapped == 0, "Last chunk is not expected to be mapped");
+
+  REQUIRE (mstl3_flatten_samples (seg) == 3952, "mstl3_flatten_samples() did not return expected 3952");
+
+  rv = ms3_readtracelist (&ref, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (memcmp (seg->datasamples, ref->traces.next[0]->first->datasamples, 3952 * sizeof (int32_t)) == 0,
+         "Samples including spilled chunks do not match samples unpacked when parsed");
+
+  mstl3_free (&ref, 1);
+  mstl3_free (&mstl, 1);
+}
+
+TEST (trace, findID)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id     = NULL;
+  MS3Record *msr     = NULL;
+  int idx;
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+
+  msr = msr3_init (NULL);
+  REQUIRE (msr != NULL, "msr3_init() did not return a record");
+
+  msr->starttime  = ms_timestr2nstime ("2010-02-27T06:50:00.000000Z");
+  msr->samprate   = 1.0;
+  msr->samplecnt  = 10;
+  msr->pubversion = 1;
+
+  /* Add IDs in reverse order, enough to grow the hash index */
+  for (idx = 199; idx >= 0; idx--)
+  {
+    snprintf (msr->sid, sizeof (msr->sid), "FDSN:XX_S%03d__B_H_Z", idx);
+
+    REQUIRE (mstl3_findID (mstl, msr->sid, 0, NULL) == NULL, "mstl3_findID() found unexpected ID");
+    REQUIRE (mstl3_addmsr (mstl, msr, 1, 1, 0, NULL) != NULL, "mstl3_addmsr() returned unexpected NULL");
+  }
+
+  CHECK (mstl->numtraceids == 200, "mstl->numtraceids is not expected 200");
+  CHECK_STREQ (mstl->traces.next[0]->sid, "FDSN:XX_S000__B_H_Z");
+
+  for (idx = 0; idx < 200; idx++)
+  {
+    snprintf (msr->sid, sizeof (msr->sid), "FDSN:XX_S%03d__B_H_Z", idx);
+
+    id = mstl3_findID (mstl, msr->sid, 0, NULL);
+    REQUIRE (id != NULL, "mstl3_findID() did not find expected ID");
+    CHECK_STREQ (id->sid, msr->sid);
+    CHECK (mstl3_findID (mstl, msr->sid, 1, NULL) == id, "mstl3_findID() did not find expected version 1");
+    CHECK (mstl3_findID (mstl, msr->sid, 2, NULL) == NULL, "mstl3_findID() found unexpected version 2");
+  }
+
+  CHECK (mstl3_findID (mstl, "FDSN:XX_S200__B_H_Z", 0, NULL) == NULL, "mstl3_findID() found unexpected ID");
+
+  /* Add a second version of a SID */
+  strcpy (msr->sid, "FDSN:XX_S100__B_H_Z");
+  msr->pubversion = 2;
+  REQUIRE (mstl3_addmsr (mstl, msr, 1, 1, 0, NULL) != NULL, "mstl3_addmsr() returned unexpected NULL");
+
+  CHECK (mstl->numtraceids == 201, "mstl->numtraceids is not expected 201");
+  id = mstl3_findID (mstl, "FDSN:XX_S100__B_H_Z", 2, NULL);
+  REQUIRE (id != NULL, "mstl3_findID() did not find expected version 2");
+  CHECK (id->pubversion == 2, "id->pubversion is not expected 2");
+  id = mstl3_findID (mstl, "FDSN:XX_S100__B_H_Z", 1, NULL);
+  REQUIRE (id != NULL, "mstl3_findID() did not find expected version 1");
+  CHECK (id->pubversion == 1, "id->pubversion is not expected 1");
+  CHECK (mstl3_findID (mstl, "FDSN:XX_S100__B_H_Z", 0, NULL) != NULL, "mstl3_findID() did not find any version");
+  CHECK (mstl3_findID (mstl, "FDSN:XX_S150__B_H_Z", 0, NULL) != NULL, "mstl3_findID() did not find expected ID");
+  CHECK (id->sid == mstl3_findID (mstl, "FDSN:XX_S100__B_H_Z", 2, NULL)->sid, "Versions do not share the SID");
+
+  /* IDs are ordered by SID and then version */
+  idx = 0;
+  for (id = mstl->traces.next[0]; id && id->next[0]; id = id->next[0])
+  {
+    if (strcmp (id->sid, id->next[0]->sid) > 0 ||
+        (strcmp (id->sid, id->next[0]->sid) == 0 && id->pubversion >= id->next[0]->pubversion))
+      idx++;
+  }
+
+  CHECK (idx == 0, "Trace IDs are not ordered");
+
+  msr3_free (&msr);
+  mstl3_free (&mstl, 0);
+}
+
+TEST (trace, gappy_segments)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceSeg *seg   = NULL;
+  MS3Record *msr     = NULL;
+  nstime_t start;
+  uint32_t lcg = 1;
+  int order[600];
+  int idx;
+  int swap;
+  int tmp;
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+
+  msr = msr3_init (NULL);
+  REQUIRE (msr != NULL, "msr3_init() did not return a record");
+
+  strcpy (msr->sid, "FDSN:XX_TEST__B_H_Z");
+  msr->samprate  = 10.0;
+  msr->samplecnt = 100;
+  start = ms_timestr2nstime ("2010-02-27T06:50:00.000000Z");
+
+  /* Shuffle record order */
+  for (idx = 0; idx < 600; idx++)
+    order[idx] = idx;
+
+  for (idx = 599; idx > 0; idx--)
+  {
+    lcg = lcg * 1103515245 + 12345;
+    swap = (lcg >> 16) % (idx + 1);
+    tmp = order[idx];
+    order[idx] = order[swap];
+    order[swap] = tmp;
+  }
+
+  /* Add 10-second records with every third record missing, 200 segments */
+  for (idx = 0; idx < 600; idx++)
+  {
+    if (order[idx] % 3 == 2)
+      continue;
+
+    msr->starttime = start + (nstime_t)order[idx] * 10 * NSTMODULUS;
+    REQUIRE (mstl3_addmsr (mstl, msr, 0, 1, 0, NULL) != NULL, "mstl3_addmsr() returned unexpected NULL");
+  }
+
+  REQUIRE (mstl->traces.next[0] != NULL, "mstl->traces.next[0] is not populated");
+  CHECK (mstl->traces.next[0]->numsegments == 200, "numsegments is not expected 200");
+
+  idx = 0;
+  for (seg = mstl->traces.next[0]->first; seg; seg = seg->next, idx++)
+  {
+    if (seg->starttime != start + (nstime_t)idx * 30 * NSTMODULUS ||
+        seg->endtime != start + ((nstime_t)idx * 30 + 20) * NSTMODULUS - NSTMODULUS / 10 ||
+        seg->samplecnt != 200)
+      break;
+  }
+
+  CHECK (idx == 200, "Segments do not match expected coverage");
+
+  msr3_free (&msr);
+  mstl3_free (&mstl, 0);
+}
+
+TEST (trace, remove_segment)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id     = NULL;
+  MS3TraceSeg *seg   = NULL;
+  MS3TraceSeg *next  = NULL;
+  MS3Record *msr     = NULL;
+  nstime_t start;
+  int idx;
+
+  mstl = mstl3_init_arena (NULL, 0);
+  REQUIRE (mstl != NULL, "mstl3_init_arena() did not return a list");
+
+  msr = msr3_init (NULL);
+  REQUIRE (msr != NULL, "msr3_init() did not return a record");
+
+  strcpy (msr->sid, "FDSN:XX_TEST__B_H_Z");
+  msr->samprate  = 10.0;
+  msr->samplecnt = 100;
+  start = ms_timestr2nstime ("2010-02-27T06:50:00.000000Z");
+
+  /* Add 10-second records with every other record missing, 100 segments */
+  for (idx = 0; idx < 200; idx += 2)
+  {
+    msr->starttime = start + (nstime_t)idx * 10 * NSTMODULUS;
+    REQUIRE (mstl3_addmsr (mstl, msr, 0, 1, 0, NULL) != NULL, "mstl3_addmsr() returned unexpected NULL");
+  }
+
+  id = mstl->traces.next[0];
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  CHECK (id->numsegments == 100, "numsegments is not expected 100");
+
+  /* Remove every other segment, including the first */
+  idx = 0;
+  for (seg = id->first; seg; seg = next, idx++)
+  {
+    next = seg->next;
+
+    if (idx % 2 == 0)
+      CHECK (mstl3_remove_segment (mstl, id, seg, 0) == 0, "mstl3_remove_segment() returned an error");
+  }
+
+  CHECK (id->numsegments == 50, "numsegments is not expected 50");
+  REQUIRE (id->first != NULL && id->last != NULL, "Segment list is empty");
+  CHECK (id->first->starttime == start + (nstime_t)20 * NSTMODULUS, "First segment is not expected segment");
+  CHECK (id->first->prev == NULL, "First segment has a previous segment");
+  CHECK (id->last->starttime == start + (nstime_t)1980 * NSTMODULUS, "Last segment is not expected segment");
+
+  /* Add a record where a removed segment was, it must start a new segment in order */
+  msr->starttime = start + (nstime_t)40 * NSTMODULUS;
+  REQUIRE (mstl3_addmsr (mstl, msr, 0, 1, 0, NULL) != NULL, "mstl3_addmsr() returned unexpected NULL");
+
+  CHECK (id->numsegments == 51, "numsegments is not expected 51");
+  REQUIRE (id->first->next != NULL, "Second segment is missing");
+  CHECK (id->first->next->starttime == start + (nstime_t)40 * NSTMODULUS, "Second segment is not the added record");
+
+  msr3_free (&msr);
+  mstl3_free (&mstl, 0);
+}
+
+/* Add 10-second records of 100 samples at 10 Hz with sample values in
+ * sequence to a list, for the record indexes that match a modulus */
+static int
+addsequence (MS3TraceList *mstl, const char *sid, int first, int last, int modulus, int remainder)
+{
+  MS3Record *msr = NULL;
+  int32_t samples[100];
+  nstime_t start;
+  int idx;
+  int sample;
+
+  if (!(msr = msr3_init (NULL)))
+    return -1;
+
+  strcpy (msr->sid, sid);
+  msr->samprate   = 10.0;
+  msr->samplecnt  = 100;
+  msr->numsamples = 100;
+  msr->sampletype = 'i';
+  msr->datasamples = samples;
+  start = ms_timestr2nstime ("2010-02-27T06:50:00.000000Z");
+
+  for (idx = first; idx <= last; idx++)
+  {
+    if (idx % modulus != remainder)
+      continue;
+
+    for (sample = 0; sample < 100; sample++)
+      samples[sample] = idx * 100 + sample;
+
+    msr->starttime = start + (nstime_t)idx * 10 * NSTMODULUS;
+    if (!mstl3_addmsr (mstl, msr, 0, 1, MSF_SAMPLECHUNKS, NULL))
+      return -1;
+  }
+
+  msr->datasamples = NULL;
+  msr3_free (&msr);
+
+  return 0;
+}
+
+TEST (trace, merge)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *src  = NULL;
+  MS3TraceID *id     = NULL;
+  int32_t *samples;
+  int idx;
+
+  mstl = mstl3_init_arena (NULL, 0);
+  src  = mstl3_init_arena (NULL, 0);
+  REQUIRE (mstl != NULL && src != NULL, "mstl3_init_arena() did not return a list");
+
+  /* Interleave records of a series with a gap at records 100-109 between
+   * two lists and add a second source to the second list only */
+  CHECK (addsequence (mstl, "FDSN:XX_TEST__B_H_Z", 0, 99, 3, 0) == 0, "Cannot add records");
+  CHECK (addsequence (mstl, "FDSN:XX_TEST__B_H_Z", 110, 199, 3, 0) == 0, "Cannot add records");
+  CHECK (addsequence (src, "FDSN:XX_TEST__B_H_Z", 0, 99, 3, 1) == 0, "Cannot add records");
+  CHECK (addsequence (src, "FDSN:XX_TEST__B_H_Z", 0, 99, 3, 2) == 0, "Cannot add records");
+  CHECK (addsequence (src, "FDSN:XX_TEST__B_H_Z", 110, 199, 3, 1) == 0, "Cannot add records");
+  CHECK (addsequence (src, "FDSN:XX_TEST__B_H_Z", 110, 199, 3, 2) == 0, "Cannot add records");
+  CHECK (addsequence (src, "FDSN:XX_TEST__B_H_E", 0, 9, 1, 0) == 0, "Cannot add records");
+
+  id = mstl->traces.next[0];
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  CHECK (id->numsegments == 64, "numsegments is not expected 64");
+
+  CHECK (mstl3_merge (mstl, &src, 0, 1, NULL) == 0, "mstl3_merge() returned an error");
+  CHECK (src == NULL, "Source list was not freed");
+  CHECK (mstl->numtraceids == 2, "numtraceids is not expected 2");
+
+  /* Added in source identifier order */
+  id = mstl->traces.next[0];
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  CHECK_STREQ (id->sid, "FDSN:XX_TEST__B_H_E");
+  CHECK (id->numsegments == 1, "numsegments is not expected 1");
+
+  id = id->next[0];
+  REQUIRE (id != NULL, "Second trace ID is not populated");
+  CHECK_STREQ (id->sid, "FDSN:XX_TEST__B_H_Z");
+  REQUIRE (id->numsegments == 2, "numsegments is not expected 2");
+  CHECK (id->first->samplecnt == 10000, "First segment samplecnt is not expected 10000");
+  CHECK (id->last->samplecnt == 9000, "Last segment samplecnt is not expected 9000");
+  CHECK (id->first->next == id->last && id->last->prev == id->first, "Segment list is not linked");
+
+  /* Samples of the joined segments are in sequence */
+  REQUIRE (mstl3_flatten_samples (id->first) >= 0, "mstl3_flatten_samples() returned an error");
+  REQUIRE (mstl3_flatten_samples (id->last) >= 0, "mstl3_flatten_samples() returned an error");
+
+  samples = (int32_t *)id->first->datasamples;
+  for (idx = 0; idx < 10000; idx++)
+    if (samples[idx] != idx)
+      break;
+  CHECK (idx == 10000, "First segment samples are not in sequence");
+
+  samples = (int32_t *)id->last->datasamples;
+  for (idx = 0; idx < 9000; idx++)
+    if (samples[idx] != 11000 + idx)
+      break;
+  CHECK (idx == 9000, "Last segment samples are not in sequence");
+
+  mstl3_free (&mstl, 0);
+}
+
+TEST (trace, merge_concurrent)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *src  = NULL;
+  MS3TraceID *id     = NULL;
+  char sid[LM_SIDLEN];
+  int32_t *samples;
+  int idx;
+  int count;
+
+  mstl = mstl3_init_arena (NULL, 0);
+  src  = mstl3_init_arena (NULL, 0);
+  REQUIRE (mstl != NULL && src != NULL, "mstl3_init_arena() did not return a list");
+  REQUIRE (mstl3_set_concurrent (mstl) == 0, "mstl3_set_concurrent() returned an error");
+
+  /* Interleave records of many sources between two lists, merged by multiple threads */
+  for (idx = 0; idx < 64; idx++)
+  {
+    snprintf (sid, sizeof (sid), "FDSN:XX_S%03d__B_H_Z", idx);
+    CHECK (addsequence (mstl, sid, 0, 199, 2, 0) == 0, "Cannot add records");
+    CHECK (addsequence (src, sid, 0, 199, 2, 1) == 0, "Cannot add records");
+  }
+
+  CHECK (mstl3_merge (mstl, &src, 0, 1, NULL) == 0, "mstl3_merge() returned an error");
+  CHECK (src == NULL, "Source list was not freed");
+  CHECK (mstl->numtraceids == 64, "numtraceids is not expected 64");
+
+  /* Each source is one segment with samples in sequence */
+  count = 0;
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    if (id->numsegments != 1 || id->first->samplecnt != 20000 ||
+        mstl3_flatten_samples (id->first) < 0)
+      break;
+
+    samples = (int32_t *)id->first->datasamples;
+    for (idx = 0; idx < 20000; idx++)
+      if (samples[idx] != idx)
+        break;
+    if (idx != 20000)
+      break;
+
+    count++;
+  }
+  CHECK (count == 64, "Merged sources are not single segments with samples in sequence");
+
+  mstl3_free (&mstl, 0);
+}
+
+TEST (trace, split_segment)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id     = NULL;
+  MS3TraceSeg *seg   = NULL;
+  int32_t *samples;
+  int idx;
+
+  mstl = mstl3_init (NULL);
+  REQUIRE (mstl != NULL, "mstl3_init() did not return a list");
+
+  CHECK (addsequence (mstl, "FDSN:XX_TEST__B_H_Z", 0, 9, 1, 0) == 0, "Cannot add records");
+
+  id = mstl->traces.next[0];
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  REQUIRE (id->numsegments == 1, "numsegments is not expected 1");
+
+  CHECK (mstl3_split_segment (mstl, id, id->first, 0) == NULL, "Split of 0 samples did not fail");
+  CHECK (mstl3_split_segment (mstl, id, id->first, 1000) == NULL, "Split of all samples did not fail");
+
+  /* Split within a chunk and at a chunk boundary */
+  seg = mstl3_split_segment (mstl, id, id->last, 250);
+  REQUIRE (seg != NULL, "mstl3_split_segment() returned an error");
+  seg = mstl3_split_segment (mstl, id, id->last, 350);
+  REQUIRE (seg != NULL, "mstl3_split_segment() returned an error");
+
+  REQUIRE (id->numsegments == 3, "numsegments is not expected 3");
+  CHECK (id->first->next == seg && seg->prev == id->first, "Segment list is not linked");
+  CHECK (seg->next == id->last && id->last->prev == seg, "Segment list is not linked");
+  CHECK (id->first->samplecnt == 250 && seg->samplecnt == 350 && id->last->samplecnt == 400,
+         "Segment sample counts are not expected 250, 350 and 400");
+  CHECK (id->earliest == id->first->starttime, "earliest time is not the first start time");
+  CHECK (id->latest == id->last->endtime, "latest time is not the last end time");
+  CHECK (seg->starttime == id->first->endtime + (nstime_t)(NSTMODULUS / 10), "Second segment start time is not expected");
+  CHECK (id->last->starttime == seg->endtime + (nstime_t)(NSTMODULUS / 10), "Last segment start time is not expected");
+
+  /* Samples of the split segments are in sequence */
+  for (seg = id->first; seg; seg = seg->next)
+  {
+    REQUIRE (mstl3_flatten_samples (seg) >= 0, "mstl3_flatten_samples() returned an error");
+    CHECK (seg->numsamples == seg->samplecnt, "numsamples is not samplecnt");
+  }
+
+  CHECK (mstl3_split_segment (mstl, id, id->last, 100) != NULL, "Split of contiguous samples returned an error");
+
+  samples = (int32_t *)id->last->datasamples;
+  for (idx = 0; idx < 300; idx++)
+    if (samples[idx] != 700 + idx)
+      break;
+  CHECK (idx == 300, "Last segment samples are not in sequence");
+
+  samples = (int32_t *)id->first->next->datasamples;
+  for (idx = 0; idx < 350; idx++)
+    if (samples[idx] != 250 + idx)
+      break;
+  CHECK (idx == 350, "Second segment samples are not in sequence");
+
+  mstl3_free (&mstl, 0);
+}
+
+#if !defined(LMP_WIN)
+/* Add every fourth record of two sources, offset by thread number */
+static void *
+addthread (void *arg)
+{
+  MS3TraceList *mstl = ((void **)arg)[0];
+  int remainder      = *(int *)((void **)arg)[1];
+
+  if (addsequence (mstl, "FDSN:XX_TEST__B_H_Z", 0, 999, 4, remainder) ||
+      addsequence (mstl, "FDSN:XX_TEST__B_H_N", 0, 999, 4, 3 - remainder))
+    return arg;
+
+  return NULL;
+}
+
+TEST (trace, concurrent)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceID *id     = NULL;
+  pthread_t threads[4];
+  void *args[4][2];
+  int remainders[4];
+  void *result;
+  int32_t *samples;
+  int idx;
+
+  mstl = mstl3_init_arena (NULL, 0);
+  REQUIRE (mstl != NULL, "mstl3_init_arena() did not return a list");
+  REQUIRE (mstl3_set_concurrent (mstl) == 0, "mstl3_set_concurrent() returned an error");
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    remainders[idx] = idx;
+    args[idx][0] = mstl;
+    args[idx][1] = &remainders[idx];
+    REQUIRE (pthread_create (&threads[idx], NULL, addthread, args[idx]) == 0, "Cannot create thread");
+  }
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    CHECK (pthread_join (threads[idx], &result) == 0 && result == NULL, "Thread did not add records");
+  }
+
+  CHECK (mstl->numtraceids == 2, "numtraceids is not expected 2");
+
+  /* Each source is a single segment with samples in sequence */
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    REQUIRE (id->numsegments == 1, "numsegments is not expected 1");
+    CHECK (id->first->samplecnt == 100000, "samplecnt is not expected 100000");
+    REQUIRE (mstl3_flatten_samples (id->first) >= 0, "mstl3_flatten_samples() returned an error");
+
+    samples = (int32_t *)id->first->datasamples;
+    for (idx = 0; idx < 100000; idx++)
+      if (samples[idx] != idx)
+        break;
+    CHECK (idx == 100000, "Segment samples are not in sequence");
+  }
+
+  mstl3_free (&mstl, 0);
+}
+#endif
+
 TEST (read, recptr_file)
 {
   MS3TraceList *mstl   = NULL;
@@ -106,6 +739,103 @@ TEST (read, recptr_file)
   mstl3_free (&mstl, 1);
 }
 
+TEST (read, recptr_arena)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *ref  = NULL;
+  MS3TraceID *id     = NULL;
+  int64_t unpacked;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+
+  CHECK (mstl3_init_arena (NULL, 8) == NULL, "mstl3_init_arena() accepted a too small block size");
+
+  /* Small blocks to exercise block allocation */
+  mstl = mstl3_init_arena (NULL, 1024);
+  REQUIRE (mstl != NULL, "mstl3_init_arena() did not return a list");
+
+  rv = ms3_readtracelist (&mstl, path, NULL, 0, MSF_RECORDLIST, 0);
+
+  CHECK (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (mstl->numtraceids == 1, "mstl->numtraceids is not expected 1");
+
+  id = mstl->traces.next[0];
+
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  REQUIRE (id->first != NULL, "id->first is not populated");
+  REQUIRE (id->first->recordlist != NULL, "id->first->recordlist is not populated");
+  CHECK (id->numsegments == 1, "id->numsegments is not expected 1");
+  CHECK (id->first->recordlist->last->fileoffset == 1152, "recptr->fileoffset is not expected 1152");
+
+  unpacked = mstl3_unpack_recordlist (id, id->first, NULL, 0, 0);
+  CHECK (unpacked == 3952, "Return from mstl3_unpack_recordlist is not expected 3952");
+
+  rv = ms3_readtracelist (&ref, path, NULL, 0, MSF_UNPACKDATA | MSF_RECORDLIST, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (id->first->recordlist->recordcnt == ref->traces.next[0]->first->recordlist->recordcnt,
+         "Arena record list count does not match");
+  CHECK (memcmp (id->first->datasamples, ref->traces.next[0]->first->datasamples, 3952 * sizeof (int32_t)) == 0,
+         "Samples unpacked from arena record list do not match");
+
+  mstl3_free (&ref, 1);
+  mstl3_free (&mstl, 1);
+  CHECK (mstl == NULL, "mstl3_free() did not set list to NULL");
+}
+
+TEST (read, recptr_files)
+{
+  MS3TraceList *mstl = NULL;
+  MS3TraceList *ref  = NULL;
+  MS3FileParam *msfp = NULL;
+  MS3Record *msr     = NULL;
+  MS3TraceID *id     = NULL;
+  FILE *files[2];
+  int64_t unpacked;
+  int count = 0;
+  int rv;
+
+  char *path = "data/testdata-oneseries-mixedlengths-mixedorder.mseed2";
+  char *paths[] = {"testdata-recptr-even.mseed2", "testdata-recptr-odd.mseed2"};
+
+  /* Split records alternately into two files, interleaving them in the record list */
+  files[0] = fopen (paths[0], "wb");
+  files[1] = fopen (paths[1], "wb");
+  REQUIRE (files[0] != NULL && files[1] != NULL, "Cannot open test files for writing");
+
+  while ((rv = ms3_readmsr_r (&msfp, &msr, path, 0, 0)) == MS_NOERROR)
+    fwrite (msr->record, 1, msr->reclen, files[count++ % 2]);
+
+  ms3_readmsr_r (&msfp, &msr, NULL, 0, 0);
+  fclose (files[0]);
+  fclose (files[1]);
+  REQUIRE (count == 7, "Unexpected number of records split");
+
+  rv = ms3_readtracelist (&mstl, paths[0], NULL, 0, MSF_RECORDLIST, 0);
+  CHECK (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  rv = ms3_readtracelist (&mstl, paths[1], NULL, 0, MSF_RECORDLIST, 0);
+  CHECK (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+
+  id = mstl->traces.next[0];
+
+  REQUIRE (id != NULL, "mstl->traces.next[0] is not populated");
+  REQUIRE (id->first != NULL && id->first->recordlist != NULL, "id->first->recordlist is not populated");
+  CHECK (id->numsegments == 1, "id->numsegments is not expected 1");
+  CHECK (id->first->recordlist->recordcnt == 7, "Record list count is not expected 7");
+  CHECK (id->first->recordlist->filecache == mstl->filecache, "Record list does not share trace list file cache");
+
+  unpacked = mstl3_unpack_recordlist (id, id->first, NULL, 0, 0);
+  CHECK (unpacked == 3952, "Return from mstl3_unpack_recordlist is not expected 3952");
+
+  rv = ms3_readtracelist (&ref, path, NULL, 0, MSF_UNPACKDATA, 0);
+  REQUIRE (rv == MS_NOERROR, "ms3_readtracelist() did not return expected MS_NOERROR");
+  CHECK (memcmp (id->first->datasamples, ref->traces.next[0]->first->datasamples, 3952 * sizeof (int32_t)) == 0,
+         "Samples unpacked from records in multiple files do not match");
+
+  mstl3_free (&ref, 1);
+  mstl3_free (&mstl, 1);
+}
+
 TEST (read, recptr_buffer)
 {
   char buffer[16256];
@@ -25,11 +25,235 @@
 #include <time.h>
 
 #include "libmseed.h"
-
-MS3TraceSeg *mstl3_msr2seg (const MS3Record *msr, nstime_t endtime);
-MS3TraceSeg *mstl3_addmsrtoseg (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int8_t whence);
+#include "unpack.h"
+
+#if !defined(LMP_WIN)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MS3TraceID *mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev);
+MS3TraceSeg *mstl3_msr2seg (MS3TraceList *mstl, const MS3Record *msr, nstime_t endtime, uint32_t flags);
+MS3TraceSeg *mstl3_addmsrtoseg (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg,
+                                const MS3Record *msr, nstime_t endtime, int8_t whence, uint32_t flags);
 MS3TraceSeg *mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2);
-MS3RecordPtr *mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int8_t whence);
+MS3RecordPtr *mstl3_add_recordptr (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                                   nstime_t endtime, int8_t whence);
+
+static int64_t mstl3_addsamples (MS3TraceSeg *seg, const MS3Record *msr, int8_t whence, uint32_t flags);
+static char *mstl3_reserve_samples (MS3TraceSeg *seg, uint8_t samplesize, int64_t count,
+                                    int8_t whence, int8_t chunked, MS3SampleChunk **ppchunk);
+static void mstl3_release_samples (MS3TraceSeg *seg, uint8_t samplesize, int64_t count,
+                                   int8_t whence, MS3SampleChunk *chunk);
+static int mstl3_seg2chunks (MS3TraceSeg *seg);
+static void mstl3_free_samples (MS3TraceSeg *seg, int8_t freeprvtptr);
+static void mstl3_free_chunks (MS3TraceSeg *seg, int8_t freeprvtptr);
+static void mstl3_free_chunkdata (MS3SampleChunk *chunk);
+static void *mstl3_alloc_node (MS3TraceList *mstl, int nodetype);
+static void *mstl3_arena_alloc (struct MS3TraceListArena *arena, size_t size);
+static MS3TraceID *mstl3_alloc_ID (MS3TraceList *mstl, uint8_t height);
+static const char *mstl3_intern_sid (MS3TraceList *mstl, const char *sid);
+static void mstl3_free_sidtable (MS3TraceList *mstl);
+static void mstl3_free_node (MS3TraceList *mstl, int nodetype, void *node);
+static void mstl3_free_arena (MS3TraceList *mstl);
+static void mstl3_lock_list (MS3TraceList *mstl, int8_t exclusive);
+static void mstl3_unlock_list (MS3TraceList *mstl);
+static void mstl3_lock_ID (MS3TraceList *mstl, const MS3TraceID *id);
+static void mstl3_unlock_ID (MS3TraceList *mstl, const MS3TraceID *id);
+static void mstl3_lock_alloc (MS3TraceList *mstl);
+static void mstl3_unlock_alloc (MS3TraceList *mstl);
+static void mstl3_free_lock (MS3TraceList *mstl);
+static void mstl3_free_recordlist (MS3TraceList *mstl, MS3RecordList *recordlist, int8_t freeprvtptr);
+static MS3TraceSeg *mstl3_addmsr_newID (MS3TraceList *mstl, const MS3Record *msr, nstime_t endtime,
+                                        MS3TraceID **previd, MS3RecordPtr **pprecptr, uint32_t flags);
+static MS3TraceSeg *mstl3_addmsr_toID (MS3TraceList *mstl, MS3TraceID *id, const MS3Record *msr,
+                                       nstime_t endtime, MS3RecordPtr **pprecptr, int8_t autoheal,
+                                       uint32_t flags, const MS3Tolerance *tolerance);
+static int mstl3_split_samples (MS3TraceSeg *seg, MS3TraceSeg *newseg, int64_t count);
+static void mstl3_free_joinedseg (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
+static int mstl3_segfollows (const MS3TraceSeg *seg, const MS3TraceSeg *nextseg, nstime_t nsdelta,
+                             nstime_t nstimetol, double sampratetol, int8_t ratetol);
+static int mstl3_merge_ID (MS3TraceList *dst, MS3TraceID *id, MS3TraceID *srcid, int8_t autoheal,
+                           const MS3Tolerance *tolerance);
+static void *mstl3_merge_thread (void *arg);
+static MS3TraceSeg *mstl3_merge_segment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *after,
+                                         MS3TraceSeg *seg, int8_t autoheal,
+                                         const MS3Tolerance *tolerance);
+static uint32_t mstl3_sidhash (const char *sid);
+static int mstl3_indexID (MS3TraceList *mstl, MS3TraceID *id);
+static void mstl3_free_index (MS3TraceList *mstl);
+static void mstl3_segindex_add (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
+static void mstl3_segindex_remove (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
+static void mstl3_segindex_update (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg,
+                                   nstime_t oldstart, nstime_t oldend);
+static void mstl3_segindex_find (MS3TraceID *id, const MS3Record *msr, nstime_t endtime,
+                                 nstime_t nsdelta, nstime_t nstimetol, int8_t autoheal,
+                                 double sampratehz, double sampratetol, int8_t ratetol,
+                                 MS3TraceSeg **segbefore, MS3TraceSeg **segafter,
+                                 MS3TraceSeg **followseg);
+static void mstl3_build_segindex (MS3TraceList *mstl, MS3TraceID *id);
+static void mstl3_free_segindex (MS3TraceList *mstl, MS3TraceID *id);
+struct MS3RecordRead;
+static FILE *mstl3_filecache_open (struct MS3FileCache *cache, const char *filename);
+static void mstl3_filecache_close (struct MS3FileCache *cache);
+static int mstl3_read_records (struct MS3FileCache *cache, struct MS3RecordRead **order,
+                               size_t count, char **buffer, size_t *buffersize, const char *sid);
+static int mstl3_cmp_recordread (const void *a, const void *b);
+
+/* Maximum size in bytes of a MS3SampleChunk sample buffer */
+#define MSTL_CHUNK_MAXSIZE 1048576
+
+/* Trace list node types, allocated from an arena when enabled */
+#define MSTL_NODE_ID         0
+#define MSTL_NODE_SEG        1
+#define MSTL_NODE_RECORDLIST 2
+#define MSTL_NODE_RECORDPTR  3
+#define MSTL_NODE_RECORD     4
+#define MSTL_NODE_SEGINDEX   5
+#define MSTL_NODE_TYPES      6
+
+/* Default arena block size and node alignment in bytes */
+#define MSTL_ARENA_BLOCKSIZE 1048576
+#define MSTL_ARENA_ALIGN     16
+
+/* Round node sizes up to the arena alignment */
+#define MSTL_ARENA_SIZE(SIZE) (((SIZE) + MSTL_ARENA_ALIGN - 1) & ~((size_t)MSTL_ARENA_ALIGN - 1))
+
+/* Arena for trace list nodes, carved from large blocks and freed in bulk */
+struct MS3TraceListArena
+{
+  size_t blocksize;                /* Size of each block in bytes */
+  void *blocks;                    /* Allocated blocks, linked through first pointer */
+  char *cursor;                    /* Next unused byte in current block */
+  size_t remaining;                /* Unused bytes remaining in current block */
+  void *freelist[MSTL_NODE_TYPES]; /* Released nodes for reuse, linked through first pointer */
+};
+
+/* Size of blocks of the source identifier table */
+#define MSTL_SIDTABLE_BLOCKSIZE 16384
+
+/* Source identifiers of trace IDs, each stored once in blocks freed in bulk */
+struct MS3SIDTable
+{
+  void *blocks;     /* Allocated blocks, linked through first pointer */
+  char *cursor;     /* Next unused byte in current block */
+  size_t remaining; /* Unused bytes remaining in current block */
+};
+
+/* Number of locks shared by the trace IDs of a concurrent trace list, a power of 2 */
+#define MSTL_LOCK_STRIPES 256
+
+/* Locks of a trace list allowing concurrent addition of records */
+#if !defined(LMP_WIN)
+struct MS3TraceListLock
+{
+  pthread_rwlock_t list;                  /* Trace ID skip list, index and SID table */
+  pthread_mutex_t alloc;                  /* Node arena */
+  pthread_mutex_t ids[MSTL_LOCK_STRIPES]; /* Segments of trace IDs, selected by ID address */
+};
+#endif
+
+/* Maximum number of threads merging the trace IDs of a concurrent trace list */
+#define MSTL_MERGE_THREADS 8
+
+/* Source trace IDs merged into existing IDs, shared by merging threads */
+struct MS3MergeShare
+{
+  MS3TraceList *dst;
+  MS3TraceID **ids;    /* Destination IDs, IDs of the same source are adjacent */
+  MS3TraceID **srcids; /* Source IDs, merged into ids in source order */
+  uint32_t count;
+  uint32_t next;       /* Next ID to merge, advanced past all of the same destination */
+  int8_t autoheal;
+  const MS3Tolerance *tolerance;
+  int rv;
+#if !defined(LMP_WIN)
+  pthread_mutex_t lock;
+#endif
+};
+
+/* Height of segment index skip lists */
+#define MSTL_SEGINDEX_HEIGHT 16
+
+/* Number of segments of a trace ID at which the segments are indexed */
+#define MSTL_SEGINDEX_MINSEGMENTS 64
+
+/* Segment index skip list node, ordered by time and then segment address */
+struct MS3SegIndexNode
+{
+  nstime_t time;
+  MS3TraceSeg *seg;
+  struct MS3SegIndexNode *next[MSTL_SEGINDEX_HEIGHT];
+};
+
+/* Index of the segments of a trace ID by start and end times */
+struct MS3TraceSegIndex
+{
+  struct MS3SegIndexNode start; /* Head node of skip list ordered by segment start time */
+  struct MS3SegIndexNode end;   /* Head node of skip list ordered by segment end time */
+  uint64_t prngstate;           /* State for node heights, per ID for concurrent lists */
+};
+
+/* Trace ID nodes are followed by their skip list pointers, maximum size */
+static const size_t mstl_nodesize[MSTL_NODE_TYPES] = {
+    sizeof (MS3TraceID) + MSTRACEID_SKIPLIST_HEIGHT * sizeof (MS3TraceID *),
+    sizeof (MS3TraceSeg),
+    sizeof (MS3RecordList),
+    sizeof (MS3RecordPtr),
+    sizeof (MS3Record),
+    sizeof (struct MS3SegIndexNode)};
+
+/* Initial number of slots in trace ID hash index, must be a power of 2 */
+#define MSTL_INDEX_INITSIZE 64
+
+/* Hash index of trace IDs by SID, with open addressing and linear probing */
+struct MS3TraceIDIndex
+{
+  MS3TraceID **slots;   /* Hash slots, NULL when empty */
+  uint32_t size;        /* Number of slots, a power of 2 */
+  uint32_t count;       /* Number of indexed IDs */
+  MS3TraceID *lasthit;  /* Most recently found ID */
+  int8_t multiversion;  /* A SID is present with multiple publication versions */
+};
+
+/* Number of files kept open for reading record lists */
+#define MSTL_FILECACHE_SIZE 16
+
+/* Open files used to read record lists, least recently used are closed */
+struct MS3FileCache
+{
+  struct
+  {
+    char *filename;   /* File name, allocated */
+    FILE *fileptr;    /* Open file, NULL when unused */
+    uint64_t lastuse; /* Use counter value of last use */
+  } files[MSTL_FILECACHE_SIZE];
+  uint64_t usecount;  /* Counter incremented on each use */
+};
+
+/* Bytes of records from files staged for decoding at once */
+#define MSTL_STAGING_SIZE 4194304
+
+/* Largest gap between records in a file that are read in a single call */
+#define MSTL_READ_GAP 4096
+
+/* A record of a record list to be read from a file and decoded */
+struct MS3RecordRead
+{
+  MS3RecordPtr *recordptr; /* Record pointer in record list */
+  size_t listindex;        /* Position in record list window */
+  size_t stageoffset;      /* Offset of record in staging buffer */
+};
+
+/* Test if MS3Record samples should be decoded directly into a segment */
+#define MSTL_DECODE(MSR, FLAGS) (((FLAGS) & MSF_UNPACKDATA) && (MSR)->record && \
+                                 (MSR)->samplecnt > 0 && (MSR)->numsamples == 0)
+
+/* Test if MS3TraceSeg A is ordered before B, by start time and then longest first */
+#define MSTL_SEGBEFORE(A, B) ((A)->starttime < (B)->starttime || \
+                              ((A)->starttime == (B)->starttime && (A)->endtime >= (B)->endtime))
 
 static uint32_t lm_lcg_r (uint64_t *state);
 static uint8_t lm_random_height (uint8_t maximum, uint64_t *state);
@@ -67,11 +291,141 @@ mstl3_init (MS3TraceList *mstl)
 
   /* Seed PRNG with 1, we only need random distribution */
   mstl->prngstate = 1;
+  mstl->traces.next = mstl->tracesnext;
   mstl->traces.height = MSTRACEID_SKIPLIST_HEIGHT;
 
   return mstl;
 } /* End of mstl3_init() */
 
+/**********************************************************************/ /**
+ * @brief Initialize a ::MS3TraceList container using an arena allocator
+ *
+ * Like mstl3_init(), but the ::MS3TraceID, ::MS3TraceSeg,
+ * ::MS3RecordList, ::MS3RecordPtr and record list ::MS3Record
+ * structures of the list are carved from blocks of \a blocksize bytes
+ * instead of being allocated individually.  The blocks are allocated
+ * with the ::libmseed_memory functions and released in bulk by
+ * mstl3_free().
+ *
+ * Structures of a list initialized this way must not be freed
+ * individually by the caller, only via mstl3_free().  Data sample
+ * buffers and \a prvtptr data are allocated and freed as usual.
+ *
+ * @param[in] mstl ::MS3TraceList to reinitialize or NULL
+ * @param[in] blocksize Size of arena blocks in bytes, 0 for the default of 1 MiB
+ *
+ * @returns a pointer to a MS3TraceList struct on success or NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+MS3TraceList *
+mstl3_init_arena (MS3TraceList *mstl, size_t blocksize)
+{
+  struct MS3TraceListArena *arena;
+  size_t maxnodesize = 0;
+  int idx;
+
+  for (idx = 0; idx < MSTL_NODE_TYPES; idx++)
+  {
+    if (MSTL_ARENA_SIZE (mstl_nodesize[idx]) > maxnodesize)
+      maxnodesize = MSTL_ARENA_SIZE (mstl_nodesize[idx]);
+  }
+
+  if (blocksize == 0)
+    blocksize = MSTL_ARENA_BLOCKSIZE;
+
+  if (blocksize < MSTL_ARENA_ALIGN + maxnodesize)
+  {
+    ms_log (2, "Arena block size too small: %" PRIsize_t ", minimum is %" PRIsize_t "\n",
+            blocksize, (size_t) (MSTL_ARENA_ALIGN + maxnodesize));
+    return NULL;
+  }
+
+  if (!(mstl = mstl3_init (mstl)))
+    return NULL;
+
+  arena = (struct MS3TraceListArena *)libmseed_memory.malloc (sizeof (struct MS3TraceListArena));
+
+  if (arena == NULL)
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    mstl3_free (&mstl, 0);
+    return NULL;
+  }
+
+  memset (arena, 0, sizeof (struct MS3TraceListArena));
+  arena->blocksize = blocksize;
+  mstl->arena = arena;
+
+  return mstl;
+} /* End of mstl3_init_arena() */
+
+/**********************************************************************/ /**
+ * @brief Allow records to be added to a ::MS3TraceList concurrently
+ *
+ * After this call mstl3_addmsr() and mstl3_addmsr_recordptr() may be
+ * called for the list from multiple threads simultaneously, e.g. by
+ * threads that each read different files.  Searching and adding trace
+ * IDs is protected by a reader-writer lock of the list, so adding
+ * records of known IDs only takes a shared lock, and adding coverage
+ * to the segments of an ID by a lock selected by the ID.  Records of
+ * different IDs, including their decoding into segments, are added in
+ * parallel.
+ *
+ * Each thread must use its own ::MS3Record, the \a tolerance functions
+ * and the ::libmseed_memory functions must be thread-safe.  All other
+ * operations on the list, including reading its IDs and segments and
+ * mstl3_findID(), must not be performed while records are added.
+ *
+ * The coverage of the list does not depend on the order in which
+ * records are added, but the segments formed from overlapping records
+ * of an ID do, so they may differ between runs.
+ *
+ * Not supported on Windows.
+ *
+ * @param[in] mstl ::MS3TraceList to allow concurrent additions to
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+mstl3_set_concurrent (MS3TraceList *mstl)
+{
+#if defined(LMP_WIN)
+  ms_log (2, "Concurrent trace lists are not supported on this platform\n");
+  return -1;
+#else
+  struct MS3TraceListLock *lock;
+  int idx;
+
+  if (!mstl)
+  {
+    ms_log (2, "Required argument not defined: 'mstl'\n");
+    return -1;
+  }
+
+  if (mstl->lock)
+    return 0;
+
+  if (!(lock = (struct MS3TraceListLock *)libmseed_memory.malloc (sizeof (struct MS3TraceListLock))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  pthread_rwlock_init (&lock->list, NULL);
+  pthread_mutex_init (&lock->alloc, NULL);
+
+  for (idx = 0; idx < MSTL_LOCK_STRIPES; idx++)
+    pthread_mutex_init (&lock->ids[idx], NULL);
+
+  mstl->lock = lock;
+
+  return 0;
+#endif
+} /* End of mstl3_set_concurrent() */
+
 /**********************************************************************/ /**
  * @brief Free all memory associated with a ::MS3TraceList
  *
@@ -79,7 +433,8 @@ mstl3_init (MS3TraceList *mstl)
  *
  * @param[in] ppmstl Pointer-to-pointer to the target ::MS3TraceList to free
  * @param[in] freeprvtptr If true, also free any data at the \a
- * prvtptr members of ::MS3TraceID.prvtptr, ::MS3TraceSeg.prvtptr, and
+ * prvtptr members of ::MS3TraceID.prvtptr, ::MS3TraceSeg.prvtptr,
+ * ::MS3SampleChunk.prvtptr (in ::MS3TraceSeg.chunks) and
  * ::MS3RecordPtr.prvtptr (in ::MS3TraceSeg.recordlist)
  ***************************************************************************/
 void
@@ -89,14 +444,15 @@ mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr)
   MS3TraceID *nextid = 0;
   MS3TraceSeg *seg = 0;
   MS3TraceSeg *nextseg = 0;
-  MS3RecordPtr *recordptr;
-  MS3RecordPtr *nextrecordptr;
+  MS3TraceList *mstl;
 
-  if (!ppmstl)
+  if (!ppmstl || !*ppmstl)
     return;
 
+  mstl = *ppmstl;
+
   /* Free any associated traces */
-  id = (*ppmstl)->traces.next[0];
+  id = mstl->traces.next[0];
   while (id)
   {
     nextid = id->next[0];
@@ -111,45 +467,51 @@ mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr)
       if (freeprvtptr && seg->prvtptr)
         libmseed_memory.free (seg->prvtptr);
 
-      /* Free data array if allocated */
-      if (seg->datasamples)
-        libmseed_memory.free (seg->datasamples);
+      /* Free data samples, contiguous or chunked */
+      mstl3_free_samples (seg, freeprvtptr);
 
       /* Free associated record list and related private pointers */
       if (seg->recordlist)
-      {
-        recordptr = seg->recordlist->first;
-        while (recordptr)
-        {
-          nextrecordptr = recordptr->next;
-
-          if (recordptr->msr)
-            msr3_free (&recordptr->msr);
-
-          if (freeprvtptr && recordptr->prvtptr)
-            libmseed_memory.free (recordptr->prvtptr);
-
-          libmseed_memory.free (recordptr);
-
-          recordptr = nextrecordptr;
-        }
+        mstl3_free_recordlist (mstl, seg->recordlist, freeprvtptr);
 
-        libmseed_memory.free (seg->recordlist);
-      }
-
-      libmseed_memory.free (seg);
+      if (!mstl->arena)
+        libmseed_memory.free (seg);
       seg = nextseg;
     }
 
+    if (id->segindex)
+      mstl3_free_segindex (mstl, id);
+
     /* Free private pointer data if present and requested */
     if (freeprvtptr && id->prvtptr)
       libmseed_memory.free (id->prvtptr);
 
-    libmseed_memory.free (id);
+    if (!mstl->arena)
+      libmseed_memory.free (id);
 
     id = nextid;
   }
 
+  if (mstl->idindex)
+    mstl3_free_index (mstl);
+
+  /* Close files opened for unpacking record lists */
+  if (mstl->filecache)
+  {
+    mstl3_filecache_close (mstl->filecache);
+    libmseed_memory.free (mstl->filecache);
+  }
+
+  if (mstl->sidtable)
+    mstl3_free_sidtable (mstl);
+
+  /* Release all arena blocks */
+  if (mstl->arena)
+    mstl3_free_arena (mstl);
+
+  if (mstl->lock)
+    mstl3_free_lock (mstl);
+
   libmseed_memory.free (*ppmstl);
 
   *ppmstl = NULL;
@@ -158,1024 +520,3052 @@ mstl3_free (MS3TraceList **ppmstl, int8_t freeprvtptr)
 } /* End of mstl3_free() */
 
 /**********************************************************************/ /**
- * @brief Find matching ::MS3TraceID in a ::MS3TraceList
+ * @brief Remove a ::MS3TraceSeg from a ::MS3TraceList and free it
  *
- * Return the ::MS3TraceID matching the \a sid in the specified ::MS3TraceList.
+ * The segment is unlinked from the segment list of \a id and its
+ * data samples, @ref record-list and structure are freed.  The
+ * ::MS3TraceID is retained even when no segments remain.
  *
- * If \a prev is not NULL, set pointers to previous entries for the
- * expected location of the trace ID.  Useful for adding a new ID
- * with mstl3_addID(), and should be set to \a NULL otherwise.
+ * This allows a caller to release segments that are complete, e.g.
+ * when reading time-ordered data and a segment can no longer be
+ * extended, bounding the memory used by a trace list.
  *
- * @param[in] mstl Pointer to the ::MS3TraceList to search
- * @param[in] sid Source ID to search for in the list
- * @param[in] pubversion If non-zero, find the entry with this version
- * @param[out] prev Pointers to previous entries in expected location or NULL
+ * @param[in] mstl ::MS3TraceList containing \a id
+ * @param[in] id ::MS3TraceID containing \a seg
+ * @param[in] seg ::MS3TraceSeg to remove
+ * @param[in] freeprvtptr If true, also free any data at the \a
+ * prvtptr members of the segment, its sample chunks and record list
  *
- * @returns a pointer to the matching ::MS3TraceID or NULL if not found or error.
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
  ***************************************************************************/
-MS3TraceID *
-mstl3_findID (MS3TraceList *mstl, const char *sid, uint8_t pubversion, MS3TraceID **prev)
+int
+mstl3_remove_segment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg, int8_t freeprvtptr)
 {
-  MS3TraceID *id = NULL;
-  int level;
-  int cmp;
-
-  if (!mstl || !sid)
+  if (!mstl || !id || !seg)
   {
-    ms_log (2, "Required argument not defined: 'mstl' or 'sid'\n");
-    return NULL;
+    ms_log (2, "Required argument not defined: 'mstl', 'id' or 'seg'\n");
+    return -1;
   }
 
-  level = MSTRACEID_SKIPLIST_HEIGHT - 1;
+  mstl3_segindex_remove (mstl, id, seg);
 
-  /* Search trace ID skip list, starting from the head/sentinel node */
-  id = &(mstl->traces);
-  while (id != NULL && level >= 0)
-  {
-    if (prev != NULL) /* Track previous entries at each level */
-    {
-      prev[level] = id;
-    }
+  /* Remove segment from list */
+  if (seg->prev)
+    seg->prev->next = seg->next;
+  else
+    id->first = seg->next;
 
-    if (id->next[level] == NULL)
-    {
-      level -= 1;
-    }
-    else
-    {
-      cmp = strcmp(id->next[level]->sid, sid);
+  if (seg->next)
+    seg->next->prev = seg->prev;
+  else
+    id->last = seg->prev;
 
-      /* If source IDs match, check publication if matching requested */
-      if (!cmp && pubversion && id->next[level]->pubversion != pubversion)
-      {
-        cmp = (id->next[level]->pubversion < pubversion) ? -1 : 1;
-      }
+  /* Free private pointer data if present and requested */
+  if (freeprvtptr && seg->prvtptr)
+    libmseed_memory.free (seg->prvtptr);
 
-      if (cmp == 0) /* Found matching trace ID */
-      {
-        return id->next[level];
-      }
-      else if (cmp > 0) /* Drop a level */
-      {
-        level -= 1;
-      }
-      else /* Continue at this level */
-      {
-        id = id->next[level];
-      }
-    }
-  }
+  mstl3_free_samples (seg, freeprvtptr);
 
-  return NULL;
-} /* End of mstl3_findID() */
+  if (seg->recordlist)
+    mstl3_free_recordlist (mstl, seg->recordlist, freeprvtptr);
+
+  mstl3_free_node (mstl, MSTL_NODE_SEG, seg);
+
+  id->numsegments -= 1;
+
+  return 0;
+} /* End of mstl3_remove_segment() */
 
 /**********************************************************************/ /**
- * @brief Add ::MS3TraceID to a ::MS3TraceList
+ * @brief Split the first samples of a ::MS3TraceSeg into a new segment
  *
- * The \a prev array is the list of pointers to previous entries at different
- * levels of the skip list.  It is common to first search the list using
- * mstl3_findID() which returns this list of pointers for use here.
- * If this value is NULL mstl3_findID() will be run to find the pointers.
+ * The coverage and data samples of the first \a count samples of \a
+ * seg are moved to a new ::MS3TraceSeg inserted before \a seg in the
+ * segment list of \a id, and the start time of \a seg is advanced to
+ * the following sample.  Sample times are calculated with
+ * ms_sampletime().
  *
- * @param[in] mstl Add ID to this ::MS3TraceList
- * @param[in] id The ::MS3TraceID to add
- * @param[in] prev Pointers to previous entries in expected location, can be NULL
+ * Chunked samples (see ::MSF_SAMPLECHUNKS) are moved by chunk, only
+ * the samples of a chunk spanning the split are copied.  Contiguous
+ * samples are copied.
  *
- * @returns a pointer to the added ::MS3TraceID or NULL on error.
+ * This allows a caller to cut segments at time boundaries, e.g. to
+ * emit and remove the part of a segment before a boundary with
+ * mstl3_remove_segment() while the rest of the segment is extended.
  *
- * \sa mstl3_findID()
+ * Segments with a @ref record-list cannot be split, as records may
+ * contain samples on both sides of the split.
+ *
+ * @param[in] mstl ::MS3TraceList containing \a id
+ * @param[in] id ::MS3TraceID containing \a seg
+ * @param[in] seg ::MS3TraceSeg to split
+ * @param[in] count Number of samples to split from the start of \a seg,
+ * greater than 0 and less than the sample count of \a seg
+ *
+ * @returns a pointer to the new ::MS3TraceSeg on success and NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
  ***************************************************************************/
-MS3TraceID *
-mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev)
+MS3TraceSeg *
+mstl3_split_segment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg, int64_t count)
 {
-  MS3TraceID *local_prev[MSTRACEID_SKIPLIST_HEIGHT] = {NULL};
-  int level;
+  MS3TraceSeg *newseg;
+  nstime_t oldstart;
 
-  if (!mstl || !id)
+  if (!mstl || !id || !seg)
   {
-    ms_log (2, "Required argument not defined: 'mstl' or 'id'\n");
+    ms_log (2, "Required argument not defined: 'mstl', 'id' or 'seg'\n");
     return NULL;
   }
 
-  /* If previous list pointers not supplied, find them */
-  if (!prev)
+  if (count <= 0 || count >= seg->samplecnt || seg->samprate <= 0.0)
   {
-    mstl3_findID (mstl, id->sid, 0, local_prev);
-    prev = local_prev;
+    ms_log (2, "Cannot split %" PRId64 " samples from segment of %" PRId64 " samples at %g Hz\n",
+            count, seg->samplecnt, seg->samprate);
+    return NULL;
   }
 
-  /* Set level of new entry to a random level within head height */
-  id->height = lm_random_height (MSTRACEID_SKIPLIST_HEIGHT, &(mstl->prngstate));
+  if (seg->recordlist)
+  {
+    ms_log (2, "Cannot split a segment with a record list\n");
+    return NULL;
+  }
 
-  /* Set all pointers above new entry level to NULL */
-  for (level = MSTRACEID_SKIPLIST_HEIGHT - 1;
-       level > id->height;
-       level--)
+  if (seg->numsamples > 0 && seg->numsamples != seg->samplecnt)
   {
-    id->next[level] = NULL;
+    ms_log (2, "Cannot split a segment with %" PRId64 " of %" PRId64 " samples\n",
+            seg->numsamples, seg->samplecnt);
+    return NULL;
   }
 
-  /* Connect previous and new ID pointers */
-  for (level = id->height - 1;
-       level >= 0;
-       level--)
+  if (!(newseg = (MS3TraceSeg *)mstl3_alloc_node (mstl, MSTL_NODE_SEG)))
   {
-    if (!prev[level])
-    {
-      ms_log (2, "No previous pointer at level %d for adding SID %s\n",
-              level, id->sid);
-      return NULL;
-    }
+    ms_log (2, "Error allocating memory\n");
+    return NULL;
+  }
+  memset (newseg, 0, sizeof (MS3TraceSeg));
 
-    id->next[level] = prev[level]->next[level];
-    prev[level]->next[level] = id;
+  newseg->starttime  = seg->starttime;
+  newseg->endtime    = ms_sampletime (seg->starttime, count - 1, seg->samprate);
+  newseg->samprate   = seg->samprate;
+  newseg->samplecnt  = count;
+  newseg->sampletype = seg->sampletype;
+
+  if (seg->numsamples > 0 && mstl3_split_samples (seg, newseg, count))
+  {
+    mstl3_free_node (mstl, MSTL_NODE_SEG, newseg);
+    return NULL;
   }
 
-  mstl->numtraceids++;
+  oldstart = seg->starttime;
+  seg->starttime = ms_sampletime (seg->starttime, count, seg->samprate);
+  seg->samplecnt -= count;
 
-  return id;
-} /* End of mstl3_addID() */
+  mstl3_segindex_update (mstl, id, seg, oldstart, seg->endtime);
 
+  /* Insert new segment before the split segment */
+  newseg->prev = seg->prev;
+  newseg->next = seg;
 
-/**********************************************************************/ /**
- * @brief Add data coverage from an ::MS3Record to a ::MS3TraceList
- *
- * Searching the list for the appropriate ::MS3TraceID and
- * ::MS3TraceSeg and either add data to existing entries or create new
- * ones as needed.
- *
- * As this routine adds data to a trace list it constructs continuous
- * time series, merging segments when possible.  The \a tolerance
- * pointer to a ::MS3Tolerance identifies function pointers that are
- * expected to return time tolerace, in seconds, and sample rate
- * tolerance, in Hertz, for the given ::MS3Record.  If \a tolerance is
- * NULL, or the function pointers it identifies are NULL, default
- * tolerances will be used as follows: - Default time tolerance is 1/2
- * the sampling period - Default sample rate (sr) tolerance is
- * abs(1‐sr1/sr2) < 0.0001
+  if (seg->prev)
+    seg->prev->next = newseg;
+  else
+    id->first = newseg;
+
+  seg->prev = newseg;
+
+  id->numsegments++;
+  mstl3_segindex_add (mstl, id, newseg);
+
+  return newseg;
+} /* End of mstl3_split_segment() */
+
+/***************************************************************************
+ * mstl3_split_samples:
  *
- * In recommended usage, the \a splitversion flag is \b 0 and
- * different publication versions of otherwise matching data are
- * merged.  If more than one version contributes to a given source
- * identifer's segments, its ::MS3TraceID.pubversion will be the set to
- * the largest contributing version.  If the \a splitversion flag is
- * \b 1 the publication versions will be kept separate with each
- * version isolated in separate ::MS3TraceID entries.
+ * Move the first count data samples of a segment to the empty new
+ * segment.  Whole chunks are moved, the first samples of a chunk
+ * spanning the split are copied to a new chunk.  All memory is
+ * allocated before the segments are modified.
  *
- * If the \a autoheal flag is true, extra processing is invoked to
- * conjoin trace segments that fit together after the ::MS3Record
- * coverage is added.  For segments that are removed, any memory at
- * the ::MS3TraceSeg.prvtptr will be freed.
- *
- * If the \a pprecptr is not NULL a @ref record-list will be
- * maintained for each segment.  If the value of \c *pprecptr is NULL,
- * a new ::MS3RecordPtr will be allocated, otherwise the supplied
- * structure will be updated.  The ::MS3RecordPtr will be added to the
- * appropriate record list and the values of ::MS3RecordPtr.msr and
- * ::MS3RecordPtr.endtime will be set, all other fields should be set
- * by the caller.
- *
- * The lists are always maintained in a sorted order.  An
- * ::MS3TraceList is maintained with the ::MS3TraceID entries in
- * ascending alphanumeric order of SID. If repeated SIDs are present
- * due to splitting on publication version, they are maintained in
- * order of ascending version.  A ::MS3TraceID is always maintained
- * with ::MS3TraceSeg entries in data time time order.
- *
- * @param[in] mstl Destination ::MS3TraceList to add data to
- * @param[in] msr ::MS3Record containing the data to add to list
- * @param[in] pprecptr Pointer to pointer to a ::MS3RecordPtr for @ref record-list
- * @param[in] splitversion Flag to control splitting of version/quality
- * @param[in] autoheal Flag to control automatic merging of segments
- * @param[in] flags Flags to control optional functionality (unused)
- * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
- *
- * @returns a pointer to the ::MS3TraceSeg updated or NULL on error.
- *
- * \sa mstl3_readbuffer()
- * \sa ms3_readtracelist()
- *
- * \ref MessageOnError - this function logs a message on error
+ * Return 0 on success and -1 on error.
  ***************************************************************************/
-MS3TraceSeg *
-mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr **pprecptr,
-                        int8_t splitversion, int8_t autoheal, uint32_t flags,
-                        const MS3Tolerance *tolerance)
+static int
+mstl3_split_samples (MS3TraceSeg *seg, MS3TraceSeg *newseg, int64_t count)
 {
-  MS3TraceID *id = 0;
-  MS3TraceID *previd[MSTRACEID_SKIPLIST_HEIGHT] = {NULL};
+  MS3SampleChunk *chunk = NULL;
+  MS3SampleChunk *prevchunk = NULL;
+  MS3SampleChunk *head = NULL;
+  void *tail = NULL;
+  size_t headsize;
+  size_t tailsize = 0;
+  int64_t skipped = 0;
+  uint8_t samplesize;
+
+  if (!(samplesize = ms_samplesize (seg->sampletype)))
+  {
+    ms_log (2, "Unknown sample size for sample type: %c\n", seg->sampletype);
+    return -1;
+  }
 
-  MS3TraceSeg *seg = 0;
-  MS3TraceSeg *searchseg = 0;
-  MS3TraceSeg *segbefore = 0;
-  MS3TraceSeg *segafter = 0;
-  MS3TraceSeg *followseg = 0;
+  /* Copy the first samples of a contiguous buffer and shift the rest down */
+  if (!seg->chunks)
+  {
+    headsize = (size_t)count * samplesize;
 
-  nstime_t endtime;
-  nstime_t pregap;
-  nstime_t postgap;
-  nstime_t lastgap;
-  nstime_t firstgap;
-  nstime_t nsdelta;
-  nstime_t nstimetol = 0;
-  nstime_t nnstimetol = 0;
+    if (!(newseg->datasamples = libmseed_memory.malloc (headsize)))
+    {
+      ms_log (2, "Error allocating memory\n");
+      return -1;
+    }
 
-  double sampratehz;
-  double sampratetol = -1.0;
-  int8_t whence;
-  int8_t lastratecheck;
-  int8_t firstratecheck;
+    memcpy (newseg->datasamples, seg->datasamples, headsize);
+    memmove (seg->datasamples, (char *)seg->datasamples + headsize,
+             (size_t)(seg->numsamples - count) * samplesize);
 
-  if (!mstl || !msr)
-  {
-    ms_log (2, "Required argument not defined: 'mstl' or 'msr'\n");
-    return NULL;
+    newseg->datasize   = headsize;
+    newseg->numsamples = count;
+    seg->numsamples -= count;
+
+    return 0;
   }
 
-  /* Calculate end time for MS3Record */
-  if ((endtime = msr3_endtime (msr)) == NSTERROR)
+  /* Find the chunk containing the first sample after the split */
+  for (chunk = seg->chunks; chunk && skipped + chunk->numsamples <= count; chunk = chunk->next)
   {
-    ms_log (2, "Error calculating record end time\n");
-    return NULL;
+    skipped += chunk->numsamples;
+    prevchunk = chunk;
   }
 
-  /* Search for matching trace ID */
-  id = mstl3_findID (mstl,
-                     msr->sid,
-                     (splitversion) ? msr->pubversion : 0,
-                     previd);
+  if (!chunk)
+  {
+    ms_log (2, "Sample chunks do not contain %" PRId64 " samples\n", seg->numsamples);
+    return -1;
+  }
 
-  /* If no matching ID was found create new MS3TraceID and MS3TraceSeg entries */
-  if (!id)
+  /* Allocate a chunk for the first samples of a chunk spanning the split */
+  if (skipped < count)
   {
-    if (!(id = (MS3TraceID *)libmseed_memory.malloc (sizeof (MS3TraceID))))
+    headsize = (size_t)(count - skipped) * samplesize;
+    tailsize = (size_t)chunk->numsamples * samplesize - headsize;
+
+    if (!(head = (MS3SampleChunk *)libmseed_memory.malloc (sizeof (MS3SampleChunk))) ||
+        !(head->datasamples = libmseed_memory.malloc (headsize)) ||
+        (chunk->mapped && !(tail = libmseed_memory.malloc (tailsize))))
     {
       ms_log (2, "Error allocating memory\n");
-      return NULL;
+      if (head && head->datasamples)
+        libmseed_memory.free (head->datasamples);
+      if (head)
+        libmseed_memory.free (head);
+      return -1;
     }
-    memset (id, 0, sizeof (MS3TraceID));
 
-    /* Populate MS3TraceID */
-    memcpy (id->sid, msr->sid, sizeof(id->sid));
-    id->pubversion = msr->pubversion;
-    id->earliest = msr->starttime;
-    id->latest = endtime;
-    id->numsegments = 1;
+    head->datasize   = headsize;
+    head->numsamples = count - skipped;
+    head->mapped     = 0;
+    head->prvtptr    = NULL;
+    head->next       = NULL;
+    memcpy (head->datasamples, chunk->datasamples, headsize);
 
-    if (!(seg = mstl3_msr2seg (msr, endtime)))
+    /* Samples of a chunk mapped from a spill file are read-only, copy the remainder */
+    if (chunk->mapped)
     {
-      return NULL;
+      memcpy (tail, (char *)chunk->datasamples + headsize, tailsize);
+      mstl3_free_chunkdata (chunk);
+      chunk->datasamples = tail;
+      chunk->datasize = tailsize;
     }
-    id->first = id->last = seg;
-
-    /* Add MS3RecordPtr if requested */
-    if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 1)))
+    else
     {
-      return NULL;
+      memmove (chunk->datasamples, (char *)chunk->datasamples + headsize, tailsize);
     }
 
-    /* Add new MS3TraceID to MS3TraceList */
-    if (mstl3_addID (mstl, id, previd) == NULL)
-    {
-      ms_log (2, "Error adding new ID to trace list\n");
-      return NULL;
-    }
+    chunk->numsamples -= head->numsamples;
   }
-  /* Add data coverage to the matching MS3TraceID */
-  else
+
+  /* Move the chunks before the split */
+  if (prevchunk)
   {
-    /* Calculate high-precision sample period, handling different rate notations */
-    if (msr->samprate > 0.0)
-      nsdelta = (nstime_t) (NSTMODULUS / msr->samprate); /* samples/second */
-    else if (msr->samprate < 0.0)
-      nsdelta = (nstime_t) (NSTMODULUS * -msr->samprate); /* period */
-    else
-      nsdelta = 0;
+    newseg->chunks = seg->chunks;
+    newseg->lastchunk = prevchunk;
+    prevchunk->next = NULL;
+    seg->chunks = chunk;
+  }
 
-    /* Calculate high-precision time tolerance */
-    if (tolerance && tolerance->time)
-      nstimetol = (nstime_t) (NSTMODULUS * tolerance->time (msr));
+  if (head)
+  {
+    if (newseg->lastchunk)
+      newseg->lastchunk->next = head;
     else
-      nstimetol = (nstime_t) (0.5 * nsdelta); /* Default time tolerance is 1/2 sample period */
+      newseg->chunks = head;
+
+    newseg->lastchunk = head;
+  }
 
-    nnstimetol = (nstimetol) ? -nstimetol : 0;
+  newseg->numsamples = count;
+  seg->numsamples -= count;
 
-    /* Calculate sample rate tolerance */
-    if (tolerance && tolerance->samprate)
-      sampratetol = tolerance->samprate (msr);
+  return 0;
+} /* End of mstl3_split_samples() */
 
-    sampratehz = msr3_sampratehz(msr);
+/**********************************************************************/ /**
+ * @brief Merge the contents of one ::MS3TraceList into another
+ *
+ * The trace IDs of \a *ppsrc are added to \a dst in source identifier
+ * order and their segments are moved into the segment lists of the
+ * matching IDs of \a dst.  Segments, their data samples and @ref
+ * record-list are moved, not copied, except when two segments with
+ * contiguous sample buffers are joined.  Chunked samples (see
+ * ::MSF_SAMPLECHUNKS) are always linked without copying.
+ *
+ * A moved segment is joined with a segment of \a dst that it follows
+ * within the time and sample rate tolerances, the same rules used by
+ * mstl3_addmsr() to add a record to the end of a segment.  If \a
+ * autoheal is true, a segment that then also abuts the following
+ * segment is joined with it.  For a source list built from records
+ * that are contiguous with the data of \a dst, e.g. the second half
+ * of a file read separately, the result is the same as adding all
+ * records to one list.
+ *
+ * The \a tolerance functions are called with an ::MS3Record populated
+ * with the source identifier, publication version, start time,
+ * sample rate and sample count of each moved segment.
+ *
+ * Both lists must either use an arena (see mstl3_init_arena()) or
+ * not; the arena blocks of the source list are transferred to \a dst.
+ * The source list is freed in all cases and \a *ppsrc set to NULL.
+ * Private data of segments is moved, private data of source trace
+ * IDs is moved only for IDs not already in \a dst and otherwise left
+ * to the caller.
+ *
+ * The segments of different trace IDs are independent.  If \a dst is
+ * a concurrent list (see mstl3_set_concurrent()) the segments of
+ * existing IDs are moved by multiple threads, each merging all
+ * segments of one ID at a time, and the \a tolerance functions and
+ * the ::libmseed_memory functions must be thread-safe.  Not threaded
+ * on Windows.
+ *
+ * The merge is deterministic: the result only depends on the contents
+ * of the two lists, not on the number of threads.
+ *
+ * @param[in] dst Destination ::MS3TraceList
+ * @param[in] ppsrc Pointer-to-pointer to source ::MS3TraceList, freed
+ * @param[in] splitversion Flag to control splitting of version/quality, see mstl3_addmsr()
+ * @param[in] autoheal Flag to control joining of segments that fit between others
+ * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
+ *
+ * @returns 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+mstl3_merge (MS3TraceList *dst, MS3TraceList **ppsrc, int8_t splitversion, int8_t autoheal,
+             const MS3Tolerance *tolerance)
+{
+  MS3TraceID *previd[MSTRACEID_SKIPLIST_HEIGHT] = {NULL};
+  struct MS3MergeShare share;
+  MS3TraceList *src;
+  MS3TraceID *srcid;
+  MS3TraceID *id;
+  void *block;
+#if !defined(LMP_WIN)
+  pthread_t tids[MSTL_MERGE_THREADS - 1];
+  int started = 0;
+  int idx;
+#endif
+
+  if (!dst || !ppsrc || !*ppsrc)
+  {
+    ms_log (2, "Required argument not defined: 'dst' or 'ppsrc'\n");
+    return -1;
+  }
 
-    /* last/firstgap are negative when the record overlaps the trace
-     * segment and positive when there is a time gap. */
+  src = *ppsrc;
 
-    /* Gap relative to the last segment */
-    lastgap = msr->starttime - id->last->endtime - nsdelta;
+  if ((dst->arena == NULL) != (src->arena == NULL))
+  {
+    ms_log (2, "Cannot merge trace lists, only one uses an arena\n");
+    return -1;
+  }
 
-    /* Gap relative to the first segment */
-    firstgap = id->first->starttime - endtime - nsdelta;
+  memset (&share, 0, sizeof (struct MS3MergeShare));
+  share.dst       = dst;
+  share.autoheal  = autoheal;
+  share.tolerance = tolerance;
 
-    /* Sample rate tolerance checks for first and last segments */
-    if (tolerance && tolerance->samprate)
-    {
-      lastratecheck = (sampratetol < 0.0 || ms_dabs (sampratehz - id->last->samprate) > sampratetol) ? 0 : 1;
-      firstratecheck = (sampratetol < 0.0 || ms_dabs (sampratehz - id->first->samprate) > sampratetol) ? 0 : 1;
-    }
-    else
-    {
-      lastratecheck = MS_ISRATETOLERABLE (sampratehz, id->last->samprate);
-      firstratecheck = MS_ISRATETOLERABLE (sampratehz, id->first->samprate);
-    }
+  if (src->numtraceids > 0 &&
+      (!(share.ids = (MS3TraceID **)libmseed_memory.malloc (src->numtraceids * sizeof (MS3TraceID *))) ||
+       !(share.srcids = (MS3TraceID **)libmseed_memory.malloc (src->numtraceids * sizeof (MS3TraceID *)))))
+  {
+    ms_log (2, "Error allocating memory\n");
+    share.rv = -1;
+  }
+
+  /* Add new IDs and collect the existing IDs receiving segments, in source order */
+  for (srcid = src->traces.next[0]; srcid && share.rv == 0; srcid = srcid->next[0])
+  {
+    if (!srcid->first)
+      continue;
+
+    if (srcid->segindex)
+      mstl3_free_segindex (src, srcid);
 
-    /* Search first for the simple scenarios in order of likelihood:
-     * - Record fits at end of last segment
-     * - Record fits after all coverage
-     * - Record fits before all coverage
-     * - Record fits at beginning of first segment
-     *
-     * If none of those scenarios are true search the complete segment list.
-     */
+    id = mstl3_findID (dst, srcid->sid, (splitversion) ? srcid->pubversion : 0, previd);
 
-    /* Record coverage fits at end of last segment */
-    if (lastgap <= nstimetol && lastgap >= nnstimetol && lastratecheck)
+    /* Move all segments to a new ID */
+    if (!id)
     {
-      if (!mstl3_addmsrtoseg (id->last, msr, endtime, 1))
-        return NULL;
+      if (!(id = mstl3_alloc_ID (dst, lm_random_height (MSTRACEID_SKIPLIST_HEIGHT, &(dst->prngstate)))) ||
+          !(id->sid = mstl3_intern_sid (dst, srcid->sid)))
+      {
+        ms_log (2, "Error allocating memory\n");
+        share.rv = -1;
+        break;
+      }
 
-      seg = id->last;
+      id->pubversion  = srcid->pubversion;
+      id->earliest    = srcid->earliest;
+      id->latest      = srcid->latest;
+      id->first       = srcid->first;
+      id->last        = srcid->last;
+      id->numsegments = srcid->numsegments;
+      id->prvtptr     = srcid->prvtptr;
 
-      if (endtime > id->latest)
-        id->latest = endtime;
+      srcid->first = srcid->last = NULL;
+      srcid->numsegments = 0;
+      srcid->prvtptr = NULL;
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 1)))
-        return NULL;
+      if (mstl3_addID (dst, id, previd) == NULL)
+      {
+        ms_log (2, "Error adding new ID to trace list\n");
+        share.rv = -1;
+        break;
+      }
+
+      if (!id->segindex && id->numsegments >= MSTL_SEGINDEX_MINSEGMENTS)
+        mstl3_build_segindex (dst, id);
     }
-    /* Record coverage is after all other coverage */
-    else if ((msr->starttime - nsdelta - nstimetol) > id->latest)
+    /* Segments are moved into the time-ordered list of an existing ID below */
+    else
     {
-      if (!(seg = mstl3_msr2seg (msr, endtime)))
-        return NULL;
+      if (id->segindex)
+        mstl3_free_segindex (dst, id);
 
-      /* Add to end of list */
-      id->last->next = seg;
-      seg->prev = id->last;
-      id->last = seg;
-      id->numsegments++;
+      share.ids[share.count]    = id;
+      share.srcids[share.count] = srcid;
+      share.count++;
+    }
+  }
 
-      if (endtime > id->latest)
-        id->latest = endtime;
+  /* Merge into existing IDs, with multiple threads for a concurrent list.
+   * The IDs are independent, so the result does not depend on the threads. */
+  if (share.rv == 0 && share.count > 0)
+  {
+#if !defined(LMP_WIN)
+    if (dst->lock)
+    {
+      pthread_mutex_init (&share.lock, NULL);
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 0)))
-        return NULL;
+      for (started = 0; started < MSTL_MERGE_THREADS - 1 && (uint32_t)started + 1 < share.count; started++)
+      {
+        if (pthread_create (&tids[started], NULL, mstl3_merge_thread, &share))
+          break;
+      }
     }
-    /* Record coverage is before all other coverage */
-    else if ((endtime + nsdelta + nstimetol) < id->earliest)
-    {
-      if (!(seg = mstl3_msr2seg (msr, endtime)))
-        return NULL;
+#endif
 
-      /* Add to beginning of list */
-      id->first->prev = seg;
-      seg->next = id->first;
-      id->first = seg;
-      id->numsegments++;
+    mstl3_merge_thread (&share);
 
-      if (msr->starttime < id->earliest)
-        id->earliest = msr->starttime;
+#if !defined(LMP_WIN)
+    if (dst->lock)
+    {
+      for (idx = 0; idx < started; idx++)
+        pthread_join (tids[idx], NULL);
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 0)))
-        return NULL;
+      pthread_mutex_destroy (&share.lock);
     }
-    /* Record coverage fits at beginning of first segment */
-    else if (firstgap <= nstimetol && firstgap >= nnstimetol && firstratecheck)
-    {
-      if (!mstl3_addmsrtoseg (id->first, msr, endtime, 2))
-        return NULL;
+#endif
+  }
 
-      seg = id->first;
+  if (share.ids)
+    libmseed_memory.free (share.ids);
+  if (share.srcids)
+    libmseed_memory.free (share.srcids);
 
-      if (msr->starttime < id->earliest)
-        id->earliest = msr->starttime;
+  /* Transfer arena blocks holding moved nodes, after the current block of dst */
+  if (src->arena && src->arena->blocks)
+  {
+    for (block = src->arena->blocks; *(void **)block; block = *(void **)block)
+      ;
 
-      /* Add MS3RecordPtr if requested */
-      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 2)))
-        return NULL;
+    if (dst->arena->blocks)
+    {
+      *(void **)block = *(void **)dst->arena->blocks;
+      *(void **)dst->arena->blocks = src->arena->blocks;
     }
-    /* Search complete segment list for matches */
     else
     {
-      searchseg = id->first;
-      segbefore = NULL; /* Find segment that record fits before */
-      segafter  = NULL; /* Find segment that record fits after */
-      followseg = NULL; /* Track segment that record follows in time order */
+      dst->arena->blocks = src->arena->blocks;
+    }
 
-      while (searchseg)
-      {
-        /* Done searching if autohealing and record exactly matches
-         * a segment.
-         *
-         * Rationale: autohealing would have combined this segment
-         * with another if that were possible, so this record will
-         * also not fit with any other segment. */
-        if (autoheal &&
-            msr->starttime == searchseg->starttime &&
-            endtime == searchseg->endtime)
-        {
-          followseg = searchseg;
-          break;
-        }
+    src->arena->blocks = NULL;
+  }
 
-        if (msr->starttime > searchseg->starttime)
-          followseg = searchseg;
+  mstl3_free (ppsrc, 0);
 
-        whence = 0;
+  return share.rv;
+} /* End of mstl3_merge() */
 
-        postgap = msr->starttime - searchseg->endtime - nsdelta;
-        if (!segbefore && postgap <= nstimetol && postgap >= nnstimetol)
-          whence = 1;
+/***************************************************************************
+ * mstl3_merge_thread:
+ *
+ * Merge source trace IDs of a MS3MergeShare into their destination IDs
+ * until none remain or a merge failed.  All source IDs of the same
+ * destination ID are merged by one thread, in source order.  Called by
+ * each merging thread, locking is only used for concurrent lists.
+ ***************************************************************************/
+static void *
+mstl3_merge_thread (void *arg)
+{
+  struct MS3MergeShare *share = (struct MS3MergeShare *)arg;
+  uint32_t first;
+  uint32_t last;
+  uint32_t idx;
+  int rv = 0;
 
-        pregap = searchseg->starttime - endtime - nsdelta;
-        if (!segafter && pregap <= nstimetol && pregap >= nnstimetol)
-          whence = 2;
+  for (;;)
+  {
+#if !defined(LMP_WIN)
+    if (share->dst->lock)
+      pthread_mutex_lock (&share->lock);
+#endif
+    first = share->next;
+    last = first;
+    if (share->rv == 0)
+    {
+      while (last < share->count && share->ids[last] == share->ids[first])
+        last++;
+    }
+    share->next = last;
+#if !defined(LMP_WIN)
+    if (share->dst->lock)
+      pthread_mutex_unlock (&share->lock);
+#endif
 
-        if (!whence)
-        {
-          searchseg = searchseg->next;
-          continue;
-        }
+    if (first == last)
+      break;
 
-        if (tolerance && tolerance->samprate)
-        {
-          if (sampratetol >= 0 && ms_dabs (sampratehz - searchseg->samprate) > sampratetol)
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
-        }
-        else
-        {
-          if (!MS_ISRATETOLERABLE (sampratehz, searchseg->samprate))
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
-        }
+    for (idx = first; idx < last && rv == 0; idx++)
+      rv = mstl3_merge_ID (share->dst, share->ids[idx], share->srcids[idx],
+                           share->autoheal, share->tolerance);
 
-        if (whence == 1)
-          segbefore = searchseg;
-        else
-          segafter = searchseg;
+    if (!share->ids[first]->segindex && share->ids[first]->numsegments >= MSTL_SEGINDEX_MINSEGMENTS)
+      mstl3_build_segindex (share->dst, share->ids[first]);
 
-        /* Done searching if not autohealing */
-        if (!autoheal)
-          break;
+    if (rv)
+    {
+#if !defined(LMP_WIN)
+      if (share->dst->lock)
+        pthread_mutex_lock (&share->lock);
+#endif
+      share->rv = -1;
+#if !defined(LMP_WIN)
+      if (share->dst->lock)
+        pthread_mutex_unlock (&share->lock);
+#endif
+      break;
+    }
+  }
 
-        /* Done searching if both before and after segments are found */
-        if (segbefore && segafter)
-          break;
+  return NULL;
+} /* End of mstl3_merge_thread() */
 
-        searchseg = searchseg->next;
-      } /* Done looping through segments */
+/***************************************************************************
+ * mstl3_merge_ID:
+ *
+ * Move the segments of a source MS3TraceID into the time-ordered
+ * segment list of an existing MS3TraceID, see mstl3_merge().  Only the
+ * node arena of the destination list is shared with other IDs.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl3_merge_ID (MS3TraceList *dst, MS3TraceID *id, MS3TraceID *srcid, int8_t autoheal,
+                const MS3Tolerance *tolerance)
+{
+  MS3TraceSeg *seg;
+  MS3TraceSeg *after = NULL;
+  int rv = 0;
 
-      /* Add MS3Record coverage to end of segment before */
-      if (segbefore)
-      {
-        if (!mstl3_addmsrtoseg (segbefore, msr, endtime, 1))
-        {
-          return NULL;
-        }
+  while ((seg = srcid->first) != NULL)
+  {
+    srcid->first = seg->next;
+    if (srcid->first)
+      srcid->first->prev = NULL;
+    else
+      srcid->last = NULL;
+    srcid->numsegments--;
 
-        /* Add MS3RecordPtr if requested */
-        if (pprecptr && !(*pprecptr = mstl3_add_recordptr (segbefore, msr, endtime, 1)))
-        {
-          return NULL;
-        }
+    seg->prev = seg->next = NULL;
 
-        /* Merge two segments that now fit if autohealing */
-        if (autoheal && segafter && segbefore != segafter)
-        {
-          /* Add segafter coverage to segbefore */
-          if (!mstl3_addsegtoseg (segbefore, segafter))
-          {
-            return NULL;
-          }
+    if (!(after = mstl3_merge_segment (dst, id, after, seg, autoheal, tolerance)))
+    {
+      rv = -1;
+      break;
+    }
+  }
 
-          /* Shift last segment pointer if it's going to be removed */
-          if (segafter == id->last)
-            id->last = id->last->prev;
+  if (srcid->pubversion > id->pubversion)
+    id->pubversion = srcid->pubversion;
 
-          /* Remove segafter from list */
-          if (segafter->prev)
-            segafter->prev->next = segafter->next;
-          if (segafter->next)
-            segafter->next->prev = segafter->prev;
+  if (srcid->earliest < id->earliest)
+    id->earliest = srcid->earliest;
 
-          /* Free data samples, record list, private data and segment structure */
-          if (segafter->datasamples)
-            libmseed_memory.free (segafter->datasamples);
+  if (srcid->latest > id->latest)
+    id->latest = srcid->latest;
 
-          if (segafter->recordlist)
-            libmseed_memory.free (segafter->recordlist);
+  return rv;
+} /* End of mstl3_merge_ID() */
 
-          if (segafter->prvtptr)
-            libmseed_memory.free (segafter->prvtptr);
+/***************************************************************************
+ * mstl3_merge_segment:
+ *
+ * Insert a segment into the time-ordered segment list of a MS3TraceID,
+ * searching forward from the \a after segment if not NULL, and join it
+ * with the previous segment and, if autohealing, the next segment when
+ * they fit within the tolerances.  The time and sample rate tolerances
+ * are determined as in mstl3_addmsr_recordptr().
+ *
+ * Return the segment containing the inserted coverage or NULL on error.
+ ***************************************************************************/
+static MS3TraceSeg *
+mstl3_merge_segment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *after,
+                     MS3TraceSeg *seg, int8_t autoheal, const MS3Tolerance *tolerance)
+{
+  MS3Record msr;
+  MS3TraceSeg *prev;
+  MS3TraceSeg *next;
+  nstime_t nsdelta;
+  nstime_t nstimetol;
+  double sampratetol = -1.0;
+  int8_t ratetol;
+  int8_t joined = 0;
+
+  /* Populate a record with the segment details for the tolerance functions */
+  memset (&msr, 0, sizeof (MS3Record));
+  strncpy (msr.sid, id->sid, sizeof (msr.sid) - 1);
+  msr.pubversion = id->pubversion;
+  msr.starttime  = seg->starttime;
+  msr.samprate   = seg->samprate;
+  msr.samplecnt  = seg->samplecnt;
+  msr.sampletype = seg->sampletype;
+  msr.reclen     = -1;
+
+  nsdelta = (seg->samprate > 0.0) ? (nstime_t) (NSTMODULUS / seg->samprate) : 0;
+
+  if (tolerance && tolerance->time)
+    nstimetol = (nstime_t) (NSTMODULUS * tolerance->time (&msr));
+  else
+    nstimetol = (nstime_t) (0.5 * nsdelta);
 
-          libmseed_memory.free (segafter);
+  if ((ratetol = (tolerance && tolerance->samprate) ? 1 : 0))
+    sampratetol = tolerance->samprate (&msr);
 
-          id->numsegments -= 1;
-        }
+  /* Find the last segment ordered before the new segment */
+  prev = after;
+  while (prev && !MSTL_SEGBEFORE (prev, seg))
+    prev = prev->prev;
 
-        seg = segbefore;
-      }
-      /* Add MS3Record coverage to beginning of segment after */
-      else if (segafter)
-      {
-        if (!mstl3_addmsrtoseg (segafter, msr, endtime, 2))
-        {
-          return NULL;
-        }
+  next = (prev) ? prev->next : id->first;
+  while (next && MSTL_SEGBEFORE (next, seg))
+  {
+    prev = next;
+    next = next->next;
+  }
 
-        /* Add MS3RecordPtr if requested */
-        if (pprecptr && !(*pprecptr = mstl3_add_recordptr (segafter, msr, endtime, 2)))
-        {
-          return NULL;
-        }
+  /* Insert segment between prev and next */
+  seg->prev = prev;
+  seg->next = next;
 
-        seg = segafter;
-      }
-      /* Add MS3Record coverage to new segment */
-      else
-      {
-        /* Create new segment */
-        if (!(seg = mstl3_msr2seg (msr, endtime)))
-        {
-          return NULL;
-        }
+  if (prev)
+    prev->next = seg;
+  else
+    id->first = seg;
 
-        /* Add MS3RecordPtr if requested */
-        if (pprecptr && !(*pprecptr = mstl3_add_recordptr (seg, msr, endtime, 0)))
-        {
-          return NULL;
+  if (next)
+    next->prev = seg;
+  else
+    id->last = seg;
+
+  id->numsegments++;
+
+  /* Join with previous segment if the new segment follows it */
+  if (prev && mstl3_segfollows (prev, seg, nsdelta, nstimetol, sampratetol, ratetol))
+  {
+    if (!mstl3_addsegtoseg (prev, seg))
+      return NULL;
+
+    mstl3_free_joinedseg (mstl, id, seg);
+    seg = prev;
+    joined = 1;
+  }
+
+  /* Join with next segment if autohealing or not already joined */
+  if (next && (autoheal || !joined) &&
+      mstl3_segfollows (seg, next, nsdelta, nstimetol, sampratetol, ratetol))
+  {
+    if (!mstl3_addsegtoseg (seg, next))
+      return NULL;
+
+    mstl3_free_joinedseg (mstl, id, next);
+  }
+
+  return seg;
+} /* End of mstl3_merge_segment() */
+
+/***************************************************************************
+ * mstl3_segfollows:
+ *
+ * Test if \a nextseg follows \a seg within the time tolerance and the
+ * sample rate tolerance if \a ratetol is set, otherwise the default
+ * sample rate tolerance.
+ *
+ * Return 1 if the segment follows, otherwise 0.
+ ***************************************************************************/
+static int
+mstl3_segfollows (const MS3TraceSeg *seg, const MS3TraceSeg *nextseg, nstime_t nsdelta,
+                  nstime_t nstimetol, double sampratetol, int8_t ratetol)
+{
+  nstime_t gap = nextseg->starttime - seg->endtime - nsdelta;
+
+  if (gap > nstimetol || gap < -nstimetol)
+    return 0;
+
+  if (ratetol)
+    return (sampratetol >= 0.0 && ms_dabs (nextseg->samprate - seg->samprate) <= sampratetol) ? 1 : 0;
+
+  return MS_ISRATETOLERABLE (nextseg->samprate, seg->samprate) ? 1 : 0;
+} /* End of mstl3_segfollows() */
+
+/***************************************************************************
+ * mstl3_free_joinedseg:
+ *
+ * Remove a segment whose coverage was added to another segment with
+ * mstl3_addsegtoseg() from the list of a MS3TraceID and free it.  The
+ * record pointers of its record list belong to the other segment.
+ ***************************************************************************/
+static void
+mstl3_free_joinedseg (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg)
+{
+  mstl3_segindex_remove (mstl, id, seg);
+
+  /* Shift first and last segment pointers if removed */
+  if (seg == id->first)
+    id->first = seg->next;
+  if (seg == id->last)
+    id->last = seg->prev;
+
+  /* Remove segment from list */
+  if (seg->prev)
+    seg->prev->next = seg->next;
+  if (seg->next)
+    seg->next->prev = seg->prev;
+
+  /* Free data samples, record list, private data and segment structure */
+  mstl3_free_samples (seg, 1);
+
+  if (seg->recordlist)
+    mstl3_free_node (mstl, MSTL_NODE_RECORDLIST, seg->recordlist);
+
+  if (seg->prvtptr)
+    libmseed_memory.free (seg->prvtptr);
+
+  mstl3_free_node (mstl, MSTL_NODE_SEG, seg);
+
+  id->numsegments -= 1;
+} /* End of mstl3_free_joinedseg() */
+
+/***************************************************************************
+ * mstl3_free_recordlist:
+ *
+ * Free a record list, the duplicated records and, if requested, the
+ * private data of its record pointers.  Nodes allocated from an arena
+ * are returned to the arena.
+ ***************************************************************************/
+static void
+mstl3_free_recordlist (MS3TraceList *mstl, MS3RecordList *recordlist, int8_t freeprvtptr)
+{
+  MS3RecordPtr *recordptr;
+  MS3RecordPtr *nextrecordptr;
+
+  recordptr = recordlist->first;
+  while (recordptr)
+  {
+    nextrecordptr = recordptr->next;
+
+    if (recordptr->msr)
+    {
+      if (mstl->arena)
+      {
+        if (recordptr->msr->extra)
+          libmseed_memory.free (recordptr->msr->extra);
+        if (recordptr->msr->datasamples)
+          libmseed_memory.free (recordptr->msr->datasamples);
+
+        mstl3_free_node (mstl, MSTL_NODE_RECORD, recordptr->msr);
+      }
+      else
+      {
+        msr3_free (&recordptr->msr);
+      }
+    }
+
+    if (freeprvtptr && recordptr->prvtptr)
+      libmseed_memory.free (recordptr->prvtptr);
+
+    mstl3_free_node (mstl, MSTL_NODE_RECORDPTR, recordptr);
+
+    recordptr = nextrecordptr;
+  }
+
+  mstl3_free_node (mstl, MSTL_NODE_RECORDLIST, recordlist);
+} /* End of mstl3_free_recordlist() */
+
+/**********************************************************************/ /**
+ * @brief Find matching ::MS3TraceID in a ::MS3TraceList
+ *
+ * Return the ::MS3TraceID matching the \a sid in the specified ::MS3TraceList.
+ *
+ * If \a prev is not NULL, set pointers to previous entries for the
+ * expected location of the trace ID.  Useful for adding a new ID
+ * with mstl3_addID(), and should be set to \a NULL otherwise.  The
+ * \a prev pointers are only set when no matching ID is found.
+ *
+ * IDs are found through a hash index of the list and the most
+ * recently found ID is checked first.  The skip list is only searched
+ * when \a prev pointers are requested or when \a pubversion is zero
+ * and a SID is present in the list with multiple versions.
+ *
+ * @param[in] mstl Pointer to the ::MS3TraceList to search
+ * @param[in] sid Source ID to search for in the list
+ * @param[in] pubversion If non-zero, find the entry with this version
+ * @param[out] prev Pointers to previous entries in expected location or NULL
+ *
+ * @returns a pointer to the matching ::MS3TraceID or NULL if not found or error.
+ ***************************************************************************/
+MS3TraceID *
+mstl3_findID (MS3TraceList *mstl, const char *sid, uint8_t pubversion, MS3TraceID **prev)
+{
+  struct MS3TraceIDIndex *index;
+  MS3TraceID *id = NULL;
+  uint32_t slot;
+  int level;
+  int cmp;
+
+  if (!mstl || !sid)
+  {
+    ms_log (2, "Required argument not defined: 'mstl' or 'sid'\n");
+    return NULL;
+  }
+
+  /* Search the hash index unless any version may match one of several */
+  index = mstl->idindex;
+  if (index && (pubversion || !index->multiversion))
+  {
+    /* Consecutive searches are usually for the same ID */
+    id = index->lasthit;
+    if (id && (!pubversion || id->pubversion == pubversion) && !strcmp (id->sid, sid))
+      return id;
+
+    slot = mstl3_sidhash (sid) & (index->size - 1);
+    while ((id = index->slots[slot]) != NULL)
+    {
+      if ((!pubversion || id->pubversion == pubversion) && !strcmp (id->sid, sid))
+      {
+        /* Shared by concurrent searches and not updated */
+        if (!mstl->lock)
+          index->lasthit = id;
+        return id;
+      }
+
+      slot = (slot + 1) & (index->size - 1);
+    }
+
+    /* Not present, search skip list only for expected location */
+    if (!prev)
+      return NULL;
+  }
+
+  level = MSTRACEID_SKIPLIST_HEIGHT - 1;
+
+  /* Search trace ID skip list, starting from the head/sentinel node */
+  id = &(mstl->traces);
+  while (id != NULL && level >= 0)
+  {
+    if (prev != NULL) /* Track previous entries at each level */
+    {
+      prev[level] = id;
+    }
+
+    if (id->next[level] == NULL)
+    {
+      level -= 1;
+    }
+    else
+    {
+      cmp = strcmp(id->next[level]->sid, sid);
+
+      /* If source IDs match, check publication if matching requested */
+      if (!cmp && pubversion && id->next[level]->pubversion != pubversion)
+      {
+        cmp = (id->next[level]->pubversion < pubversion) ? -1 : 1;
+      }
+
+      if (cmp == 0) /* Found matching trace ID */
+      {
+        if (index && !mstl->lock)
+          index->lasthit = id->next[level];
+
+        return id->next[level];
+      }
+      else if (cmp > 0) /* Drop a level */
+      {
+        level -= 1;
+      }
+      else /* Continue at this level */
+      {
+        id = id->next[level];
+      }
+    }
+  }
+
+  return NULL;
+} /* End of mstl3_findID() */
+
+/**********************************************************************/ /**
+ * @brief Add ::MS3TraceID to a ::MS3TraceList
+ *
+ * The \a prev array is the list of pointers to previous entries at different
+ * levels of the skip list.  It is common to first search the list using
+ * mstl3_findID() which returns this list of pointers for use here.
+ * If this value is NULL mstl3_findID() will be run to find the pointers.
+ *
+ * The \a id must be allocated with mstl3_alloc_ID(), which sets the
+ * skip list height and pointers, and its \a sid copied to the list
+ * with mstl3_intern_sid().
+ *
+ * @param[in] mstl Add ID to this ::MS3TraceList
+ * @param[in] id The ::MS3TraceID to add
+ * @param[in] prev Pointers to previous entries in expected location, can be NULL
+ *
+ * @returns a pointer to the added ::MS3TraceID or NULL on error.
+ *
+ * \sa mstl3_findID()
+ ***************************************************************************/
+MS3TraceID *
+mstl3_addID (MS3TraceList *mstl, MS3TraceID *id, MS3TraceID **prev)
+{
+  MS3TraceID *local_prev[MSTRACEID_SKIPLIST_HEIGHT] = {NULL};
+  int level;
+
+  if (!mstl || !id)
+  {
+    ms_log (2, "Required argument not defined: 'mstl' or 'id'\n");
+    return NULL;
+  }
+
+  /* If previous list pointers not supplied, find them */
+  if (!prev)
+  {
+    mstl3_findID (mstl, id->sid, 0, local_prev);
+    prev = local_prev;
+  }
+
+  /* Connect previous and new ID pointers */
+  for (level = id->height - 1;
+       level >= 0;
+       level--)
+  {
+    if (!prev[level])
+    {
+      ms_log (2, "No previous pointer at level %d for adding SID %s\n",
+              level, id->sid);
+      return NULL;
+    }
+
+    id->next[level] = prev[level]->next[level];
+    prev[level]->next[level] = id;
+  }
+
+  mstl->numtraceids++;
+
+  if (mstl3_indexID (mstl, id))
+    return NULL;
+
+  return id;
+} /* End of mstl3_addID() */
+
+
+/**********************************************************************/ /**
+ * @brief Add data coverage from an ::MS3Record to a ::MS3TraceList
+ *
+ * Searching the list for the appropriate ::MS3TraceID and
+ * ::MS3TraceSeg and either add data to existing entries or create new
+ * ones as needed.
+ *
+ * As this routine adds data to a trace list it constructs continuous
+ * time series, merging segments when possible.  The \a tolerance
+ * pointer to a ::MS3Tolerance identifies function pointers that are
+ * expected to return time tolerace, in seconds, and sample rate
+ * tolerance, in Hertz, for the given ::MS3Record.  If \a tolerance is
+ * NULL, or the function pointers it identifies are NULL, default
+ * tolerances will be used as follows: - Default time tolerance is 1/2
+ * the sampling period - Default sample rate (sr) tolerance is
+ * abs(1‐sr1/sr2) < 0.0001
+ *
+ * In recommended usage, the \a splitversion flag is \b 0 and
+ * different publication versions of otherwise matching data are
+ * merged.  If more than one version contributes to a given source
+ * identifer's segments, its ::MS3TraceID.pubversion will be the set to
+ * the largest contributing version.  If the \a splitversion flag is
+ * \b 1 the publication versions will be kept separate with each
+ * version isolated in separate ::MS3TraceID entries.
+ *
+ * If the \a autoheal flag is true, extra processing is invoked to
+ * conjoin trace segments that fit together after the ::MS3Record
+ * coverage is added.  For segments that are removed, any memory at
+ * the ::MS3TraceSeg.prvtptr will be freed.
+ *
+ * If the ::MSF_UNPACKDATA flag is set in \a flags and the data
+ * samples of \a msr have not been unpacked, the encoded data in
+ * ::MS3Record.record are decoded directly into the sample buffer of
+ * the target ::MS3TraceSeg, avoiding an intermediate copy.  This
+ * allows records to be parsed without ::MSF_UNPACKDATA and only
+ * decoded when added to a list.  If ::MS3Record.record is not set
+ * only the coverage is added, the same as without the flag.
+ *
+ * If the \a pprecptr is not NULL a @ref record-list will be
+ * maintained for each segment.  If the value of \c *pprecptr is NULL,
+ * a new ::MS3RecordPtr will be allocated, otherwise the supplied
+ * structure will be updated.  The ::MS3RecordPtr will be added to the
+ * appropriate record list and the values of ::MS3RecordPtr.msr and
+ * ::MS3RecordPtr.endtime will be set, all other fields should be set
+ * by the caller.
+ *
+ * The lists are always maintained in a sorted order.  An
+ * ::MS3TraceList is maintained with the ::MS3TraceID entries in
+ * ascending alphanumeric order of SID. If repeated SIDs are present
+ * due to splitting on publication version, they are maintained in
+ * order of ascending version.  A ::MS3TraceID is always maintained
+ * with ::MS3TraceSeg entries in data time time order.
+ *
+ * @param[in] mstl Destination ::MS3TraceList to add data to
+ * @param[in] msr ::MS3Record containing the data to add to list
+ * @param[in] pprecptr Pointer to pointer to a ::MS3RecordPtr for @ref record-list
+ * @param[in] splitversion Flag to control splitting of version/quality
+ * @param[in] autoheal Flag to control automatic merging of segments
+ * @param[in] flags Flags to control optional functionality
+ * @parblock
+ *  - \c ::MSF_UNPACKDATA : Decode data samples of \a msr directly into the segment
+ * @endparblock
+ * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
+ *
+ * @returns a pointer to the ::MS3TraceSeg updated or NULL on error.
+ *
+ * \sa mstl3_readbuffer()
+ * \sa ms3_readtracelist()
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+MS3TraceSeg *
+mstl3_addmsr_recordptr (MS3TraceList *mstl, const MS3Record *msr, MS3RecordPtr **pprecptr,
+                        int8_t splitversion, int8_t autoheal, uint32_t flags,
+                        const MS3Tolerance *tolerance)
+{
+  MS3TraceID *id = 0;
+  MS3TraceID *previd[MSTRACEID_SKIPLIST_HEIGHT] = {NULL};
+  MS3TraceSeg *seg = 0;
+  nstime_t endtime;
+  uint8_t pubversion;
+
+  if (!mstl || !msr)
+  {
+    ms_log (2, "Required argument not defined: 'mstl' or 'msr'\n");
+    return NULL;
+  }
+
+  /* Calculate end time for MS3Record */
+  if ((endtime = msr3_endtime (msr)) == NSTERROR)
+  {
+    ms_log (2, "Error calculating record end time\n");
+    return NULL;
+  }
+
+  pubversion = (splitversion) ? msr->pubversion : 0;
+
+  /* Search for matching trace ID, in a concurrent list under a shared
+   * lock and only in the hash index */
+  mstl3_lock_list (mstl, 0);
+  id = mstl3_findID (mstl, msr->sid, pubversion, (mstl->lock) ? NULL : previd);
+  mstl3_unlock_list (mstl);
+
+  /* Search again under an exclusive lock, the ID may have been added by
+   * another thread, and keep the lock to add the ID if not found */
+  if (!id && mstl->lock)
+  {
+    mstl3_lock_list (mstl, 1);
+
+    if ((id = mstl3_findID (mstl, msr->sid, pubversion, previd)) != NULL)
+      mstl3_unlock_list (mstl);
+  }
+
+  /* If no matching ID was found create new MS3TraceID and MS3TraceSeg entries */
+  if (!id)
+  {
+    seg = mstl3_addmsr_newID (mstl, msr, endtime, previd, pprecptr, flags);
+    mstl3_unlock_list (mstl);
+
+    return seg;
+  }
+
+  /* Add data coverage to the matching MS3TraceID */
+  mstl3_lock_ID (mstl, id);
+  seg = mstl3_addmsr_toID (mstl, id, msr, endtime, pprecptr, autoheal, flags, tolerance);
+  mstl3_unlock_ID (mstl, id);
+
+  return seg;
+} /* End of mstl3_addmsr_recordptr() */
+
+/***************************************************************************
+ * mstl3_addmsr_newID:
+ *
+ * Create a MS3TraceID with a MS3TraceSeg for the coverage of a
+ * MS3Record and add it to a MS3TraceList at the location identified
+ * by the \a previd pointers, see mstl3_findID().
+ *
+ * Return a pointer to the new MS3TraceSeg or NULL on error.
+ ***************************************************************************/
+static MS3TraceSeg *
+mstl3_addmsr_newID (MS3TraceList *mstl, const MS3Record *msr, nstime_t endtime,
+                    MS3TraceID **previd, MS3RecordPtr **pprecptr, uint32_t flags)
+{
+  MS3TraceID *id = 0;
+  MS3TraceSeg *seg = 0;
+
+  if (!(id = mstl3_alloc_ID (mstl, lm_random_height (MSTRACEID_SKIPLIST_HEIGHT, &(mstl->prngstate)))) ||
+      !(id->sid = mstl3_intern_sid (mstl, msr->sid)))
+  {
+    ms_log (2, "Error allocating memory\n");
+    return NULL;
+  }
+
+  /* Populate MS3TraceID */
+  id->pubversion = msr->pubversion;
+  id->earliest = msr->starttime;
+  id->latest = endtime;
+  id->numsegments = 1;
+
+  if (!(seg = mstl3_msr2seg (mstl, msr, endtime, flags)))
+  {
+    return NULL;
+  }
+  id->first = id->last = seg;
+
+  /* Add MS3RecordPtr if requested */
+  if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, seg, msr, endtime, 1)))
+  {
+    return NULL;
+  }
+
+  /* Add new MS3TraceID to MS3TraceList */
+  if (mstl3_addID (mstl, id, previd) == NULL)
+  {
+    ms_log (2, "Error adding new ID to trace list\n");
+    return NULL;
+  }
+
+  return seg;
+} /* End of mstl3_addmsr_newID() */
+
+/***************************************************************************
+ * mstl3_addmsr_toID:
+ *
+ * Add the coverage of a MS3Record to the segments of a matching
+ * MS3TraceID, see mstl3_addmsr_recordptr() for details.
+ *
+ * Return a pointer to the MS3TraceSeg updated or NULL on error.
+ ***************************************************************************/
+static MS3TraceSeg *
+mstl3_addmsr_toID (MS3TraceList *mstl, MS3TraceID *id, const MS3Record *msr, nstime_t endtime,
+                   MS3RecordPtr **pprecptr, int8_t autoheal, uint32_t flags,
+                   const MS3Tolerance *tolerance)
+{
+  MS3TraceSeg *seg = 0;
+  MS3TraceSeg *searchseg = 0;
+  MS3TraceSeg *segbefore = 0;
+  MS3TraceSeg *segafter = 0;
+  MS3TraceSeg *followseg = 0;
+
+  nstime_t segendtime;
+  nstime_t pregap;
+  nstime_t postgap;
+  nstime_t lastgap;
+  nstime_t firstgap;
+  nstime_t nsdelta;
+  nstime_t nstimetol = 0;
+  nstime_t nnstimetol = 0;
+
+  double sampratehz;
+  double sampratetol = -1.0;
+  int8_t whence;
+  int8_t lastratecheck;
+  int8_t firstratecheck;
+
+  /* Calculate high-precision sample period, handling different rate notations */
+  if (msr->samprate > 0.0)
+    nsdelta = (nstime_t) (NSTMODULUS / msr->samprate); /* samples/second */
+  else if (msr->samprate < 0.0)
+    nsdelta = (nstime_t) (NSTMODULUS * -msr->samprate); /* period */
+  else
+    nsdelta = 0;
+
+  /* Calculate high-precision time tolerance */
+  if (tolerance && tolerance->time)
+    nstimetol = (nstime_t) (NSTMODULUS * tolerance->time (msr));
+  else
+    nstimetol = (nstime_t) (0.5 * nsdelta); /* Default time tolerance is 1/2 sample period */
+
+  nnstimetol = (nstimetol) ? -nstimetol : 0;
+
+  /* Calculate sample rate tolerance */
+  if (tolerance && tolerance->samprate)
+    sampratetol = tolerance->samprate (msr);
+
+  sampratehz = msr3_sampratehz(msr);
+
+  /* last/firstgap are negative when the record overlaps the trace
+   * segment and positive when there is a time gap. */
+
+  /* Gap relative to the last segment */
+  lastgap = msr->starttime - id->last->endtime - nsdelta;
+
+  /* Gap relative to the first segment */
+  firstgap = id->first->starttime - endtime - nsdelta;
+
+  /* Sample rate tolerance checks for first and last segments */
+  if (tolerance && tolerance->samprate)
+  {
+    lastratecheck = (sampratetol < 0.0 || ms_dabs (sampratehz - id->last->samprate) > sampratetol) ? 0 : 1;
+    firstratecheck = (sampratetol < 0.0 || ms_dabs (sampratehz - id->first->samprate) > sampratetol) ? 0 : 1;
+  }
+  else
+  {
+    lastratecheck = MS_ISRATETOLERABLE (sampratehz, id->last->samprate);
+    firstratecheck = MS_ISRATETOLERABLE (sampratehz, id->first->samprate);
+  }
+
+  /* Search first for the simple scenarios in order of likelihood:
+   * - Record fits at end of last segment
+   * - Record fits after all coverage
+   * - Record fits before all coverage
+   * - Record fits at beginning of first segment
+   *
+   * If none of those scenarios are true search the complete segment list.
+   */
+
+  /* Record coverage fits at end of last segment */
+  if (lastgap <= nstimetol && lastgap >= nnstimetol && lastratecheck)
+  {
+    if (!mstl3_addmsrtoseg (mstl, id, id->last, msr, endtime, 1, flags))
+      return NULL;
+
+    seg = id->last;
+
+    if (endtime > id->latest)
+      id->latest = endtime;
+
+    /* Add MS3RecordPtr if requested */
+    if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, seg, msr, endtime, 1)))
+      return NULL;
+  }
+  /* Record coverage is after all other coverage */
+  else if ((msr->starttime - nsdelta - nstimetol) > id->latest)
+  {
+    if (!(seg = mstl3_msr2seg (mstl, msr, endtime, flags)))
+      return NULL;
+
+    /* Add to end of list */
+    id->last->next = seg;
+    seg->prev = id->last;
+    id->last = seg;
+    id->numsegments++;
+    mstl3_segindex_add (mstl, id, seg);
+
+    if (endtime > id->latest)
+      id->latest = endtime;
+
+    /* Add MS3RecordPtr if requested */
+    if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, seg, msr, endtime, 0)))
+      return NULL;
+  }
+  /* Record coverage is before all other coverage */
+  else if ((endtime + nsdelta + nstimetol) < id->earliest)
+  {
+    if (!(seg = mstl3_msr2seg (mstl, msr, endtime, flags)))
+      return NULL;
+
+    /* Add to beginning of list */
+    id->first->prev = seg;
+    seg->next = id->first;
+    id->first = seg;
+    id->numsegments++;
+    mstl3_segindex_add (mstl, id, seg);
+
+    if (msr->starttime < id->earliest)
+      id->earliest = msr->starttime;
+
+    /* Add MS3RecordPtr if requested */
+    if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, seg, msr, endtime, 0)))
+      return NULL;
+  }
+  /* Record coverage fits at beginning of first segment */
+  else if (firstgap <= nstimetol && firstgap >= nnstimetol && firstratecheck)
+  {
+    if (!mstl3_addmsrtoseg (mstl, id, id->first, msr, endtime, 2, flags))
+      return NULL;
+
+    seg = id->first;
+
+    if (msr->starttime < id->earliest)
+      id->earliest = msr->starttime;
+
+    /* Add MS3RecordPtr if requested */
+    if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, seg, msr, endtime, 2)))
+      return NULL;
+  }
+  /* Search complete segment list for matches */
+  else
+  {
+    searchseg = id->first;
+    segbefore = NULL; /* Find segment that record fits before */
+    segafter  = NULL; /* Find segment that record fits after */
+    followseg = NULL; /* Track segment that record follows in time order */
+
+    /* Search the segment index instead of the list when a record
+     * cannot fit both before and after the same segment */
+    if (id->segindex && nstimetol >= 0 && nstimetol < nsdelta)
+    {
+      mstl3_segindex_find (id, msr, endtime, nsdelta, nstimetol, autoheal,
+                           sampratehz, sampratetol, (tolerance && tolerance->samprate) ? 1 : 0,
+                           &segbefore, &segafter, &followseg);
+      searchseg = NULL;
+    }
+
+    while (searchseg)
+    {
+      /* Done searching if autohealing and record exactly matches
+       * a segment.
+       *
+       * Rationale: autohealing would have combined this segment
+       * with another if that were possible, so this record will
+       * also not fit with any other segment. */
+      if (autoheal &&
+          msr->starttime == searchseg->starttime &&
+          endtime == searchseg->endtime)
+      {
+        followseg = searchseg;
+        break;
+      }
+
+      if (msr->starttime > searchseg->starttime)
+        followseg = searchseg;
+
+      whence = 0;
+
+      postgap = msr->starttime - searchseg->endtime - nsdelta;
+      if (!segbefore && postgap <= nstimetol && postgap >= nnstimetol)
+        whence = 1;
+
+      pregap = searchseg->starttime - endtime - nsdelta;
+      if (!segafter && pregap <= nstimetol && pregap >= nnstimetol)
+        whence = 2;
+
+      if (!whence)
+      {
+        searchseg = searchseg->next;
+        continue;
+      }
+
+      if (tolerance && tolerance->samprate)
+      {
+        if (sampratetol >= 0 && ms_dabs (sampratehz - searchseg->samprate) > sampratetol)
+        {
+          searchseg = searchseg->next;
+          continue;
+        }
+      }
+      else
+      {
+        if (!MS_ISRATETOLERABLE (sampratehz, searchseg->samprate))
+        {
+          searchseg = searchseg->next;
+          continue;
+        }
+      }
+
+      if (whence == 1)
+        segbefore = searchseg;
+      else
+        segafter = searchseg;
+
+      /* Done searching if not autohealing */
+      if (!autoheal)
+        break;
+
+      /* Done searching if both before and after segments are found */
+      if (segbefore && segafter)
+        break;
+
+      searchseg = searchseg->next;
+    } /* Done looping through segments */
+
+    /* Add MS3Record coverage to end of segment before */
+    if (segbefore)
+    {
+      if (!mstl3_addmsrtoseg (mstl, id, segbefore, msr, endtime, 1, flags))
+      {
+        return NULL;
+      }
+
+      /* Add MS3RecordPtr if requested */
+      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, segbefore, msr, endtime, 1)))
+      {
+        return NULL;
+      }
+
+      /* Merge two segments that now fit if autohealing */
+      if (autoheal && segafter && segbefore != segafter)
+      {
+        /* Add segafter coverage to segbefore */
+        segendtime = segbefore->endtime;
+        if (!mstl3_addsegtoseg (segbefore, segafter))
+        {
+          return NULL;
+        }
+
+        mstl3_segindex_update (mstl, id, segbefore, segbefore->starttime, segendtime);
+
+        /* Remove segafter from list and free it */
+        mstl3_free_joinedseg (mstl, id, segafter);
+      }
+
+      seg = segbefore;
+    }
+    /* Add MS3Record coverage to beginning of segment after */
+    else if (segafter)
+    {
+      if (!mstl3_addmsrtoseg (mstl, id, segafter, msr, endtime, 2, flags))
+      {
+        return NULL;
+      }
+
+      /* Add MS3RecordPtr if requested */
+      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, segafter, msr, endtime, 2)))
+      {
+        return NULL;
+      }
+
+      seg = segafter;
+    }
+    /* Add MS3Record coverage to new segment */
+    else
+    {
+      /* Create new segment */
+      if (!(seg = mstl3_msr2seg (mstl, msr, endtime, flags)))
+      {
+        return NULL;
+      }
+
+      /* Add MS3RecordPtr if requested */
+      if (pprecptr && !(*pprecptr = mstl3_add_recordptr (mstl, seg, msr, endtime, 0)))
+      {
+        return NULL;
+      }
+
+      /* Add new segment as first in list */
+      if (!followseg)
+      {
+        seg->next = id->first;
+        if (id->first)
+          id->first->prev = seg;
+
+        id->first = seg;
+      }
+      /* Add new segment after the followseg segment */
+      else
+      {
+        seg->next = followseg->next;
+        seg->prev = followseg;
+        if (followseg->next)
+          followseg->next->prev = seg;
+        followseg->next = seg;
+
+        if (followseg == id->last)
+          id->last = seg;
+      }
+
+      id->numsegments++;
+      mstl3_segindex_add (mstl, id, seg);
+    }
+  } /* End of searching segment list */
+
+  /* Track largest publication version */
+  if (msr->pubversion > id->pubversion)
+    id->pubversion = msr->pubversion;
+
+  /* Track earliest and latest times */
+  if (msr->starttime < id->earliest)
+    id->earliest = msr->starttime;
+
+  if (endtime > id->latest)
+    id->latest = endtime;
+
+  /* Sort modified segment into place, logic above should limit these to few shifts if any */
+  while (seg->next &&
+         (seg->starttime > seg->next->starttime ||
+          (seg->starttime == seg->next->starttime && seg->endtime < seg->next->endtime)))
+  {
+    /* Move segment down list, swap seg and seg->next */
+    segafter = seg->next;
+
+    if (seg->prev)
+      seg->prev->next = segafter;
+
+    if (segafter->next)
+      segafter->next->prev = seg;
+
+    segafter->prev = seg->prev;
+    seg->prev = segafter;
+    seg->next = segafter->next;
+    segafter->next = seg;
+
+    /* Reset first and last segment pointers if replaced */
+    if (id->first == seg)
+      id->first = segafter;
+
+    if (id->last == segafter)
+      id->last = seg;
+  }
+  while (seg->prev && (seg->starttime < seg->prev->starttime ||
+                       (seg->starttime == seg->prev->starttime && seg->endtime > seg->prev->endtime)))
+  {
+    /* Move segment up list, swap seg and seg->prev */
+    segbefore = seg->prev;
+
+    if (seg->next)
+      seg->next->prev = segbefore;
+
+    if (segbefore->prev)
+      segbefore->prev->next = seg;
+
+    segbefore->next = seg->next;
+    seg->next = segbefore;
+    seg->prev = segbefore->prev;
+    segbefore->prev = seg;
+
+    /* Reset first and last segment pointers if replaced */
+    if (id->first == segbefore)
+      id->first = seg;
+
+    if (id->last == seg)
+      id->last = segbefore;
+  }
+
+  /* Index segments when the segment list is long */
+  if (!id->segindex && id->numsegments >= MSTL_SEGINDEX_MINSEGMENTS)
+    mstl3_build_segindex (mstl, id);
+
+  return seg;
+} /* End of mstl3_addmsr_toID() */
+
+
+/****************************************************************/ /**
+ * @brief Parse miniSEED from a buffer and populate a ::MS3TraceList
+ *
+ * For a full description of \a tolerance see mstl3_addmsr().
+ *
+ * If the ::MSF_UNPACKDATA flag is set in \a flags, the data samples
+ * will be unpacked.  In most cases the caller probably wants this
+ * flag set, without it the trace list will merely be a list of
+ * channels.
+ *
+ * If the ::MSF_RECORDLIST flag is set in \a flags, a ::MS3RecordList
+ * will be built for each ::MS3TraceSeg.  The ::MS3RecordPtr entries
+ * contain the location of the data record, bit flags, extra headers, etc.
+ *
+ * @param[in] ppmstl Pointer-to-point to destination MS3TraceList
+ * @param[in] buffer Source buffer to read miniSEED records from
+ * @param[in] bufferlength Maximum length of \a buffer
+ * @param[in] splitversion Flag to control splitting of version/quality
+ * @param[in] flags Flags to control parsing and optional functionality:
+ * @parblock
+ *  - \c ::MSF_RECORDLIST : Build a ::MS3RecordList for each ::MS3TraceSeg
+ *  - Flags supported by msr3_parse()
+ *  - Flags supported by mstl3_addmsr()
+ * @endparblock
+ * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns The number of records parsed on success, otherwise a
+ * negative library error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_addmsr()
+ *********************************************************************/
+int64_t
+mstl3_readbuffer (MS3TraceList **ppmstl, const char *buffer, uint64_t bufferlength,
+                  int8_t splitversion, uint32_t flags,
+                  const MS3Tolerance *tolerance, int8_t verbose)
+{
+  return mstl3_readbuffer_selection (ppmstl, buffer, bufferlength,
+                                     splitversion, flags, tolerance,
+                                     NULL, verbose);
+} /* End of mstl3_readbuffer() */
+
+/****************************************************************/ /**
+ * @brief Parse miniSEED from a buffer and populate a ::MS3TraceList
+ *
+ * For a full description of \a tolerance see mstl3_addmsr().
+ *
+ * If the ::MSF_UNPACKDATA flag is set in \a flags, the data samples
+ * will be unpacked.  In most cases the caller probably wants this
+ * flag set, without it the trace list will merely be a list of
+ * channels.
+ *
+ * If the ::MSF_RECORDLIST flag is set in \a flags, a ::MS3RecordList
+ * will be built for each ::MS3TraceSeg.  The ::MS3RecordPtr entries
+ * contain the location of the data record, bit flags, extra headers, etc.
+ *
+ * If \a selections is not NULL, the ::MS3Selections will be used to
+ * limit what is returned to the caller.  Any data not matching the
+ * selections will be skipped.
+ *
+ * @param[in] ppmstl Pointer-to-point to destination MS3TraceList
+ * @param[in] buffer Source buffer to read miniSEED records from
+ * @param[in] bufferlength Maximum length of \a buffer
+ * @param[in] splitversion Flag to control splitting of version/quality
+ * @param[in] flags Flags to control parsing and optional functionality:
+ * @parblock
+ *  - \c ::MSF_RECORDLIST : Build a ::MS3RecordList for each ::MS3TraceSeg
+ *  - Flags supported by msr3_parse()
+ *  - Flags supported by mstl3_addmsr()
+ * @endparblock
+ * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
+ * @param[in] selections Specify limits to which data should be returned, see @ref data-selections
+ * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ *
+ * @returns The number of records parsed on success, otherwise a
+ * negative library error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ *
+ * \sa mstl3_addmsr()
+ *********************************************************************/
+int64_t
+mstl3_readbuffer_selection (MS3TraceList **ppmstl, const char *buffer, uint64_t bufferlength,
+                            int8_t splitversion, uint32_t flags,
+                            const MS3Tolerance *tolerance, const MS3Selections *selections,
+                            int8_t verbose)
+{
+  MS3Record *msr   = NULL;
+  MS3TraceSeg *seg = NULL;
+  MS3RecordPtr *recordptr = NULL;
+  uint32_t dataoffset;
+  uint32_t datasize;
+  uint64_t offset  = 0;
+  uint32_t pflags  = flags;
+  int64_t reccount = 0;
+  int parsevalue;
+
+  if (!ppmstl)
+  {
+    ms_log (2, "Required argument not defined: 'ppmstl'\n");
+    return MS_GENERROR;
+  }
+
+  /* Initialize MS3TraceList if needed */
+  if (!*ppmstl)
+  {
+    *ppmstl = mstl3_init (*ppmstl);
+
+    if (!*ppmstl)
+      return MS_GENERROR;
+  }
+
+  /* Defer data unpacking if selections are used by unsetting MSF_UNPACKDATA */
+  if ((flags & MSF_UNPACKDATA) && selections)
+    pflags &= ~(MSF_UNPACKDATA);
+
+  while ((bufferlength - offset) > MINRECLEN)
+  {
+    parsevalue = msr3_parse (buffer + offset, bufferlength - offset, &msr, pflags, verbose);
+
+    if (parsevalue < 0)
+    {
+      if (msr)
+        msr3_free (&msr);
+
+      return parsevalue;
+    }
+
+    if (parsevalue > 0)
+      break;
+
+    /* Test data against selections if specified */
+    if (selections)
+    {
+      if (!ms3_matchselect (selections, msr->sid, msr->starttime,
+                            msr3_endtime (msr), msr->pubversion, NULL))
+      {
+        if (verbose > 1)
+        {
+          ms_log (0, "Skipping (selection) record for %s (%d bytes) starting at offset %" PRIu64 "\n",
+                  msr->sid, msr->reclen, offset);
         }
 
-        /* Add new segment as first in list */
-        if (!followseg)
+        offset += msr->reclen;
+        continue;
+      }
+
+      /* Unpack data samples if this has been deferred */
+      if ((flags & MSF_UNPACKDATA) && msr->samplecnt > 0)
+      {
+        if (msr3_unpack_data (msr, verbose) != msr->samplecnt)
         {
-          seg->next = id->first;
-          if (id->first)
-            id->first->prev = seg;
+          if (msr)
+            msr3_free (&msr);
+
+          return MS_GENERROR;
+        }
+      }
+    }
+
+    /* Add record to trace list */
+    seg = mstl3_addmsr_recordptr (*ppmstl, msr, (flags & MSF_RECORDLIST) ? &recordptr : NULL,
+                                  splitversion, 1, flags, tolerance);
+
+    if (seg == NULL)
+    {
+      if (msr)
+        msr3_free (&msr);
+
+      return MS_GENERROR;
+    }
+
+    /* Populate remaining fields of record pointer */
+    if (recordptr)
+    {
+      /* Determine offset to data and length of data payload */
+      if (msr3_data_bounds (msr, &dataoffset, &datasize))
+        return MS_GENERROR;
+
+      recordptr->bufferptr  = buffer + offset;
+      recordptr->fileptr    = NULL;
+      recordptr->filename   = NULL;
+      recordptr->fileoffset = 0;
+      recordptr->dataoffset = dataoffset;
+      recordptr->prvtptr    = NULL;
+    }
+
+    reccount += 1;
+    offset += msr->reclen;
+  }
+
+  if (msr)
+    msr3_free (&msr);
+
+  return reccount;
+} /* End of mstl3_readbuffer_selection() */
+
+/***************************************************************************
+ * Create an MS3TraceSeg structure from an MS3Record structure.
+ *
+ * If MSF_UNPACKDATA is set in flags and the record samples have not
+ * been unpacked they are decoded directly into the segment.  If
+ * MSF_SAMPLECHUNKS is set in flags the samples are stored in chunks.
+ *
+ * Return a pointer to a MS3TraceSeg otherwise NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+MS3TraceSeg *
+mstl3_msr2seg (MS3TraceList *mstl, const MS3Record *msr, nstime_t endtime, uint32_t flags)
+{
+  MS3TraceSeg *seg = 0;
+
+  if (!(seg = (MS3TraceSeg *)mstl3_alloc_node (mstl, MSTL_NODE_SEG)))
+  {
+    ms_log (2, "Error allocating memory\n");
+    return NULL;
+  }
+  memset (seg, 0, sizeof (MS3TraceSeg));
+
+  /* Populate MS3TraceSeg */
+  seg->starttime = msr->starttime;
+  seg->endtime = endtime;
+  seg->samprate = msr3_sampratehz(msr);
+  seg->samplecnt = msr->samplecnt;
+  seg->sampletype = msr->sampletype;
+
+  /* Decode or copy data samples to segment */
+  if (mstl3_addsamples (seg, msr, 1, flags) < 0)
+  {
+    mstl3_free_samples (seg, 0);
+    mstl3_free_node (mstl, MSTL_NODE_SEG, seg);
+    return NULL;
+  }
+
+  return seg;
+} /* End of mstl3_msr2seg() */
+
+/***************************************************************************
+ * Add data coverage from a MS3Record structure to a MS3TraceSeg structure.
+ *
+ * Data coverage is added to the beginning or end of MS3TraceSeg
+ * according to the whence flag:
+ * 1 : add coverage to the end
+ * 2 : add coverage to the beginninig
+ *
+ * If MSF_UNPACKDATA is set in flags and the record samples have not
+ * been unpacked they are decoded directly into the segment.
+ *
+ * The segment index of the MS3TraceID is updated for the new coverage.
+ *
+ * Return a pointer to a MS3TraceSeg otherwise, NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+MS3TraceSeg *
+mstl3_addmsrtoseg (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg,
+                   const MS3Record *msr, nstime_t endtime, int8_t whence, uint32_t flags)
+{
+  nstime_t oldstart;
+  nstime_t oldend;
+
+  if (!seg || !msr)
+  {
+    ms_log (2, "Required argument not defined: 'seg' or 'msr'\n");
+    return NULL;
+  }
+
+  if (whence != 1 && whence != 2)
+  {
+    ms_log (2, "unrecognized whence value: %d\n", whence);
+    return NULL;
+  }
+
+  /* Decode or copy data samples to segment */
+  if (mstl3_addsamples (seg, msr, whence, flags) < 0)
+    return NULL;
+
+  oldstart = seg->starttime;
+  oldend = seg->endtime;
+
+  /* Add coverage to end of segment */
+  if (whence == 1)
+  {
+    seg->endtime = endtime;
+    seg->samplecnt += msr->samplecnt;
+  }
+  /* Add coverage to beginning of segment */
+  else
+  {
+    seg->starttime = msr->starttime;
+    seg->samplecnt += msr->samplecnt;
+  }
+
+  mstl3_segindex_update (mstl, id, seg, oldstart, oldend);
+
+  return seg;
+} /* End of mstl3_addmsrtoseg() */
+
+/***************************************************************************
+ * Add the data samples of a MS3Record to the beginning or end of a
+ * MS3TraceSeg according to the whence flag:
+ * 1 : add samples to the end
+ * 2 : add samples to the beginning
+ *
+ * If MSF_UNPACKDATA is set in flags and the record samples have not
+ * been unpacked they are decoded directly into the segment, otherwise
+ * any unpacked samples are copied.
+ *
+ * Samples are stored in chunks if the segment already uses chunks or
+ * MSF_SAMPLECHUNKS is set in flags, in which case existing contiguous
+ * samples are converted to a chunk.
+ *
+ * Only the samples, MS3TraceSeg.numsamples and MS3TraceSeg.sampletype
+ * are updated, coverage is left to the caller.
+ *
+ * Return number of samples added or negative libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+static int64_t
+mstl3_addsamples (MS3TraceSeg *seg, const MS3Record *msr, int8_t whence, uint32_t flags)
+{
+  MS3SampleChunk *chunk = NULL;
+  int8_t decode = MSTL_DECODE (msr, flags);
+  int8_t chunked;
+  uint8_t samplesize = 0;
+  uint8_t encoding;
+  char sampletype = 0;
+  char *output;
+  int64_t count;
+  int64_t nsamples;
+
+  if (decode)
+  {
+    /* Fallback encoding for when encoding is unknown, matching msr3_unpack_data() */
+    encoding = (msr->encoding < 0) ? DE_STEIM1 : (uint8_t)msr->encoding;
+
+    if (ms_encoding_sizetype (encoding, &samplesize, &sampletype))
+    {
+      ms_log (2, "%s: Cannot determine sample size for encoding: %u\n", msr->sid, encoding);
+      return MS_GENERROR;
+    }
+
+    count = msr->samplecnt;
+  }
+  else if (msr->datasamples && msr->numsamples > 0)
+  {
+    sampletype = msr->sampletype;
+
+    if (!(samplesize = ms_samplesize (sampletype)))
+    {
+      ms_log (2, "Unknown sample size for sample type: %c\n", sampletype);
+      return MS_GENERROR;
+    }
+
+    count = msr->numsamples;
+  }
+  /* No samples to add */
+  else
+  {
+    return 0;
+  }
+
+  if (seg->numsamples > 0 && sampletype != seg->sampletype)
+  {
+    ms_log (2, "MS3Record sample type (%c) does not match segment sample type (%c)\n",
+            sampletype, seg->sampletype);
+    return MS_GENERROR;
+  }
+
+  chunked = (seg->chunks || (flags & MSF_SAMPLECHUNKS)) ? 1 : 0;
+
+  /* Convert existing contiguous samples to a chunk */
+  if (chunked && !seg->chunks && seg->datasamples && seg->numsamples > 0)
+  {
+    if (mstl3_seg2chunks (seg) < 0)
+      return MS_GENERROR;
+  }
+
+  if (!(output = mstl3_reserve_samples (seg, samplesize, count, whence, chunked, &chunk)))
+    return MS_GENERROR;
+
+  if (decode)
+  {
+    nsamples = msr3_decode_data (msr, output, (size_t)count * samplesize, &sampletype, 0);
+
+    if (nsamples != count)
+    {
+      if (nsamples >= 0)
+        ms_log (2, "%s: Only decoded %" PRId64 " samples of %" PRId64 " expected\n",
+                msr->sid, nsamples, count);
+
+      mstl3_release_samples (seg, samplesize, count, whence, chunk);
+      return MS_GENERROR;
+    }
+  }
+  else
+  {
+    memcpy (output, msr->datasamples, (size_t)count * samplesize);
+  }
+
+  if (chunk)
+    chunk->numsamples += count;
+
+  seg->sampletype = sampletype;
+  seg->numsamples += count;
+
+  return count;
+} /* End of mstl3_addsamples() */
+
+/***************************************************************************
+ * Reserve space for count samples of samplesize bytes at the end or
+ * beginning of a MS3TraceSeg according to the whence flag:
+ * 1 : reserve space at the end
+ * 2 : reserve space at the beginning
+ *
+ * For contiguous storage the MS3TraceSeg.datasamples buffer is grown
+ * and, when reserving at the beginning, existing samples are shifted.
+ *
+ * For chunked storage space is reserved at the end of the last chunk,
+ * which is grown by doubling up to MSTL_CHUNK_MAXSIZE bytes, or in a
+ * new chunk.  Space at the beginning is always a new first chunk.
+ * The chunk containing the space is returned at ppchunk.
+ *
+ * MS3TraceSeg.numsamples and MS3SampleChunk.numsamples are not
+ * updated, the caller must add count when the samples are written.
+ *
+ * Return pointer to the reserved space or NULL on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+static char *
+mstl3_reserve_samples (MS3TraceSeg *seg, uint8_t samplesize, int64_t count,
+                       int8_t whence, int8_t chunked, MS3SampleChunk **ppchunk)
+{
+  MS3SampleChunk *chunk = NULL;
+  void *newdatasamples = NULL;
+  size_t newdatasize = 0;
+  size_t size = (size_t)count * samplesize;
+  size_t used;
+
+  *ppchunk = NULL;
+
+  if (!chunked)
+  {
+    newdatasize = (size_t)(seg->numsamples + count) * samplesize;
+
+    if (libmseed_prealloc_block_size)
+    {
+      newdatasamples = libmseed_memory_prealloc (seg->datasamples, newdatasize, &(seg->datasize));
+    }
+    else
+    {
+      newdatasamples = libmseed_memory.realloc (seg->datasamples, newdatasize);
+      seg->datasize = newdatasize;
+    }
 
-          id->first = seg;
-        }
-        /* Add new segment after the followseg segment */
-        else
-        {
-          seg->next = followseg->next;
-          seg->prev = followseg;
-          if (followseg->next)
-            followseg->next->prev = seg;
-          followseg->next = seg;
-
-          if (followseg == id->last)
-            id->last = seg;
-        }
+    if (!newdatasamples)
+    {
+      ms_log (2, "Error allocating memory\n");
+      seg->datasize = 0;
+      return NULL;
+    }
 
-        id->numsegments++;
-      }
-    } /* End of searching segment list */
+    seg->datasamples = newdatasamples;
 
-    /* Track largest publication version */
-    if (msr->pubversion > id->pubversion)
-      id->pubversion = msr->pubversion;
+    if (whence == 1)
+      return (char *)seg->datasamples + (seg->numsamples * samplesize);
 
-    /* Track earliest and latest times */
-    if (msr->starttime < id->earliest)
-      id->earliest = msr->starttime;
+    memmove ((char *)seg->datasamples + size,
+             seg->datasamples,
+             (size_t) (seg->numsamples * samplesize));
 
-    if (endtime > id->latest)
-      id->latest = endtime;
-  } /* End of adding coverage to matching ID */
+    return (char *)seg->datasamples;
+  }
 
-  /* Sort modified segment into place, logic above should limit these to few shifts if any */
-  while (seg->next &&
-         (seg->starttime > seg->next->starttime ||
-          (seg->starttime == seg->next->starttime && seg->endtime < seg->next->endtime)))
+  /* Use space at the end of, or grow, the last chunk */
+  if (whence == 1 && (chunk = seg->lastchunk) && !chunk->mapped)
   {
-    /* Move segment down list, swap seg and seg->next */
-    segafter = seg->next;
+    used = (size_t)chunk->numsamples * samplesize;
 
-    if (seg->prev)
-      seg->prev->next = segafter;
+    if (chunk->datasize - used < size && used + size <= MSTL_CHUNK_MAXSIZE)
+    {
+      newdatasize = chunk->datasize * 2;
 
-    if (segafter->next)
-      segafter->next->prev = seg;
+      if (newdatasize < used + size)
+        newdatasize = used + size;
+      if (newdatasize > MSTL_CHUNK_MAXSIZE)
+        newdatasize = MSTL_CHUNK_MAXSIZE;
 
-    segafter->prev = seg->prev;
-    seg->prev = segafter;
-    seg->next = segafter->next;
-    segafter->next = seg;
+      if (!(newdatasamples = libmseed_memory.realloc (chunk->datasamples, newdatasize)))
+      {
+        ms_log (2, "Error allocating memory\n");
+        return NULL;
+      }
 
-    /* Reset first and last segment pointers if replaced */
-    if (id->first == seg)
-      id->first = segafter;
+      chunk->datasamples = newdatasamples;
+      chunk->datasize = newdatasize;
+    }
 
-    if (id->last == segafter)
-      id->last = seg;
+    if (chunk->datasize - used >= size)
+    {
+      *ppchunk = chunk;
+      return (char *)chunk->datasamples + used;
+    }
   }
-  while (seg->prev && (seg->starttime < seg->prev->starttime ||
-                       (seg->starttime == seg->prev->starttime && seg->endtime > seg->prev->endtime)))
+
+  /* Otherwise create a new chunk */
+  if (!(chunk = (MS3SampleChunk *)libmseed_memory.malloc (sizeof (MS3SampleChunk))))
   {
-    /* Move segment up list, swap seg and seg->prev */
-    segbefore = seg->prev;
+    ms_log (2, "Error allocating memory\n");
+    return NULL;
+  }
+  memset (chunk, 0, sizeof (MS3SampleChunk));
 
-    if (seg->next)
-      seg->next->prev = segbefore;
+  if (!(chunk->datasamples = libmseed_memory.malloc (size)))
+  {
+    ms_log (2, "Error allocating memory\n");
+    libmseed_memory.free (chunk);
+    return NULL;
+  }
+  chunk->datasize = size;
 
-    if (segbefore->prev)
-      segbefore->prev->next = seg;
+  if (whence == 1 || !seg->chunks)
+  {
+    if (seg->lastchunk)
+      seg->lastchunk->next = chunk;
+    else
+      seg->chunks = chunk;
 
-    segbefore->next = seg->next;
-    seg->next = segbefore;
-    seg->prev = segbefore->prev;
-    segbefore->prev = seg;
+    seg->lastchunk = chunk;
+  }
+  else
+  {
+    chunk->next = seg->chunks;
+    seg->chunks = chunk;
+  }
 
-    /* Reset first and last segment pointers if replaced */
-    if (id->first == segbefore)
-      id->first = seg;
+  *ppchunk = chunk;
+  return (char *)chunk->datasamples;
+} /* End of mstl3_reserve_samples() */
 
-    if (id->last == seg)
-      id->last = segbefore;
+/***************************************************************************
+ * Release space reserved with mstl3_reserve_samples() that was not
+ * used, restoring shifted contiguous samples and removing an empty
+ * chunk.
+ ***************************************************************************/
+static void
+mstl3_release_samples (MS3TraceSeg *seg, uint8_t samplesize, int64_t count,
+                       int8_t whence, MS3SampleChunk *chunk)
+{
+  MS3SampleChunk *prevchunk = NULL;
+
+  if (!chunk)
+  {
+    /* Restore existing samples shifted for space at the beginning */
+    if (whence == 2 && seg->datasamples)
+      memmove (seg->datasamples,
+               (char *)seg->datasamples + ((size_t)count * samplesize),
+               (size_t) (seg->numsamples * samplesize));
+
+    return;
   }
 
-  return seg;
-} /* End of mstl3_addmsr_recordptr() */
+  if (chunk->numsamples > 0)
+    return;
 
+  /* Unlink and free empty chunk */
+  if (seg->chunks == chunk)
+  {
+    seg->chunks = chunk->next;
+  }
+  else
+  {
+    for (prevchunk = seg->chunks; prevchunk->next != chunk; prevchunk = prevchunk->next)
+      ;
+    prevchunk->next = chunk->next;
+  }
 
-/****************************************************************/ /**
- * @brief Parse miniSEED from a buffer and populate a ::MS3TraceList
- *
- * For a full description of \a tolerance see mstl3_addmsr().
- *
- * If the ::MSF_UNPACKDATA flag is set in \a flags, the data samples
- * will be unpacked.  In most cases the caller probably wants this
- * flag set, without it the trace list will merely be a list of
- * channels.
- *
- * If the ::MSF_RECORDLIST flag is set in \a flags, a ::MS3RecordList
- * will be built for each ::MS3TraceSeg.  The ::MS3RecordPtr entries
- * contain the location of the data record, bit flags, extra headers, etc.
- *
- * @param[in] ppmstl Pointer-to-point to destination MS3TraceList
- * @param[in] buffer Source buffer to read miniSEED records from
- * @param[in] bufferlength Maximum length of \a buffer
- * @param[in] splitversion Flag to control splitting of version/quality
- * @param[in] flags Flags to control parsing and optional functionality:
- * @parblock
- *  - \c ::MSF_RECORDLIST : Build a ::MS3RecordList for each ::MS3TraceSeg
- *  - Flags supported by msr3_parse()
- *  - Flags supported by mstl3_addmsr()
- * @endparblock
- * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
- * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+  if (seg->lastchunk == chunk)
+    seg->lastchunk = prevchunk;
+
+  mstl3_free_chunkdata (chunk);
+  libmseed_memory.free (chunk);
+} /* End of mstl3_release_samples() */
+
+/***************************************************************************
+ * Convert the contiguous data samples of a MS3TraceSeg to a single
+ * chunk, the MS3TraceSeg.datasamples buffer becomes the chunk buffer.
  *
- * @returns The number of records parsed on success, otherwise a
- * negative library error code.
+ * Return 0 on success and negative libmseed error code on error.
  *
  * \ref MessageOnError - this function logs a message on error
- *
- * \sa mstl3_addmsr()
- *********************************************************************/
-int64_t
-mstl3_readbuffer (MS3TraceList **ppmstl, const char *buffer, uint64_t bufferlength,
-                  int8_t splitversion, uint32_t flags,
-                  const MS3Tolerance *tolerance, int8_t verbose)
+ ***************************************************************************/
+static int
+mstl3_seg2chunks (MS3TraceSeg *seg)
 {
-  return mstl3_readbuffer_selection (ppmstl, buffer, bufferlength,
-                                     splitversion, flags, tolerance,
-                                     NULL, verbose);
-} /* End of mstl3_readbuffer() */
+  MS3SampleChunk *chunk = NULL;
 
-/****************************************************************/ /**
- * @brief Parse miniSEED from a buffer and populate a ::MS3TraceList
- *
- * For a full description of \a tolerance see mstl3_addmsr().
- *
- * If the ::MSF_UNPACKDATA flag is set in \a flags, the data samples
- * will be unpacked.  In most cases the caller probably wants this
- * flag set, without it the trace list will merely be a list of
- * channels.
- *
- * If the ::MSF_RECORDLIST flag is set in \a flags, a ::MS3RecordList
- * will be built for each ::MS3TraceSeg.  The ::MS3RecordPtr entries
- * contain the location of the data record, bit flags, extra headers, etc.
+  if (seg->chunks || !seg->datasamples)
+    return 0;
+
+  if (!(chunk = (MS3SampleChunk *)libmseed_memory.malloc (sizeof (MS3SampleChunk))))
+  {
+    ms_log (2, "Error allocating memory\n");
+    return MS_GENERROR;
+  }
+  memset (chunk, 0, sizeof (MS3SampleChunk));
+
+  chunk->datasamples = seg->datasamples;
+  chunk->datasize = seg->datasize;
+  chunk->numsamples = seg->numsamples;
+
+  seg->chunks = seg->lastchunk = chunk;
+  seg->datasamples = NULL;
+  seg->datasize = 0;
+
+  return 0;
+} /* End of mstl3_seg2chunks() */
+
+/***************************************************************************
+ * Free the data samples of a MS3TraceSeg, contiguous or chunked, and
+ * reset the sample count.  If freeprvtptr is true also free any data
+ * at MS3SampleChunk.prvtptr.
+ ***************************************************************************/
+static void
+mstl3_free_samples (MS3TraceSeg *seg, int8_t freeprvtptr)
+{
+  if (seg->datasamples)
+    libmseed_memory.free (seg->datasamples);
+
+  seg->datasamples = NULL;
+  seg->datasize = 0;
+
+  mstl3_free_chunks (seg, freeprvtptr);
+
+  seg->numsamples = 0;
+} /* End of mstl3_free_samples() */
+
+/***************************************************************************
+ * Free the list of sample chunks of a MS3TraceSeg.  If freeprvtptr is
+ * true also free any data at MS3SampleChunk.prvtptr.
+ ***************************************************************************/
+static void
+mstl3_free_chunks (MS3TraceSeg *seg, int8_t freeprvtptr)
+{
+  MS3SampleChunk *chunk = NULL;
+  MS3SampleChunk *nextchunk = NULL;
+
+  chunk = seg->chunks;
+  while (chunk)
+  {
+    nextchunk = chunk->next;
+
+    mstl3_free_chunkdata (chunk);
+
+    if (freeprvtptr && chunk->prvtptr)
+      libmseed_memory.free (chunk->prvtptr);
+
+    libmseed_memory.free (chunk);
+    chunk = nextchunk;
+  }
+
+  seg->chunks = seg->lastchunk = NULL;
+} /* End of mstl3_free_chunks() */
+
+/***************************************************************************
+ * Free the sample buffer of a MS3SampleChunk, unmapping the samples
+ * of a chunk spilled to a file.
+ ***************************************************************************/
+static void
+mstl3_free_chunkdata (MS3SampleChunk *chunk)
+{
+  if (!chunk->datasamples)
+    return;
+
+#if !defined(LMP_WIN)
+  if (chunk->mapped)
+    munmap (chunk->datasamples, chunk->datasize);
+  else
+#endif
+    libmseed_memory.free (chunk->datasamples);
+
+  chunk->datasamples = NULL;
+  chunk->mapped = 0;
+} /* End of mstl3_free_chunkdata() */
+
+/***************************************************************************
+ * Allocate a trace list node of the specified type.
  *
- * If \a selections is not NULL, the ::MS3Selections will be used to
- * limit what is returned to the caller.  Any data not matching the
- * selections will be skipped.
+ * If the MS3TraceList uses an arena the node is taken from the list
+ * of released nodes of that type or carved from the current block,
+ * allocating a new block when needed.  Otherwise the node is
+ * allocated individually.
  *
- * @param[in] ppmstl Pointer-to-point to destination MS3TraceList
- * @param[in] buffer Source buffer to read miniSEED records from
- * @param[in] bufferlength Maximum length of \a buffer
- * @param[in] splitversion Flag to control splitting of version/quality
- * @param[in] flags Flags to control parsing and optional functionality:
- * @parblock
- *  - \c ::MSF_RECORDLIST : Build a ::MS3RecordList for each ::MS3TraceSeg
- *  - Flags supported by msr3_parse()
- *  - Flags supported by mstl3_addmsr()
- * @endparblock
- * @param[in] tolerance Tolerance function pointers as ::MS3Tolerance
- * @param[in] selections Specify limits to which data should be returned, see @ref data-selections
- * @param[in] verbose Controls verbosity, 0 means no diagnostic output
+ * Return a pointer to the uninitialized node or NULL on error.
+ ***************************************************************************/
+static void *
+mstl3_alloc_node (MS3TraceList *mstl, int nodetype)
+{
+  struct MS3TraceListArena *arena = mstl->arena;
+  void *node;
+
+  if (!arena)
+    return libmseed_memory.malloc (mstl_nodesize[nodetype]);
+
+  mstl3_lock_alloc (mstl);
+
+  /* Reuse a released node */
+  if ((node = arena->freelist[nodetype]) != NULL)
+    arena->freelist[nodetype] = *(void **)node;
+  else
+    node = mstl3_arena_alloc (arena, mstl_nodesize[nodetype]);
+
+  mstl3_unlock_alloc (mstl);
+
+  return node;
+} /* End of mstl3_alloc_node() */
+
+/***************************************************************************
+ * Carve the specified number of bytes from the current arena block,
+ * allocating a new block when needed.  The size must not exceed the
+ * largest node size.
  *
- * @returns The number of records parsed on success, otherwise a
- * negative library error code.
+ * Return a pointer to the uninitialized memory or NULL on error.
+ ***************************************************************************/
+static void *
+mstl3_arena_alloc (struct MS3TraceListArena *arena, size_t size)
+{
+  void *node;
+  char *block;
+
+  size = MSTL_ARENA_SIZE (size);
+
+  /* Allocate a new block, linked to prior blocks through the first pointer */
+  if (arena->remaining < size)
+  {
+    if (!(block = (char *)libmseed_memory.malloc (arena->blocksize)))
+      return NULL;
+
+    *(void **)block = arena->blocks;
+    arena->blocks = block;
+    arena->cursor = block + MSTL_ARENA_ALIGN;
+    arena->remaining = arena->blocksize - MSTL_ARENA_ALIGN;
+  }
+
+  node = arena->cursor;
+  arena->cursor += size;
+  arena->remaining -= size;
+
+  return node;
+} /* End of mstl3_arena_alloc() */
+
+/***************************************************************************
+ * Allocate a zeroed MS3TraceID followed by its skip list pointers for
+ * the specified height.
  *
- * \ref MessageOnError - this function logs a message on error
+ * Trace IDs are not released individually, only with the list.
  *
- * \sa mstl3_addmsr()
- *********************************************************************/
-int64_t
-mstl3_readbuffer_selection (MS3TraceList **ppmstl, const char *buffer, uint64_t bufferlength,
-                            int8_t splitversion, uint32_t flags,
-                            const MS3Tolerance *tolerance, const MS3Selections *selections,
-                            int8_t verbose)
+ * Return a pointer to the MS3TraceID or NULL on error.
+ ***************************************************************************/
+static MS3TraceID *
+mstl3_alloc_ID (MS3TraceList *mstl, uint8_t height)
 {
-  MS3Record *msr   = NULL;
-  MS3TraceSeg *seg = NULL;
-  MS3RecordPtr *recordptr = NULL;
-  uint32_t dataoffset;
-  uint32_t datasize;
-  uint64_t offset  = 0;
-  uint32_t pflags  = flags;
-  int64_t reccount = 0;
-  int parsevalue;
+  MS3TraceID *id;
+  size_t size = sizeof (MS3TraceID) + height * sizeof (MS3TraceID *);
+
+  if (mstl->arena)
+  {
+    mstl3_lock_alloc (mstl);
+    id = (MS3TraceID *)mstl3_arena_alloc (mstl->arena, size);
+    mstl3_unlock_alloc (mstl);
+  }
+  else
+    id = (MS3TraceID *)libmseed_memory.malloc (size);
+
+  if (!id)
+    return NULL;
+
+  memset (id, 0, size);
+  id->next = (MS3TraceID **)(id + 1);
+  id->height = height;
+
+  return id;
+} /* End of mstl3_alloc_ID() */
+
+/***************************************************************************
+ * Return the copy of a source identifier in the table of a
+ * MS3TraceList, adding it if not present.  Trace IDs of the same
+ * source with different publication versions share the copy.
+ *
+ * Return a pointer to the copy or NULL on error.
+ ***************************************************************************/
+static const char *
+mstl3_intern_sid (MS3TraceList *mstl, const char *sid)
+{
+  struct MS3TraceIDIndex *index = mstl->idindex;
+  struct MS3SIDTable *table = mstl->sidtable;
+  MS3TraceID *entry;
+  uint32_t slot;
+  size_t length;
+  char *block;
+  char *copy;
+
+  /* Use the identifier of an indexed ID of another version */
+  if (index && index->size)
+  {
+    slot = mstl3_sidhash (sid) & (index->size - 1);
+    while ((entry = index->slots[slot]) != NULL)
+    {
+      if (!strcmp (entry->sid, sid))
+        return entry->sid;
 
-  if (!ppmstl)
+      slot = (slot + 1) & (index->size - 1);
+    }
+  }
+
+  if (!table)
   {
-    ms_log (2, "Required argument not defined: 'ppmstl'\n");
-    return MS_GENERROR;
+    if (!(table = (struct MS3SIDTable *)libmseed_memory.malloc (sizeof (struct MS3SIDTable))))
+      return NULL;
+
+    memset (table, 0, sizeof (struct MS3SIDTable));
+    mstl->sidtable = table;
   }
 
-  /* Initialize MS3TraceList if needed */
-  if (!*ppmstl)
+  length = strlen (sid) + 1;
+
+  /* Allocate a new block, linked to prior blocks through the first pointer */
+  if (table->remaining < length)
   {
-    *ppmstl = mstl3_init (*ppmstl);
+    if (!(block = (char *)libmseed_memory.malloc (MSTL_SIDTABLE_BLOCKSIZE)))
+      return NULL;
 
-    if (!*ppmstl)
-      return MS_GENERROR;
+    *(void **)block = table->blocks;
+    table->blocks = block;
+    table->cursor = block + sizeof (void *);
+    table->remaining = MSTL_SIDTABLE_BLOCKSIZE - sizeof (void *);
   }
 
-  /* Defer data unpacking if selections are used by unsetting MSF_UNPACKDATA */
-  if ((flags & MSF_UNPACKDATA) && selections)
-    pflags &= ~(MSF_UNPACKDATA);
+  copy = table->cursor;
+  memcpy (copy, sid, length);
+  table->cursor += length;
+  table->remaining -= length;
 
-  while ((bufferlength - offset) > MINRECLEN)
+  return copy;
+} /* End of mstl3_intern_sid() */
+
+/***************************************************************************
+ * Free the source identifier table of a MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_free_sidtable (MS3TraceList *mstl)
+{
+  void *block;
+  void *nextblock;
+
+  for (block = mstl->sidtable->blocks; block; block = nextblock)
   {
-    parsevalue = msr3_parse (buffer + offset, bufferlength - offset, &msr, pflags, verbose);
+    nextblock = *(void **)block;
+    libmseed_memory.free (block);
+  }
 
-    if (parsevalue < 0)
-    {
-      if (msr)
-        msr3_free (&msr);
+  libmseed_memory.free (mstl->sidtable);
+  mstl->sidtable = NULL;
+} /* End of mstl3_free_sidtable() */
 
-      return parsevalue;
-    }
+/***************************************************************************
+ * Release a trace list node of the specified type.
+ *
+ * If the MS3TraceList uses an arena the node is added to the list of
+ * released nodes of that type for reuse.  Otherwise the node is freed.
+ ***************************************************************************/
+static void
+mstl3_free_node (MS3TraceList *mstl, int nodetype, void *node)
+{
+  struct MS3TraceListArena *arena = mstl->arena;
 
-    if (parsevalue > 0)
-      break;
+  if (!node)
+    return;
 
-    /* Test data against selections if specified */
-    if (selections)
-    {
-      if (!ms3_matchselect (selections, msr->sid, msr->starttime,
-                            msr3_endtime (msr), msr->pubversion, NULL))
-      {
-        if (verbose > 1)
-        {
-          ms_log (0, "Skipping (selection) record for %s (%d bytes) starting at offset %" PRIu64 "\n",
-                  msr->sid, msr->reclen, offset);
-        }
+  if (!arena)
+  {
+    libmseed_memory.free (node);
+    return;
+  }
 
-        offset += msr->reclen;
-        continue;
-      }
+  mstl3_lock_alloc (mstl);
+  *(void **)node = arena->freelist[nodetype];
+  arena->freelist[nodetype] = node;
+  mstl3_unlock_alloc (mstl);
+} /* End of mstl3_free_node() */
 
-      /* Unpack data samples if this has been deferred */
-      if ((flags & MSF_UNPACKDATA) && msr->samplecnt > 0)
-      {
-        if (msr3_unpack_data (msr, verbose) != msr->samplecnt)
-        {
-          if (msr)
-            msr3_free (&msr);
+/***************************************************************************
+ * Free all blocks of the arena of a MS3TraceList and the arena itself.
+ ***************************************************************************/
+static void
+mstl3_free_arena (MS3TraceList *mstl)
+{
+  void *block;
+  void *nextblock;
 
-          return MS_GENERROR;
-        }
-      }
-    }
+  block = mstl->arena->blocks;
+  while (block)
+  {
+    nextblock = *(void **)block;
+    libmseed_memory.free (block);
+    block = nextblock;
+  }
 
-    /* Add record to trace list */
-    seg = mstl3_addmsr_recordptr (*ppmstl, msr, (flags & MSF_RECORDLIST) ? &recordptr : NULL,
-                                  splitversion, 1, flags, tolerance);
+  libmseed_memory.free (mstl->arena);
+  mstl->arena = NULL;
+} /* End of mstl3_free_arena() */
 
-    if (seg == NULL)
+/***************************************************************************
+ * Lock the trace ID skip list, hash index and SID table of a concurrent
+ * MS3TraceList, shared for searching or exclusive for adding IDs.  No
+ * operation for other lists.
+ ***************************************************************************/
+static void
+mstl3_lock_list (MS3TraceList *mstl, int8_t exclusive)
+{
+#if !defined(LMP_WIN)
+  if (!mstl->lock)
+    return;
+
+  if (exclusive)
+    pthread_rwlock_wrlock (&mstl->lock->list);
+  else
+    pthread_rwlock_rdlock (&mstl->lock->list);
+#endif
+} /* End of mstl3_lock_list() */
+
+/***************************************************************************
+ * Unlock the trace ID skip list of a concurrent MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_unlock_list (MS3TraceList *mstl)
+{
+#if !defined(LMP_WIN)
+  if (mstl->lock)
+    pthread_rwlock_unlock (&mstl->lock->list);
+#endif
+} /* End of mstl3_unlock_list() */
+
+/***************************************************************************
+ * Lock the segments of a trace ID of a concurrent MS3TraceList.  Each
+ * lock is shared by the IDs with the same address hash.
+ ***************************************************************************/
+static void
+mstl3_lock_ID (MS3TraceList *mstl, const MS3TraceID *id)
+{
+#if !defined(LMP_WIN)
+  if (mstl->lock)
+    pthread_mutex_lock (&mstl->lock->ids[((uintptr_t)id / MSTL_ARENA_ALIGN) & (MSTL_LOCK_STRIPES - 1)]);
+#endif
+} /* End of mstl3_lock_ID() */
+
+/***************************************************************************
+ * Unlock the segments of a trace ID of a concurrent MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_unlock_ID (MS3TraceList *mstl, const MS3TraceID *id)
+{
+#if !defined(LMP_WIN)
+  if (mstl->lock)
+    pthread_mutex_unlock (&mstl->lock->ids[((uintptr_t)id / MSTL_ARENA_ALIGN) & (MSTL_LOCK_STRIPES - 1)]);
+#endif
+} /* End of mstl3_unlock_ID() */
+
+/***************************************************************************
+ * Lock the node arena of a concurrent MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_lock_alloc (MS3TraceList *mstl)
+{
+#if !defined(LMP_WIN)
+  if (mstl->lock)
+    pthread_mutex_lock (&mstl->lock->alloc);
+#endif
+} /* End of mstl3_lock_alloc() */
+
+/***************************************************************************
+ * Unlock the node arena of a concurrent MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_unlock_alloc (MS3TraceList *mstl)
+{
+#if !defined(LMP_WIN)
+  if (mstl->lock)
+    pthread_mutex_unlock (&mstl->lock->alloc);
+#endif
+} /* End of mstl3_unlock_alloc() */
+
+/***************************************************************************
+ * Destroy and free the locks of a concurrent MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_free_lock (MS3TraceList *mstl)
+{
+#if !defined(LMP_WIN)
+  int idx;
+
+  pthread_rwlock_destroy (&mstl->lock->list);
+  pthread_mutex_destroy (&mstl->lock->alloc);
+
+  for (idx = 0; idx < MSTL_LOCK_STRIPES; idx++)
+    pthread_mutex_destroy (&mstl->lock->ids[idx]);
+
+  libmseed_memory.free (mstl->lock);
+#endif
+  mstl->lock = NULL;
+} /* End of mstl3_free_lock() */
+
+/***************************************************************************
+ * Calculate a hash of a SID using the 32-bit FNV-1a algorithm.
+ ***************************************************************************/
+static uint32_t
+mstl3_sidhash (const char *sid)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*sid)
+  {
+    hash ^= (uint8_t)*sid++;
+    hash *= 16777619u;
+  }
+
+  return hash;
+} /* End of mstl3_sidhash() */
+
+/***************************************************************************
+ * Add a MS3TraceID to the hash index of a MS3TraceList.
+ *
+ * The index is created when the first ID is added and doubled in size
+ * when half full.
+ *
+ * Return 0 on success and -1 on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+static int
+mstl3_indexID (MS3TraceList *mstl, MS3TraceID *id)
+{
+  struct MS3TraceIDIndex *index = mstl->idindex;
+  MS3TraceID **slots;
+  MS3TraceID *entry;
+  uint32_t size;
+  uint32_t slot;
+  uint32_t idx;
+
+  if (!index)
+  {
+    if (!(index = (struct MS3TraceIDIndex *)libmseed_memory.malloc (sizeof (struct MS3TraceIDIndex))))
     {
-      if (msr)
-        msr3_free (&msr);
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
 
-      return MS_GENERROR;
+    memset (index, 0, sizeof (struct MS3TraceIDIndex));
+    mstl->idindex = index;
+  }
+
+  /* Grow and rehash when half full */
+  if ((index->count + 1) * 2 > index->size)
+  {
+    size = (index->size) ? index->size * 2 : MSTL_INDEX_INITSIZE;
+
+    if (!(slots = (MS3TraceID **)libmseed_memory.malloc (size * sizeof (MS3TraceID *))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
     }
 
-    /* Populate remaining fields of record pointer */
-    if (recordptr)
+    memset (slots, 0, size * sizeof (MS3TraceID *));
+
+    for (idx = 0; idx < index->size; idx++)
     {
-      /* Determine offset to data and length of data payload */
-      if (msr3_data_bounds (msr, &dataoffset, &datasize))
-        return MS_GENERROR;
+      if ((entry = index->slots[idx]) == NULL)
+        continue;
 
-      recordptr->bufferptr  = buffer + offset;
-      recordptr->fileptr    = NULL;
-      recordptr->filename   = NULL;
-      recordptr->fileoffset = 0;
-      recordptr->dataoffset = dataoffset;
-      recordptr->prvtptr    = NULL;
+      slot = mstl3_sidhash (entry->sid) & (size - 1);
+      while (slots[slot])
+        slot = (slot + 1) & (size - 1);
+
+      slots[slot] = entry;
     }
 
-    reccount += 1;
-    offset += msr->reclen;
+    if (index->slots)
+      libmseed_memory.free (index->slots);
+
+    index->slots = slots;
+    index->size = size;
   }
 
-  if (msr)
-    msr3_free (&msr);
+  /* Find empty slot, noting any existing entries for the same SID */
+  slot = mstl3_sidhash (id->sid) & (index->size - 1);
+  while ((entry = index->slots[slot]) != NULL)
+  {
+    if (!strcmp (entry->sid, id->sid))
+      index->multiversion = 1;
 
-  return reccount;
-} /* End of mstl3_readbuffer_selection() */
+    slot = (slot + 1) & (index->size - 1);
+  }
+
+  index->slots[slot] = id;
+  index->count++;
+  index->lasthit = id;
+
+  return 0;
+} /* End of mstl3_indexID() */
 
 /***************************************************************************
- * Create an MS3TraceSeg structure from an MS3Record structure.
+ * Free the trace ID hash index of a MS3TraceList.
+ ***************************************************************************/
+static void
+mstl3_free_index (MS3TraceList *mstl)
+{
+  if (mstl->idindex->slots)
+    libmseed_memory.free (mstl->idindex->slots);
+
+  libmseed_memory.free (mstl->idindex);
+  mstl->idindex = NULL;
+} /* End of mstl3_free_index() */
+
+/***************************************************************************
+ * Search a segment index skip list for the position of a time and
+ * segment, NULL for seg to search for the first entry at time.
  *
- * Return a pointer to a MS3TraceSeg otherwise NULL on error.
+ * If prev is not NULL, set pointers to previous entries at each level.
  *
- * \ref MessageOnError - this function logs a message on error
+ * Return the last node ordered before the position, the head node if
+ * none.
  ***************************************************************************/
-MS3TraceSeg *
-mstl3_msr2seg (const MS3Record *msr, nstime_t endtime)
+static struct MS3SegIndexNode *
+mstl3_segindex_seek (struct MS3SegIndexNode *head, nstime_t time, MS3TraceSeg *seg,
+                     struct MS3SegIndexNode **prev)
 {
-  MS3TraceSeg *seg = 0;
-  size_t datasize = 0;
-  int samplesize;
+  struct MS3SegIndexNode *node = head;
+  struct MS3SegIndexNode *next;
+  int level;
 
-  if (!(seg = (MS3TraceSeg *)libmseed_memory.malloc (sizeof (MS3TraceSeg))))
+  for (level = MSTL_SEGINDEX_HEIGHT - 1; level >= 0; level--)
   {
-    ms_log (2, "Error allocating memory\n");
-    return NULL;
+    while ((next = node->next[level]) != NULL &&
+           (next->time < time ||
+            (next->time == time && (uintptr_t)next->seg < (uintptr_t)seg)))
+    {
+      node = next;
+    }
+
+    if (prev)
+      prev[level] = node;
   }
-  memset (seg, 0, sizeof (MS3TraceSeg));
 
-  /* Populate MS3TraceSeg */
-  seg->starttime = msr->starttime;
-  seg->endtime = endtime;
-  seg->samprate = msr3_sampratehz(msr);
-  seg->samplecnt = msr->samplecnt;
-  seg->sampletype = msr->sampletype;
-  seg->numsamples = msr->numsamples;
+  return node;
+} /* End of mstl3_segindex_seek() */
+
+/***************************************************************************
+ * Insert a segment into a segment index skip list at time.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl3_segindex_insert (MS3TraceList *mstl, struct MS3TraceSegIndex *segindex,
+                       struct MS3SegIndexNode *head, nstime_t time, MS3TraceSeg *seg)
+{
+  struct MS3SegIndexNode *prev[MSTL_SEGINDEX_HEIGHT];
+  struct MS3SegIndexNode *node;
+  uint8_t height;
+  int level;
 
-  /* Allocate space for and copy datasamples */
-  if (msr->datasamples && msr->numsamples)
+  if (!(node = (struct MS3SegIndexNode *)mstl3_alloc_node (mstl, MSTL_NODE_SEGINDEX)))
+    return -1;
+
+  mstl3_segindex_seek (head, time, seg, prev);
+
+  node->time = time;
+  node->seg = seg;
+
+  height = lm_random_height (MSTL_SEGINDEX_HEIGHT, &(segindex->prngstate));
+
+  for (level = 0; level < MSTL_SEGINDEX_HEIGHT; level++)
   {
-    if (!(samplesize = ms_samplesize (msr->sampletype)))
+    if (level < height)
     {
-      ms_log (2, "Unknown sample size for sample type: %c\n", msr->sampletype);
-      return NULL;
+      node->next[level] = prev[level]->next[level];
+      prev[level]->next[level] = node;
     }
-
-    datasize = samplesize * msr->numsamples;
-
-    if (!(seg->datasamples = libmseed_memory.malloc ((size_t) (datasize))))
+    else
     {
-      ms_log (2, "Error allocating memory\n");
-      return NULL;
+      node->next[level] = NULL;
     }
-    seg->datasize = datasize;
+  }
+
+  return 0;
+} /* End of mstl3_segindex_insert() */
+
+/***************************************************************************
+ * Delete a segment at time from a segment index skip list.
+ *
+ * Return 0 on success and -1 if the segment is not in the list at time.
+ ***************************************************************************/
+static int
+mstl3_segindex_delete (MS3TraceList *mstl, struct MS3SegIndexNode *head,
+                       nstime_t time, MS3TraceSeg *seg)
+{
+  struct MS3SegIndexNode *prev[MSTL_SEGINDEX_HEIGHT];
+  struct MS3SegIndexNode *node;
+  int level;
+
+  node = mstl3_segindex_seek (head, time, seg, prev)->next[0];
+
+  if (!node || node->seg != seg || node->time != time)
+    return -1;
 
-    /* Copy data samples from MS3Record to MS3TraceSeg */
-    memcpy (seg->datasamples, msr->datasamples, datasize);
+  for (level = 0; level < MSTL_SEGINDEX_HEIGHT; level++)
+  {
+    if (prev[level]->next[level] == node)
+      prev[level]->next[level] = node->next[level];
   }
 
-  return seg;
-} /* End of mstl3_msr2seg() */
+  mstl3_free_node (mstl, MSTL_NODE_SEGINDEX, node);
+
+  return 0;
+} /* End of mstl3_segindex_delete() */
+
+/***************************************************************************
+ * Add a segment to the segment index of a MS3TraceID, if indexed.
+ *
+ * On error the index is dropped and searches use the segment list.
+ ***************************************************************************/
+static void
+mstl3_segindex_add (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg)
+{
+  if (!id->segindex)
+    return;
+
+  if (mstl3_segindex_insert (mstl, id->segindex, &id->segindex->start, seg->starttime, seg) ||
+      mstl3_segindex_insert (mstl, id->segindex, &id->segindex->end, seg->endtime, seg))
+    mstl3_free_segindex (mstl, id);
+} /* End of mstl3_segindex_add() */
+
+/***************************************************************************
+ * Remove a segment from the segment index of a MS3TraceID, if indexed.
+ *
+ * On error the index is dropped and searches use the segment list.
+ ***************************************************************************/
+static void
+mstl3_segindex_remove (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg)
+{
+  if (!id->segindex)
+    return;
+
+  if (mstl3_segindex_delete (mstl, &id->segindex->start, seg->starttime, seg) ||
+      mstl3_segindex_delete (mstl, &id->segindex->end, seg->endtime, seg))
+    mstl3_free_segindex (mstl, id);
+} /* End of mstl3_segindex_remove() */
+
+/***************************************************************************
+ * Update the segment index of a MS3TraceID, if indexed, for a segment
+ * that changed from the specified start and end times.
+ *
+ * On error the index is dropped and searches use the segment list.
+ ***************************************************************************/
+static void
+mstl3_segindex_update (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg,
+                       nstime_t oldstart, nstime_t oldend)
+{
+  if (!id || !id->segindex)
+    return;
+
+  if (oldstart != seg->starttime &&
+      (mstl3_segindex_delete (mstl, &id->segindex->start, oldstart, seg) ||
+       mstl3_segindex_insert (mstl, id->segindex, &id->segindex->start, seg->starttime, seg)))
+  {
+    mstl3_free_segindex (mstl, id);
+    return;
+  }
+
+  if (oldend != seg->endtime &&
+      (mstl3_segindex_delete (mstl, &id->segindex->end, oldend, seg) ||
+       mstl3_segindex_insert (mstl, id->segindex, &id->segindex->end, seg->endtime, seg)))
+  {
+    mstl3_free_segindex (mstl, id);
+  }
+} /* End of mstl3_segindex_update() */
 
 /***************************************************************************
- * Add data coverage from a MS3Record structure to a MS3TraceSeg structure.
- *
- * Data coverage is added to the beginning or end of MS3TraceSeg
- * according to the whence flag:
- * 1 : add coverage to the end
- * 2 : add coverage to the beginninig
- *
- * Return a pointer to a MS3TraceSeg otherwise, NULL on error.
+ * Find the segments a record fits before and after, and the segment it
+ * follows in time order, using the segment index of a MS3TraceID.
  *
- * \ref MessageOnError - this function logs a message on error
+ * The results are the same as searching the complete segment list in
+ * mstl3_addmsr_recordptr(), which relies on the list being ordered by
+ * segment start time and on a time tolerance smaller than the sample
+ * period.  Then segments the record fits after all start before the
+ * record, segments it fits before all start after the record, and
+ * segments that start at the same time are adjacent in the list.
  ***************************************************************************/
-MS3TraceSeg *
-mstl3_addmsrtoseg (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int8_t whence)
+static void
+mstl3_segindex_find (MS3TraceID *id, const MS3Record *msr, nstime_t endtime,
+                     nstime_t nsdelta, nstime_t nstimetol, int8_t autoheal,
+                     double sampratehz, double sampratetol, int8_t ratetol,
+                     MS3TraceSeg **segbefore, MS3TraceSeg **segafter,
+                     MS3TraceSeg **followseg)
 {
-  int samplesize = 0;
-  void *newdatasamples = NULL;
-  size_t newdatasize = 0;
-
-  if (!seg || !msr)
+  struct MS3TraceSegIndex *index = id->segindex;
+  struct MS3SegIndexNode *node;
+  MS3TraceSeg *seg;
+  MS3TraceSeg *exact = NULL;
+  nstime_t nnstimetol = (nstimetol) ? -nstimetol : 0;
+  nstime_t low;
+  nstime_t high;
+
+/* Test if a segment sample rate is within tolerance, as in the list search */
+#define MSTL_RATEMATCH(SEG) ((ratetol) ? !(sampratetol >= 0 && ms_dabs (sampratehz - (SEG)->samprate) > sampratetol) \
+                                       : MS_ISRATETOLERABLE (sampratehz, (SEG)->samprate))
+
+  *segbefore = NULL;
+  *segafter = NULL;
+  *followseg = NULL;
+
+  /* Last segment starting before the record */
+  node = mstl3_segindex_seek (&index->start, msr->starttime, NULL, NULL);
+  if (node != &index->start)
   {
-    ms_log (2, "Required argument not defined: 'seg' or 'msr'\n");
-    return NULL;
+    seg = node->seg;
+    while (seg->next && seg->next->starttime < msr->starttime)
+      seg = seg->next;
+
+    *followseg = seg;
   }
 
-  /* Allocate more memory for data samples if included */
-  if (msr->datasamples && msr->numsamples > 0)
+  /* First segment exactly matching the record coverage when autohealing */
+  if (autoheal && (node = node->next[0]) != NULL && node->time == msr->starttime)
   {
-    if (msr->sampletype != seg->sampletype)
-    {
-      ms_log (2, "MS3Record sample type (%c) does not match segment sample type (%c)\n",
-              msr->sampletype, seg->sampletype);
-      return NULL;
-    }
+    seg = node->seg;
+    while (seg->prev && seg->prev->starttime == msr->starttime)
+      seg = seg->prev;
 
-    if (!(samplesize = ms_samplesize (msr->sampletype)))
+    for (; seg && seg->starttime == msr->starttime; seg = seg->next)
     {
-      ms_log (2, "Unknown sample size for sample type: %c\n", msr->sampletype);
-      return NULL;
+      if (seg->endtime == endtime)
+      {
+        exact = seg;
+        *followseg = seg;
+        break;
+      }
     }
+  }
 
-    newdatasize = (seg->numsamples + msr->numsamples) * samplesize;
+  /* First segment, in list order, that the record fits after the end of */
+  low = msr->starttime - nsdelta - nstimetol;
+  high = msr->starttime - nsdelta - nnstimetol;
 
-    if (libmseed_prealloc_block_size)
-    {
-      newdatasamples = libmseed_memory_prealloc (seg->datasamples, newdatasize, &(seg->datasize));
-    }
-    else
-    {
-      newdatasamples = libmseed_memory.realloc (seg->datasamples, newdatasize);
-      seg->datasize = newdatasize;
-    }
+  for (node = mstl3_segindex_seek (&index->end, low, NULL, NULL)->next[0];
+       node && node->time <= high;
+       node = node->next[0])
+  {
+    seg = node->seg;
 
-    if (!newdatasamples)
+    if (!MSTL_RATEMATCH (seg))
+      continue;
+
+    if (!*segbefore || seg->starttime < (*segbefore)->starttime ||
+        (seg->starttime == (*segbefore)->starttime && seg->endtime > (*segbefore)->endtime))
+      *segbefore = seg;
+  }
+
+  /* Earliest in the list of segments with the same coverage */
+  if (*segbefore)
+  {
+    for (seg = (*segbefore)->prev;
+         seg && seg->starttime == (*segbefore)->starttime && seg->endtime == (*segbefore)->endtime;
+         seg = seg->prev)
     {
-      ms_log (2, "Error allocating memory\n");
-      seg->datasize = 0;
-      return NULL;
+      if (MSTL_RATEMATCH (seg))
+        *segbefore = seg;
     }
-
-    seg->datasamples = newdatasamples;
   }
 
-  /* Add coverage to end of segment */
-  if (whence == 1)
+  /* List search ends before segments after an exact match, or at the first fit if not autohealing */
+  if (exact || (!autoheal && *segbefore))
+    return;
+
+  /* First segment, in list order, that the record fits before the start of */
+  low = endtime + nsdelta + nnstimetol;
+  high = endtime + nsdelta + nstimetol;
+
+  node = mstl3_segindex_seek (&index->start, low, NULL, NULL)->next[0];
+  if (node && node->time <= high)
   {
-    seg->endtime = endtime;
-    seg->samplecnt += msr->samplecnt;
+    seg = node->seg;
+    while (seg->prev && seg->prev->starttime >= low)
+      seg = seg->prev;
 
-    if (msr->datasamples && msr->numsamples > 0)
+    for (; seg && seg->starttime <= high; seg = seg->next)
     {
-      memcpy ((char *)seg->datasamples + (seg->numsamples * samplesize),
-              msr->datasamples,
-              (size_t) (msr->numsamples * samplesize));
-
-      seg->numsamples += msr->numsamples;
+      if (MSTL_RATEMATCH (seg))
+      {
+        *segafter = seg;
+        break;
+      }
     }
   }
-  /* Add coverage to beginning of segment */
-  else if (whence == 2)
+
+#undef MSTL_RATEMATCH
+} /* End of mstl3_segindex_find() */
+
+/***************************************************************************
+ * Build an index of the segments of a MS3TraceID by start and end time.
+ *
+ * The index is only built when the segment list is ordered by start
+ * time, which is maintained by mstl3_addmsr_recordptr().
+ ***************************************************************************/
+static void
+mstl3_build_segindex (MS3TraceList *mstl, MS3TraceID *id)
+{
+  MS3TraceSeg *seg;
+
+  for (seg = id->first; seg && seg->next; seg = seg->next)
   {
-    seg->starttime = msr->starttime;
-    seg->samplecnt += msr->samplecnt;
+    if (seg->next->starttime < seg->starttime)
+      return;
+  }
 
-    if (msr->datasamples && msr->numsamples > 0)
-    {
-      memmove ((char *)seg->datasamples + (msr->numsamples * samplesize),
-               seg->datasamples,
-               (size_t) (seg->numsamples * samplesize));
+  if (!(id->segindex = (struct MS3TraceSegIndex *)libmseed_memory.malloc (sizeof (struct MS3TraceSegIndex))))
+    return;
 
-      memcpy (seg->datasamples,
-              msr->datasamples,
-              (size_t) (msr->numsamples * samplesize));
+  memset (id->segindex, 0, sizeof (struct MS3TraceSegIndex));
+  id->segindex->prngstate = 1;
 
-      seg->numsamples += msr->numsamples;
-    }
+  for (seg = id->first; seg && id->segindex; seg = seg->next)
+    mstl3_segindex_add (mstl, id, seg);
+} /* End of mstl3_build_segindex() */
+
+/***************************************************************************
+ * Free the segment index of a MS3TraceID.
+ ***************************************************************************/
+static void
+mstl3_free_segindex (MS3TraceList *mstl, MS3TraceID *id)
+{
+  struct MS3SegIndexNode *node;
+  struct MS3SegIndexNode *nextnode;
+
+  node = id->segindex->start.next[0];
+  while (node)
+  {
+    nextnode = node->next[0];
+    mstl3_free_node (mstl, MSTL_NODE_SEGINDEX, node);
+    node = nextnode;
   }
-  else
+
+  node = id->segindex->end.next[0];
+  while (node)
   {
-    ms_log (2, "unrecognized whence value: %d\n", whence);
-    return NULL;
+    nextnode = node->next[0];
+    mstl3_free_node (mstl, MSTL_NODE_SEGINDEX, node);
+    node = nextnode;
   }
 
-  return seg;
-} /* End of mstl3_addmsrtoseg() */
+  libmseed_memory.free (id->segindex);
+  id->segindex = NULL;
+} /* End of mstl3_free_segindex() */
 
 /***************************************************************************
  * Add data coverage from seg2 to seg1.
  *
+ * If either segment stores samples in chunks, the chunks of seg2 are
+ * linked to the end of seg1 without copying samples.
+ *
  * Return a pointer to a seg1 otherwise NULL on error.
  *
  * \ref MessageOnError - this function logs a message on error
@@ -1193,19 +3583,38 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
     return NULL;
   }
 
-  /* Allocate more memory for data samples if included */
-  if (seg2->datasamples && seg2->numsamples > 0)
+  if (seg2->numsamples > 0 && seg1->numsamples > 0 &&
+      seg2->sampletype != seg1->sampletype)
   {
-    if (seg2->sampletype != seg1->sampletype)
-    {
-      ms_log (2, "MS3TraceSeg sample types do not match (%c and %c)\n",
-              seg1->sampletype, seg2->sampletype);
+    ms_log (2, "MS3TraceSeg sample types do not match (%c and %c)\n",
+            seg1->sampletype, seg2->sampletype);
+    return NULL;
+  }
+
+  /* Link chunks of seg2 to the end of seg1 if either uses chunks */
+  if ((seg1->chunks || seg2->chunks) && seg2->numsamples > 0)
+  {
+    if (mstl3_seg2chunks (seg1) < 0 || mstl3_seg2chunks (seg2) < 0)
       return NULL;
-    }
 
-    if (!(samplesize = ms_samplesize (seg1->sampletype)))
+    if (seg1->lastchunk)
+      seg1->lastchunk->next = seg2->chunks;
+    else
+      seg1->chunks = seg2->chunks;
+
+    seg1->lastchunk = seg2->lastchunk;
+    seg1->sampletype = seg2->sampletype;
+    seg1->numsamples += seg2->numsamples;
+
+    seg2->chunks = seg2->lastchunk = NULL;
+    seg2->numsamples = 0;
+  }
+  /* Allocate more memory for data samples if included */
+  else if (seg2->datasamples && seg2->numsamples > 0)
+  {
+    if (!(samplesize = ms_samplesize (seg2->sampletype)))
     {
-      ms_log (2, "Unknown sample size for sample type: %c\n", seg1->sampletype);
+      ms_log (2, "Unknown sample size for sample type: %c\n", seg2->sampletype);
       return NULL;
     }
 
@@ -1229,21 +3638,19 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
     }
 
     seg1->datasamples = newdatasamples;
-  }
-
-  /* Add seg2 coverage to end of seg1 */
-  seg1->endtime = seg2->endtime;
-  seg1->samplecnt += seg2->samplecnt;
 
-  if (seg2->datasamples && seg2->numsamples > 0)
-  {
     memcpy ((char *)seg1->datasamples + (seg1->numsamples * samplesize),
             seg2->datasamples,
             (size_t) (seg2->numsamples * samplesize));
 
+    seg1->sampletype = seg2->sampletype;
     seg1->numsamples += seg2->numsamples;
   }
 
+  /* Add seg2 coverage to end of seg1 */
+  seg1->endtime = seg2->endtime;
+  seg1->samplecnt += seg2->samplecnt;
+
   /* Add seg2 record list to end of seg1 record list */
   if (seg2->recordlist)
   {
@@ -1289,9 +3696,11 @@ mstl3_addsegtoseg (MS3TraceSeg *seg1, MS3TraceSeg *seg2)
  * \sa mstl3_addmsr()
  ***************************************************************************/
 MS3RecordPtr *
-mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, int8_t whence)
+mstl3_add_recordptr (MS3TraceList *mstl, MS3TraceSeg *seg, const MS3Record *msr,
+                     nstime_t endtime, int8_t whence)
 {
   MS3RecordPtr *recordptr = NULL;
+  MS3Record *dupmsr = NULL;
 
   if (!seg || !msr)
   {
@@ -1305,7 +3714,7 @@ mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, i
     return NULL;
   }
 
-  recordptr = (MS3RecordPtr *)libmseed_memory.malloc (sizeof (MS3RecordPtr));
+  recordptr = (MS3RecordPtr *)mstl3_alloc_node (mstl, MSTL_NODE_RECORDPTR);
 
   if (recordptr == NULL)
   {
@@ -1314,31 +3723,81 @@ mstl3_add_recordptr (MS3TraceSeg *seg, const MS3Record *msr, nstime_t endtime, i
   }
 
   memset (recordptr, 0, sizeof(MS3RecordPtr));
-  recordptr->msr     = msr3_duplicate (msr, 0);
   recordptr->endtime = endtime;
 
-  if (recordptr->msr == NULL)
+  /* Duplicate record header, into the arena if used */
+  if (mstl->arena)
+  {
+    if ((dupmsr = (MS3Record *)mstl3_alloc_node (mstl, MSTL_NODE_RECORD)) != NULL)
+    {
+      memcpy (dupmsr, msr, sizeof (MS3Record));
+
+      dupmsr->extra = NULL;
+      dupmsr->extralength = 0;
+      dupmsr->datasamples = NULL;
+      dupmsr->datasize = 0;
+      dupmsr->numsamples = 0;
+
+      if (msr->extralength > 0 && msr->extra)
+      {
+        if ((dupmsr->extra = (char *)libmseed_memory.malloc (msr->extralength)) == NULL)
+        {
+          mstl3_free_node (mstl, MSTL_NODE_RECORD, dupmsr);
+          dupmsr = NULL;
+        }
+        else
+        {
+          memcpy (dupmsr->extra, msr->extra, msr->extralength);
+          dupmsr->extralength = msr->extralength;
+        }
+      }
+    }
+  }
+  else
+  {
+    dupmsr = msr3_duplicate (msr, 0);
+  }
+
+  if (dupmsr == NULL)
   {
     ms_log (2, "Cannot duplicate MS3Record\n");
-    libmseed_memory.free (recordptr);
+    mstl3_free_node (mstl, MSTL_NODE_RECORDPTR, recordptr);
     return NULL;
   }
 
+  recordptr->msr = dupmsr;
+
   /* If no record list for the segment is present, allocate and add record pointer */
   if (seg->recordlist == NULL)
   {
-    seg->recordlist = (MS3RecordList *)libmseed_memory.malloc (sizeof (MS3RecordList));
+    seg->recordlist = (MS3RecordList *)mstl3_alloc_node (mstl, MSTL_NODE_RECORDLIST);
 
     if (seg->recordlist == NULL)
     {
       ms_log (2, "Cannot allocate memory\n");
-      libmseed_memory.free (recordptr);
+      if (mstl->arena)
+      {
+        if (dupmsr->extra)
+          libmseed_memory.free (dupmsr->extra);
+        mstl3_free_node (mstl, MSTL_NODE_RECORD, dupmsr);
+      }
+      else
+      {
+        msr3_free (&dupmsr);
+      }
+      mstl3_free_node (mstl, MSTL_NODE_RECORDPTR, recordptr);
       return NULL;
     }
 
+    /* Record lists of the trace list share a cache of open files, created on first use */
+    if (mstl->filecache == NULL &&
+        (mstl->filecache = (struct MS3FileCache *)libmseed_memory.malloc (sizeof (struct MS3FileCache))) != NULL)
+      memset (mstl->filecache, 0, sizeof (struct MS3FileCache));
+
     seg->recordlist->recordcnt = 1;
     seg->recordlist->first     = recordptr;
     seg->recordlist->last      = recordptr;
+    seg->recordlist->filecache = mstl->filecache;
   }
   /* Otherwise, add record pointer to existing list */
   else
@@ -1419,6 +3878,10 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
     return -1;
   }
 
+  /* Conversion requires contiguous samples */
+  if (seg->chunks && mstl3_flatten_samples (seg) < 0)
+    return -1;
+
   idata = (int32_t *)seg->datasamples;
   fdata = (float *)seg->datasamples;
   ddata = (double *)seg->datasamples;
@@ -1536,64 +3999,298 @@ mstl3_convertsamples (MS3TraceSeg *seg, char type, int8_t truncate)
 /**********************************************************************/ /**
  * @brief Resize data sample buffers of ::MS3TraceList to what is needed
  *
- * This routine should only be used if pre-allocation of memory, via
- * ::libmseed_prealloc_block_size, was enabled to allocate the buffers.
+ * This routine should only be used if pre-allocation of memory, via
+ * ::libmseed_prealloc_block_size, was enabled to allocate the buffers.
+ *
+ * @param[in] mstl ::MS3TraceList to resize buffers
+ *
+ * @returns Return 0 on success, otherwise returns a libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+mstl3_resize_buffers (MS3TraceList *mstl)
+{
+  MS3TraceID *id = NULL;
+  MS3TraceSeg *seg = NULL;
+  uint8_t samplesize = 0;
+  size_t datasize;
+
+  if (!mstl)
+  {
+    ms_log (2, "Required argument not defined: 'mstl'\n");
+    return MS_GENERROR;
+  }
+
+  /* Loop through trace ID and segment lists */
+  id = mstl->traces.next[0];
+  while (id)
+  {
+    seg = id->first;
+    while (seg)
+    {
+      samplesize = ms_samplesize(seg->sampletype);
+
+      /* Shrink the last sample chunk, only the last has unused space */
+      if (samplesize && seg->lastchunk && seg->lastchunk->numsamples > 0)
+      {
+        datasize = (size_t) seg->lastchunk->numsamples * samplesize;
+
+        if (seg->lastchunk->datasize > datasize)
+        {
+          seg->lastchunk->datasamples = libmseed_memory.realloc (seg->lastchunk->datasamples, datasize);
+
+          if (seg->lastchunk->datasamples == NULL)
+          {
+            ms_log (2, "%s: Cannot (re)allocate memory\n", id->sid);
+            return MS_GENERROR;
+          }
+
+          seg->lastchunk->datasize = datasize;
+        }
+      }
+
+      if (samplesize && seg->datasamples && seg->numsamples > 0)
+      {
+        datasize = (size_t) seg->numsamples * samplesize;
+
+        if (seg->datasize > datasize)
+        {
+          seg->datasamples = libmseed_memory.realloc (seg->datasamples, datasize);
+
+          if (seg->datasamples == NULL)
+          {
+            ms_log (2, "%s: Cannot (re)allocate memory\n", id->sid);
+            return MS_GENERROR;
+          }
+
+          seg->datasize = datasize;
+        }
+      }
+
+      seg = seg->next;
+    }
+
+    id = id->next[0];
+  }
+
+  return 0;
+} /* End of mstl3_resize_buffers() */
+
+/**********************************************************************/ /**
+ * @brief Convert chunked data samples of a ::MS3TraceSeg to a
+ * contiguous buffer
+ *
+ * When data samples are stored in a list of ::MS3SampleChunk
+ * entries, see ::MSF_SAMPLECHUNKS, the samples are copied to a
+ * single ::MS3TraceSeg.datasamples buffer and the chunks are freed,
+ * including any data at ::MS3SampleChunk.prvtptr.
+ *
+ * Segments with contiguous samples or no samples are not modified.
+ *
+ * @param[in] seg ::MS3TraceSeg to flatten
+ *
+ * @returns number of samples in ::MS3TraceSeg.datasamples on success
+ * and a negative library error code on error.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+mstl3_flatten_samples (MS3TraceSeg *seg)
+{
+  MS3SampleChunk *chunk = NULL;
+  uint8_t samplesize = 0;
+  size_t datasize;
+  size_t chunksize;
+  size_t offset = 0;
+  char *datasamples = NULL;
+
+  if (!seg)
+  {
+    ms_log (2, "Required argument not defined: 'seg'\n");
+    return MS_GENERROR;
+  }
+
+  if (!seg->chunks)
+    return seg->numsamples;
+
+  if (!(samplesize = ms_samplesize (seg->sampletype)))
+  {
+    ms_log (2, "Unknown sample size for sample type: %c\n", seg->sampletype);
+    return MS_GENERROR;
+  }
+
+  /* A single chunk in memory becomes the contiguous buffer */
+  if (seg->chunks == seg->lastchunk && !seg->chunks->mapped)
+  {
+    chunk = seg->chunks;
+
+    seg->datasamples = chunk->datasamples;
+    seg->datasize = chunk->datasize;
+    chunk->datasamples = NULL;
+  }
+  else
+  {
+    datasize = (size_t)seg->numsamples * samplesize;
+
+    if (!(datasamples = (char *)libmseed_memory.malloc (datasize)))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return MS_GENERROR;
+    }
+
+    for (chunk = seg->chunks; chunk; chunk = chunk->next)
+    {
+      chunksize = (size_t)chunk->numsamples * samplesize;
+      memcpy (datasamples + offset, chunk->datasamples, chunksize);
+      offset += chunksize;
+    }
+
+    seg->datasamples = datasamples;
+    seg->datasize = datasize;
+  }
+
+  /* Free chunks, retaining samples and sample count */
+  mstl3_free_chunks (seg, 1);
+
+  return seg->numsamples;
+} /* End of mstl3_flatten_samples() */
+
+/**********************************************************************/ /**
+ * @brief Move the data samples of a ::MS3TraceSeg to a temporary file
+ *
+ * The sample chunks of the segment that are in memory are written to
+ * a temporary file and replaced by read-only memory mappings of the
+ * file, releasing the memory while the samples remain accessible at
+ * ::MS3SampleChunk.datasamples.  The operating system pages spilled
+ * samples back in when they are read, e.g. for hashing, and may evict
+ * them again without writing.  The file is removed immediately and
+ * its space is released when the chunks are freed.
+ *
+ * Contiguous samples are first converted to a chunk.  Samples added to
+ * the segment afterwards are stored in new chunks in memory and may be
+ * spilled by a later call.  Spilled chunks are ::MS3SampleChunk.mapped
+ * and must not be modified.
+ *
+ * Not supported on Windows.
  *
- * @param[in] mstl ::MS3TraceList to resize buffers
+ * @param[in] seg ::MS3TraceSeg to spill
+ * @param[in] tempdir Directory for the temporary file, if NULL the
+ * \c TMPDIR environment variable or \c /tmp is used
  *
- * @returns Return 0 on success, otherwise returns a libmseed error code.
+ * @returns number of bytes of sample memory released on success and
+ * a negative library error code on error.
  *
  * \ref MessageOnError - this function logs a message on error
  ***************************************************************************/
-int
-mstl3_resize_buffers (MS3TraceList *mstl)
+int64_t
+mstl3_spill_samples (MS3TraceSeg *seg, const char *tempdir)
 {
-  MS3TraceID *id = NULL;
-  MS3TraceSeg *seg = NULL;
+#if defined(LMP_WIN)
+  (void)seg;
+  (void)tempdir;
+
+  ms_log (2, "Spilling samples to a file is not supported on this platform\n");
+  return MS_GENERROR;
+#else
+  MS3SampleChunk *chunk = NULL;
+  char path[1024];
   uint8_t samplesize = 0;
-  size_t datasize;
+  size_t pagesize;
+  size_t length;
+  size_t written;
+  ssize_t rv;
+  off_t offset = 0;
+  int64_t released = 0;
+  void *map;
+  int fd;
 
-  if (!mstl)
+  if (!seg)
   {
-    ms_log (2, "Required argument not defined: 'mstl'\n");
+    ms_log (2, "Required argument not defined: 'seg'\n");
     return MS_GENERROR;
   }
 
-  /* Loop through trace ID and segment lists */
-  id = mstl->traces.next[0];
-  while (id)
+  if (seg->numsamples <= 0)
+    return 0;
+
+  if (!(samplesize = ms_samplesize (seg->sampletype)))
   {
-    seg = id->first;
-    while (seg)
-    {
-      samplesize = ms_samplesize(seg->sampletype);
+    ms_log (2, "Unknown sample size for sample type: %c\n", seg->sampletype);
+    return MS_GENERROR;
+  }
 
-      if (samplesize && seg->datasamples && seg->numsamples > 0)
-      {
-        datasize = (size_t) seg->numsamples * samplesize;
+  if (!seg->chunks && mstl3_seg2chunks (seg) < 0)
+    return MS_GENERROR;
 
-        if (seg->datasize > datasize)
-        {
-          seg->datasamples = libmseed_memory.realloc (seg->datasamples, datasize);
+  /* Nothing to do if all chunks are already spilled */
+  for (chunk = seg->chunks; chunk; chunk = chunk->next)
+  {
+    if (!chunk->mapped && chunk->numsamples > 0)
+      break;
+  }
 
-          if (seg->datasamples == NULL)
-          {
-            ms_log (2, "%s: Cannot (re)allocate memory\n", id->sid);
-            return MS_GENERROR;
-          }
+  if (!chunk)
+    return 0;
 
-          seg->datasize = datasize;
-        }
+  if (!tempdir && !(tempdir = getenv ("TMPDIR")))
+    tempdir = "/tmp";
+
+  snprintf (path, sizeof (path), "%s/libmseed-spill-XXXXXX", tempdir);
+
+  if ((fd = mkstemp (path)) < 0)
+  {
+    ms_log (2, "Cannot create temporary file (%s): %s\n", path, strerror (errno));
+    return MS_GENERROR;
+  }
+
+  unlink (path);
+
+  pagesize = (size_t)sysconf (_SC_PAGESIZE);
+
+  /* Write each chunk at a page-aligned offset and map it from the file */
+  for (chunk = seg->chunks; chunk; chunk = chunk->next)
+  {
+    if (chunk->mapped || chunk->numsamples <= 0)
+      continue;
+
+    length = (size_t)chunk->numsamples * samplesize;
+
+    for (written = 0; written < length; written += (size_t)rv)
+    {
+      if ((rv = pwrite (fd, (char *)chunk->datasamples + written,
+                        length - written, offset + (off_t)written)) <= 0)
+      {
+        ms_log (2, "Cannot write temporary file: %s\n", (rv < 0) ? strerror (errno) : "no space");
+        close (fd);
+        return MS_GENERROR;
       }
+    }
 
-      seg = seg->next;
+    map = mmap (NULL, length, PROT_READ, MAP_SHARED, fd, offset);
+
+    if (map == MAP_FAILED)
+    {
+      ms_log (2, "Cannot map temporary file: %s\n", strerror (errno));
+      close (fd);
+      return MS_GENERROR;
     }
 
-    id = id->next[0];
+    released += (int64_t)chunk->datasize;
+
+    libmseed_memory.free (chunk->datasamples);
+    chunk->datasamples = map;
+    chunk->datasize = length;
+    chunk->mapped = 1;
+
+    offset += (off_t)(((length + pagesize - 1) / pagesize) * pagesize);
   }
 
-  return 0;
-} /* End of mstl3_resize_buffers() */
+  close (fd);
+
+  return released;
+#endif
+} /* End of mstl3_spill_samples() */
 
 /**********************************************************************/ /**
  * @brief Unpack data samples in a @ref record-list associated with a ::MS3TraceList
@@ -1617,6 +4314,15 @@ mstl3_resize_buffers (MS3TraceList *mstl)
  *   -# Open file and offset (::MS3RecordPtr.fileptr and ::MS3RecordPtr.fileoffset)
  *   -# File name and offset (::MS3RecordPtr.filename and ::MS3RecordPtr.fileoffset)
  *
+ * Records in files are read in windows of record list entries: the
+ * records of a window are sorted by file and offset, records that are
+ * adjacent (or separated by small gaps) in a file are read with a
+ * single call and the window is then decoded in record list order.
+ * Files identified by name are opened via a cache of open files
+ * shared by all record lists of a ::MS3TraceList, which are closed
+ * by mstl3_free().  The record lists of a trace list should therefore
+ * not be unpacked concurrently from multiple threads.
+ *
  * It would be unusual to build a record list outside of the library,
  * but should that ever occur note that the record list is assumed to
  * be in correct time order and represent a contiguous time series.
@@ -1644,6 +4350,14 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   int64_t unpackedsamples = 0;
   int64_t totalunpackedsamples = 0;
 
+  struct MS3RecordRead *reads = NULL;
+  struct MS3RecordRead **order = NULL;
+  size_t readsize = 0;
+  size_t readcount = 0;
+  size_t ordercount = 0;
+  size_t stagedbytes = 0;
+  size_t idx;
+
   char *filebuffer = NULL;
   size_t filebuffersize = 0;
 
@@ -1653,17 +4367,12 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   char sampletype = 0;
   char recsampletype = 0;
 
-  FILE *fileptr = NULL;
   const char *input = NULL;
+  void *ptr;
 
-  /* Linked list of open file pointers */
-  struct filelist_s {
-    const char *filename;
-    FILE *fileptr;
-    struct filelist_s *next;
-  };
-  struct filelist_s *filelist = NULL;
-  struct filelist_s *filelistptr = NULL;
+  /* Files opened for this call if the record list does not share a cache */
+  struct MS3FileCache localcache;
+  struct MS3FileCache *filecache;
 
   if (!id || !seg)
   {
@@ -1677,6 +4386,9 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
     return -1;
   }
 
+  memset (&localcache, 0, sizeof (localcache));
+  filecache = (seg->recordlist->filecache) ? seg->recordlist->filecache : &localcache;
+
   recordptr = seg->recordlist->first;
 
   if (ms_encoding_sizetype(recordptr->msr->encoding, &samplesize, &sampletype))
@@ -1700,7 +4412,7 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
     }
   }
   /* Otherwise check that buffer is not already allocated  */
-  else if (seg->datasamples)
+  else if (seg->datasamples || seg->chunks)
   {
     ms_log (2, "%s: Segment data buffer is already allocated, cannot replace\n", id->sid);
     return -1;
@@ -1719,163 +4431,148 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
     seg->datasize = decodedsize;
   }
 
-  /* Iterate through record list and unpack data samples */
-  while (recordptr)
+  /* Iterate through record list in windows of up to MSTL_STAGING_SIZE
+   * bytes of records in files, reading the records of each window in
+   * file and offset order and decoding them in record list order */
+  while (recordptr && totalunpackedsamples >= 0)
   {
-    /* Skip records with no samples */
-    if (recordptr->msr->samplecnt == 0)
-    {
-      recordptr = recordptr->next;
-      continue;
-    }
-
-    if (ms_encoding_sizetype(recordptr->msr->encoding, NULL, &recsampletype))
-    {
-      ms_log (2, "%s: Cannot determine sample type for encoding: %u\n", id->sid, recordptr->msr->encoding);
-
-      totalunpackedsamples = -1;
-      break;
-    }
-
-    if (recsampletype != sampletype)
-    {
-      ms_log (2, "%s: Mixed sample types cannot be decoded together: %c versus %c\n", id->sid, recsampletype, sampletype);
-
-      totalunpackedsamples = -1;
-      break;
-    }
+    readcount   = 0;
+    ordercount  = 0;
+    stagedbytes = 0;
 
-    /* Decode data from buffer */
-    if (recordptr->bufferptr)
-    {
-      input = recordptr->bufferptr + recordptr->dataoffset;
-    }
-    /* Decode data from a file at a byte offset */
-    else if (recordptr->fileptr || recordptr->filename)
+    for (; recordptr && stagedbytes < MSTL_STAGING_SIZE; recordptr = recordptr->next)
     {
-      if (recordptr->fileptr)
+      if (readcount >= readsize)
       {
-        fileptr = recordptr->fileptr;
-      }
-      else
-      {
-        /* Search file list for matching entry */
-        filelistptr = filelist;
-        while (filelistptr)
+        readsize = (readsize) ? readsize * 2 : 256;
+
+        if ((ptr = libmseed_memory.realloc (reads, readsize * sizeof (struct MS3RecordRead))) == NULL)
         {
-          if (filelistptr->filename == recordptr->filename)
-            break;
+          ms_log (2, "%s: Cannot allocate memory for record reads\n", id->sid);
 
-          filelistptr = filelistptr->next;
+          totalunpackedsamples = -1;
+          break;
         }
 
-        /* Add new entry to list and open file if needed */
-        if (filelistptr == NULL)
-        {
-          if ((filelistptr = libmseed_memory.malloc (sizeof (struct filelist_s))) == NULL)
-          {
-            ms_log (2, "%s: Cannot allocate memory for file list entry for %s\n", id->sid, recordptr->filename);
+        reads = (struct MS3RecordRead *)ptr;
+      }
 
-            totalunpackedsamples = -1;
-            break;
-          }
+      reads[readcount].recordptr   = recordptr;
+      reads[readcount].listindex   = readcount;
+      reads[readcount].stageoffset = 0;
 
-          if ((filelistptr->fileptr = fopen (recordptr->filename, "rb")) == NULL)
-          {
-            ms_log (2, "%s: Cannot open file (%s): %s\n", id->sid, recordptr->filename, strerror(errno));
+      if (recordptr->msr->samplecnt > 0 && !recordptr->bufferptr &&
+          (recordptr->fileptr || recordptr->filename))
+      {
+        stagedbytes += recordptr->msr->reclen;
+        ordercount++;
+      }
 
-            totalunpackedsamples = -1;
-            break;
-          }
+      readcount++;
+    }
 
-          filelistptr->filename = recordptr->filename;
-          filelistptr->next = filelist;
+    if (totalunpackedsamples < 0)
+      break;
 
-          filelist = filelistptr;
-        }
+    /* Read records from files into the staging buffer */
+    if (ordercount > 0)
+    {
+      if ((ptr = libmseed_memory.realloc (order, readsize * sizeof (struct MS3RecordRead *))) == NULL)
+      {
+        ms_log (2, "%s: Cannot allocate memory for record reads\n", id->sid);
 
-        fileptr = filelistptr->fileptr;
+        totalunpackedsamples = -1;
+        break;
       }
 
-      /* Allocate memory if needed, over-allocating (x2) to minimize reallocation */
-      if (recordptr->msr->reclen > filebuffersize)
+      order = (struct MS3RecordRead **)ptr;
+
+      for (idx = 0, ordercount = 0; idx < readcount; idx++)
       {
-        if ((filebuffer = libmseed_memory.realloc (filebuffer, recordptr->msr->reclen * 2)) == NULL)
-        {
-          ms_log (2, "%s: Cannot allocate memory for file read buffer\n", id->sid);
+        if (reads[idx].recordptr->msr->samplecnt > 0 && !reads[idx].recordptr->bufferptr &&
+            (reads[idx].recordptr->fileptr || reads[idx].recordptr->filename))
+          order[ordercount++] = &reads[idx];
+      }
 
-          totalunpackedsamples = -1;
-          break;
-        }
+      qsort (order, ordercount, sizeof (struct MS3RecordRead *), mstl3_cmp_recordread);
 
-        filebuffersize = recordptr->msr->reclen * 2;
+      if (mstl3_read_records (filecache, order, ordercount, &filebuffer, &filebuffersize, id->sid))
+      {
+        totalunpackedsamples = -1;
+        break;
       }
+    }
 
-      /* Seek to record position in file */
-      if (lmp_fseek64 (fileptr, recordptr->fileoffset, SEEK_SET))
+    /* Decode records of the window in record list order */
+    for (idx = 0; idx < readcount; idx++)
+    {
+      MS3RecordPtr *readptr = reads[idx].recordptr;
+
+      /* Skip records with no samples */
+      if (readptr->msr->samplecnt == 0)
+        continue;
+
+      if (ms_encoding_sizetype(readptr->msr->encoding, NULL, &recsampletype))
       {
-        ms_log (2, "%s: Cannot seek in file: %s (%s)\n",
-                id->sid,
-                (recordptr->filename) ? recordptr->filename : "",
-                strerror (errno));
+        ms_log (2, "%s: Cannot determine sample type for encoding: %u\n", id->sid, readptr->msr->encoding);
 
         totalunpackedsamples = -1;
         break;
       }
 
-      /* Read record into buffer */
-      if (fread (filebuffer, 1, recordptr->msr->reclen, fileptr) != recordptr->msr->reclen)
+      if (recsampletype != sampletype)
       {
-        ms_log (2, "%s: Cannot read record from file: %s (%s)\n",
-                id->sid,
-                (recordptr->filename) ? recordptr->filename : "",
-                strerror (errno));
+        ms_log (2, "%s: Mixed sample types cannot be decoded together: %c versus %c\n", id->sid, recsampletype, sampletype);
 
         totalunpackedsamples = -1;
         break;
+      }
 
+      /* Decode data from buffer */
+      if (readptr->bufferptr)
+      {
+        input = readptr->bufferptr + readptr->dataoffset;
+      }
+      /* Decode data read from a file at a byte offset */
+      else if (readptr->fileptr || readptr->filename)
+      {
+        input = filebuffer + reads[idx].stageoffset + readptr->dataoffset;
       }
+      else
+      {
+        ms_log (2, "%s: No buffer or file pointer for record\n", id->sid);
 
-      input = filebuffer + recordptr->dataoffset;
-    } /* Done reading from file */
-    else
-    {
-      ms_log (2, "%s: No buffer or file pointer for record\n", id->sid);
+        totalunpackedsamples = -1;
+        break;
+      }
 
-      totalunpackedsamples = -1;
-      break;
-    }
+      /* Decode data from buffer */
+      unpackedsamples = ms_decode_data (input, readptr->msr->reclen - readptr->dataoffset,
+                                        readptr->msr->encoding, readptr->msr->samplecnt,
+                                        (unsigned char *)output + outputoffset, decodedsize - outputoffset,
+                                        &sampletype, readptr->msr->swapflag, id->sid, verbose);
 
-    /* Decode data from buffer */
-    unpackedsamples = ms_decode_data (input, recordptr->msr->reclen - recordptr->dataoffset,
-                                      recordptr->msr->encoding, recordptr->msr->samplecnt,
-                                      (unsigned char *)output + outputoffset, decodedsize - outputoffset,
-                                      &sampletype, recordptr->msr->swapflag, id->sid, verbose);
+      if (unpackedsamples < 0)
+      {
+        totalunpackedsamples = -1;
+        break;
+      }
 
-    if (unpackedsamples < 0)
-    {
-      totalunpackedsamples = -1;
-      break;
+      outputoffset += unpackedsamples * samplesize;
+      totalunpackedsamples += unpackedsamples;
     }
-
-    outputoffset += unpackedsamples * samplesize;
-    totalunpackedsamples += unpackedsamples;
-
-    recordptr = recordptr->next;
   } /* Done with record list entries */
 
-  /* Free file read buffer if used */
+  /* Free file read buffers if used */
   if (filebuffer)
     libmseed_memory.free (filebuffer);
+  if (reads)
+    libmseed_memory.free (reads);
+  if (order)
+    libmseed_memory.free (order);
 
-  /* Close and free file list if used */
-  while (filelist)
-  {
-    filelistptr = filelist->next;
-    fclose (filelist->fileptr);
-    libmseed_memory.free (filelist);
-    filelist = filelistptr;
-  }
+  /* Close files opened for this call only */
+  mstl3_filecache_close (&localcache);
 
   /* If output buffer was allocated here, do some maintenance */
   if (output == seg->datasamples)
@@ -1899,6 +4596,242 @@ mstl3_unpack_recordlist (MS3TraceID *id, MS3TraceSeg *seg, void *output,
   return totalunpackedsamples;
 } /* End of mstl3_unpack_recordlist() */
 
+/***************************************************************************
+ * mstl3_read_records:
+ *
+ * Read records of a record list from files into a staging buffer.
+ * The reads in 'order' must be sorted by file and offset, records in
+ * the same file separated by no more than MSTL_READ_GAP bytes are read
+ * with a single call.  The staging buffer is (re)allocated as needed
+ * and the offset of each record in the buffer is set in its read.
+ *
+ * Files identified by name are opened via the cache.  Files in the
+ * cache are read with pread(), leaving the file position unchanged,
+ * where supported.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl3_read_records (struct MS3FileCache *cache, struct MS3RecordRead **order,
+                    size_t count, char **buffer, size_t *buffersize, const char *sid)
+{
+  MS3RecordPtr *first;
+  MS3RecordPtr *recordptr;
+  FILE *fileptr;
+  size_t stagelength = 0;
+  size_t runlength;
+  size_t start;
+  size_t end;
+  size_t idx;
+  int64_t runstart;
+  int64_t runend;
+  void *ptr;
+
+  for (start = 0; start < count; start = end)
+  {
+    first    = order[start]->recordptr;
+    runstart = first->fileoffset;
+    runend   = first->fileoffset + first->msr->reclen;
+
+    /* Extend run over following records in the same file */
+    for (end = start + 1; end < count; end++)
+    {
+      recordptr = order[end]->recordptr;
+
+      if (recordptr->fileptr != first->fileptr ||
+          (!first->fileptr && strcmp (recordptr->filename, first->filename)) ||
+          recordptr->fileoffset > runend + MSTL_READ_GAP)
+        break;
+
+      if (recordptr->fileoffset + recordptr->msr->reclen > runend)
+        runend = recordptr->fileoffset + recordptr->msr->reclen;
+    }
+
+    runlength = (size_t)(runend - runstart);
+
+    /* Allocate memory if needed, over-allocating (x2) to minimize reallocation */
+    if (stagelength + runlength > *buffersize)
+    {
+      if ((ptr = libmseed_memory.realloc (*buffer, (stagelength + runlength) * 2)) == NULL)
+      {
+        ms_log (2, "%s: Cannot allocate memory for file read buffer\n", sid);
+        return -1;
+      }
+
+      *buffer     = (char *)ptr;
+      *buffersize = (stagelength + runlength) * 2;
+    }
+
+    if (first->fileptr)
+    {
+      fileptr = first->fileptr;
+    }
+    else if ((fileptr = mstl3_filecache_open (cache, first->filename)) == NULL)
+    {
+      ms_log (2, "%s: Cannot open file (%s): %s\n", sid, first->filename, strerror (errno));
+      return -1;
+    }
+
+#if !defined(LMP_WIN)
+    /* Read files opened by the cache without changing the file position */
+    if (!first->fileptr)
+    {
+      ssize_t rv = 0;
+
+      for (idx = 0; idx < runlength; idx += (size_t)rv)
+      {
+        if ((rv = pread (fileno (fileptr), *buffer + stagelength + idx,
+                         runlength - idx, (off_t)(runstart + idx))) <= 0)
+          break;
+      }
+
+      if (idx != runlength)
+      {
+        ms_log (2, "%s: Cannot read record from file: %s (%s)\n",
+                sid, first->filename, (rv < 0) ? strerror (errno) : "end of file");
+        return -1;
+      }
+    }
+    else
+#endif
+    {
+      /* Seek to record position in file */
+      if (lmp_fseek64 (fileptr, runstart, SEEK_SET))
+      {
+        ms_log (2, "%s: Cannot seek in file: %s (%s)\n",
+                sid, (first->filename) ? first->filename : "", strerror (errno));
+        return -1;
+      }
+
+      /* Read records into buffer */
+      if (fread (*buffer + stagelength, 1, runlength, fileptr) != runlength)
+      {
+        ms_log (2, "%s: Cannot read record from file: %s (%s)\n",
+                sid, (first->filename) ? first->filename : "", strerror (errno));
+        return -1;
+      }
+    }
+
+    for (idx = start; idx < end; idx++)
+      order[idx]->stageoffset = stagelength + (size_t)(order[idx]->recordptr->fileoffset - runstart);
+
+    stagelength += runlength;
+  }
+
+  return 0;
+} /* End of mstl3_read_records() */
+
+/***************************************************************************
+ * mstl3_cmp_recordread:
+ *
+ * Compare two record reads for sorting by file, identified by open
+ * file or name, then offset and then record list order.
+ *
+ * Returns <0, 0 or >0 as for qsort().
+ ***************************************************************************/
+static int
+mstl3_cmp_recordread (const void *a, const void *b)
+{
+  const struct MS3RecordRead *reada = *(const struct MS3RecordRead *const *)a;
+  const struct MS3RecordRead *readb = *(const struct MS3RecordRead *const *)b;
+  const MS3RecordPtr *ptra = reada->recordptr;
+  const MS3RecordPtr *ptrb = readb->recordptr;
+  int cmp;
+
+  if (ptra->fileptr != ptrb->fileptr)
+    return ((uintptr_t)ptra->fileptr < (uintptr_t)ptrb->fileptr) ? -1 : 1;
+
+  if (!ptra->fileptr && ptra->filename != ptrb->filename &&
+      (cmp = strcmp (ptra->filename, ptrb->filename)) != 0)
+    return cmp;
+
+  if (ptra->fileoffset != ptrb->fileoffset)
+    return (ptra->fileoffset < ptrb->fileoffset) ? -1 : 1;
+
+  return (reada->listindex < readb->listindex) ? -1 : (reada->listindex > readb->listindex);
+} /* End of mstl3_cmp_recordread() */
+
+/***************************************************************************
+ * mstl3_filecache_open:
+ *
+ * Return an open file for 'filename' from the cache, opening it if
+ * needed.  When the cache is full the least recently used file is
+ * closed.
+ *
+ * Returns the open file on success and NULL on error.
+ ***************************************************************************/
+static FILE *
+mstl3_filecache_open (struct MS3FileCache *cache, const char *filename)
+{
+  size_t length;
+  int slot = 0;
+  int idx;
+
+  cache->usecount++;
+
+  for (idx = 0; idx < MSTL_FILECACHE_SIZE; idx++)
+  {
+    if (cache->files[idx].fileptr && !strcmp (cache->files[idx].filename, filename))
+    {
+      cache->files[idx].lastuse = cache->usecount;
+      return cache->files[idx].fileptr;
+    }
+
+    /* Track an unused or the least recently used slot */
+    if (cache->files[slot].fileptr &&
+        (!cache->files[idx].fileptr || cache->files[idx].lastuse < cache->files[slot].lastuse))
+      slot = idx;
+  }
+
+  if (cache->files[slot].fileptr)
+  {
+    fclose (cache->files[slot].fileptr);
+    libmseed_memory.free (cache->files[slot].filename);
+    cache->files[slot].fileptr  = NULL;
+    cache->files[slot].filename = NULL;
+  }
+
+  length = strlen (filename) + 1;
+
+  if ((cache->files[slot].filename = (char *)libmseed_memory.malloc (length)) == NULL)
+    return NULL;
+
+  memcpy (cache->files[slot].filename, filename, length);
+
+  if ((cache->files[slot].fileptr = fopen (filename, "rb")) == NULL)
+  {
+    libmseed_memory.free (cache->files[slot].filename);
+    cache->files[slot].filename = NULL;
+    return NULL;
+  }
+
+  cache->files[slot].lastuse = cache->usecount;
+
+  return cache->files[slot].fileptr;
+} /* End of mstl3_filecache_open() */
+
+/***************************************************************************
+ * mstl3_filecache_close:
+ *
+ * Close all files in the cache and release file names.
+ ***************************************************************************/
+static void
+mstl3_filecache_close (struct MS3FileCache *cache)
+{
+  int idx;
+
+  for (idx = 0; idx < MSTL_FILECACHE_SIZE; idx++)
+  {
+    if (cache->files[idx].fileptr)
+      fclose (cache->files[idx].fileptr);
+    if (cache->files[idx].filename)
+      libmseed_memory.free (cache->files[idx].filename);
+
+    cache->files[idx].fileptr  = NULL;
+    cache->files[idx].filename = NULL;
+  }
+} /* End of mstl3_filecache_close() */
+
 /**********************************************************************/ /**
  * @brief Pack ::MS3TraceList data into miniSEED records
  *
@@ -2020,13 +4953,22 @@ mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
   id = mstl->traces.next[0];
   while (id)
   {
-    memcpy (msr->sid, id->sid, sizeof(msr->sid));
+    memcpy (msr->sid, id->sid, strlen (id->sid) + 1);
     msr->pubversion = id->pubversion;
 
     /* Loop through segment list */
     seg = id->first;
     while (seg)
     {
+      /* Packing requires contiguous samples */
+      if (seg->chunks && mstl3_flatten_samples (seg) < 0)
+      {
+        msr->datasamples = NULL;
+        msr->extra = NULL;
+        msr3_free (&msr);
+        return -1;
+      }
+
       msr->starttime = seg->starttime;
       msr->samprate = seg->samprate;
       msr->samplecnt = seg->samplecnt;
@@ -2061,6 +5003,10 @@ mstl3_pack (MS3TraceList *mstl, void (*record_handler) (char *, int, void *),
       /* If MSF_MAINTAINMSTL not set, adjust segment start time and reduce data array and sample counts */
       if (!(flags & MSF_MAINTAINMSTL) && segpackedsamples > 0)
       {
+        /* Segment order may change, drop any segment index */
+        if (id->segindex)
+          mstl3_free_segindex (mstl, id);
+
         /* Calculate new start time, shortcut when all samples have been packed */
         if (segpackedsamples == seg->numsamples)
           seg->starttime = seg->endtime;
@@ -37,6 +37,10 @@
 
 /* Function(s) internal to this file */
 static nstime_t ms_btime2nstime (uint8_t *btime, int8_t swapflag);
+static int64_t ms_decode_samples (const void *input, size_t inputsize, uint8_t encoding,
+                                  int64_t samplecount, int8_t partial, void *output,
+                                  size_t outputsize, char *sampletype, int8_t swapflag,
+                                  const char *sid, int8_t verbose);
 
 /* Test POINTER for alignment with BYTE_COUNT sized quantities */
 #define is_aligned(POINTER, BYTE_COUNT) \
@@ -995,6 +999,218 @@ msr3_unpack_mseed2 (const char *record, int reclen, MS3Record **ppmsr,
   return MS_NOERROR;
 } /* End of msr3_unpack_mseed2() */
 
+/***************************************************************************
+ * ms3_unpack_header3:
+ *
+ * Populate a MS3RecordHeader from the fixed header of a miniSEED 3
+ * record.  Extra headers and data are not inspected.
+ *
+ * Returns MS_NOERROR on success, otherwise returns a libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_unpack_header3 (const char *record, int reclen, MS3RecordHeader *header,
+                    int8_t verbose)
+{
+  uint8_t sidlength;
+  int8_t swapflag = (ms_bigendianhost ()) ? 1 : 0;
+
+  if (!record || !header)
+  {
+    ms_log (2, "Required argument not defined: 'record' or 'header'\n");
+    return MS_GENERROR;
+  }
+
+  if (!MS3_ISVALIDHEADER (record))
+  {
+    ms_log (2, "Record header unrecognized, not a valid miniSEED record\n");
+    return MS_NOTSEED;
+  }
+
+  sidlength = *pMS3FSDH_SIDLENGTH (record);
+
+  if (sidlength >= sizeof (header->sid))
+  {
+    ms_log (2, "%.*s: Source identifier is longer (%d) than supported (%d)\n",
+            sidlength, pMS3FSDH_SID (record), sidlength, (int)sizeof (header->sid) - 1);
+    return MS_GENERROR;
+  }
+
+  header->reclen        = reclen;
+  header->formatversion = *pMS3FSDH_FORMATVERSION (record);
+  header->pubversion    = *pMS3FSDH_PUBVERSION (record);
+  header->samprate      = HO8f (*pMS3FSDH_SAMPLERATE (record), swapflag);
+  header->samplecnt     = HO4u (*pMS3FSDH_NUMSAMPLES (record), swapflag);
+
+  memcpy (header->sid, pMS3FSDH_SID (record), sidlength);
+  header->sid[sidlength] = '\0';
+
+  header->starttime = ms_time2nstime (HO2u (*pMS3FSDH_YEAR (record), swapflag),
+                                      HO2u (*pMS3FSDH_DAY (record), swapflag),
+                                      *pMS3FSDH_HOUR (record),
+                                      *pMS3FSDH_MIN (record),
+                                      *pMS3FSDH_SEC (record),
+                                      HO4u (*pMS3FSDH_NSEC (record), swapflag));
+  if (header->starttime == NSTERROR)
+  {
+    ms_log (2, "%s: Cannot convert start time to internal time representation\n", header->sid);
+    return MS_GENERROR;
+  }
+
+  if (verbose > 2)
+    ms_log (0, "%s: Parsed header of %d byte record\n", header->sid, reclen);
+
+  return MS_NOERROR;
+} /* End of ms3_unpack_header3() */
+
+/***************************************************************************
+ * ms3_unpack_header2:
+ *
+ * Populate a MS3RecordHeader from the fixed header of a miniSEED 2
+ * record.  The blockette chain is traversed only for the values that
+ * affect time coverage: the actual sample rate (Blockette 100), the
+ * record length (Blockette 1000) and the start time microseconds
+ * (Blockette 1001).  No extra headers are built and data are not
+ * inspected.
+ *
+ * Returns MS_NOERROR on success, otherwise returns a libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int
+ms3_unpack_header2 (const char *record, int reclen, MS3RecordHeader *header,
+                    int8_t verbose)
+{
+  uint16_t blkt_offset;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  uint16_t blkt_length;
+  uint16_t B1001offset = 0;
+  int blkt_count = 0;
+  int8_t swapflag = 0;
+  char errorsid[64];
+
+  if (!record || !header)
+  {
+    ms_log (2, "Required argument not defined: 'record' or 'header'\n");
+    return MS_GENERROR;
+  }
+
+  if (reclen < 64 || reclen > MAXRECLEN)
+  {
+    ms2_recordsid (record, errorsid, sizeof (errorsid));
+    ms_log (2, "%s: Record length is out of allowed range: %d\n", errorsid, reclen);
+    return MS_OUTOFRANGE;
+  }
+
+  if (!MS2_ISVALIDHEADER (record))
+  {
+    ms2_recordsid (record, errorsid, sizeof (errorsid));
+    ms_log (2, "%s: Record header unrecognized, not a valid miniSEED record\n", errorsid);
+    return MS_NOTSEED;
+  }
+
+  /* Check to see if byte swapping is needed by testing the year and day */
+  if (!MS_ISVALIDYEARDAY (*pMS2FSDH_YEAR (record), *pMS2FSDH_DAY (record)))
+    swapflag = 1;
+
+  ms2_recordsid (record, header->sid, sizeof (header->sid));
+  header->reclen        = reclen;
+  header->formatversion = 2;
+  header->samprate      = ms_nomsamprate (HO2d (*pMS2FSDH_SAMPLERATEFACT (record), swapflag),
+                                          HO2d (*pMS2FSDH_SAMPLERATEMULT (record), swapflag));
+  header->samplecnt     = HO2u (*pMS2FSDH_NUMSAMPLES (record), swapflag);
+
+  /* Map data quality indicator to publication version */
+  switch (*pMS2FSDH_DATAQUALITY (record))
+  {
+  case 'M':
+    header->pubversion = 4;
+    break;
+  case 'Q':
+    header->pubversion = 3;
+    break;
+  case 'D':
+    header->pubversion = 2;
+    break;
+  case 'R':
+    header->pubversion = 1;
+    break;
+  default:
+    header->pubversion = 0;
+    break;
+  }
+
+  header->starttime = ms_btime2nstime ((uint8_t *)pMS2FSDH_YEAR (record), swapflag);
+  if (header->starttime == NSTERROR)
+  {
+    ms_log (2, "%s: Cannot convert start time to internal time stamp\n", header->sid);
+    return MS_GENERROR;
+  }
+
+  /* Apply time correction if it has not been applied, bit 1 of activity flags */
+  if (HO4d (*pMS2FSDH_TIMECORRECT (record), swapflag) != 0 &&
+      !(*pMS2FSDH_ACTFLAGS (record) & 0x02))
+  {
+    header->starttime += (nstime_t)HO4d (*pMS2FSDH_TIMECORRECT (record), swapflag) * (NSTMODULUS / 10000);
+  }
+
+  /* Traverse the blockettes for values affecting time coverage, each
+   * must have room for its type and next offset */
+  blkt_offset = HO2u (*pMS2FSDH_BLOCKETTEOFFSET (record), swapflag);
+
+  while ((blkt_offset != 0) &&
+         (blkt_offset + 4 <= reclen))
+  {
+    memcpy (&blkt_type, record + blkt_offset, 2);
+    memcpy (&next_blkt, record + blkt_offset + 2, 2);
+
+    if (swapflag)
+    {
+      ms_gswap2 (&blkt_type);
+      ms_gswap2 (&next_blkt);
+    }
+
+    blkt_length = ms2_blktlen (blkt_type, record + blkt_offset, swapflag);
+
+    if (blkt_length == 0 || (blkt_offset + blkt_length) > reclen)
+      break;
+
+    if (blkt_type == 100)
+    {
+      header->samprate = HO4f (*pMS2B100_SAMPRATE (record + blkt_offset), swapflag);
+    }
+    else if (blkt_type == 1000)
+    {
+      header->reclen = (uint32_t)1 << *pMS2B1000_RECLEN (record + blkt_offset);
+    }
+    else if (blkt_type == 1001)
+    {
+      B1001offset = blkt_offset;
+    }
+
+    /* Stop at invalid next blockette offsets */
+    if (next_blkt && (next_blkt < (blkt_offset + blkt_length) || next_blkt > reclen))
+      break;
+
+    blkt_offset = next_blkt;
+    blkt_count++;
+  }
+
+  /* Apply microsecond precision if Blockette 1001 is present */
+  if (B1001offset)
+  {
+    header->starttime += (nstime_t)*pMS2B1001_MICROSECOND (record + B1001offset) * (NSTMODULUS / 1000000);
+  }
+
+  if (verbose > 2)
+    ms_log (0, "%s: Parsed header of %d byte record with %d blockettes\n",
+            header->sid, reclen, blkt_count);
+
+  return MS_NOERROR;
+} /* End of ms3_unpack_header2() */
+
 /*******************************************************************/ /**
  * @brief Determine the data payload bounds for a MS3Record
  *
@@ -1119,13 +1335,9 @@ msr3_data_bounds (const MS3Record *msr, uint32_t *dataoffset, uint32_t *datasize
 int64_t
 msr3_unpack_data (MS3Record *msr, int8_t verbose)
 {
-  uint32_t datasize; /* byte size of data samples in record */
   int64_t nsamples; /* number of samples unpacked */
   size_t unpacksize; /* byte size of unpacked samples */
   uint8_t samplesize = 0; /* size of the data samples in bytes */
-  uint32_t dataoffset = 0;
-  const char *encoded = NULL;
-  char *encoded_allocated = NULL;
 
   if (!msr)
   {
@@ -1136,6 +1348,119 @@ msr3_unpack_data (MS3Record *msr, int8_t verbose)
   if (msr->samplecnt <= 0)
     return 0;
 
+  /* Fallback encoding for when encoding is unknown */
+  if (msr->encoding < 0)
+  {
+    if (verbose > 2)
+      ms_log (0, "%s: No data encoding (no blockette 1000?), assuming Steim-1\n", msr->sid);
+
+    msr->encoding = DE_STEIM1;
+  }
+
+  if (ms_encoding_sizetype(msr->encoding, &samplesize, NULL))
+  {
+    ms_log (2, "%s: Cannot determine sample size for encoding: %u\n", msr->sid, msr->encoding);
+    return MS_GENERROR;
+  }
+
+  if (msr->samplecnt > INT32_MAX)
+  {
+    ms_log (2, "%s: Too many samples to unpack: %" PRId64 "\n", msr->sid, msr->samplecnt);
+    return MS_GENERROR;
+  }
+
+  /* Calculate buffer size needed for unpacked samples */
+  unpacksize = (size_t)msr->samplecnt * samplesize;
+
+  /* (Re)Allocate space for the unpacked data */
+  if (unpacksize > 0)
+  {
+    if (libmseed_prealloc_block_size)
+    {
+      msr->datasamples = libmseed_memory_prealloc (msr->datasamples, unpacksize, &(msr->datasize));
+    }
+    else
+    {
+      msr->datasamples = libmseed_memory.realloc (msr->datasamples, unpacksize);
+      msr->datasize = unpacksize;
+    }
+
+    if (msr->datasamples == NULL)
+    {
+      ms_log (2, "%s: Cannot (re)allocate memory\n", msr->sid);
+      msr->datasize = 0;
+      return MS_GENERROR;
+    }
+  }
+  else
+  {
+    if (msr->datasamples)
+      libmseed_memory.free (msr->datasamples);
+    msr->datasamples = NULL;
+    msr->datasize = 0;
+    msr->numsamples = 0;
+  }
+
+  nsamples = msr3_decode_data (msr, msr->datasamples, msr->datasize,
+                               &(msr->sampletype), verbose);
+
+  if (nsamples > 0)
+    msr->numsamples = nsamples;
+
+  return nsamples;
+} /* End of msr3_unpack_data() */
+
+/*******************************************************************/ /**
+ * @brief Decode the first data samples of a ::MS3Record into a supplied buffer
+ *
+ * Decoding stops after \a count samples, allowing the leading part of
+ * a record to be decoded without decoding the rest, e.g. when only
+ * the samples before a time are needed.  Differencing encodings such
+ * as Steim-1 and Steim-2 must still be decoded from the first sample,
+ * and their integrity check of the last sample is only performed when
+ * all samples are decoded.
+ *
+ * The ::MS3Record is not modified, an unknown encoding is treated as
+ * Steim-1.
+ *
+ * @param[in] msr ::MS3Record with encoded data at ::MS3Record.record
+ * @param[in] count Number of samples to decode, at most ::MS3Record.samplecnt
+ * @param[out] output Buffer for decoded samples
+ * @param[in] outputsize Size of \a output buffer in bytes
+ * @param[out] sampletype Pointer to (single character) sample type of decoded data
+ * @param[in] verbose Flag to control verbosity, 0 means no diagnostic output
+ *
+ * @return number of samples decoded or negative libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ************************************************************************/
+int64_t
+msr3_decode_samples (const MS3Record *msr, int64_t count, void *output, size_t outputsize,
+                     char *sampletype, int8_t verbose)
+{
+  uint32_t datasize; /* byte size of data samples in record */
+  int64_t nsamples; /* number of samples unpacked */
+  uint8_t samplesize = 0; /* size of the data samples in bytes */
+  uint32_t dataoffset = 0;
+  uint8_t encoding;
+  const char *encoded = NULL;
+  char *encoded_allocated = NULL;
+
+  if (!msr || !output || !sampletype)
+  {
+    ms_log (2, "Required argument not defined: 'msr', 'output' or 'sampletype'\n");
+    return MS_GENERROR;
+  }
+
+  if (msr->samplecnt <= 0 || count <= 0)
+    return 0;
+
+  if (count > msr->samplecnt)
+  {
+    ms_log (2, "%s: Cannot decode %" PRId64 " samples of %" PRId64 "\n", msr->sid, count, msr->samplecnt);
+    return MS_GENERROR;
+  }
+
   if (!msr->record)
   {
     ms_log (2, "%s: Raw record pointer is unset\n", msr->sid);
@@ -1154,9 +1479,9 @@ msr3_unpack_data (MS3Record *msr, int8_t verbose)
     return MS_OUTOFRANGE;
   }
 
-  if (msr->samplecnt > INT32_MAX)
+  if (count > INT32_MAX)
   {
-    ms_log (2, "%s: Too many samples to unpack: %" PRId64 "\n", msr->sid, msr->samplecnt);
+    ms_log (2, "%s: Too many samples to unpack: %" PRId64 "\n", msr->sid, count);
     return MS_GENERROR;
   }
 
@@ -1172,17 +1497,11 @@ msr3_unpack_data (MS3Record *msr, int8_t verbose)
   }
 
   /* Fallback encoding for when encoding is unknown */
-  if (msr->encoding < 0)
-  {
-    if (verbose > 2)
-      ms_log (0, "%s: No data encoding (no blockette 1000?), assuming Steim-1\n", msr->sid);
+  encoding = (msr->encoding < 0) ? DE_STEIM1 : (uint8_t)msr->encoding;
 
-    msr->encoding = DE_STEIM1;
-  }
-
-  if (ms_encoding_sizetype(msr->encoding, &samplesize, NULL))
+  if (ms_encoding_sizetype(encoding, &samplesize, NULL))
   {
-    ms_log (2, "%s: Cannot determine sample size for encoding: %u\n", msr->sid, msr->encoding);
+    ms_log (2, "%s: Cannot determine sample size for encoding: %u\n", msr->sid, encoding);
     return MS_GENERROR;
   }
 
@@ -1201,55 +1520,42 @@ msr3_unpack_data (MS3Record *msr, int8_t verbose)
     encoded = encoded_allocated;
   }
 
-  /* Calculate buffer size needed for unpacked samples */
-  unpacksize = (size_t)msr->samplecnt * samplesize;
-
-  /* (Re)Allocate space for the unpacked data */
-  if (unpacksize > 0)
-  {
-    if (libmseed_prealloc_block_size)
-    {
-      msr->datasamples = libmseed_memory_prealloc (msr->datasamples, unpacksize, &(msr->datasize));
-    }
-    else
-    {
-      msr->datasamples = libmseed_memory.realloc (msr->datasamples, unpacksize);
-      msr->datasize = unpacksize;
-    }
-
-    if (msr->datasamples == NULL)
-    {
-      ms_log (2, "%s: Cannot (re)allocate memory\n", msr->sid);
-      msr->datasize = 0;
-      if (encoded_allocated)
-        libmseed_memory.free (encoded_allocated);
-      return MS_GENERROR;
-    }
-  }
-  else
-  {
-    if (msr->datasamples)
-      libmseed_memory.free (msr->datasamples);
-    msr->datasamples = NULL;
-    msr->datasize = 0;
-    msr->numsamples = 0;
-  }
-
   if (verbose > 2)
-    ms_log (0, "%s: Unpacking %" PRId64 " samples\n", msr->sid, msr->samplecnt);
+    ms_log (0, "%s: Unpacking %" PRId64 " samples\n", msr->sid, count);
 
-  nsamples = ms_decode_data (encoded, datasize, msr->encoding, msr->samplecnt,
-                             msr->datasamples, msr->datasize, &(msr->sampletype),
-                             (msr->swapflag & MSSWAP_PAYLOAD), msr->sid, verbose);
+  nsamples = ms_decode_samples (encoded, datasize, encoding, count, (count < msr->samplecnt),
+                                output, outputsize, sampletype,
+                                (msr->swapflag & MSSWAP_PAYLOAD), msr->sid, verbose);
 
   if (encoded_allocated)
     libmseed_memory.free (encoded_allocated);
 
-  if (nsamples > 0)
-    msr->numsamples = nsamples;
-
   return nsamples;
-} /* End of msr3_unpack_data() */
+} /* End of msr3_decode_samples() */
+
+/***************************************************************************
+ * Decode the data samples of a ::MS3Record into a supplied buffer.
+ *
+ * This is the common decoding path of msr3_unpack_data() and the
+ * trace list routines that decode directly into segment sample
+ * buffers, decoding all samples with msr3_decode_samples().
+ *
+ * Returns number of samples decoded or negative libmseed error code.
+ *
+ * \ref MessageOnError - this function logs a message on error
+ ***************************************************************************/
+int64_t
+msr3_decode_data (const MS3Record *msr, void *output, size_t outputsize,
+                  char *sampletype, int8_t verbose)
+{
+  if (!msr)
+  {
+    ms_log (2, "Required argument not defined: 'msr'\n");
+    return MS_GENERROR;
+  }
+
+  return msr3_decode_samples (msr, msr->samplecnt, output, outputsize, sampletype, verbose);
+} /* End of msr3_decode_data() */
 
 /*******************************************************************/ /**
  * @brief Decode data samples to a supplied buffer
@@ -1273,6 +1579,25 @@ int64_t
 ms_decode_data (const void *input, size_t inputsize, uint8_t encoding,
                 int64_t samplecount, void *output, size_t outputsize,
                 char *sampletype, int8_t swapflag, const char *sid, int8_t verbose)
+{
+  return ms_decode_samples (input, inputsize, encoding, samplecount, 0, output,
+                            outputsize, sampletype, swapflag, sid, verbose);
+} /* End of ms_decode_data() */
+
+/***************************************************************************
+ * Decode data samples to a supplied buffer, see ms_decode_data().
+ *
+ * If partial is set only the first samples of the encoded data are
+ * decoded and the Steim integrity checks of the last sample are not
+ * performed.
+ *
+ * Returns number of samples decoded or negative libmseed error code.
+ ***************************************************************************/
+static int64_t
+ms_decode_samples (const void *input, size_t inputsize, uint8_t encoding,
+                   int64_t samplecount, int8_t partial, void *output,
+                   size_t outputsize, char *sampletype, int8_t swapflag,
+                   const char *sid, int8_t verbose)
 {
   size_t decodedsize; /* byte size of decodeded samples */
   int32_t nsamples; /* number of samples unpacked */
@@ -1355,7 +1680,7 @@ ms_decode_data (const void *input, size_t inputsize, uint8_t encoding,
       ms_log (0, "%s: Decoding Steim1 data frames\n", (sid) ? sid : "");
 
     nsamples = msr_decode_steim1 ((int32_t *)input, inputsize, samplecount,
-                                  (int32_t *)output, decodedsize, (sid) ? sid : "", swapflag);
+                                  (int32_t *)output, decodedsize, (sid) ? sid : "", swapflag, partial);
 
     if (nsamples < 0)
     {
@@ -1370,7 +1695,7 @@ ms_decode_data (const void *input, size_t inputsize, uint8_t encoding,
       ms_log (0, "%s: Decoding Steim2 data frames\n", (sid) ? sid : "");
 
     nsamples = msr_decode_steim2 ((int32_t *)input, inputsize, samplecount,
-                                  (int32_t *)output, decodedsize, (sid) ? sid : "", swapflag);
+                                  (int32_t *)output, decodedsize, (sid) ? sid : "", swapflag, partial);
 
     if (nsamples < 0)
     {
@@ -1437,7 +1762,7 @@ ms_decode_data (const void *input, size_t inputsize, uint8_t encoding,
   }
 
   return nsamples;
-} /* End of ms_decode_data() */
+} /* End of ms_decode_samples() */
 
 /***************************************************************************
  * Calculate a sample rate from SEED sample rate factor and multiplier
@@ -31,6 +31,16 @@ extern int64_t msr3_unpack_mseed3 (const char *record, int reclen, MS3Record **p
                                    uint32_t flags, int8_t verbose);
 extern int64_t msr3_unpack_mseed2 (const char *record, int reclen, MS3Record **ppmsr,
                                    uint32_t flags, int8_t verbose);
+extern int ms3_unpack_header3 (const char *record, int reclen, MS3RecordHeader *header,
+                               int8_t verbose);
+extern int ms3_unpack_header2 (const char *record, int reclen, MS3RecordHeader *header,
+                               int8_t verbose);
+
+extern int msr3_parse_reclen (const char *record, int reclen, uint8_t formatversion,
+                              MS3Record **ppmsr, uint32_t flags, int8_t verbose);
+
+extern int64_t msr3_decode_data (const MS3Record *msr, void *output, size_t outputsize,
+                                 char *sampletype, int8_t verbose);
 
 extern double ms_nomsamprate (int factor, int multiplier);
 extern char *ms2_recordsid (const char *record, char *sid, int sidlen);
@@ -183,14 +183,15 @@ msr_decode_float64 (double *input, int64_t samplecount, double *output,
  * msr_decode_steim1:
  *
  * Decode Steim1 encoded miniSEED data and place in supplied buffer
- * as 32-bit integers.
+ * as 32-bit integers.  If partial is set only the first samples are
+ * decoded and the last sample is not checked against Xn.
  *
  * Return number of samples in output buffer on success, -1 on error.
  ************************************************************************/
 int
 msr_decode_steim1 (int32_t *input, int inputlength, int64_t samplecount,
                    int32_t *output, int64_t outputlength, const char *srcname,
-                   int swapflag)
+                   int swapflag, int partial)
 {
   uint32_t frame[16]; /* Frame, 16 x 32-bit quantities = 64 bytes */
   int32_t diff[60];   /* Difference values for a frame, max is 15 x 4 (8-bit samples) */
@@ -339,8 +340,9 @@ msr_decode_steim1 (int32_t *input, int inputlength, int64_t samplecount,
     }
   } /* Done looping over frames */
 
-  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
-  if (outputidx == samplecount && output[outputidx - 1] != Xn)
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant),
+   * unless only the first samples were decoded */
+  if (!partial && outputidx == samplecount && output[outputidx - 1] != Xn)
   {
     ms_log (1, "%s: Warning: Data integrity check for Steim1 failed, Last sample=%d, Xn=%d\n",
             srcname, output[outputidx - 1], Xn);
@@ -353,14 +355,15 @@ msr_decode_steim1 (int32_t *input, int inputlength, int64_t samplecount,
  * msr_decode_steim2:
  *
  * Decode Steim2 encoded miniSEED data and place in supplied buffer
- * as 32-bit integers.
+ * as 32-bit integers.  If partial is set only the first samples are
+ * decoded and the last sample is not checked against Xn.
  *
  * Return number of samples in output buffer on success, -1 on error.
  ************************************************************************/
 int
 msr_decode_steim2 (int32_t *input, int inputlength, int64_t samplecount,
                    int32_t *output, int64_t outputlength, const char *srcname,
-                   int swapflag)
+                   int swapflag, int partial)
 {
   uint32_t frame[16]; /* Frame, 16 x 32-bit quantities = 64 bytes */
   int32_t diff[105];  /* Difference values for a frame, max is 15 x 7 (4-bit samples) */
@@ -589,8 +592,9 @@ msr_decode_steim2 (int32_t *input, int inputlength, int64_t samplecount,
     }
   } /* Done looping over frames */
 
-  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
-  if (outputidx == samplecount && output[outputidx - 1] != Xn)
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant),
+   * unless only the first samples were decoded */
+  if (!partial && outputidx == samplecount && output[outputidx - 1] != Xn)
   {
     ms_log (1, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
             srcname, output[outputidx - 1], Xn);
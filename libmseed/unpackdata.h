@@ -41,10 +41,10 @@ extern int msr_decode_float64 (double *input, int64_t samplecount, double *outpu
                                int64_t outputlength, int swapflag);
 extern int msr_decode_steim1 (int32_t *input, int inputlength, int64_t samplecount,
                               int32_t *output, int64_t outputlength, const char *srcname,
-                              int swapflag);
+                              int swapflag, int partial);
 extern int msr_decode_steim2 (int32_t *input, int inputlength, int64_t samplecount,
                               int32_t *output, int64_t outputlength, const char *srcname,
-                              int swapflag);
+                              int swapflag, int partial);
 extern int msr_decode_geoscope (char *input, int64_t samplecount, float *output,
                                 int64_t outputlength, int encoding, const char *srcname,
                                 int swapflag);
@@ -16,19 +16,72 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include <libmseed.h>
 
+#if !defined(LMP_WIN)
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
 #include "md5.h"
 
+struct filelink;
+
+static int readfile (MS3TraceList *mstl, const char *filename, MS3Selections *selections,
+                     uint32_t flags, uint32_t addflags);
+static int readfiles (MS3TraceList *mstl, MS3Selections *selections, uint32_t flags, uint32_t addflags);
+static void *readthread (void *arg);
+static int addrecord (MS3TraceList *mstl, MS3Record *msr, uint32_t addflags);
+static int trimrecord (MS3Record *msr, MS3Record *trimmed, void **buffer);
+static int addrecorddesc (MS3Record *msr, int64_t offset);
+static int addsorted (MS3TraceList *mstl, const char *filename, uint32_t flags, uint32_t addflags);
+static int cmprecorddesc (const void *a, const void *b);
 static void trimsegments (MS3TraceList *mstl);
+static int trimsegment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg **pseg);
+static nstime_t trimtolerance (double samprate);
+static int64_t samplesbefore (nstime_t first, double samprate, nstime_t limit, int64_t maximum);
+static int splitsegments (MS3TraceList *mstl);
+static int splitsegment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg);
 static void printesynclist (MS3TraceList *mstl, char *dccid);
+static void formatsyncline (MS3TraceID *id, MS3TraceSeg *seg, char *line, size_t linesize);
+static int flushsegments (MS3TraceList *mstl, MS3TraceID *id, nstime_t newest);
+static int addsyncline (MS3TraceID *id, MS3TraceSeg *seg);
+static int cmpsynclines (const void *a, const void *b);
+static void spillsegments (MS3TraceList *mstl, MS3TraceSeg *active);
+static int cmpspill (const void *a, const void *b);
+static void *budget_malloc (size_t size);
+static void *budget_realloc (void *ptr, size_t size);
+static void budget_free (void *ptr);
 static void comparetraces (MS3TraceList *mstl);
+static int64_t comparesamples (char sampletype, void *data, void *tdata, int64_t count, int64_t offset);
 static int processparam (int argcount, char **argvec);
+static size_t parsesize (const char *sizestr);
+static nstime_t parseinterval (const char *intervalstr);
 static char *getoptval (int argcount, char **argvec, int argopt);
 static int addfile (char *filename);
 static int addlistfile (char *filename);
+static int addsdsfiles (const char *root);
+static int planfiles (void);
+static void *statthread (void *arg);
+static void statfile (struct filelink *flp);
+static int cmpfileident (const struct filelink *fa, const struct filelink *fb);
+static int cmpfileid (const void *a, const void *b);
+static int cmpfileorder (const void *a, const void *b);
+static int sdslist (const char *path, char ***names, size_t *count);
+static void *sdsthread (void *arg);
+static int sdscandidate (const char *name, nstime_t earliest, nstime_t latest);
+static int cmpstrings (const void *a, const void *b);
 static int my_globmatch (const char *string, const char *pattern);
 static void usage (void);
 
@@ -40,9 +93,20 @@ static flag verbose       = 0;
 static flag compare       = 0;
 static flag splitversion  = 1; /* Controls consideration of publication version */
 static flag dataflag      = 1; /* Controls decompression of data and production of MD5 */
+static flag timesorted    = 0; /* Input files are time-ordered, seek to time range */
+static flag useindex      = 0; /* Use record index files to read selected records */
+static flag buildindex    = 0; /* Build record index files for input files and exit */
+static flag flushclosed   = 0; /* Flush closed segments while reading time-ordered input */
+static flag presort       = 0; /* Sort records of each file by source and time before adding */
+static flag fileorder     = 0; /* Order of input files: 0 = as specified, 1 = locality, 2 = size */
+static int threads        = 1; /* Number of threads reading input files */
+static size_t maxmemory   = 0; /* Memory budget, sample buffers are spilled to files beyond */
+static size_t memoryused  = 0; /* Bytes currently allocated by the library */
+static size_t spillmark   = 0; /* Memory use at which sample buffers are spilled */
 static char *dccidstr     = 0;
 static nstime_t starttime = NSTUNSET; /* Limit to records containing or after starttime */
 static nstime_t endtime   = NSTUNSET; /* Limit to records containing or before endtime */
+static nstime_t splitinterval = 0; /* Split segments at multiples of interval since the epoch */
 static char *match        = 0; /* Glob match pattern */
 static char *reject       = 0; /* Glob reject pattern */
 
@@ -56,20 +120,112 @@ struct filelink
 {
   char *filename;
   struct filelink *next;
+  const char *range; /* Byte range suffix of filename, e.g. "@START-END" */
+  uint64_t dev;      /* Device, inode and size of a local file */
+  uint64_t ino;
+  uint64_t size;
+  uint64_t offset;   /* Physical offset of the first block, if known */
+  size_t sequence;   /* Position in the order specified */
+  flag local;        /* Status of the file was determined */
 };
 
 struct filelink *filelist     = 0;
 struct filelink *filelisttail = 0;
+struct filelink *sdsroots     = 0; /* SDS archive roots to select input files from */
+
+/* SYNC line of a segment flushed while reading, sorted for output */
+struct syncline
+{
+  const char *sid;
+  uint8_t pubversion;
+  nstime_t starttime;
+  size_t sequence;
+  char *line;
+};
+
+static struct syncline *synclines = 0;
+static size_t synclinecount       = 0;
+static size_t synclinesize        = 0;
+static char yearday[30];
+
+/* Record of a file to be added to the trace list in sorted order */
+struct recorddesc
+{
+  uint64_t sidhash;
+  nstime_t starttime;
+  int64_t offset;
+  int32_t reclen;
+  uint8_t pubversion;
+};
+
+static struct recorddesc *recorddescs = 0;
+static size_t recorddesccount         = 0;
+static size_t recorddescsize          = 0;
+
+/* Segment and the size of its sample buffers in memory, a spill candidate */
+struct spillseg
+{
+  MS3TraceSeg *seg;
+  size_t size;
+};
+
+/* Input files shared by threads each reading into their own trace list */
+struct readshare
+{
+  MS3Selections *selections;
+  uint32_t flags;
+  uint32_t addflags;
+  struct filelink *next; /* Next file to read, NULL after an error */
+  int error;
+#if !defined(LMP_WIN)
+  pthread_mutex_t lock;
+#endif
+};
+
+/* Channel directories of an SDS archive scanned by threads for candidate files */
+struct sdsscan
+{
+  char **dirs;
+  size_t dircount;
+  size_t next;      /* Next directory to scan */
+  char **files;
+  size_t filecount;
+  size_t filesize;
+  nstime_t earliest; /* Start of the first candidate day, NSTUNSET for all */
+  nstime_t latest;   /* Start of the last candidate day, NSTUNSET for all */
+  int error;
+#if !defined(LMP_WIN)
+  pthread_mutex_t lock;
+#endif
+};
+
+/* Input files of which the status is determined by threads */
+struct statshare
+{
+  struct filelink **files;
+  size_t count;
+  size_t next; /* Next file to determine the status of */
+#if !defined(LMP_WIN)
+  pthread_mutex_t lock;
+#endif
+};
+
+/* Maximum number of threads scanning directories and input file status */
+#define SCANTHREADS 8
+
+/* Size of the header recording the size of allocations for accounting */
+#define MEMHEADER 16
 
 int
 main (int argc, char **argv)
 {
   struct filelink *flp;
-  MS3Record *msr     = 0;
   MS3TraceList *mstl = 0;
-  int retcode        = MS_NOERROR;
+  MS3Selections *selections = 0;
   uint32_t flags     = 0;
-  char stime[30];
+  uint32_t addflags  = 0;
+  time_t now;
+  struct tm *nt;
 
   /* Set default error message prefix */
   ms_loginit (NULL, NULL, NULL, "ERROR: ");
@@ -78,786 +234,2905 @@ main (int argc, char **argv)
   if (processparam (argc, argv) < 0)
     return 1;
 
-  if (dataflag)
-    flags |= MSF_UNPACKDATA;
+  /* Generate current time stamp for SYNC lines */
+  now = time (NULL);
+  nt  = localtime (&now);
+  nt->tm_year += 1900;
+  nt->tm_yday += 1;
+  snprintf (yearday, sizeof (yearday), "%04d,%03d", nt->tm_year, nt->tm_yday);
 
-  flags |= MSF_PNAMERANGE;
+  /* Track memory allocated by the library to enforce the memory budget */
+  if (maxmemory)
+  {
+    libmseed_memory.malloc  = budget_malloc;
+    libmseed_memory.realloc = budget_realloc;
+    libmseed_memory.free    = budget_free;
+    spillmark               = maxmemory;
+  }
 
-  mstl = mstl3_init (NULL);
+  /* Data samples are decoded directly into chunked trace list storage when records are added */
+  if (dataflag)
+    addflags |= MSF_UNPACKDATA | MSF_SAMPLECHUNKS;
+  /* Otherwise only the record header values needed for coverage are parsed */
+  else
+    flags |= MSF_HEADERONLY;
 
-  flp = filelist;
+  flags |= MSF_PNAMERANGE | MSF_MMAP;
 
-  while (flp)
+  /* Build record index files and exit */
+  if (buildindex)
   {
-    /* Loop over the input file */
-    while ((retcode = ms3_readmsr (&msr, flp->filename, flags, verbose)) == MS_NOERROR)
+    for (flp = filelist; flp; flp = flp->next)
     {
-      /* Check if record matches start/end time criteria */
-      if (starttime != NSTUNSET || endtime != NSTUNSET)
+      if (ms3_index_build (flp->filename, NULL, MSF_MMAP, verbose) < 0)
       {
-        nstime_t recendtime = msr3_endtime (msr);
+        ms_log (2, "Cannot build record index for %s\n", flp->filename);
+        retval = 1;
+      }
+    }
 
-        if (starttime != NSTUNSET && (msr->starttime < starttime && !(msr->starttime <= starttime && recendtime >= starttime)))
-        {
-          if (verbose >= 3)
-          {
-            ms_nstime2timestr (msr->starttime, stime, SEEDORDINAL, NANO_MICRO);
-            ms_log (1, "Skipping (starttime) %s, %s\n", msr->sid, stime);
-          }
-          continue;
-        }
+    return retval;
+  }
 
-        if (endtime != NSTUNSET && (recendtime > endtime && !(msr->starttime <= endtime && recendtime >= endtime)))
-        {
-          if (verbose >= 3)
-          {
-            ms_nstime2timestr (msr->starttime, stime, SEEDORDINAL, NANO_MICRO);
-            ms_log (1, "Skipping (starttime) %s, %s\n", msr->sid, stime);
-          }
-          continue;
-        }
-      }
+  /* Locate the time range in time-ordered files by bisection and select
+   * records by record index files using a selection */
+  if ((timesorted && (starttime != NSTUNSET || endtime != NSTUNSET)) ||
+      (useindex && (starttime != NSTUNSET || endtime != NSTUNSET || match)))
+  {
+    if (ms3_addselect (&selections, (useindex && match) ? match : "*", starttime, endtime, 0))
+    {
+      ms_log (2, "Cannot add selection\n");
+      return 1;
+    }
 
-      if (match || reject)
-      {
-        /* Check if record is matched by the match pattern */
-        if (match)
-        {
-          if (my_globmatch (msr->sid, match) == 0)
-          {
-            if (verbose >= 3)
-            {
-              ms_nstime2timestr (msr->starttime, stime, ISOMONTHDAY, NANO);
-              ms_log (1, "Skipping (match) %s, %s\n", msr->sid, stime);
-            }
-            continue;
-          }
-        }
+    if (timesorted)
+      flags |= MSF_TIMESORTED;
+    if (useindex)
+      flags |= MSF_RECORDINDEX;
+  }
 
-        /* Check if record is rejected by the reject pattern */
-        if (reject)
-        {
-          if (my_globmatch (msr->sid, reject) != 0)
-          {
-            if (verbose >= 3)
-            {
-              ms_nstime2timestr (msr->starttime, stime, ISOMONTHDAY, NANO);
-              ms_log (1, "Skipping (reject) %s, %s\n", msr->sid, stime);
-            }
-            continue;
-          }
-        }
-      }
+  /* Read streams that cannot be memory-mapped, e.g. stdin, in large chunks */
+  libmseed_readbuffer_size = 4 * 1024 * 1024;
 
-      /* Add to TraceList */
-      mstl3_addmsr (mstl, msr, splitversion, flags, 1, &tolerance);
-    }
+  /* Trace list nodes are allocated from an arena and freed in bulk */
+  if (!(mstl = mstl3_init_arena (NULL, 0)))
+    return 1;
 
-    /* Print error if not EOF */
-    if (retcode != MS_ENDOFFILE)
-    {
-      ms_log (2, "Cannot read %s: %s\n", flp->filename, ms_errorstr (retcode));
-      ms3_readmsr (&msr, NULL, 0, 0);
+  /* Read files with multiple threads and merge their trace lists */
+  if (threads > 1)
+  {
+    if (readfiles (mstl, selections, flags, addflags))
       exit (1);
-    }
-
-    /* Make sure everything is cleaned up */
-    ms3_readmsr (&msr, NULL, 0, 0);
+  }
+  else
+  {
+    for (flp = filelist; flp; flp = flp->next)
+    {
+      /* Start reading the next file into the page cache while this one is processed */
+      if (flp->next)
+        ms3_prefetch (flp->next->filename, flags);
 
-    flp = flp->next;
-  } /* End of looping over file list */
+      if (readfile (mstl, flp->filename, selections, flags, addflags))
+        exit (1);
+    }
+  }
 
   /* Trim each segment to specified time range */
   if (starttime != NSTUNSET || endtime != NSTUNSET)
     trimsegments (mstl);
 
+  /* Split each segment into windows of the split interval */
+  if (splitinterval && splitsegments (mstl))
+    exit (1);
+
   /* Print the ESYNC listing */
   printesynclist (mstl, dccidstr);
 
   if (compare)
     comparetraces (mstl);
 
+  /* Free trace list, with the flushed data limits of IDs when flushing */
   if (mstl)
-    mstl3_free (&mstl, 0);
+    mstl3_free (&mstl, flushclosed);
+
+  if (selections)
+    ms3_freeselections (selections);
+
+  if (recorddescs)
+    free (recorddescs);
 
   return retval;
 } /* End of main() */
 
 /***************************************************************************
- * trimsegments():
- *
- * Trim data segments to specified start and end times.  The specified
- * or default time tolerance is used to liberally match sample times:
- *
- *   The first sample can be at start time minus the tolerance value
- *   The last sample can be at the end time plus the tolerance value
+ * readfile():
  *
- * If timetol is -1 the default tolerance of 1/2 sample period is used.
+ * Read the records of a file, select them by time range and source
+ * patterns and add them to the trace list.
  *
  * Returns 0 on success, and -1 on failure
  ***************************************************************************/
-static void
-trimsegments (MS3TraceList *mstl)
+static int
+readfile (MS3TraceList *mstl, const char *filename, MS3Selections *selections,
+          uint32_t flags, uint32_t addflags)
 {
-  MS3TraceID *id   = 0;
-  MS3TraceSeg *seg = 0;
-
-  nstime_t sampletime;
-  nstime_t nsdelta;
-  nstime_t nstimetol = 0;
-  int64_t trimcount;
-  int samplesize;
-  void *datasamples;
+  MS3FileParam *msfp = 0;
+  MS3Record *msr     = 0;
+  int retcode        = MS_NOERROR;
+  flag presortfile;
+  char stime[30];
 
-  if (!mstl)
-    return;
+  /* Records of regular files can be re-read by offset and added in sorted order */
+  presortfile = (presort && strcmp (filename, "-") && !strstr (filename, "://"));
 
-  /* Loop through trace list */
-  id = mstl->traces.next[0];
-  while (id)
+  /* Loop over the input file */
+  while ((retcode = ms3_readmsr_selection (&msfp, &msr, filename, flags,
+                                           selections, verbose)) == MS_NOERROR)
   {
-    /* Loop through segment list */
-    seg = id->first;
-    while (seg)
+    /* Check if record matches start/end time criteria */
+    if (starttime != NSTUNSET || endtime != NSTUNSET)
     {
-      /* Skip segments that do not have integer, float or double types */
-      if (seg->sampletype != 'i' && seg->sampletype != 'f' && seg->sampletype != 'd')
+      nstime_t recendtime = msr3_endtime (msr);
+
+      if (starttime != NSTUNSET && (msr->starttime < starttime && !(msr->starttime <= starttime && recendtime >= starttime)))
       {
-        seg = seg->next;
+        if (verbose >= 3)
+        {
+          ms_nstime2timestr (msr->starttime, stime, SEEDORDINAL, NANO_MICRO);
+          ms_log (1, "Skipping (starttime) %s, %s\n", msr->sid, stime);
+        }
         continue;
       }
 
-      /* Calculate high-precision sample period */
-      nsdelta = (nstime_t)((seg->samprate) ? (NSTMODULUS / seg->samprate) : 0.0);
-
-      /* Calculate high-precision time tolerance */
-      if (timetol == -1.0)
-        nstimetol = (nstime_t)(0.5 * nsdelta); /* Default time tolerance is 1/2 sample period */
-      else if (timetol >= 0.0)
-        nstimetol = (nstime_t)(timetol * NSTMODULUS);
-
-      samplesize = ms_samplesize (seg->sampletype);
-
-      /* Trim samples from beginning of segment if earlier than starttime */
-      if (starttime != NSTUNSET && seg->starttime < starttime)
+      if (endtime != NSTUNSET && (recendtime > endtime && !(msr->starttime <= endtime && recendtime >= endtime)))
       {
-        trimcount  = 0;
-        sampletime = seg->starttime;
-        while (sampletime < (starttime - nstimetol))
+        if (verbose >= 3)
         {
-          sampletime += nsdelta;
-          trimcount++;
+          ms_nstime2timestr (msr->starttime, stime, SEEDORDINAL, NANO_MICRO);
+          ms_log (1, "Skipping (starttime) %s, %s\n", msr->sid, stime);
         }
+        continue;
+      }
+    }
 
-        if (trimcount > 0 && trimcount < seg->numsamples)
+    if (match || reject)
+    {
+      /* Check if record is matched by the match pattern */
+      if (match)
+      {
+        if (my_globmatch (msr->sid, match) == 0)
         {
-          if (verbose)
-            ms_log (1, "Trimming %lld samples from beginning of trace for %s\n",
-                    (long long)trimcount, id->sid);
-
-          memmove (seg->datasamples,
-                   (char *)seg->datasamples + (trimcount * samplesize),
-                   (seg->numsamples - trimcount) * samplesize);
-
-          datasamples = realloc (seg->datasamples, (seg->numsamples - trimcount) * samplesize);
-
-          if (!datasamples)
+          if (verbose >= 3)
           {
-            ms_log (2, "Cannot reallocate sample buffer\n");
-            return;
+            ms_nstime2timestr (msr->starttime, stime, ISOMONTHDAY, NANO);
+            ms_log (1, "Skipping (match) %s, %s\n", msr->sid, stime);
           }
-
-          seg->datasamples = datasamples;
-          seg->starttime += MS_EPOCH2NSTIME ((trimcount / seg->samprate));
-          seg->numsamples -= trimcount;
-          seg->samplecnt -= trimcount;
+          continue;
         }
       }
 
-      /* Trim samples from end of segment if later than endtime */
-      if (endtime != NSTUNSET && seg->endtime > endtime)
+      /* Check if record is rejected by the reject pattern */
+      if (reject)
       {
-        trimcount  = 0;
-        sampletime = seg->endtime;
-        while (sampletime > (endtime + nstimetol))
-        {
-          sampletime -= nsdelta;
-          trimcount++;
-        }
-
-        if (trimcount > 0 && trimcount < seg->numsamples)
+        if (my_globmatch (msr->sid, reject) != 0)
         {
-          if (verbose)
-            ms_log (1, "Trimming %lld samples from end of trace for %s\n",
-                    (long long)trimcount, id->sid);
-
-          datasamples = realloc (seg->datasamples, (seg->numsamples - trimcount) * samplesize);
-
-          if (!datasamples)
+          if (verbose >= 3)
           {
-            ms_log (2, "Cannot reallocate sample buffer\n");
-            return;
+            ms_nstime2timestr (msr->starttime, stime, ISOMONTHDAY, NANO);
+            ms_log (1, "Skipping (reject) %s, %s\n", msr->sid, stime);
           }
-
-          seg->datasamples = datasamples;
-          seg->endtime -= MS_EPOCH2NSTIME ((trimcount / seg->samprate));
-          seg->numsamples -= trimcount;
-          seg->samplecnt -= trimcount;
+          continue;
         }
       }
+    }
 
-      seg = seg->next;
+    /* Collect the records of uncompressed files to add in sorted order */
+    if (presortfile && (msfp->input.type == LMIO_FILE || msfp->input.type == LMIO_MMAP))
+    {
+      if (addrecorddesc (msr, msfp->streampos - msr->reclen))
+      {
+        ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+        return -1;
+      }
+
+      continue;
     }
 
-    id = id->next[0];
+    /* Add to TraceList */
+    if (addrecord (mstl, msr, addflags))
+    {
+      ms_log (2, "Cannot add record to trace list from %s\n", filename);
+      ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+      return -1;
+    }
   }
 
-  return;
-} /* End of trimsegments() */
+  /* Print error if not EOF */
+  if (retcode != MS_ENDOFFILE)
+  {
+    ms_log (2, "Cannot read %s: %s\n", filename, ms_errorstr (retcode));
+    ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+    return -1;
+  }
+
+  /* Make sure everything is cleaned up */
+  ms3_readmsr_selection (&msfp, &msr, NULL, 0, NULL, 0);
+
+  /* Add collected records sorted by source and time */
+  if (recorddesccount && addsorted (mstl, filename, flags, addflags))
+    return -1;
+
+  return 0;
+} /* End of readfile() */
 
 /***************************************************************************
- * printesynclist():
+ * readfiles():
  *
- * Print the MS3TraceList as an Enhanced SYNC Listing.
+ * Read the input files with multiple threads, each taking the next
+ * file from the list and adding records to its own trace list.  The
+ * lists of the threads are then merged into the concurrent trace list,
+ * with the segments of different IDs moved in parallel.
  *
  * Returns 0 on success, and -1 on failure
  ***************************************************************************/
-static void
-printesynclist (MS3TraceList *mstl, char *dccid)
+static int
+readfiles (MS3TraceList *mstl, MS3Selections *selections, uint32_t flags, uint32_t addflags)
 {
-  MS3TraceID *id   = 0;
-  MS3TraceSeg *seg = 0;
-  char starttime[30];
-  char endtime[30];
-  char yearday[30];
-  char network[11];
-  char station[11];
-  char location[11];
-  char channel[11];
-  char quality[10];
-  time_t now;
-  struct tm *nt;
-
-  md5_state_t pms;
-  md5_byte_t digest[16];
-  int samplesize;
+#if defined(LMP_WIN)
+  ms_log (2, "Reading with multiple threads (-T) is not supported on this platform\n");
+  return -1;
+#else
+  struct readshare share;
+  MS3TraceList *threadmstl;
+  pthread_t *tids;
+  void *result;
+  int started;
   int idx;
-  char digeststr[33];
 
-  if (!mstl)
-    return;
+  if (mstl3_set_concurrent (mstl))
+    return -1;
 
-  /* Generate current time stamp */
-  now = time (NULL);
-  nt  = localtime (&now);
-  nt->tm_year += 1900;
-  nt->tm_yday += 1;
-  snprintf (yearday, sizeof (yearday), "%04d,%03d", nt->tm_year, nt->tm_yday);
+  if (!(tids = (pthread_t *)malloc (threads * sizeof (pthread_t))))
+  {
+    ms_log (2, "Cannot allocate memory for threads\n");
+    return -1;
+  }
 
-  /* Print SYNC header line */
-  ms_log (0, "%s|%s\n", (dccid) ? dccid : "DCC", yearday);
+  share.selections = selections;
+  share.flags      = flags;
+  share.addflags   = addflags;
+  share.next       = filelist;
+  share.error      = 0;
+  pthread_mutex_init (&share.lock, NULL);
 
-  /* Loop through trace list */
-  id = mstl->traces.next[0];
-  while (id)
+  for (started = 0; started < threads; started++)
   {
-    /* Split SID into network, station, location and channel */
-    ms_sid2nslc (id->sid, network, station, location, channel);
-
-    /* Loop through segment list */
-    seg = id->first;
-    while (seg)
+    if (pthread_create (&tids[started], NULL, readthread, &share))
     {
-      ms_nstime2timestr (seg->starttime, starttime, SEEDORDINAL, NANO_MICRO);
-      ms_nstime2timestr (seg->endtime, endtime, SEEDORDINAL, NANO_MICRO);
-
-      /* Calculate MD5 hash of sample values if samples present */
-      if (seg->datasamples)
-      {
-        samplesize = ms_samplesize (seg->sampletype);
-        memset (&pms, 0, sizeof (md5_state_t));
-        md5_init (&pms);
-        md5_append (&pms, (const md5_byte_t *)seg->datasamples, (seg->numsamples * samplesize));
-        md5_finish (&pms, digest);
-
-        for (idx = 0; idx < 16; idx++)
-          sprintf (digeststr + (idx * 2), "%02x", digest[idx]);
-      }
-
-      /* Set quality flag, mapping to legacy codes for backwards compatibility */
-      switch (id->pubversion)
-      {
-      case 1:
-        quality[0] = 'D';
-        quality[1] = 0;
-        break;
-      case 2:
-        quality[0] = 'R';
-        quality[1] = 0;
-        break;
-      case 3:
-        quality[0] = 'Q';
-        quality[1] = 0;
-        break;
-      case 4:
-        quality[0] = 'M';
-        quality[1] = 0;
-        break;
-      default:
-        snprintf (quality, sizeof (quality), "%d", id->pubversion);
-        break;
-      }
+      ms_log (2, "Cannot create thread: %s\n", strerror (errno));
+      share.error = 1;
+      break;
+    }
+  }
 
-      /* Print SYNC line */
-      ms_log (0, "%s|%s|%s|%s|%s|%s||%.10g|%lld|||%s|%.32s|||%s\n",
-              network, station, location, channel,
-              starttime, endtime, seg->samprate, (long long int)seg->samplecnt,
-              (id->pubversion) ? quality : "",
-              (seg->datasamples) ? digeststr : "",
-              yearday);
+  /* Merge the list of each thread in thread order */
+  for (idx = 0; idx < started; idx++)
+  {
+    pthread_join (tids[idx], &result);
 
-      seg = seg->next;
-    }
+    if ((threadmstl = (MS3TraceList *)result) == NULL)
+      continue;
 
-    id = id->next[0];
+    if (share.error)
+      mstl3_free (&threadmstl, 0);
+    else if (mstl3_merge (mstl, &threadmstl, splitversion, 1, &tolerance))
+      share.error = 1;
   }
 
-  return;
-} /* End of printesynclist() */
+  pthread_mutex_destroy (&share.lock);
+  free (tids);
+
+  return (share.error) ? -1 : 0;
+#endif
+} /* End of readfiles() */
 
 /***************************************************************************
- * comparetraces():
+ * readthread():
  *
- * Compare sample values for each segment
+ * Thread reading files from the shared file list into its own trace
+ * list until none remain or another thread failed.
  *
- * Returns 0 on success, and -1 on failure
+ * Returns the trace list, NULL if no files were read or on failure.
  ***************************************************************************/
-static void
-comparetraces (MS3TraceList *mstl)
+static void *
+readthread (void *arg)
 {
-  MS3TraceID *id    = 0;
-  MS3TraceID *tid   = 0;
-  MS3TraceSeg *seg  = 0;
-  MS3TraceSeg *tseg = 0;
-  char start[30];
-  char end[30];
-  char tstart[30];
-  char tend[30];
-  int64_t idx = 0;
-
-  if (!mstl)
-    return;
+  MS3TraceList *mstl = NULL;
+#if !defined(LMP_WIN)
+  struct readshare *share = (struct readshare *)arg;
+  struct filelink *flp;
 
-  /* Loop through trace list */
-  id = mstl->traces.next[0];
-  while (id)
+  for (;;)
   {
-    /* Loop through segment list */
-    seg = id->first;
-    while (seg)
-    {
-      ms_nstime2timestr (seg->starttime, start, SEEDORDINAL, NANO_MICRO);
-      ms_nstime2timestr (seg->endtime, end, SEEDORDINAL, NANO_MICRO);
+    pthread_mutex_lock (&share->lock);
+    if ((flp = share->next) != NULL)
+      share->next = flp->next;
+    pthread_mutex_unlock (&share->lock);
 
-      if (!seg->datasamples)
-      {
-        ms_log (2, "%s, %s, %s :: No data samples\n", id->sid, start, end);
-        seg = seg->next;
-        continue;
-      }
+    if (!flp)
+      break;
 
-      /* Loop through trace list for targets */
-      tid = id;
-      while (tid)
-      {
-        /* Loop through target segment list */
-        tseg = (tid == id) ? seg->next : tid->first;
-        while (tseg)
-        {
-          if (!tseg->datasamples)
-          {
-            ms_log (1, "%s, %s, %s :: No data samples\n", tid->sid, tstart, tend);
-            tseg = tseg->next;
-            continue;
-          }
+    /* Start reading the following file into the page cache */
+    if (flp->next)
+      ms3_prefetch (flp->next->filename, share->flags);
 
-          ms_nstime2timestr (tseg->starttime, tstart, SEEDORDINAL, NANO_MICRO);
-          ms_nstime2timestr (tseg->endtime, tend, SEEDORDINAL, NANO_MICRO);
+    if ((!mstl && !(mstl = mstl3_init_arena (NULL, 0))) ||
+        readfile (mstl, flp->filename, share->selections, share->flags, share->addflags))
+    {
+      pthread_mutex_lock (&share->lock);
+      share->next  = NULL;
+      share->error = 1;
+      pthread_mutex_unlock (&share->lock);
 
-          if (seg->sampletype != tseg->sampletype)
-          {
-            ms_log (1, "%s and %s :: Sample type mismatch\n", id->sid, tid->sid);
-            tseg = tseg->next;
-            continue;
-          }
+      if (mstl)
+        mstl3_free (&mstl, 0);
+      break;
+    }
+  }
+#endif
 
-          if (seg->numsamples != tseg->numsamples)
-          {
-            ms_log (1, "%s (%lld) and %s (%lld) :: Sample count mismatch\n",
-                    id->sid, (long long int)seg->numsamples,
-                    tid->sid, (long long int)tseg->numsamples);
-            tseg = tseg->next;
-            continue;
-          }
+  return mstl;
+} /* End of readthread() */
 
-          if (seg->sampletype == 'i')
-          {
-            int32_t *data  = (int32_t *)seg->datasamples;
-            int32_t *tdata = (int32_t *)tseg->datasamples;
-
-            for (idx = 0; idx < seg->numsamples; idx++)
-              if (data[idx] != tdata[idx])
-              {
-                ms_log (0, "Time series are NOT the same, differing at sample %lld (%d versus %d)\n",
-                        (long long int)idx + 1, data[idx], tdata[idx]);
-                retval = 1;
-                break;
-              }
-          }
-          else if (seg->sampletype == 'f')
-          {
-            float *data  = (float *)seg->datasamples;
-            float *tdata = (float *)tseg->datasamples;
-
-            for (idx = 0; idx < seg->numsamples; idx++)
-              if (data[idx] != tdata[idx])
-              {
-                ms_log (0, "Time series are NOT the same, differing at sample %lld (%f versus %f)\n",
-                        (long long int)idx + 1, data[idx], tdata[idx]);
-                retval = 1;
-                break;
-              }
-          }
-          else if (seg->sampletype == 'd')
-          {
-            double *data  = (double *)seg->datasamples;
-            double *tdata = (double *)tseg->datasamples;
-
-            for (idx = 0; idx < seg->numsamples; idx++)
-              if (data[idx] != tdata[idx])
-              {
-                ms_log (0, "Time series are NOT the same, differing at sample %lld (%f versus %f)\n",
-                        (long long int)idx + 1, data[idx], tdata[idx]);
-                retval = 1;
-                break;
-              }
-          }
-          else if (seg->sampletype == 'a')
-          {
-            char *data  = (char *)seg->datasamples;
-            char *tdata = (char *)tseg->datasamples;
-
-            for (idx = 0; idx < seg->numsamples; idx++)
-              if (data[idx] != tdata[idx])
-              {
-                ms_log (0, "Time series are NOT the same, differing at sample %lld (%c versus %c)\n",
-                        (long long int)idx + 1, data[idx], tdata[idx]);
-                retval = 1;
-                break;
-              }
-          }
+/***************************************************************************
+ * addrecord():
+ *
+ * Add a record to the trace list, then flush completed segments and
+ * spill sample buffers if requested.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+addrecord (MS3TraceList *mstl, MS3Record *msr, uint32_t addflags)
+{
+  MS3TraceID *id   = 0;
+  MS3TraceSeg *seg = 0;
+  MS3Record trimmed;
+  void *buffer = 0;
+  char stime[40];
+  int rv;
+
+  /* A record that starts within flushed data was not read in time order */
+  if (flushclosed &&
+      (id = mstl3_findID (mstl, msr->sid, (splitversion) ? msr->pubversion : 0, NULL)) &&
+      id->prvtptr && msr->starttime <= *(nstime_t *)id->prvtptr)
+  {
+    ms_nstime2timestr (msr->starttime, stime, SEEDORDINAL, NANO_MICRO);
+    ms_log (2, "%s: Input not time-ordered, record starting %s is within flushed segments, -F unusable\n",
+            msr->sid, stime);
+    return -1;
+  }
 
-          if (idx == seg->numsamples)
-          {
-            ms_log (0, "Time series are the same, %lld samples compared\n",
-                    (long long int)idx);
-          }
+  /* Decode and add only the samples of a record within the time range,
+   * or only its coverage within the range for coverage-only listings */
+  if ((starttime != NSTUNSET || endtime != NSTUNSET) && ((addflags & MSF_UNPACKDATA) || !dataflag))
+  {
+    if ((rv = trimrecord (msr, &trimmed, &buffer)) < 0)
+      return -1;
 
-          ms_log (0, "  %s  %s  %s\n", id->sid, start, end);
-          ms_log (0, "  %s  %s  %s\n", tid->sid, tstart, tend);
+    if (rv > 0)
+      msr = &trimmed;
+  }
 
-          tseg = tseg->next;
-        }
+  seg = mstl3_addmsr (mstl, msr, splitversion, 1, addflags, &tolerance);
 
-        tid = tid->next[0];
-      }
+  if (buffer)
+    free (buffer);
 
-      seg = seg->next;
-    }
+  if (!seg)
+    return -1;
 
-    id = id->next[0];
+  /* Flush segments of this trace that cannot be extended by later records */
+  if (flushclosed &&
+      flushsegments (mstl, (id) ? id : mstl3_findID (mstl, msr->sid, (splitversion) ? msr->pubversion : 0, NULL),
+                     msr->starttime))
+    return -1;
+
+  /* Spill sample buffers to temporary files when over the memory budget */
+  if (maxmemory && memoryused > spillmark)
+    spillsegments (mstl, seg);
+
+  return 0;
+} /* End of addrecord() */
+
+/***************************************************************************
+ * trimrecord():
+ *
+ * Trim the samples of a record that are outside the time range, see
+ * trimsegments() for the use of the time tolerance.  Only the samples
+ * before the end of the range are decoded, into a buffer that is
+ * allocated and must be freed by the caller.  The trimmed record is a
+ * shallow copy of the record referencing the decoded samples.  For
+ * coverage-only listings (-N) only the start time and sample count of
+ * the copy are adjusted, nothing is decoded.
+ *
+ * Records with samples that would not be trimmed from segments, e.g.
+ * text, or with no samples within the range are not trimmed.
+ *
+ * Returns 1 if the record was trimmed, 0 if not, and -1 on failure
+ ***************************************************************************/
+static int
+trimrecord (MS3Record *msr, MS3Record *trimmed, void **buffer)
+{
+  nstime_t nstimetol;
+  int64_t first = 0;
+  int64_t count;
+  int64_t nsamples;
+  uint8_t samplesize = 0;
+  uint8_t encoding;
+  char sampletype = 0;
+
+  if (!msr->record || msr->numsamples > 0 || msr->samplecnt <= 0 || msr->samprate <= 0.0)
+    return 0;
+
+  /* Fallback encoding for when encoding is unknown, as when decoding */
+  encoding = (msr->encoding < 0) ? DE_STEIM1 : (uint8_t)msr->encoding;
+
+  if (ms_encoding_sizetype (encoding, &samplesize, &sampletype) ||
+      (sampletype != 'i' && sampletype != 'f' && sampletype != 'd'))
+    return 0;
+
+  nstimetol = trimtolerance (msr->samprate);
+
+  /* Count the samples before the start and up to the end of the range */
+  if (starttime != NSTUNSET)
+    first = samplesbefore (msr->starttime, msr->samprate, starttime - nstimetol, msr->samplecnt);
+
+  if (endtime != NSTUNSET)
+    count = samplesbefore (msr->starttime, msr->samprate, endtime + nstimetol + 1, msr->samplecnt);
+  else
+    count = msr->samplecnt;
+
+  if ((first == 0 && count == msr->samplecnt) || count <= first)
+    return 0;
+
+  if (verbose > 1)
+    ms_log (1, "Trimming %lld of %lld samples from record for %s\n",
+            (long long)(msr->samplecnt - count + first), (long long)msr->samplecnt, msr->sid);
+
+  *trimmed = *msr;
+  trimmed->starttime = ms_sampletime (msr->starttime, first, msr->samprate);
+  trimmed->samplecnt = count - first;
+
+  /* Coverage-only records (-N) are trimmed without decoding */
+  if (!dataflag)
+    return 1;
+
+  if (!(*buffer = malloc ((size_t)count * samplesize)))
+  {
+    ms_log (2, "Cannot allocate memory for samples\n");
+    return -1;
   }
 
-  return;
-} /* End of comparetraces() */
+  /* Decode samples up to the end of the range, the leading samples cannot be skipped */
+  nsamples = msr3_decode_samples (msr, count, *buffer, (size_t)count * samplesize, &sampletype, 0);
+
+  if (nsamples != count)
+  {
+    ms_log (2, "%s: Cannot decode %lld samples\n", msr->sid, (long long)count);
+    return -1;
+  }
+
+  trimmed->datasamples = (char *)*buffer + (first * samplesize);
+  trimmed->numsamples  = count - first;
+  trimmed->sampletype  = sampletype;
+
+  return 1;
+} /* End of trimrecord() */
 
 /***************************************************************************
- * parameter_proc():
- * Process the command line parameters.
+ * addrecorddesc():
+ *
+ * Save the source, start time and location in the file of a record to
+ * be added in sorted order.  The source is identified by a 64-bit
+ * FNV-1a hash of the SID, a collision only interleaves the records of
+ * two sources.
  *
  * Returns 0 on success, and -1 on failure
  ***************************************************************************/
 static int
-processparam (int argcount, char **argvec)
+addrecorddesc (MS3Record *msr, int64_t offset)
 {
-  int optind;
-  char *match_pattern  = 0;
-  char *reject_pattern = 0;
-  char *tptr;
+  struct recorddesc *rd;
+  const char *cp;
+  uint64_t hash = 14695981039346656037ULL;
 
-  /* Process all command line arguments */
-  for (optind = 1; optind < argcount; optind++)
+  if (recorddesccount >= recorddescsize)
   {
-    if (strcmp (argvec[optind], "-V") == 0)
+    recorddescsize = (recorddescsize) ? recorddescsize * 2 : 4096;
+
+    if (!(rd = realloc (recorddescs, recorddescsize * sizeof (struct recorddesc))))
     {
-      ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
-      exit (0);
+      ms_log (2, "Cannot allocate memory for record list\n");
+      return -1;
     }
-    else if (strcmp (argvec[optind], "-h") == 0)
+
+    recorddescs = rd;
+  }
+
+  for (cp = msr->sid; *cp; cp++)
+    hash = (hash ^ (uint8_t)*cp) * 1099511628211ULL;
+
+  rd             = &recorddescs[recorddesccount++];
+  rd->sidhash    = hash;
+  rd->starttime  = msr->starttime;
+  rd->offset     = offset;
+  rd->reclen     = msr->reclen;
+  rd->pubversion = msr->pubversion;
+
+  return 0;
+} /* End of addrecorddesc() */
+
+/***************************************************************************
+ * addsorted():
+ *
+ * Sort the saved records of a file by source, publication version and
+ * start time, then read and add each record to the trace list.  Each
+ * record then extends the end of a segment, avoiding the creation and
+ * joining of segments for multiplexed and mixed-order input.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+addsorted (MS3TraceList *mstl, const char *filename, uint32_t flags, uint32_t addflags)
+{
+  struct recorddesc *rd;
+  MS3Record *msr = 0;
+  FILE *fp       = 0;
+  char *record   = 0;
+  int64_t position = -1;
+  size_t idx;
+  int rv = 0;
+
+  qsort (recorddescs, recorddesccount, sizeof (struct recorddesc), cmprecorddesc);
+
+  if (!(fp = fopen (filename, "rb")))
+  {
+    ms_log (2, "Cannot open %s: %s\n", filename, strerror (errno));
+    return -1;
+  }
+
+  if (!(record = (char *)malloc (MAXRECLEN)))
+  {
+    ms_log (2, "Cannot allocate memory for record buffer\n");
+    fclose (fp);
+    return -1;
+  }
+
+  for (idx = 0; idx < recorddesccount && rv == 0; idx++)
+  {
+    rd = &recorddescs[idx];
+
+    /* Seek only when the record does not follow the previous one */
+    if (position != rd->offset && lmp_fseek64 (fp, rd->offset, SEEK_SET))
     {
-      usage ();
-      exit (0);
+      ms_log (2, "Cannot seek in %s: %s\n", filename, strerror (errno));
+      rv = -1;
     }
-    else if (strncmp (argvec[optind], "-v", 2) == 0)
+    else if (rd->reclen > MAXRECLEN || fread (record, 1, rd->reclen, fp) != (size_t)rd->reclen)
     {
-      verbose += strspn (&argvec[optind][1], "v");
+      ms_log (2, "Cannot read record at offset %lld of %s\n", (long long int)rd->offset, filename);
+      rv = -1;
     }
-    else if (strcmp (argvec[optind], "-D") == 0)
+    /* The buffer holds exactly one record, parse as if at the end of a file */
+    else if (msr3_parse (record, rd->reclen, &msr, (flags & MSF_HEADERONLY) | MSF_ATENDOFFILE, verbose) != MS_NOERROR)
     {
-      dccidstr = getoptval (argcount, argvec, optind++);
+      ms_log (2, "Cannot parse record at offset %lld of %s\n", (long long int)rd->offset, filename);
+      rv = -1;
     }
-    else if (strcmp (argvec[optind], "-C") == 0)
+    else if (addrecord (mstl, msr, addflags))
     {
-      compare = 1;
+      ms_log (2, "Cannot add record to trace list from %s\n", filename);
+      rv = -1;
     }
-    else if (strcmp (argvec[optind], "-ts") == 0)
+
+    position = rd->offset + rd->reclen;
+  }
+
+  msr3_free (&msr);
+  free (record);
+  fclose (fp);
+
+  recorddesccount = 0;
+
+  return rv;
+} /* End of addsorted() */
+
+/***************************************************************************
+ * cmprecorddesc():
+ *
+ * Compare records by source, publication version, start time and then
+ * offset in the file.
+ ***************************************************************************/
+static int
+cmprecorddesc (const void *a, const void *b)
+{
+  const struct recorddesc *rda = (const struct recorddesc *)a;
+  const struct recorddesc *rdb = (const struct recorddesc *)b;
+
+  if (rda->sidhash != rdb->sidhash)
+    return (rda->sidhash < rdb->sidhash) ? -1 : 1;
+
+  if (rda->pubversion != rdb->pubversion)
+    return (rda->pubversion < rdb->pubversion) ? -1 : 1;
+
+  if (rda->starttime != rdb->starttime)
+    return (rda->starttime < rdb->starttime) ? -1 : 1;
+
+  return (rda->offset < rdb->offset) ? -1 : (rda->offset > rdb->offset);
+} /* End of cmprecorddesc() */
+
+/***************************************************************************
+ * trimsegments():
+ *
+ * Trim data segments to specified start and end times.  The specified
+ * or default time tolerance is used to liberally match sample times:
+ *
+ *   The first sample can be at start time minus the tolerance value
+ *   The last sample can be at the end time plus the tolerance value
+ *
+ * If timetol is -1 the default tolerance of 1/2 sample period is used.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static void
+trimsegments (MS3TraceList *mstl)
+{
+  MS3TraceID *id   = 0;
+  MS3TraceSeg *seg = 0;
+
+  if (!mstl)
+    return;
+
+  /* Loop through trace list */
+  id = mstl->traces.next[0];
+  while (id)
+  {
+    /* Loop through segment list */
+    seg = id->first;
+    while (seg)
     {
-      starttime = ms_timestr2nstime (getoptval (argcount, argvec, optind++));
-      if (starttime == NSTUNSET)
-        return -1;
+      if (trimsegment (mstl, id, &seg))
+        return;
+
+      seg = seg->next;
     }
-    else if (strcmp (argvec[optind], "-te") == 0)
+
+    id = id->next[0];
+  }
+
+  return;
+} /* End of trimsegments() */
+
+/***************************************************************************
+ * trimsegment():
+ *
+ * Trim a single data segment to specified start and end times, see
+ * trimsegments() for the use of the time tolerance.  The samples to
+ * trim are counted arithmetically and split from the segment with
+ * mstl3_split_segment(), then removed.  Coverage-only segments (-N)
+ * have no samples, only their times and sample count are adjusted by
+ * the split.  Trimming the end of a segment
+ * replaces it with the segment split from it, which is returned in
+ * pseg.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+trimsegment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg **pseg)
+{
+  MS3TraceSeg *seg = *pseg;
+  MS3TraceSeg *split;
+  nstime_t nstimetol;
+  int64_t trimcount;
+
+  /* Skip segments that do not have integer, float or double types,
+   * coverage-only segments without samples are trimmed arithmetically */
+  if (seg->numsamples > 0 &&
+      seg->sampletype != 'i' && seg->sampletype != 'f' && seg->sampletype != 'd')
+    return 0;
+
+  if (seg->samprate <= 0.0)
+    return 0;
+
+  nstimetol = trimtolerance (seg->samprate);
+
+  /* Trim samples from beginning of segment if earlier than starttime */
+  if (starttime != NSTUNSET && seg->starttime < starttime)
+  {
+    trimcount = samplesbefore (seg->starttime, seg->samprate, starttime - nstimetol, seg->samplecnt);
+
+    if (trimcount > 0 && trimcount < seg->samplecnt)
     {
-      endtime = ms_timestr2nstime (getoptval (argcount, argvec, optind++));
-      if (endtime == NSTUNSET)
+      if (verbose)
+        ms_log (1, "Trimming %lld samples from beginning of trace for %s\n",
+                (long long)trimcount, id->sid);
+
+      if (!(split = mstl3_split_segment (mstl, id, seg, trimcount)) ||
+          mstl3_remove_segment (mstl, id, split, 0))
+      {
+        ms_log (2, "Cannot trim segment for %s\n", id->sid);
         return -1;
+      }
     }
-    else if (strcmp (argvec[optind], "-m") == 0)
+  }
+
+  /* Trim samples from end of segment if later than endtime, counting
+   * backward from the last sample by negating times */
+  if (endtime != NSTUNSET && seg->endtime > endtime)
+  {
+    trimcount = samplesbefore (-seg->endtime, seg->samprate, -(endtime + nstimetol), seg->samplecnt);
+
+    if (trimcount > 0 && trimcount < seg->samplecnt)
     {
-      match_pattern = strdup (getoptval (argcount, argvec, optind++));
+      if (verbose)
+        ms_log (1, "Trimming %lld samples from end of trace for %s\n",
+                (long long)trimcount, id->sid);
+
+      if (!(split = mstl3_split_segment (mstl, id, seg, seg->samplecnt - trimcount)) ||
+          mstl3_remove_segment (mstl, id, seg, 0))
+      {
+        ms_log (2, "Cannot trim segment for %s\n", id->sid);
+        return -1;
+      }
+
+      *pseg = split;
     }
-    else if (strcmp (argvec[optind], "-r") == 0)
+  }
+
+  return 0;
+} /* End of trimsegment() */
+
+/***************************************************************************
+ * trimtolerance():
+ *
+ * Calculate the high-precision time tolerance used for trimming and
+ * splitting segments of the sample rate, see trimsegments().
+ *
+ * Returns the time tolerance.
+ ***************************************************************************/
+static nstime_t
+trimtolerance (double samprate)
+{
+  nstime_t nsdelta;
+
+  /* Calculate high-precision sample period */
+  nsdelta = (nstime_t)((samprate) ? (NSTMODULUS / samprate) : 0.0);
+
+  if (timetol == -1.0)
+    return (nstime_t)(0.5 * nsdelta); /* Default time tolerance is 1/2 sample period */
+  else if (timetol >= 0.0)
+    return (nstime_t)(timetol * NSTMODULUS);
+
+  return 0;
+} /* End of trimtolerance() */
+
+/***************************************************************************
+ * samplesbefore():
+ *
+ * Count the samples of a series starting at time first that are
+ * earlier than time limit, up to maximum.  The count is estimated
+ * from the sample rate and adjusted using the sample times calculated
+ * by ms_sampletime(), without stepping through the samples.
+ *
+ * Returns the number of samples.
+ ***************************************************************************/
+static int64_t
+samplesbefore (nstime_t first, double samprate, nstime_t limit, int64_t maximum)
+{
+  double estimate;
+  int64_t count;
+
+  if (limit <= first || maximum <= 0)
+    return 0;
+
+  estimate = (double)(limit - first) * samprate / NSTMODULUS;
+  count    = (estimate < (double)maximum) ? (int64_t)estimate : maximum;
+
+  while (count > 0 && ms_sampletime (first, count - 1, samprate) >= limit)
+    count--;
+  while (count < maximum && ms_sampletime (first, count, samprate) < limit)
+    count++;
+
+  return count;
+} /* End of samplesbefore() */
+
+/***************************************************************************
+ * splitsegments():
+ *
+ * Split each data segment into windows of the split interval, see
+ * splitsegment().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+splitsegments (MS3TraceList *mstl)
+{
+  MS3TraceID *id   = 0;
+  MS3TraceSeg *seg = 0;
+
+  if (!mstl)
+    return 0;
+
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
     {
-      reject_pattern = strdup (getoptval (argcount, argvec, optind++));
+      if (splitsegment (mstl, id, seg))
+        return -1;
     }
-    else if (strcmp (argvec[optind], "-tt") == 0)
+  }
+
+  return 0;
+} /* End of splitsegments() */
+
+/***************************************************************************
+ * splitsegment():
+ *
+ * Split a data segment at each multiple of the split interval since
+ * the epoch that falls within it.  Windows are half-open, a sample at
+ * a boundary belongs to the later window.  The time tolerance is
+ * applied as when trimming, a sample within the tolerance before a
+ * boundary also belongs to the later window.
+ *
+ * The samples before each boundary are moved to a new segment
+ * inserted before the segment, which is left with the samples of the
+ * last window.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+splitsegment (MS3TraceList *mstl, MS3TraceID *id, MS3TraceSeg *seg)
+{
+  nstime_t nstimetol;
+  nstime_t window;
+  nstime_t boundary;
+  nstime_t offset;
+  int64_t count;
+
+  if (!splitinterval || seg->samprate <= 0.0)
+    return 0;
+
+  nstimetol = trimtolerance (seg->samprate);
+
+  for (;;)
+  {
+    /* Start of the window of the first sample and time of the first sample in the next */
+    offset = (seg->starttime + nstimetol) % splitinterval;
+    if (offset < 0)
+      offset += splitinterval;
+
+    window   = seg->starttime + nstimetol - offset;
+    boundary = window + splitinterval - nstimetol;
+
+    if (boundary > seg->endtime)
+      break;
+
+    count = samplesbefore (seg->starttime, seg->samprate, boundary, seg->samplecnt);
+
+    if (count <= 0 || count >= seg->samplecnt)
+      break;
+
+    if (verbose > 1)
+      ms_log (1, "Splitting %lld samples from beginning of trace for %s\n",
+              (long long)count, id->sid);
+
+    if (!mstl3_split_segment (mstl, id, seg, count))
     {
-      timetol        = strtod (getoptval (argcount, argvec, optind++), NULL);
-      tolerance.time = timetol_callback;
+      ms_log (2, "Cannot split segment for %s\n", id->sid);
+      return -1;
     }
-    else if (strcmp (argvec[optind], "-rt") == 0)
+  }
+
+  return 0;
+} /* End of splitsegment() */
+
+/***************************************************************************
+ * printesynclist():
+ *
+ * Print the MS3TraceList as an Enhanced SYNC Listing.  Lines of
+ * segments flushed while reading are merged with the segments remaining
+ * in the trace list in trace list order.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static void
+printesynclist (MS3TraceList *mstl, char *dccid)
+{
+  MS3TraceID *id   = 0;
+  MS3TraceSeg *seg = 0;
+  char line[512];
+  size_t idx;
+
+  if (!mstl)
+    return;
+
+  /* Print SYNC header line */
+  ms_log (0, "%s|%s\n", (dccid) ? dccid : "DCC", yearday);
+
+  /* Print directly from the trace list when no segments were flushed */
+  if (!synclinecount)
+  {
+    /* Loop through trace list */
+    id = mstl->traces.next[0];
+    while (id)
     {
-      sampratetol        = strtod (getoptval (argcount, argvec, optind++), NULL);
-      tolerance.samprate = samprate_callback;
+      /* Loop through segment list */
+      seg = id->first;
+      while (seg)
+      {
+        formatsyncline (id, seg, line, sizeof (line));
+        ms_log (0, "%s", line);
+
+        seg = seg->next;
+      }
+
+      id = id->next[0];
     }
-    else if (strncmp (argvec[optind], "-", 1) == 0 &&
-             strlen (argvec[optind]) > 1)
+
+    return;
+  }
+
+  /* Add the remaining segments to the flushed lines and sort into trace list order */
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
     {
-      ms_log (2, "Unknown option: %s\n", argvec[optind]);
-      exit (1);
+      if (addsyncline (id, seg))
+        return;
+    }
+  }
+
+  qsort (synclines, synclinecount, sizeof (struct syncline), cmpsynclines);
+
+  for (idx = 0; idx < synclinecount; idx++)
+  {
+    ms_log (0, "%s", synclines[idx].line);
+    free (synclines[idx].line);
+  }
+
+  free (synclines);
+  synclines     = 0;
+  synclinecount = 0;
+  synclinesize  = 0;
+
+  return;
+} /* End of printesynclist() */
+
+/***************************************************************************
+ * formatsyncline():
+ *
+ * Format the SYNC line, including trailing newline, for a segment.
+ ***************************************************************************/
+static void
+formatsyncline (MS3TraceID *id, MS3TraceSeg *seg, char *line, size_t linesize)
+{
+  MS3SampleChunk *chunk = 0;
+  char start[30];
+  char end[30];
+  char network[11];
+  char station[11];
+  char location[11];
+  char channel[11];
+  char quality[10];
+
+  md5_state_t pms;
+  md5_byte_t digest[16];
+  int samplesize;
+  int idx;
+  char digeststr[33];
+
+  /* Split SID into network, station, location and channel */
+  ms_sid2nslc (id->sid, network, station, location, channel);
+
+  ms_nstime2timestr (seg->starttime, start, SEEDORDINAL, NANO_MICRO);
+  ms_nstime2timestr (seg->endtime, end, SEEDORDINAL, NANO_MICRO);
+
+  /* Calculate MD5 hash of sample values if samples present, chunk by chunk if chunked */
+  if (seg->datasamples || seg->chunks)
+  {
+    samplesize = ms_samplesize (seg->sampletype);
+    memset (&pms, 0, sizeof (md5_state_t));
+    md5_init (&pms);
+
+    if (seg->chunks)
+    {
+      for (chunk = seg->chunks; chunk; chunk = chunk->next)
+        md5_append (&pms, (const md5_byte_t *)chunk->datasamples, (chunk->numsamples * samplesize));
     }
     else
     {
-      tptr = argvec[optind];
+      md5_append (&pms, (const md5_byte_t *)seg->datasamples, (seg->numsamples * samplesize));
+    }
 
-      /* Check for an input file list */
-      if (tptr[0] == '@')
+    md5_finish (&pms, digest);
+
+    for (idx = 0; idx < 16; idx++)
+      sprintf (digeststr + (idx * 2), "%02x", digest[idx]);
+  }
+
+  /* Set quality flag, mapping to legacy codes for backwards compatibility */
+  switch (id->pubversion)
+  {
+  case 1:
+    quality[0] = 'D';
+    quality[1] = 0;
+    break;
+  case 2:
+    quality[0] = 'R';
+    quality[1] = 0;
+    break;
+  case 3:
+    quality[0] = 'Q';
+    quality[1] = 0;
+    break;
+  case 4:
+    quality[0] = 'M';
+    quality[1] = 0;
+    break;
+  default:
+    snprintf (quality, sizeof (quality), "%d", id->pubversion);
+    break;
+  }
+
+  snprintf (line, linesize, "%s|%s|%s|%s|%s|%s||%.10g|%lld|||%s|%.32s|||%s\n",
+            network, station, location, channel,
+            start, end, seg->samprate, (long long int)seg->samplecnt,
+            (id->pubversion) ? quality : "",
+            (seg->datasamples || seg->chunks) ? digeststr : "",
+            yearday);
+} /* End of formatsyncline() */
+
+/***************************************************************************
+ * flushsegments():
+ *
+ * Flush the segments of a trace ID that end before the newest record
+ * start time by more than a sample period and the time tolerance.  With
+ * time-ordered input such segments cannot be extended by later records,
+ * so each is trimmed, its SYNC line saved, and it is removed from the
+ * trace list to release its samples.
+ *
+ * When splitting into windows, the completed windows of segments that
+ * are still open are flushed the same way.
+ *
+ * The latest time that a record of the trace ID could extend or fall
+ * within flushed data is kept at the ID private pointer: the end of a
+ * closed segment plus the sample period and time tolerance, or the end
+ * of a window.  A later record starting by then shows the input is not
+ * time-ordered, see addrecord().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+flushsegments (MS3TraceList *mstl, MS3TraceID *id, nstime_t newest)
+{
+  MS3TraceSeg *seg = 0;
+  MS3TraceSeg *next = 0;
+  MS3TraceSeg *prev = 0;
+  MS3TraceSeg *piece = 0;
+  MS3TraceSeg *nextpiece = 0;
+  nstime_t nsdelta;
+  nstime_t nstimetol;
+  flag closed;
+
+  if (!mstl || !id)
+    return 0;
+
+  seg = id->first;
+  while (seg)
+  {
+    next = seg->next;
+
+    /* Calculate sample period and time tolerance as used when adding records */
+    nsdelta = (nstime_t)((seg->samprate) ? (NSTMODULUS / seg->samprate) : 0.0);
+
+    if (tolerance.time)
+      nstimetol = (nstime_t)(NSTMODULUS * timetol);
+    else
+      nstimetol = (nstime_t)(0.5 * nsdelta);
+
+    if (nstimetol < 0)
+      nstimetol = -nstimetol;
+
+    closed = (seg->endtime + nsdelta + nstimetol < newest);
+
+    if (!closed && !splitinterval)
+    {
+      seg = next;
+      continue;
+    }
+
+    /* Keep the limit of flushed data before trimming */
+    if (!id->prvtptr)
+    {
+      if (!(id->prvtptr = libmseed_memory.malloc (sizeof (nstime_t))))
       {
-        if (addlistfile (tptr + 1) < 0)
-        {
-          ms_log (2, "Error adding list file %s", tptr + 1);
-          exit (1);
-        }
+        ms_log (2, "Cannot allocate memory\n");
+        return -1;
       }
-      /* Otherwise this is an input file */
-      else
+
+      *(nstime_t *)id->prvtptr = NSTUNSET;
+    }
+
+    if (closed && seg->endtime + nsdelta + nstimetol > *(nstime_t *)id->prvtptr)
+      *(nstime_t *)id->prvtptr = seg->endtime + nsdelta + nstimetol;
+
+    /* Trim a closed segment before splitting, the windows of an open segment when flushed */
+    if (closed && (starttime != NSTUNSET || endtime != NSTUNSET) && trimsegment (mstl, id, &seg))
+      return -1;
+
+    prev = seg->prev;
+
+    if (splitsegment (mstl, id, seg))
+      return -1;
+
+    /* Flush the windows split from the segment, and the segment itself if closed */
+    for (piece = (prev) ? prev->next : id->first; piece; piece = nextpiece)
+    {
+      nextpiece = piece->next;
+
+      if (piece == seg && !closed)
+        break;
+
+      if (!closed && piece->endtime > *(nstime_t *)id->prvtptr)
+        *(nstime_t *)id->prvtptr = piece->endtime;
+
+      if (!closed && (starttime != NSTUNSET || endtime != NSTUNSET) && trimsegment (mstl, id, &piece))
+        return -1;
+
+      if (addsyncline (id, piece))
+        return -1;
+
+      if (mstl3_remove_segment (mstl, id, piece, 0))
       {
-        /* Add file to global file list */
-        if (addfile (tptr))
-        {
-          ms_log (2, "Error adding file to input list %s", tptr);
-          exit (1);
-        }
+        ms_log (2, "Cannot remove segment for %s\n", id->sid);
+        return -1;
       }
+
+      if (piece == seg)
+        break;
     }
+
+    seg = next;
   }
 
-  /* Make sure input file were specified */
-  if (filelist == 0)
+  return 0;
+} /* End of flushsegments() */
+
+/***************************************************************************
+ * addsyncline():
+ *
+ * Format and save the SYNC line for a segment.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+addsyncline (MS3TraceID *id, MS3TraceSeg *seg)
+{
+  struct syncline *sl;
+  char line[512];
+
+  if (synclinecount >= synclinesize)
   {
-    ms_log (2, "No input files were specified\n\n");
-    ms_log (1, "%s version %s\n\n", PACKAGE, VERSION);
-    ms_log (1, "Try %s -h for usage\n", PACKAGE);
-    exit (1);
+    synclinesize = (synclinesize) ? synclinesize * 2 : 1024;
+
+    if (!(sl = realloc (synclines, synclinesize * sizeof (struct syncline))))
+    {
+      ms_log (2, "Cannot allocate memory for SYNC lines\n");
+      return -1;
+    }
+
+    synclines = sl;
+  }
+
+  formatsyncline (id, seg, line, sizeof (line));
+
+  sl = &synclines[synclinecount];
+  sl->sid        = id->sid;
+  sl->pubversion = id->pubversion;
+  sl->starttime  = seg->starttime;
+  sl->sequence   = synclinecount;
+
+  if (!(sl->line = strdup (line)))
+  {
+    ms_log (2, "Cannot allocate memory for SYNC line\n");
+    return -1;
   }
 
-  /* Add wildcards to match pattern for logical "contains" */
-  if (match_pattern)
-  {
-    if ((match = malloc (strlen (match_pattern) + 3)) == NULL)
+  synclinecount++;
+
+  return 0;
+} /* End of addsyncline() */
+
+/***************************************************************************
+ * cmpsynclines():
+ *
+ * Compare SYNC lines in trace list order: by SID, publication version
+ * and segment start time, then in the order saved.
+ ***************************************************************************/
+static int
+cmpsynclines (const void *a, const void *b)
+{
+  const struct syncline *sla = (const struct syncline *)a;
+  const struct syncline *slb = (const struct syncline *)b;
+  int cmp;
+
+  if ((cmp = strcmp (sla->sid, slb->sid)))
+    return cmp;
+
+  if (sla->pubversion != slb->pubversion)
+    return (sla->pubversion < slb->pubversion) ? -1 : 1;
+
+  if (sla->starttime != slb->starttime)
+    return (sla->starttime < slb->starttime) ? -1 : 1;
+
+  return (sla->sequence < slb->sequence) ? -1 : (sla->sequence > slb->sequence);
+} /* End of cmpsynclines() */
+
+/***************************************************************************
+ * spillsegments():
+ *
+ * Spill the sample buffers of the largest segments, except the active
+ * segment that the last record was added to, to temporary files until
+ * memory use is below three quarters of the budget.  If the budget
+ * cannot be met, e.g. due to the trace list itself, spilling is next
+ * attempted after memory use grows by another quarter of the budget.
+ ***************************************************************************/
+static void
+spillsegments (MS3TraceList *mstl, MS3TraceSeg *active)
+{
+  MS3TraceID *id   = 0;
+  MS3TraceSeg *seg = 0;
+  MS3SampleChunk *chunk = 0;
+  struct spillseg *spill = 0;
+  size_t spillcount = 0;
+  size_t spillsize  = 0;
+  size_t size;
+  size_t idx;
+  int64_t released;
+  int64_t total = 0;
+
+  /* Collect segments with sample buffers in memory */
+  for (id = mstl->traces.next[0]; id; id = id->next[0])
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if (seg == active)
+        continue;
+
+      size = (seg->datasamples) ? seg->datasize : 0;
+      for (chunk = seg->chunks; chunk; chunk = chunk->next)
+        size += (chunk->mapped) ? 0 : chunk->datasize;
+
+      if (!size)
+        continue;
+
+      if (spillcount >= spillsize)
+      {
+        spillsize = (spillsize) ? spillsize * 2 : 256;
+
+        if (!(spill = realloc (spill, spillsize * sizeof (struct spillseg))))
+        {
+          ms_log (2, "Cannot allocate memory for spill list\n");
+          return;
+        }
+      }
+
+      spill[spillcount].seg  = seg;
+      spill[spillcount].size = size;
+      spillcount++;
+    }
+  }
+
+  /* Spill largest first */
+  if (spillcount)
+    qsort (spill, spillcount, sizeof (struct spillseg), cmpspill);
+
+  for (idx = 0; idx < spillcount && memoryused > maxmemory / 4 * 3; idx++)
+  {
+    if ((released = mstl3_spill_samples (spill[idx].seg, NULL)) < 0)
+    {
+      ms_log (1, "Cannot spill samples to a temporary file, memory budget disabled\n");
+      maxmemory = 0;
+      break;
+    }
+
+    total += released;
+  }
+
+  if (verbose)
+    ms_log (1, "Spilled %lld bytes of samples from %lld segments, %lld bytes in memory\n",
+            (long long int)total, (long long int)idx, (long long int)memoryused);
+
+  spillmark = (memoryused > maxmemory) ? memoryused + maxmemory / 4 : maxmemory;
+
+  free (spill);
+} /* End of spillsegments() */
+
+/***************************************************************************
+ * cmpspill():
+ *
+ * Compare spill candidates by size in memory, largest first.
+ ***************************************************************************/
+static int
+cmpspill (const void *a, const void *b)
+{
+  const struct spillseg *sa = (const struct spillseg *)a;
+  const struct spillseg *sb = (const struct spillseg *)b;
+
+  if (sa->size != sb->size)
+    return (sa->size > sb->size) ? -1 : 1;
+
+  return 0;
+} /* End of cmpspill() */
+
+/***************************************************************************
+ * budget_malloc():
+ * budget_realloc():
+ * budget_free():
+ *
+ * Memory allocation functions for the library that track the number
+ * of bytes allocated in memoryused.  The size of each allocation is
+ * stored in a header before the returned pointer.
+ ***************************************************************************/
+static void *
+budget_malloc (size_t size)
+{
+  char *base;
+
+  if (!(base = (char *)malloc (size + MEMHEADER)))
+    return NULL;
+
+  *(size_t *)base = size;
+  memoryused += size;
+
+  return base + MEMHEADER;
+} /* End of budget_malloc() */
+
+static void *
+budget_realloc (void *ptr, size_t size)
+{
+  char *base;
+  size_t oldsize;
+
+  if (!ptr)
+    return budget_malloc (size);
+
+  base    = (char *)ptr - MEMHEADER;
+  oldsize = *(size_t *)base;
+
+  if (!(base = (char *)realloc (base, size + MEMHEADER)))
+    return NULL;
+
+  *(size_t *)base = size;
+  memoryused      = memoryused - oldsize + size;
+
+  return base + MEMHEADER;
+} /* End of budget_realloc() */
+
+static void
+budget_free (void *ptr)
+{
+  char *base;
+
+  if (!ptr)
+    return;
+
+  base = (char *)ptr - MEMHEADER;
+  memoryused -= *(size_t *)base;
+
+  free (base);
+} /* End of budget_free() */
+
+/***************************************************************************
+ * comparetraces():
+ *
+ * Compare sample values for each segment
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static void
+comparetraces (MS3TraceList *mstl)
+{
+  MS3TraceID *id    = 0;
+  MS3TraceID *tid   = 0;
+  MS3TraceSeg *seg  = 0;
+  MS3TraceSeg *tseg = 0;
+  MS3SampleChunk *chunk  = 0;
+  MS3SampleChunk *tchunk = 0;
+  void *data;
+  void *tdata;
+  int64_t count;
+  int64_t tcount;
+  int64_t run;
+  int64_t diffidx;
+  int samplesize;
+  char start[30];
+  char end[30];
+  char tstart[30];
+  char tend[30];
+  int64_t idx = 0;
+
+  if (!mstl)
+    return;
+
+  /* Loop through trace list */
+  id = mstl->traces.next[0];
+  while (id)
+  {
+    /* Loop through segment list */
+    seg = id->first;
+    while (seg)
+    {
+      ms_nstime2timestr (seg->starttime, start, SEEDORDINAL, NANO_MICRO);
+      ms_nstime2timestr (seg->endtime, end, SEEDORDINAL, NANO_MICRO);
+
+      if (!seg->datasamples && !seg->chunks)
+      {
+        ms_log (2, "%s, %s, %s :: No data samples\n", id->sid, start, end);
+        seg = seg->next;
+        continue;
+      }
+
+      /* Loop through trace list for targets */
+      tid = id;
+      while (tid)
+      {
+        /* Loop through target segment list */
+        tseg = (tid == id) ? seg->next : tid->first;
+        while (tseg)
+        {
+          if (!tseg->datasamples && !tseg->chunks)
+          {
+            ms_log (1, "%s, %s, %s :: No data samples\n", tid->sid, tstart, tend);
+            tseg = tseg->next;
+            continue;
+          }
+
+          ms_nstime2timestr (tseg->starttime, tstart, SEEDORDINAL, NANO_MICRO);
+          ms_nstime2timestr (tseg->endtime, tend, SEEDORDINAL, NANO_MICRO);
+
+          if (seg->sampletype != tseg->sampletype)
+          {
+            ms_log (1, "%s and %s :: Sample type mismatch\n", id->sid, tid->sid);
+            tseg = tseg->next;
+            continue;
+          }
+
+          if (seg->numsamples != tseg->numsamples)
+          {
+            ms_log (1, "%s (%lld) and %s (%lld) :: Sample count mismatch\n",
+                    id->sid, (long long int)seg->numsamples,
+                    tid->sid, (long long int)tseg->numsamples);
+            tseg = tseg->next;
+            continue;
+          }
+
+          /* Compare samples span by span, spans are either the contiguous
+           * buffers or overlapping portions of sample chunks */
+          samplesize = ms_samplesize (seg->sampletype);
+          chunk      = seg->chunks;
+          tchunk     = tseg->chunks;
+          data       = (chunk) ? chunk->datasamples : seg->datasamples;
+          tdata      = (tchunk) ? tchunk->datasamples : tseg->datasamples;
+          count      = (chunk) ? chunk->numsamples : seg->numsamples;
+          tcount     = (tchunk) ? tchunk->numsamples : tseg->numsamples;
+
+          idx = 0;
+          while (idx < seg->numsamples)
+          {
+            /* Advance to next non-empty chunks */
+            while (count == 0 && chunk && (chunk = chunk->next))
+            {
+              data  = chunk->datasamples;
+              count = chunk->numsamples;
+            }
+            while (tcount == 0 && tchunk && (tchunk = tchunk->next))
+            {
+              tdata  = tchunk->datasamples;
+              tcount = tchunk->numsamples;
+            }
+
+            run = (count < tcount) ? count : tcount;
+
+            if (run <= 0)
+              break;
+
+            if ((diffidx = comparesamples (seg->sampletype, data, tdata, run, idx)) >= 0)
+            {
+              idx += diffidx;
+              break;
+            }
+
+            idx += run;
+            data = (char *)data + (run * samplesize);
+            tdata = (char *)tdata + (run * samplesize);
+            count -= run;
+            tcount -= run;
+          }
+
+          if (idx == seg->numsamples)
+          {
+            ms_log (0, "Time series are the same, %lld samples compared\n",
+                    (long long int)idx);
+          }
+
+          ms_log (0, "  %s  %s  %s\n", id->sid, start, end);
+          ms_log (0, "  %s  %s  %s\n", tid->sid, tstart, tend);
+
+          tseg = tseg->next;
+        }
+
+        tid = tid->next[0];
+      }
+
+      seg = seg->next;
+    }
+
+    id = id->next[0];
+  }
+
+  return;
+} /* End of comparetraces() */
+
+/***************************************************************************
+ * comparesamples():
+ *
+ * Compare count samples of the specified type at data and tdata,
+ * reporting the first sample that differs.  The offset is the index
+ * of the first sample in the segment and only used for reporting.
+ *
+ * Returns index of the first differing sample or -1 if all are the same.
+ ***************************************************************************/
+static int64_t
+comparesamples (char sampletype, void *data, void *tdata, int64_t count, int64_t offset)
+{
+  int64_t idx;
+
+  if (sampletype == 'i')
+  {
+    int32_t *idata  = (int32_t *)data;
+    int32_t *tidata = (int32_t *)tdata;
+
+    for (idx = 0; idx < count; idx++)
+      if (idata[idx] != tidata[idx])
+      {
+        ms_log (0, "Time series are NOT the same, differing at sample %lld (%d versus %d)\n",
+                (long long int)(offset + idx + 1), idata[idx], tidata[idx]);
+        retval = 1;
+        return idx;
+      }
+  }
+  else if (sampletype == 'f')
+  {
+    float *fdata  = (float *)data;
+    float *tfdata = (float *)tdata;
+
+    for (idx = 0; idx < count; idx++)
+      if (fdata[idx] != tfdata[idx])
+      {
+        ms_log (0, "Time series are NOT the same, differing at sample %lld (%f versus %f)\n",
+                (long long int)(offset + idx + 1), fdata[idx], tfdata[idx]);
+        retval = 1;
+        return idx;
+      }
+  }
+  else if (sampletype == 'd')
+  {
+    double *ddata  = (double *)data;
+    double *tddata = (double *)tdata;
+
+    for (idx = 0; idx < count; idx++)
+      if (ddata[idx] != tddata[idx])
+      {
+        ms_log (0, "Time series are NOT the same, differing at sample %lld (%f versus %f)\n",
+                (long long int)(offset + idx + 1), ddata[idx], tddata[idx]);
+        retval = 1;
+        return idx;
+      }
+  }
+  else if (sampletype == 'a')
+  {
+    char *cdata  = (char *)data;
+    char *tcdata = (char *)tdata;
+
+    for (idx = 0; idx < count; idx++)
+      if (cdata[idx] != tcdata[idx])
+      {
+        ms_log (0, "Time series are NOT the same, differing at sample %lld (%c versus %c)\n",
+                (long long int)(offset + idx + 1), cdata[idx], tcdata[idx]);
+        retval = 1;
+        return idx;
+      }
+  }
+
+  return -1;
+} /* End of comparesamples() */
+
+/***************************************************************************
+ * parameter_proc():
+ * Process the command line parameters.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+processparam (int argcount, char **argvec)
+{
+  int optind;
+  char *match_pattern  = 0;
+  char *reject_pattern = 0;
+  char *tptr;
+
+  /* Process all command line arguments */
+  for (optind = 1; optind < argcount; optind++)
+  {
+    if (strcmp (argvec[optind], "-V") == 0)
+    {
+      ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strncmp (argvec[optind], "-v", 2) == 0)
+    {
+      verbose += strspn (&argvec[optind][1], "v");
+    }
+    else if (strcmp (argvec[optind], "-D") == 0)
+    {
+      dccidstr = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-C") == 0)
+    {
+      compare = 1;
+    }
+    else if (strcmp (argvec[optind], "-N") == 0)
+    {
+      dataflag = 0;
+    }
+    else if (strcmp (argvec[optind], "-F") == 0)
+    {
+      flushclosed = 1;
+    }
+    else if (strcmp (argvec[optind], "-P") == 0)
+    {
+      presort = 1;
+    }
+    else if (strcmp (argvec[optind], "-T") == 0)
+    {
+      threads = (int)strtol (getoptval (argcount, argvec, optind++), NULL, 10);
+      if (threads < 1)
+      {
+        ms_log (2, "Invalid number of threads: %s\n", argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-split") == 0)
+    {
+      splitinterval = parseinterval (getoptval (argcount, argvec, optind++));
+      if (splitinterval <= 0)
+      {
+        ms_log (2, "Invalid split interval: %s\n", argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-order") == 0)
+    {
+      tptr = getoptval (argcount, argvec, optind++);
+
+      if (strcmp (tptr, "locality") == 0)
+        fileorder = 1;
+      else if (strcmp (tptr, "size") == 0)
+        fileorder = 2;
+      else
+      {
+        ms_log (2, "Invalid input file order: %s\n", tptr);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-sds") == 0)
+    {
+      struct filelink *sdslp;
+      struct filelink **plp;
+
+      if (!(sdslp = (struct filelink *)calloc (1, sizeof (struct filelink))) ||
+          !(sdslp->filename = strdup (getoptval (argcount, argvec, optind++))))
+      {
+        ms_log (2, "Cannot allocate memory\n");
+        exit (1);
+      }
+
+      /* Add to the end of the list to scan in the order specified */
+      for (plp = &sdsroots; *plp; plp = &(*plp)->next)
+        ;
+      *plp = sdslp;
+    }
+    else if (strcmp (argvec[optind], "-maxmem") == 0)
+    {
+      maxmemory = parsesize (getoptval (argcount, argvec, optind++));
+      if (maxmemory == 0)
+      {
+        ms_log (2, "Invalid memory budget: %s\n", argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-S") == 0)
+    {
+      timesorted = 1;
+    }
+    else if (strcmp (argvec[optind], "-I") == 0)
+    {
+      useindex = 1;
+    }
+    else if (strcmp (argvec[optind], "-B") == 0)
+    {
+      buildindex = 1;
+    }
+    else if (strcmp (argvec[optind], "-ts") == 0)
+    {
+      starttime = ms_timestr2nstime (getoptval (argcount, argvec, optind++));
+      if (starttime == NSTUNSET)
+        return -1;
+    }
+    else if (strcmp (argvec[optind], "-te") == 0)
+    {
+      endtime = ms_timestr2nstime (getoptval (argcount, argvec, optind++));
+      if (endtime == NSTUNSET)
+        return -1;
+    }
+    else if (strcmp (argvec[optind], "-m") == 0)
+    {
+      match_pattern = strdup (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-r") == 0)
+    {
+      reject_pattern = strdup (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-tt") == 0)
+    {
+      timetol        = strtod (getoptval (argcount, argvec, optind++), NULL);
+      tolerance.time = timetol_callback;
+    }
+    else if (strcmp (argvec[optind], "-rt") == 0)
+    {
+      sampratetol        = strtod (getoptval (argcount, argvec, optind++), NULL);
+      tolerance.samprate = samprate_callback;
+    }
+    else if (strncmp (argvec[optind], "-", 1) == 0 &&
+             strlen (argvec[optind]) > 1)
+    {
+      ms_log (2, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+    else
+    {
+      tptr = argvec[optind];
+
+      /* Check for an input file list */
+      if (tptr[0] == '@')
+      {
+        if (addlistfile (tptr + 1) < 0)
+        {
+          ms_log (2, "Error adding list file %s", tptr + 1);
+          exit (1);
+        }
+      }
+      /* Otherwise this is an input file */
+      else
+      {
+        /* Add file to global file list */
+        if (addfile (tptr))
+        {
+          ms_log (2, "Error adding file to input list %s", tptr);
+          exit (1);
+        }
+      }
+    }
+  }
+
+  /* Comparison requires data samples */
+  if (compare && !dataflag)
+  {
+    ms_log (2, "Comparison (-C) is not possible without data samples (-N)\n");
+    exit (1);
+  }
+
+  /* Comparison requires all segments at the end */
+  if (compare && flushclosed)
+  {
+    ms_log (2, "Comparison (-C) is not possible when flushing segments (-F)\n");
+    exit (1);
+  }
+
+  /* Flushing, pre-sorting and the memory budget operate on a single reader */
+  if (threads > 1 && (flushclosed || presort || maxmemory))
+  {
+    ms_log (2, "Reading with multiple threads (-T) cannot be combined with -F, -P or -maxmem\n");
+    exit (1);
+  }
+
+  /* Make sure input file were specified */
+  if (filelist == 0 && sdsroots == 0)
+  {
+    ms_log (2, "No input files were specified\n\n");
+    ms_log (1, "%s version %s\n\n", PACKAGE, VERSION);
+    ms_log (1, "Try %s -h for usage\n", PACKAGE);
+    exit (1);
+  }
+
+  /* Add wildcards to match pattern for logical "contains" */
+  if (match_pattern)
+  {
+    if ((match = malloc (strlen (match_pattern) + 3)) == NULL)
+    {
+      ms_log (2, "Error allocating memory\n");
+      exit (1);
+    }
+
+    snprintf (match, strlen (match_pattern) + 3, "*%s*", match_pattern);
+  }
+
+  /* Add wildcards to reject pattern for logical "contains" */
+  if (reject_pattern)
+  {
+    if ((reject = malloc (strlen (reject_pattern) + 3)) == NULL)
+    {
+      ms_log (2, "Error allocating memory\n");
+      exit (1);
+    }
+
+    snprintf (reject, strlen (reject_pattern) + 3, "*%s*", reject_pattern);
+  }
+
+  /* Add the candidate files of SDS archives, selected by time range and patterns */
+  while (sdsroots)
+  {
+    struct filelink *sdslp = sdsroots;
+
+    if (addsdsfiles (sdslp->filename) < 0)
+      exit (1);
+
+    sdsroots = sdslp->next;
+    free (sdslp->filename);
+    free (sdslp);
+  }
+
+  /* Remove duplicate and empty input files and order them */
+  if (planfiles () < 0)
+    exit (1);
+
+  if (filelist == 0)
+  {
+    ms_log (2, "No input files were found\n");
+    exit (1);
+  }
+
+  /* Report the program version */
+  if (verbose)
+    ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+
+  return 0;
+} /* End of parameter_proc() */
+
+/***************************************************************************
+ * parsesize():
+ *
+ * Parse a size in bytes with an optional K, M or G (binary) suffix.
+ *
+ * Returns the size on success and 0 on error.
+ ***************************************************************************/
+static size_t
+parsesize (const char *sizestr)
+{
+  char *endptr = NULL;
+  double size;
+
+  size = strtod (sizestr, &endptr);
+
+  if (endptr == sizestr)
+    return 0;
+
+  switch (toupper ((unsigned char)*endptr))
+  {
+  case 'G':
+    size *= 1024.0 * 1024.0 * 1024.0;
+    endptr++;
+    break;
+  case 'M':
+    size *= 1024.0 * 1024.0;
+    endptr++;
+    break;
+  case 'K':
+    size *= 1024.0;
+    endptr++;
+    break;
+  }
+
+  if (*endptr != '\0' || size < 1.0)
+    return 0;
+
+  return (size_t)size;
+} /* End of parsesize() */
+
+/***************************************************************************
+ * parseinterval():
+ *
+ * Parse a split interval of "day", "hour" or a number of seconds.
+ *
+ * Returns the interval in nanoseconds on success and 0 on error.
+ ***************************************************************************/
+static nstime_t
+parseinterval (const char *intervalstr)
+{
+  char *endptr = NULL;
+  double seconds;
+
+  if (strcmp (intervalstr, "day") == 0)
+    return (nstime_t)86400 * NSTMODULUS;
+
+  if (strcmp (intervalstr, "hour") == 0)
+    return (nstime_t)3600 * NSTMODULUS;
+
+  seconds = strtod (intervalstr, &endptr);
+
+  if (endptr == intervalstr || *endptr != '\0' || seconds <= 0.0)
+    return 0;
+
+  return (nstime_t)(seconds * NSTMODULUS + 0.5);
+} /* End of parseinterval() */
+
+/***************************************************************************
+ * getoptval:
+ * Return the value to a command line option; checking that the value is
+ * itself not an option (starting with '-') and is not past the end of
+ * the argument list.
+ *
+ * argcount: total arguments in argvec
+ * argvec: argument list
+ * argopt: index of option to process, value is expected to be at argopt+1
+ *
+ * Returns value on success and exits with error message on failure
+ ***************************************************************************/
+static char *
+getoptval (int argcount, char **argvec, int argopt)
+{
+  if (argvec == NULL || argvec[argopt] == NULL)
+  {
+    ms_log (2, "getoptval(): NULL option requested\n");
+    exit (1);
+    return 0;
+  }
+
+  /* Special case of '-o -' usage */
+  if ((argopt + 1) < argcount && strcmp (argvec[argopt], "-o") == 0)
+    if (strcmp (argvec[argopt + 1], "-") == 0)
+      return argvec[argopt + 1];
+
+  if ((argopt + 1) < argcount && *argvec[argopt + 1] != '-')
+    return argvec[argopt + 1];
+
+  ms_log (2, "Option %s requires a value, try -h for usage\n", argvec[argopt]);
+  exit (1);
+  return 0;
+} /* End of getoptval() */
+
+/***************************************************************************
+ * addfile:
+ *
+ * Add file to end of the global file list (filelist).
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+addfile (char *filename)
+{
+  struct filelink *newlp;
+
+  if (filename == NULL)
+  {
+    ms_log (2, "addfile(): No file name specified\n");
+    return -1;
+  }
+
+  newlp = (struct filelink *)calloc (1, sizeof (struct filelink));
+
+  if (!newlp)
+  {
+    ms_log (2, "addfile(): Cannot allocate memory\n");
+    return -1;
+  }
+
+  newlp->filename = strdup (filename);
+
+  if (!newlp->filename)
+  {
+    ms_log (2, "addfile(): Cannot duplicate string\n");
+    return -1;
+  }
+
+  /* Add new file to the end of the list */
+  if (filelisttail == 0)
+  {
+    filelist     = newlp;
+    filelisttail = newlp;
+  }
+  else
+  {
+    filelisttail->next = newlp;
+    filelisttail       = newlp;
+  }
+
+  return 0;
+} /* End of addfile() */
+
+/***************************************************************************
+ * addlistfile:
+ *
+ * Add files listed in the specified file to the global input file list.
+ * The list is read at once and entries are not limited in length.
+ *
+ * Returns count of files added on success and -1 on error.
+ ***************************************************************************/
+static int
+addlistfile (char *filename)
+{
+  FILE *fp;
+  char *buffer     = NULL;
+  char *newbuffer  = NULL;
+  size_t buffersize = 0;
+  size_t length    = 0;
+  size_t nread     = 0;
+  char *line;
+  char *next;
+  char *end;
+  int filecount = 0;
+
+  if (verbose >= 1)
+    ms_log (1, "Reading list file '%s'\n", filename);
+
+  if (!(fp = fopen (filename, "rb")))
+  {
+    ms_log (2, "Cannot open list file %s: %s\n", filename, strerror (errno));
+    return -1;
+  }
+
+  /* Read the entire list into a buffer grown as needed */
+  do
+  {
+    if (length + 1 >= buffersize)
+    {
+      buffersize = (buffersize) ? buffersize * 2 : 1024 * 1024;
+
+      if (!(newbuffer = (char *)realloc (buffer, buffersize)))
+      {
+        ms_log (2, "Cannot allocate memory for list file %s\n", filename);
+        free (buffer);
+        fclose (fp);
+        return -1;
+      }
+
+      buffer = newbuffer;
+    }
+
+    nread = fread (buffer + length, 1, buffersize - length - 1, fp);
+    length += nread;
+  } while (nread > 0);
+
+  if (ferror (fp))
+  {
+    ms_log (2, "Cannot read list file %s: %s\n", filename, strerror (errno));
+    free (buffer);
+    fclose (fp);
+    return -1;
+  }
+
+  fclose (fp);
+  buffer[length] = '\0';
+
+  for (line = buffer, end = buffer + length; line < end; line = next)
+  {
+    /* End string at newline character */
+    if ((next = memchr (line, '\n', end - line)))
+      *next++ = '\0';
+    else
+      next = end;
+
+    /* Remove carriage return of DOS line endings */
+    if (next - line > 1 && line[strlen (line) - 1] == '\r')
+      line[strlen (line) - 1] = '\0';
+
+    /* Skip empty lines */
+    if (!*line)
+      continue;
+
+    /* Skip comment lines */
+    if (*line == '#')
+      continue;
+
+    if (verbose > 1)
+      ms_log (1, "Adding '%s' from list file\n", line);
+
+    if (addfile (line))
+    {
+      free (buffer);
+      return -1;
+    }
+
+    filecount++;
+  }
+
+  free (buffer);
+
+  return filecount;
+} /* End of addlistfile() */
+
+/***************************************************************************
+ * planfiles:
+ *
+ * Determine the status of the input files, with multiple threads for
+ * long lists, then remove duplicate and empty files from the global
+ * input file list and order it.
+ *
+ * Local files are identified by device and inode, so a file specified
+ * by different paths is only read once, and files with a byte range
+ * suffix are duplicates only for the same range.  Other input, e.g.
+ * stdin and URLs, is identified by name.  The first occurrence of a
+ * file is retained.
+ *
+ * Files are kept in the order specified unless -order is used: by
+ * device and physical offset of the first block (or inode if unknown)
+ * for locality on disk, or by size, largest first, to balance the work
+ * of reading threads.  Other input follows the local files.
+ *
+ * Returns count of files on success and -1 on error.
+ ***************************************************************************/
+static int
+planfiles (void)
+{
+  struct statshare share;
+  struct filelink **files;
+  struct filelink *flp;
+  size_t count = 0;
+  size_t kept  = 0;
+  size_t idx;
+#if !defined(LMP_WIN)
+  pthread_t tids[SCANTHREADS];
+  int started = 0;
+  int tidx;
+#endif
+
+  for (flp = filelist; flp; flp = flp->next)
+    count++;
+
+  if (count == 0)
+    return 0;
+
+  if (!(files = (struct filelink **)malloc (count * sizeof (struct filelink *))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  for (idx = 0, flp = filelist; flp; flp = flp->next, idx++)
+  {
+    files[idx]     = flp;
+    flp->sequence = idx;
+  }
+
+  share.files = files;
+  share.count = count;
+  share.next  = 0;
+
+  /* Determine the status of files, with additional threads for long lists */
+#if !defined(LMP_WIN)
+  pthread_mutex_init (&share.lock, NULL);
+
+  if (count >= 1024)
+  {
+    for (started = 0; started < SCANTHREADS - 1; started++)
+    {
+      if (pthread_create (&tids[started], NULL, statthread, &share))
+        break;
+    }
+  }
+#endif
+
+  statthread (&share);
+
+#if !defined(LMP_WIN)
+  for (tidx = 0; tidx < started; tidx++)
+    pthread_join (tids[tidx], NULL);
+
+  pthread_mutex_destroy (&share.lock);
+#endif
+
+  /* Remove duplicate files, sorted by identity and order specified */
+  qsort (files, count, sizeof (struct filelink *), cmpfileid);
+
+  for (idx = 0; idx < count; idx++)
+  {
+    flp = files[idx];
+
+    if (kept > 0 && cmpfileident (files[kept - 1], flp) == 0)
+    {
+      if (verbose >= 1)
+        ms_log (1, "Skipping duplicate input file '%s'\n", flp->filename);
+    }
+    else if (flp->local && flp->size == 0)
+    {
+      if (verbose >= 1)
+        ms_log (1, "Skipping empty input file '%s'\n", flp->filename);
+    }
+    else
+    {
+      files[kept++] = flp;
+      continue;
+    }
+
+    free (flp->filename);
+    free (flp);
+  }
+
+  /* Order and relink the remaining files */
+  qsort (files, kept, sizeof (struct filelink *), cmpfileorder);
+
+  filelist     = (kept) ? files[0] : NULL;
+  filelisttail = (kept) ? files[kept - 1] : NULL;
+
+  for (idx = 0; idx < kept; idx++)
+    files[idx]->next = (idx + 1 < kept) ? files[idx + 1] : NULL;
+
+  free (files);
+
+  if (verbose >= 1 && kept != count)
+    ms_log (1, "Reading %llu of %llu input files\n",
+            (unsigned long long)kept, (unsigned long long)count);
+
+  return (int)kept;
+} /* End of planfiles() */
+
+/***************************************************************************
+ * statthread:
+ *
+ * Thread determining the status of input files in batches until none
+ * remain.
+ ***************************************************************************/
+static void *
+statthread (void *arg)
+{
+  struct statshare *share = (struct statshare *)arg;
+  size_t first;
+  size_t last;
+
+  for (;;)
+  {
+#if !defined(LMP_WIN)
+    pthread_mutex_lock (&share->lock);
+#endif
+    first = share->next;
+    last  = (share->count - first > 256) ? first + 256 : share->count;
+    share->next = last;
+#if !defined(LMP_WIN)
+    pthread_mutex_unlock (&share->lock);
+#endif
+
+    if (first >= last)
+      break;
+
+    for (; first < last; first++)
+      statfile (share->files[first]);
+  }
+
+  return NULL;
+} /* End of statthread() */
+
+/***************************************************************************
+ * statfile:
+ *
+ * Determine the device, inode and size of a regular local file.  A
+ * byte range suffix, "@START-END", is removed if the path does not
+ * exist as specified.  With -order locality the physical offset of the
+ * first block is determined where supported, otherwise the inode is
+ * used.  Files of which the status cannot be determined are not local,
+ * any error is reported when the file is read.
+ ***************************************************************************/
+static void
+statfile (struct filelink *flp)
+{
+  struct stat st;
+  const char *range = NULL;
+  char *path        = flp->filename;
+#if defined(__linux__)
+  union
+  {
+    struct fiemap fm;
+    char buffer[sizeof (struct fiemap) + sizeof (struct fiemap_extent)];
+  } fiemap;
+  int fd;
+#endif
+
+  if (strcmp (flp->filename, "-") == 0 || strstr (flp->filename, "://"))
+    return;
+
+  if (stat (path, &st))
+  {
+    range = strrchr (flp->filename, '@');
+
+    if (!range || range[1] == '\0' || strspn (range + 1, "0123456789-") != strlen (range + 1))
+      return;
+
+    if (!(path = (char *)malloc (range - flp->filename + 1)))
+      return;
+
+    memcpy (path, flp->filename, range - flp->filename);
+    path[range - flp->filename] = '\0';
+
+    if (stat (path, &st))
     {
-      ms_log (2, "Error allocating memory\n");
-      exit (1);
+      free (path);
+      return;
     }
-
-    snprintf (match, strlen (match_pattern) + 3, "*%s*", match_pattern);
   }
 
-  /* Add wildcards to reject pattern for logical "contains" */
-  if (reject_pattern)
+  if (S_ISREG (st.st_mode))
   {
-    if ((reject = malloc (strlen (reject_pattern) + 3)) == NULL)
+    flp->range  = range;
+    flp->dev    = (uint64_t)st.st_dev;
+    flp->ino    = (uint64_t)st.st_ino;
+    flp->size   = (uint64_t)st.st_size;
+    flp->offset = flp->ino;
+    flp->local  = 1;
+
+#if defined(__linux__)
+    /* Physical offset of the first extent */
+    if (fileorder == 1 && flp->size > 0 && (fd = open (path, O_RDONLY)) >= 0)
     {
-      ms_log (2, "Error allocating memory\n");
-      exit (1);
-    }
+      memset (&fiemap, 0, sizeof (fiemap));
+      fiemap.fm.fm_length       = FIEMAP_MAX_OFFSET;
+      fiemap.fm.fm_extent_count = 1;
 
-    snprintf (reject, strlen (reject_pattern) + 3, "*%s*", reject_pattern);
+      if (ioctl (fd, FS_IOC_FIEMAP, &fiemap.fm) == 0 && fiemap.fm.fm_mapped_extents > 0)
+        flp->offset = fiemap.fm.fm_extents[0].fe_physical;
+
+      close (fd);
+    }
+#endif
   }
 
-  /* Report the program version */
-  if (verbose)
-    ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+  if (path != flp->filename)
+    free (path);
+} /* End of statfile() */
+
+/***************************************************************************
+ * cmpfileident:
+ *
+ * Compare input files by identity, local files by device, inode and
+ * byte range and other input by name.  Local files are ordered first.
+ ***************************************************************************/
+static int
+cmpfileident (const struct filelink *fa, const struct filelink *fb)
+{
+  int cmp;
+
+  if (fa->local != fb->local)
+    return (fa->local) ? -1 : 1;
+
+  if (fa->local)
+  {
+    if (fa->dev != fb->dev)
+      return (fa->dev < fb->dev) ? -1 : 1;
+
+    if (fa->ino != fb->ino)
+      return (fa->ino < fb->ino) ? -1 : 1;
+
+    if ((cmp = strcmp ((fa->range) ? fa->range : "", (fb->range) ? fb->range : "")))
+      return cmp;
+  }
+  else if ((cmp = strcmp (fa->filename, fb->filename)))
+  {
+    return cmp;
+  }
 
   return 0;
-} /* End of parameter_proc() */
+} /* End of cmpfileident() */
 
 /***************************************************************************
- * getoptval:
- * Return the value to a command line option; checking that the value is
- * itself not an option (starting with '-') and is not past the end of
- * the argument list.
+ * cmpfileid:
  *
- * argcount: total arguments in argvec
- * argvec: argument list
- * argopt: index of option to process, value is expected to be at argopt+1
+ * Compare input files by identity, then in the order specified.
+ ***************************************************************************/
+static int
+cmpfileid (const void *a, const void *b)
+{
+  const struct filelink *fa = *(const struct filelink *const *)a;
+  const struct filelink *fb = *(const struct filelink *const *)b;
+  int cmp;
+
+  if ((cmp = cmpfileident (fa, fb)))
+    return cmp;
+
+  return (fa->sequence < fb->sequence) ? -1 : (fa->sequence > fb->sequence);
+} /* End of cmpfileid() */
+
+/***************************************************************************
+ * cmpfileorder:
  *
- * Returns value on success and exits with error message on failure
+ * Compare input files in the order selected by -order, then in the
+ * order specified.
  ***************************************************************************/
-static char *
-getoptval (int argcount, char **argvec, int argopt)
+static int
+cmpfileorder (const void *a, const void *b)
 {
-  if (argvec == NULL || argvec[argopt] == NULL)
-  {
-    ms_log (2, "getoptval(): NULL option requested\n");
-    exit (1);
-    return 0;
-  }
+  const struct filelink *fa = *(const struct filelink *const *)a;
+  const struct filelink *fb = *(const struct filelink *const *)b;
 
-  /* Special case of '-o -' usage */
-  if ((argopt + 1) < argcount && strcmp (argvec[argopt], "-o") == 0)
-    if (strcmp (argvec[argopt + 1], "-") == 0)
-      return argvec[argopt + 1];
+  if (fileorder && fa->local != fb->local)
+    return (fa->local) ? -1 : 1;
 
-  if ((argopt + 1) < argcount && *argvec[argopt + 1] != '-')
-    return argvec[argopt + 1];
+  if (fileorder == 1)
+  {
+    if (fa->dev != fb->dev)
+      return (fa->dev < fb->dev) ? -1 : 1;
 
-  ms_log (2, "Option %s requires a value, try -h for usage\n", argvec[argopt]);
-  exit (1);
-  return 0;
-} /* End of getoptval() */
+    if (fa->offset != fb->offset)
+      return (fa->offset < fb->offset) ? -1 : 1;
+  }
+  else if (fileorder == 2 && fa->size != fb->size)
+  {
+    return (fa->size > fb->size) ? -1 : 1;
+  }
+
+  return (fa->sequence < fb->sequence) ? -1 : (fa->sequence > fb->sequence);
+} /* End of cmpfileorder() */
 
 /***************************************************************************
- * addfile:
+ * addsdsfiles:
  *
- * Add file to end of the global file list (filelist).
+ * Add the files of a SeisComP Data Structure (SDS) archive that may
+ * contain selected data to the global input file list.  The archive
+ * is organized as:
  *
- * Returns 0 on success and -1 on error.
+ *   ROOT/YEAR/NET/STA/CHAN.TYPE/NET.STA.LOC.CHAN.TYPE.YEAR.DOY
+ *
+ * Files are selected by their names without being opened: the source
+ * identifier formed from the codes must be matched by the match
+ * pattern and not by the reject pattern, and the day must be within
+ * the -ts/-te time range with a margin of one day for records that
+ * span midnight.  The directories of years outside the time range are
+ * not read, channel directories are scanned by multiple threads.
+ *
+ * Files are added in path order, grouping the days of each channel.
+ *
+ * Returns count of files added on success and -1 on error.
  ***************************************************************************/
 static int
-addfile (char *filename)
+addsdsfiles (const char *root)
 {
-  struct filelink *newlp;
+#if defined(LMP_WIN)
+  ms_log (2, "Reading SDS archives (-sds) is not supported on this platform\n");
+  return -1;
+#else
+  struct sdsscan scan;
+  pthread_t tids[SCANTHREADS];
+  char **years = 0;
+  char **nets  = 0;
+  char **stas  = 0;
+  char **chans = 0;
+  size_t yearcount = 0;
+  size_t netcount  = 0;
+  size_t stacount  = 0;
+  size_t chancount = 0;
+  size_t dirsize   = 0;
+  size_t yidx, nidx, sidx, cidx;
+  uint16_t firstyear = 0;
+  uint16_t lastyear  = 9999;
+  nstime_t day       = (nstime_t)86400 * NSTMODULUS;
+  char path[4096];
+  char **dirs;
+  int started;
+  int idx;
+  int year;
 
-  if (filename == NULL)
+  memset (&scan, 0, sizeof (scan));
+  scan.earliest = NSTUNSET;
+  scan.latest   = NSTUNSET;
+
+  /* Candidate days are those of the time range and one day before and after */
+  if (starttime != NSTUNSET)
   {
-    ms_log (2, "addfile(): No file name specified\n");
+    scan.earliest = starttime - (starttime % day);
+    if (starttime % day < 0)
+      scan.earliest -= day;
+    scan.earliest -= day;
+    ms_nstime2time (scan.earliest, &firstyear, NULL, NULL, NULL, NULL, NULL);
+  }
+
+  if (endtime != NSTUNSET)
+  {
+    scan.latest = endtime - (endtime % day);
+    if (endtime % day < 0)
+      scan.latest -= day;
+    scan.latest += day;
+    ms_nstime2time (scan.latest, &lastyear, NULL, NULL, NULL, NULL, NULL);
+  }
+
+  if (verbose >= 1)
+    ms_log (1, "Scanning SDS archive '%s'\n", root);
+
+  if (sdslist (root, &years, &yearcount))
     return -1;
+
+  /* Collect the channel directories of years in the time range */
+  for (yidx = 0; yidx < yearcount && !scan.error; yidx++)
+  {
+    if (strlen (years[yidx]) != 4 || strspn (years[yidx], "0123456789") != 4)
+      continue;
+
+    year = atoi (years[yidx]);
+    if (year < firstyear || year > lastyear)
+      continue;
+
+    snprintf (path, sizeof (path), "%s/%s", root, years[yidx]);
+    if (sdslist (path, &nets, &netcount))
+      scan.error = 1;
+
+    for (nidx = 0; nidx < netcount && !scan.error; nidx++)
+    {
+      snprintf (path, sizeof (path), "%s/%s/%s", root, years[yidx], nets[nidx]);
+      if (sdslist (path, &stas, &stacount))
+        scan.error = 1;
+
+      for (sidx = 0; sidx < stacount && !scan.error; sidx++)
+      {
+        snprintf (path, sizeof (path), "%s/%s/%s/%s", root, years[yidx], nets[nidx], stas[sidx]);
+        if (sdslist (path, &chans, &chancount))
+          scan.error = 1;
+
+        for (cidx = 0; cidx < chancount && !scan.error; cidx++)
+        {
+          /* Channel directories are named CHAN.TYPE */
+          if (!strchr (chans[cidx], '.'))
+            continue;
+
+          if (scan.dircount >= dirsize)
+          {
+            dirsize = (dirsize) ? dirsize * 2 : 256;
+
+            if (!(dirs = (char **)realloc (scan.dirs, dirsize * sizeof (char *))))
+            {
+              ms_log (2, "Cannot allocate memory\n");
+              scan.error = 1;
+              break;
+            }
+
+            scan.dirs = dirs;
+          }
+
+          snprintf (path, sizeof (path), "%s/%s/%s/%s/%s", root, years[yidx],
+                    nets[nidx], stas[sidx], chans[cidx]);
+
+          if (!(scan.dirs[scan.dircount] = strdup (path)))
+          {
+            ms_log (2, "Cannot allocate memory\n");
+            scan.error = 1;
+            break;
+          }
+
+          scan.dircount++;
+        }
+      }
+    }
   }
 
-  newlp = (struct filelink *)calloc (1, sizeof (struct filelink));
+  /* Scan channel directories for candidate files */
+  if (!scan.error && scan.dircount > 0)
+  {
+    pthread_mutex_init (&scan.lock, NULL);
 
-  if (!newlp)
+    for (started = 0; started < SCANTHREADS && (size_t)started < scan.dircount; started++)
+    {
+      if (pthread_create (&tids[started], NULL, sdsthread, &scan))
+      {
+        ms_log (2, "Cannot create thread: %s\n", strerror (errno));
+        scan.error = 1;
+        break;
+      }
+    }
+
+    for (idx = 0; idx < started; idx++)
+      pthread_join (tids[idx], NULL);
+
+    pthread_mutex_destroy (&scan.lock);
+  }
+
+  /* Add files in path order */
+  if (!scan.error && scan.filecount > 0)
   {
-    ms_log (2, "addfile(): Cannot allocate memory\n");
-    return -1;
+    qsort (scan.files, scan.filecount, sizeof (char *), cmpstrings);
+
+    for (idx = 0; (size_t)idx < scan.filecount && !scan.error; idx++)
+    {
+      if (verbose > 1)
+        ms_log (1, "Adding '%s' from SDS archive\n", scan.files[idx]);
+
+      if (addfile (scan.files[idx]))
+        scan.error = 1;
+    }
   }
 
-  newlp->filename = strdup (filename);
+  if (verbose >= 1)
+    ms_log (1, "Selected %llu files in %llu channel directories of '%s'\n",
+            (unsigned long long)scan.filecount, (unsigned long long)scan.dircount, root);
 
-  if (!newlp->filename)
+  sdslist (NULL, &years, &yearcount);
+  sdslist (NULL, &nets, &netcount);
+  sdslist (NULL, &stas, &stacount);
+  sdslist (NULL, &chans, &chancount);
+
+  for (idx = 0; (size_t)idx < scan.dircount; idx++)
+    free (scan.dirs[idx]);
+  for (idx = 0; (size_t)idx < scan.filecount; idx++)
+    free (scan.files[idx]);
+  free (scan.dirs);
+  free (scan.files);
+
+  return (scan.error) ? -1 : (int)scan.filecount;
+#endif
+} /* End of addsdsfiles() */
+
+/***************************************************************************
+ * sdslist:
+ *
+ * List the entries of a directory, excluding hidden entries, replacing
+ * the names of a previous listing.  A missing directory or an entry
+ * that is not a directory results in an empty list.  If path is NULL
+ * the names are only freed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sdslist (const char *path, char ***names, size_t *count)
+{
+#if defined(LMP_WIN)
+  return -1;
+#else
+  struct dirent *de;
+  DIR *dir;
+  char **newnames;
+  size_t size = 0;
+  size_t idx;
+
+  for (idx = 0; idx < *count; idx++)
+    free ((*names)[idx]);
+  free (*names);
+  *names = 0;
+  *count = 0;
+
+  if (!path)
+    return 0;
+
+  if (!(dir = opendir (path)))
   {
-    ms_log (2, "addfile(): Cannot duplicate string\n");
+    if (errno == ENOENT || errno == ENOTDIR)
+      return 0;
+
+    ms_log (2, "Cannot open directory %s: %s\n", path, strerror (errno));
     return -1;
   }
 
-  /* Add new file to the end of the list */
-  if (filelisttail == 0)
+  while ((de = readdir (dir)))
   {
-    filelist     = newlp;
-    filelisttail = newlp;
+    if (de->d_name[0] == '.')
+      continue;
+
+    if (*count >= size)
+    {
+      size = (size) ? size * 2 : 64;
+
+      if (!(newnames = (char **)realloc (*names, size * sizeof (char *))))
+      {
+        ms_log (2, "Cannot allocate memory\n");
+        closedir (dir);
+        return -1;
+      }
+
+      *names = newnames;
+    }
+
+    if (!((*names)[*count] = strdup (de->d_name)))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      closedir (dir);
+      return -1;
+    }
+
+    (*count)++;
   }
-  else
+
+  closedir (dir);
+
+  return 0;
+#endif
+} /* End of sdslist() */
+
+/***************************************************************************
+ * sdsthread:
+ *
+ * Thread scanning SDS channel directories for candidate files until
+ * none remain or an error occurs.
+ ***************************************************************************/
+static void *
+sdsthread (void *arg)
+{
+#if !defined(LMP_WIN)
+  struct sdsscan *scan = (struct sdsscan *)arg;
+  struct dirent *de;
+  DIR *dir;
+  char path[4096];
+  char **files;
+  const char *dirpath;
+  int failed = 0;
+
+  for (;;)
   {
-    filelisttail->next = newlp;
-    filelisttail       = newlp;
+    pthread_mutex_lock (&scan->lock);
+    dirpath = (scan->next < scan->dircount && !scan->error) ? scan->dirs[scan->next++] : NULL;
+    pthread_mutex_unlock (&scan->lock);
+
+    if (!dirpath)
+      break;
+
+    if (!(dir = opendir (dirpath)))
+    {
+      if (errno == ENOENT || errno == ENOTDIR)
+        continue;
+
+      ms_log (2, "Cannot open directory %s: %s\n", dirpath, strerror (errno));
+      pthread_mutex_lock (&scan->lock);
+      scan->error = 1;
+      pthread_mutex_unlock (&scan->lock);
+      break;
+    }
+
+    while ((de = readdir (dir)))
+    {
+      if (!sdscandidate (de->d_name, scan->earliest, scan->latest))
+        continue;
+
+      snprintf (path, sizeof (path), "%s/%s", dirpath, de->d_name);
+
+      pthread_mutex_lock (&scan->lock);
+
+      if (scan->filecount >= scan->filesize)
+      {
+        scan->filesize = (scan->filesize) ? scan->filesize * 2 : 1024;
+
+        if ((files = (char **)realloc (scan->files, scan->filesize * sizeof (char *))))
+          scan->files = files;
+        else
+          failed = 1;
+      }
+
+      if (!failed && (scan->files[scan->filecount] = strdup (path)))
+        scan->filecount++;
+      else
+        failed = scan->error = 1;
+
+      pthread_mutex_unlock (&scan->lock);
+
+      if (failed)
+      {
+        ms_log (2, "Cannot allocate memory\n");
+        break;
+      }
+    }
+
+    closedir (dir);
   }
+#endif
 
-  return 0;
-} /* End of addfile() */
+  return NULL;
+} /* End of sdsthread() */
 
 /***************************************************************************
- * addlistfile:
+ * sdscandidate:
  *
- * Add files listed in the specified file to the global input file list.
+ * Determine if an SDS file, named NET.STA.LOC.CHAN.TYPE.YEAR.DOY, may
+ * contain selected data by the source identifier formed from its codes
+ * and its day.
  *
- * Returns count of files added on success and -1 on error.
+ * Returns 1 if the file is a candidate and 0 otherwise.
  ***************************************************************************/
 static int
-addlistfile (char *filename)
+sdscandidate (const char *name, nstime_t earliest, nstime_t latest)
 {
-  FILE *fp;
-  char filelistent[1024];
-  int filecount = 0;
+  char buffer[256];
+  char *fields[7];
+  char sid[LM_SIDLEN];
+  char *cp;
+  int count = 0;
+  int year;
+  int yday;
+  nstime_t daystart;
+
+  if (strlen (name) >= sizeof (buffer))
+    return 0;
 
-  if (verbose >= 1)
-    ms_log (1, "Reading list file '%s'\n", filename);
+  strcpy (buffer, name);
 
-  if (!(fp = fopen (filename, "rb")))
+  /* Split the name into exactly seven fields */
+  for (cp = buffer; count < 7; count++)
   {
-    ms_log (2, "Cannot open list file %s: %s\n", filename, strerror (errno));
-    return -1;
+    fields[count] = cp;
+
+    if (!(cp = strchr (cp, '.')))
+    {
+      count++;
+      break;
+    }
+
+    *cp++ = '\0';
   }
 
-  while (fgets (filelistent, sizeof (filelistent), fp))
-  {
-    char *cp;
+  if (count != 7 || cp)
+    return 0;
 
-    /* End string at first newline character */
-    if ((cp = strchr (filelistent, '\n')))
-      *cp = '\0';
+  if (strlen (fields[5]) != 4 || strspn (fields[5], "0123456789") != 4 ||
+      strlen (fields[6]) != 3 || strspn (fields[6], "0123456789") != 3)
+    return 0;
 
-    /* Skip empty lines */
-    if (!strlen (filelistent))
-      continue;
+  year = atoi (fields[5]);
+  yday = atoi (fields[6]);
 
-    /* Skip comment lines */
-    if (*filelistent == '#')
-      continue;
+  if (yday < 1 || yday > 366)
+    return 0;
 
-    if (verbose > 1)
-      ms_log (1, "Adding '%s' from list file\n", filelistent);
+  if (earliest != NSTUNSET || latest != NSTUNSET)
+  {
+    daystart = ms_time2nstime (year, yday, 0, 0, 0, 0);
 
-    if (addfile (filelistent))
-      return -1;
+    if ((earliest != NSTUNSET && daystart < earliest) ||
+        (latest != NSTUNSET && daystart > latest))
+      return 0;
+  }
 
-    filecount++;
+  if (match || reject)
+  {
+    if (ms_nslc2sid (sid, sizeof (sid), 0, fields[0], fields[1], fields[2], fields[3]) < 0)
+      return 0;
+
+    if (match && my_globmatch (sid, match) == 0)
+      return 0;
+
+    if (reject && my_globmatch (sid, reject) != 0)
+      return 0;
   }
 
-  fclose (fp);
+  return 1;
+} /* End of sdscandidate() */
 
-  return filecount;
-} /* End of addlistfile() */
+/***************************************************************************
+ * cmpstrings:
+ *
+ * Compare strings referenced by pointers, for sorting.
+ ***************************************************************************/
+static int
+cmpstrings (const void *a, const void *b)
+{
+  return strcmp (*(char *const *)a, *(char *const *)b);
+} /* End of cmpstrings() */
 
 /***********************************************************************
  * robust glob pattern matcher
@@ -1041,11 +3316,22 @@ usage (void)
            " -v           Be more verbose, multiple flags can be used\n"
            " -D DCCID     Specify the DCC identifier for SYNC header\n"
            " -C           Compare sample values of time series, to diagnose mismatches\n"
+           " -N           Coverage only, do not decode data or calculate hashes\n"
+           " -B           Build record index files (FILE.msidx) for input files and exit\n"
+           " -F           Flush completed segments while reading, input must be time-ordered\n"
+           " -P           Sort the records of each file by source and time before adding\n"
+           " -T threads   Read input files with multiple threads\n"
+           " -split intvl Split segments into windows of interval: day, hour or seconds\n"
+           " -order type  Order input files by 'locality' on disk or by 'size', largest first\n"
+           " -sds root    Read the files of an SDS archive selected by -ts/-te/-m/-r\n"
+           " -maxmem size Memory budget, spill samples to temporary files beyond, e.g. 4G\n"
            "\n"
            " ## Data selection options ##\n"
            " -ts time     Limit to samples that start on or after time\n"
            " -te time     Limit to samples that end on or before time\n"
            "                time format: 'YYYY[,DDD,HH,MM,SS,FFFFFF]' delimiters: [,:.]\n"
+           " -S           Input files are time-ordered, locate -ts/-te by binary search\n"
+           " -I           Read only records selected by -ts/-te/-m using record index files\n"
            " -m match     Limit to records containing the specified pattern\n"
            " -r reject    Limit to records not containing the specfied pattern\n"
            "                Patterns are applied to: 'FDSN:NET_STA_LOC_BAND_SOURCE_SS'\n"